@@ -38,7 +38,7 @@ namespace expr {
       LBrace,                   ///< '{'
       LParen,                   ///< '('
       LSquare,                  ///< '['
-      Number,                   ///< [+-]?[0-9][a-zA-Z0-9_]+
+      Number,                   ///< [+-]?[0-9][a-zA-Z0-9_.]+([+-][0-9]+)?
       RBrace,                   ///< '}'
       RParen,                   ///< ')'
       RSquare,                  ///< ']'
@@ -44,6 +44,10 @@ public:
   ref<Expr> simplifyExpr(ref<Expr> e) const;
 
   void addConstraint(ref<Expr> e);
+
+  // add the constraint unless doing so reduces the constraint set to false;
+  // returns false (and leaves the set unchanged) in that case
+  bool tryAddConstraint(ref<Expr> e);
   
   bool empty() const {
     return constraints.empty();
@@ -68,10 +72,11 @@ public:
 private:
   std::vector< ref<Expr> > constraints;
 
-  // returns true iff the constraints were modified
+  // returns false iff a rewritten constraint became false
   bool rewriteConstraints(ExprVisitor &visitor);
 
-  void addConstraintInternal(ref<Expr> e);
+  // returns false iff the constraint, or one it rewrote, is false
+  bool addConstraintInternal(ref<Expr> e);
 };
 
 }
@@ -149,6 +149,10 @@ public:
   /// @brief The floating point rounding mode for the current state
   llvm::APFloat::roundingMode roundingMode;
 
+  /// @brief If not null the rounding mode is symbolic and given by this
+  /// KLEE_FP_* valued expression instead of by roundingMode.
+  ref<Expr> symbolicRoundingMode;
+
   std::string getFnAlias(std::string fn);
   void addFnAlias(std::string old_fn, std::string new_fn);
   void removeFnAlias(std::string fn);
@@ -156,6 +160,11 @@ public:
   // The objects handling the klee_open_merge calls this state ran through
   std::vector<ref<MergeHandler> > openMergeStack;
 
+  /// @brief Branches on the path whose feasibility is still being checked in
+  /// the background (see --speculative-fork), as the query ticket and the
+  /// side taken. The state is confirmed once this is empty.
+  std::vector<std::pair<unsigned, bool> > speculations;
+
 private:
   ExecutionState() : uniqueID(0), ptreeNode(0) {}
 
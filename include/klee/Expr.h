@@ -72,6 +72,15 @@ The general rules are:
     </ol>
 </li>
 
+<li> Floating point:
+   <ol type="a">
+   <li> \c FOGt and \c FOGe are not used, they are written as \c FOLt and
+   \c FOLe with swapped operands. </li>
+   <li> The operands of \c FOEq are ordered, with a constant on the LHS. </li>
+   <li> Classification predicates look through \c FAbs, and \c IsNaN and
+   \c IsInfinite also through a non-x87 \c FPExt. </li>
+   </ol>
+</li>
 
 <li> Chains are unbalanced to the right </li>
 
@@ -89,7 +98,14 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 
 class Expr {
 public:
+  /// The number of live expressions. With ENABLE_THREAD_SAFE_EXPR this is
+  /// kept per thread to avoid contention, and counts the expressions created
+  /// minus those destroyed by the current thread.
+#ifdef KLEE_THREAD_SAFE_EXPR
+  static __thread unsigned count;
+#else
   static unsigned count;
+#endif
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
   /// The type of an expression is simply its width, in bits. 
@@ -186,8 +202,8 @@ public:
     FOEq,
     FOLt,
     FOLe,
-    FOGt,
-    FOGe,
+    FOGt, ///< Not used in canonical form
+    FOGe, ///< Not used in canonical form
 
     LastKind = FOGe,
 
@@ -204,6 +220,10 @@ public:
 protected:  
   unsigned hashValue;
 
+  /// Whether this expression is in the table of unique expressions, see
+  /// createCachedExpr().
+  bool isCached;
+
   /// Compares `b` to `this` Expr and determines how they are ordered
   /// (ignoring their kid expressions - i.e. those returned by `getKid()`).
   ///
@@ -229,8 +249,12 @@ protected:
   virtual int compareContents(const Expr &b) const = 0;
 
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : refCount(0), isCached(false) { Expr::count++; }
+  virtual ~Expr() {
+    Expr::count--;
+    if (isCached)
+      removeCachedExpr(this);
+  }
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -265,6 +289,12 @@ public:
   /// `<` and `>` are binary relations that express the total order.
   int compare(const Expr &b) const;
 
+  /// Returns the expression structurally equal to `e` that is in the table
+  /// of unique expressions, first adding `e` if there is none. All `alloc`
+  /// functions go through this, so with --hash-cons-exprs equal
+  /// expressions share a single node. Otherwise `e` is returned unchanged.
+  static ref<Expr> createCachedExpr(const ref<Expr> &e);
+
   // Given an array of new kids return a copy of the expression
   // but using those children. 
   virtual ref<Expr> rebuild(ref<Expr> kids[/* getNumKids() */]) const = 0;
@@ -313,6 +343,8 @@ public:
 private:
   typedef llvm::DenseSet<std::pair<const Expr *, const Expr *> > ExprEquivSet;
   int compare(const Expr &b, ExprEquivSet &equivs) const;
+
+  static void removeCachedExpr(Expr *e);
 };
 
 struct Expr::CreateArg {
@@ -458,7 +490,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &src) {
     ref<Expr> r(new NotOptimizedExpr(src));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -570,6 +602,11 @@ public:
   Expr::Width getDomain() const { return domain; }
   Expr::Width getRange() const { return range; }
 
+  /// getSizeInBytes - The number of bytes used to store the contents of the
+  /// array. Solvers give the value of an array with a wider range than a byte
+  /// as this many bytes, storing each element in little-endian order.
+  unsigned getSizeInBytes() const { return size * (range / 8); }
+
   /// ComputeHash must take into account the name, the size, the domain, and the range
   unsigned computeHash();
   unsigned hash() const { return hashValue; }
@@ -618,7 +655,7 @@ public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
     ref<Expr> r(new ReadExpr(updates, index));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -663,7 +700,7 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new SelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -726,7 +763,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
     ref<Expr> c(new ConcatExpr(l, r));
     c->computeHash();
-    return c;
+    return createCachedExpr(c);
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -793,7 +830,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
     ref<Expr> r(new ExtractExpr(e, o, w));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -844,7 +881,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new NotExpr(e));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -922,7 +959,7 @@ public:                                                          \
       assert(w > e->getWidth());                                 \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return createCachedExpr(r);                                \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -956,7 +993,7 @@ CAST_EXPR_CLASS(FPExt)
                            llvm::APFloat::roundingMode rm) {                   \
       ref<Expr> r(new _class_kind##Expr(e, w, rm));                            \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return createCachedExpr(r);                                              \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e, Width w,                       \
                             llvm::APFloat::roundingMode rm);                   \
@@ -1000,7 +1037,7 @@ FP_CAST_EXPR_CLASS(SIToFP)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(res);                                            \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const { return left->getWidth(); }                        \
@@ -1050,7 +1087,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
                            const llvm::APFloat::roundingMode rm) {             \
       ref<Expr> res(new _class_kind##Expr(l, r, rm));                          \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(res);                                            \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r,            \
                             llvm::APFloat::roundingMode rm);                   \
@@ -1094,7 +1131,7 @@ FLOAT_ARITHMETIC_EXPR_CLASS(FDiv)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(res);                                            \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
@@ -1140,7 +1177,7 @@ public: \
   static ref<Expr> alloc(const ref<Expr> &e) { \
     ref<Expr> r(new _class_kind ## Expr(e)); \
     r->computeHash(); \
-    return r; \
+    return createCachedExpr(r); \
   } \
   static ref<Expr> create(const ref<Expr> &e); \
   \
@@ -1180,7 +1217,7 @@ FP_PRED_EXPR_CLASS(IsSubnormal)
                            const llvm::APFloat::roundingMode rm) {             \
       ref<Expr> r(new _class_kind##Expr(e, rm));                               \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return createCachedExpr(r);                                              \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e,                                \
                             const llvm::APFloat::roundingMode rm);             \
@@ -1225,7 +1262,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new FAbsExpr(e));
     r->computeHash();
-    return r;
+    return createCachedExpr(r);
   }
   static ref<Expr> create(const ref<Expr> &e);
 
@@ -1337,13 +1374,13 @@ public:
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
-    return r;
+    return cast<ConstantExpr>(createCachedExpr(r));
   }
 
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
     ref<ConstantExpr> r(new ConstantExpr(f));
     r->computeHash();
-    return r;
+    return cast<ConstantExpr>(createCachedExpr(r));
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
@@ -59,6 +59,40 @@ namespace klee {
     virtual ref<Expr> Sgt(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
     virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
 
+    // Floating point expressions
+
+    virtual ref<Expr> FPExt(const ref<Expr> &LHS, Expr::Width W) = 0;
+    virtual ref<Expr> FPTrunc(const ref<Expr> &LHS, Expr::Width W,
+                              llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FPToUI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FPToSI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> UIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> SIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FAdd(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FSub(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FMul(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FDiv(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FSqrt(const ref<Expr> &LHS,
+                            llvm::APFloat::roundingMode RM) = 0;
+    virtual ref<Expr> FAbs(const ref<Expr> &LHS) = 0;
+    virtual ref<Expr> IsNaN(const ref<Expr> &LHS) = 0;
+    virtual ref<Expr> IsInfinite(const ref<Expr> &LHS) = 0;
+    virtual ref<Expr> IsNormal(const ref<Expr> &LHS) = 0;
+    virtual ref<Expr> IsSubnormal(const ref<Expr> &LHS) = 0;
+    virtual ref<Expr> FOEq(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
+    virtual ref<Expr> FOLt(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
+    virtual ref<Expr> FOLe(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
+    virtual ref<Expr> FOGt(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
+    virtual ref<Expr> FOGe(const ref<Expr> &LHS, const ref<Expr> &RHS) = 0;
+
     // Utility functions
 
     ref<Expr> False() { return ConstantExpr::alloc(0, Expr::Bool); }
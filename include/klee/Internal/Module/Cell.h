@@ -15,8 +15,70 @@
 namespace klee {
   class MemoryObject;
 
+  /// Cell - A register of the interpreter.
+  ///
+  /// Constants of at most 64 bits (integers as well as the bit patterns of
+  /// floats and doubles) are stored unboxed so concrete interpretation does
+  /// not have to allocate a ConstantExpr for every instruction result. The
+  /// ConstantExpr is only built (and then cached) when a client asks for the
+  /// value as an Expr.
   struct Cell {
-    ref<Expr> value;
+  private:
+    /// The value as an expression, null if the cell holds an unboxed
+    /// constant that nobody has asked for as an Expr yet.
+    mutable ref<Expr> expr;
+    /// The unboxed constant, truncated to \a width bits.
+    uint64_t bits;
+    /// The width of the unboxed constant, or 0 if the cell does not hold a
+    /// constant of at most 64 bits.
+    Expr::Width width;
+
+  public:
+    Cell() : bits(0), width(0) {}
+
+    /// Return the value of the cell as an Expr.
+    ref<Expr> getValue() const {
+      if (expr.isNull() && width)
+        expr = ConstantExpr::create(bits, width);
+      return expr;
+    }
+
+    void setValue(const ref<Expr> &value) {
+      expr = value;
+      width = 0;
+      if (!value.isNull()) {
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
+          if (CE->getWidth() <= 64) {
+            bits = CE->getZExtValue();
+            width = CE->getWidth();
+          }
+        }
+      }
+    }
+
+    /// Store the constant \a value of \a w bits without allocating an Expr.
+    /// The bits of \a value above \a w must be zero.
+    void setConstant(uint64_t value, Expr::Width w) {
+      assert(w > 0 && w <= 64 && "invalid width for an unboxed constant");
+      assert((w == 64 || (value >> w) == 0) && "constant is not truncated");
+      expr = ref<Expr>();
+      bits = value;
+      width = w;
+    }
+
+    /// Return true if the cell holds a constant of at most 64 bits that can
+    /// be accessed with getConstantBits() and getConstantWidth().
+    bool isUnboxedConstant() const { return width != 0; }
+
+    uint64_t getConstantBits() const {
+      assert(width && "cell does not hold an unboxed constant");
+      return bits;
+    }
+
+    Expr::Width getConstantWidth() const {
+      assert(width && "cell does not hold an unboxed constant");
+      return width;
+    }
   };
 }
 
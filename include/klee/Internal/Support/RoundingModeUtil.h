@@ -8,12 +8,23 @@
 //===----------------------------------------------------------------------===//
 #ifndef KLEE_ROUNDING_MODE_UTIL_H
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/StringRef.h"
 
 namespace klee {
 
 int LLVMRoundingModeToCRoundingMode(llvm::APFloat::roundingMode rm);
 
 const char *LLVMRoundingModeToString(llvm::APFloat::roundingMode rm);
+
+/// The inverse of LLVMRoundingModeToString(). Returns false if \a str is not
+/// the name of a rounding mode.
+bool StringToLLVMRoundingMode(llvm::StringRef str,
+                              llvm::APFloat::roundingMode &rm);
+
+/// Convert a KLEE_FP_* value (see klee.h) to an LLVM rounding mode. Returns
+/// false if \a kleeRoundingMode is not a rounding mode.
+bool KleeRoundingModeToLLVMRoundingMode(uint64_t kleeRoundingMode,
+                                        llvm::APFloat::roundingMode &rm);
 }
 
 #endif
@@ -0,0 +1,96 @@
+//===-- WorkerPool.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKERPOOL_H
+#define KLEE_WORKERPOOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace klee {
+
+  /// A set of forked worker processes which split an exploration between
+  /// them, and the coordinator process which hands out the work.
+  ///
+  /// A unit of work (a job) is a sequence of branch decisions which leads
+  /// from the root of the process tree to the subtree a worker explores.
+  /// Initially one worker owns the whole tree. When a worker becomes idle
+  /// the coordinator asks a busy worker to give up one of its states; that
+  /// worker sends the decisions leading to the state and drops it, and the
+  /// idle worker replays them to reconstruct the state.
+  class WorkerPool {
+  public:
+    /// Data shared by all processes of the pool.
+    struct Shared;
+
+  private:
+    struct Worker {
+      pid_t pid;
+      int toWorker, fromWorker;
+      bool idle, stealPending, exiting, exited;
+    };
+
+    unsigned numWorkers;
+    /// The index of this process, or -1 in the coordinator.
+    int workerID;
+    Shared *shared;
+    std::vector<Worker> workers;
+
+    /// In a worker, the ends of its pipes.
+    int input, output;
+
+    void sendToCoordinator(char type, const std::vector<char> &payload);
+
+  public:
+    WorkerPool(unsigned _numWorkers);
+    ~WorkerPool();
+
+    /// Fork the workers. Returns in every process; \ref isWorker tells the
+    /// workers from the coordinator.
+    void start();
+
+    bool isWorker() const { return workerID >= 0; }
+    unsigned getWorkerID() const { return workerID; }
+    unsigned getNumWorkers() const { return numWorkers; }
+
+    /// Return a test case number which is unique across the pool.
+    unsigned allocateTestID();
+    /// The number of test cases written by all workers so far.
+    unsigned getNumTestIDs() const;
+
+    /// Ask every worker to stop exploring.
+    void halt();
+    bool isHalted() const;
+
+    // Worker side.
+
+    /// Block until the coordinator hands out a job, whose branch decisions
+    /// are stored in \a prefix. Returns false once all work is done.
+    bool getJob(std::vector<bool> &prefix);
+
+    /// Check, without blocking, whether the coordinator wants this worker
+    /// to give up a state. It must answer with \ref donate or \ref decline.
+    bool isStealRequested();
+    void donate(const std::vector<bool> &prefix);
+    void decline();
+
+    /// Report the final counters of this worker to the coordinator.
+    void finish(const std::vector<uint64_t> &counters);
+
+    // Coordinator side.
+
+    /// Distribute jobs until all workers are idle and no work is left, then
+    /// wait for the workers to exit. \a totals receives the element-wise sum
+    /// of the counters the workers reported.
+    void coordinate(std::vector<uint64_t> &totals);
+  };
+}
+
+#endif
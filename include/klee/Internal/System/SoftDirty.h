@@ -0,0 +1,40 @@
+//===-- SoftDirty.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_SOFTDIRTY_H
+#define KLEE_UTIL_SOFTDIRTY_H
+
+#include <cstddef>
+#include <vector>
+
+namespace klee {
+  namespace util {
+
+    /// Size of a page of this process' memory.
+    size_t getPageSize();
+
+    /// Start tracking which pages of this process are written to, using the
+    /// soft-dirty bits of Linux.
+    ///
+    /// \return false if the kernel does not track writes this way, in which
+    /// case getSoftDirtyPages() must not be used.
+    bool clearSoftDirtyPages();
+
+    /// Find the pages overlapping [address, address + size) which were
+    /// written to since the last call to clearSoftDirtyPages(). On success
+    /// \a dirty has one entry per page, starting with the page containing
+    /// \a address.
+    ///
+    /// \return false if the pages could not be inspected.
+    bool getSoftDirtyPages(const void *address, size_t size,
+                           std::vector<bool> &dirty);
+  }
+}
+
+#endif
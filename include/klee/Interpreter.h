@@ -28,6 +28,7 @@ namespace klee {
 class ExecutionState;
 class Interpreter;
 class TreeStreamWriter;
+class WorkerPool;
 
 class InterpreterHandler {
 public:
@@ -123,6 +124,15 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply the pool of worker processes this process belongs to. the
+  // interpreter will give states away when the pool asks for work.
+  virtual void setWorkerPool(WorkerPool *pool) = 0;
+
+  // supply the decisions at process tree splits which lead to the subtree
+  // explored by the next run (see WorkerPool). an empty prefix explores
+  // the whole tree.
+  virtual void setWorkPrefix(const std::vector<bool> &prefix) = 0;
+
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
@@ -295,6 +295,26 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createFPFuzzSolver - Create a solver which tries to find satisfying
+  /// assignments for floating point queries by concretely evaluating them
+  /// under random, boundary value and mutated candidate assignments. Queries
+  /// for which no assignment is found within the budget are passed on.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createFPFuzzSolver(Solver *s);
+
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results and counterexamples in a memory-mapped file, so that they are
+  /// kept across runs and shared between processes. Once the cache is full
+  /// the oldest entries are evicted. If the file cannot be opened a warning
+  /// is printed and queries are passed on uncached.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, which is created if it does not exist.
+  /// \param capacity - The size in bytes of a newly created cache file.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path,
+                                        uint64_t capacity);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
@@ -16,17 +16,28 @@ namespace klee {
 namespace stats {
 
   extern Statistic cexCacheTime;
+  extern Statistic fpFuzzTime;
   extern Statistic queries;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
+  extern Statistic queryAckermannizedArrays;
+  extern Statistic queryArrays;
   extern Statistic queryCacheHits;
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryConstructCacheHits;
+  extern Statistic queryConstructCacheMisses;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
+  extern Statistic queryFPFuzzHits;
+  extern Statistic queryFPFuzzMisses;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryTime;
+  extern Statistic queryZ3WorkerQueries;
+  extern Statistic queryZ3WorkerRestarts;
   
 #ifdef DEBUG
   extern Statistic arrayHashTime;
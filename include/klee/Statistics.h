@@ -11,6 +11,7 @@
 #define KLEE_STATISTICS_H
 
 #include "Statistic.h"
+#include "klee/Config/config.h"
 
 #include <vector>
 #include <string>
@@ -45,6 +46,9 @@ namespace klee {
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
+#ifdef KLEE_THREAD_SAFE_EXPR
+    static __thread bool threadDisabled;
+#endif
 
   public:
     StatisticManager();
@@ -52,6 +56,13 @@ namespace klee {
 
     void useIndexedStats(unsigned totalIndices);
 
+#ifdef KLEE_THREAD_SAFE_EXPR
+    /// Ignore all updates made by the calling thread. The statistics are not
+    /// thread safe, so helper threads which run code that updates them (such
+    /// as a solver chain) must call this first.
+    static void disableForThread() { threadDisabled = true; }
+#endif
+
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
@@ -75,6 +86,10 @@ namespace klee {
 
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
+#ifdef KLEE_THREAD_SAFE_EXPR
+    if (threadDisabled)
+      return;
+#endif
     if (enabled) {
       globalStats[s.id] += addend;
       if (indexedStats) {
@@ -25,6 +25,10 @@
 #include <string>
 #include <vector>
 
+#ifdef KLEE_THREAD_SAFE_EXPR
+#include <pthread.h>
+#endif
+
 namespace klee {
 
 struct EquivArrayCmpFn {
@@ -36,9 +40,12 @@ struct EquivArrayCmpFn {
 };
 
 /// Provides an interface for creating and destroying Array objects.
+///
+/// With ENABLE_THREAD_SAFE_EXPR, CreateArray() may be called from several
+/// threads at once.
 class ArrayCache {
 public:
-  ArrayCache() {}
+  ArrayCache();
   ~ArrayCache();
   /// Create an Array object.
   //
@@ -73,6 +80,9 @@ private:
   ArrayHashMap cachedSymbolicArrays;
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+#ifdef KLEE_THREAD_SAFE_EXPR
+  pthread_mutex_t lock;
+#endif
 };
 }
 
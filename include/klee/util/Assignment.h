@@ -46,6 +46,8 @@ namespace klee {
     
     ref<Expr> evaluate(const Array *mo, unsigned index) const;
     ref<Expr> evaluate(ref<Expr> e);
+    /// Set element \a index of the bound array \a array to \a value.
+    void setValue(const Array *array, unsigned index, uint64_t value);
     void createConstraintsFromAssignment(std::vector<ref<Expr> > &out) const;
 
     template<typename InputIterator>
@@ -71,8 +73,16 @@ namespace klee {
                                         unsigned index) const {
     assert(array);
     bindings_ty::const_iterator it = bindings.find(array);
-    if (it!=bindings.end() && index<it->second.size()) {
-      return ConstantExpr::alloc(it->second[index], array->getRange());
+    unsigned bytes = array->getRange() / 8;
+    if (it!=bindings.end() && (uint64_t) (index + 1) * bytes <= it->second.size()) {
+      if (bytes == 1)
+        return ConstantExpr::alloc(it->second[index], array->getRange());
+      // Wider elements are stored little-endian.
+      llvm::APInt value(array->getRange(), 0);
+      for (unsigned i = bytes; i != 0; --i)
+        value = value.shl(8) |
+                llvm::APInt(array->getRange(), it->second[index * bytes + i - 1]);
+      return ConstantExpr::alloc(value);
     } else {
       if (allowFreeValues) {
         return ReadExpr::create(UpdateList(array, 0), 
@@ -0,0 +1,40 @@
+//===-- Atomic.h ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ATOMIC_H
+#define KLEE_ATOMIC_H
+
+#include "klee/Config/config.h"
+
+namespace klee {
+
+/// atomicIncrement - Increment a counter shared by the expression library,
+/// such as a reference count, and return the new value. This is an atomic
+/// operation if KLEE is built with ENABLE_THREAD_SAFE_EXPR and a plain
+/// increment otherwise.
+template <typename T> inline T atomicIncrement(T &value) {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  return __sync_add_and_fetch(&value, 1);
+#else
+  return ++value;
+#endif
+}
+
+/// atomicDecrement - Decrement a counter shared by the expression library
+/// and return the new value. \sa atomicIncrement
+template <typename T> inline T atomicDecrement(T &value) {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  return __sync_sub_and_fetch(&value, 1);
+#else
+  return --value;
+#endif
+}
+}
+
+#endif /* KLEE_ATOMIC_H */
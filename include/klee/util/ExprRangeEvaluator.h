@@ -12,6 +12,9 @@
 
 #include "klee/Expr.h"
 #include "klee/util/Bits.h"
+#include "klee/util/FloatRange.h"
+
+#include <algorithm>
 
 namespace klee {
 
@@ -59,6 +62,14 @@ protected:
   /// array (which may be constant), for the given range of indices.
   virtual T getInitialReadRange(const Array &os, T index) = 0;
 
+  /// getKnownFloatRange - Return a range that is known to contain the
+  /// floating point value of the given expression, independent of its
+  /// structure. The default knows nothing.
+  virtual FloatRange getKnownFloatRange(const ref<Expr> &e) {
+    return FloatRange::full(
+        ConstantExpr::widthToFloatSemantics(e->getWidth()));
+  }
+
   T evalRead(const UpdateList &ul, T index);
 
 public:
@@ -66,6 +77,11 @@ public:
   virtual ~ExprRangeEvaluator() {}
 
   T evaluate(const ref<Expr> &e);
+
+  /// evaluateFloat - Evaluate a floating point valued expression. Unlike
+  /// evaluate() the result never depends on the integer ranges, so it is a
+  /// sound over-approximation whenever getKnownFloatRange() is.
+  FloatRange evaluateFloat(const ref<Expr> &e);
 };
 
 template<class T>
@@ -266,6 +282,88 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
     break;
   }
 
+  case Expr::FOEq: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    FloatRange left = evaluateFloat(be->left);
+    FloatRange right = evaluateFloat(be->right);
+
+    if (left.mustEqual(right)) {
+      return T(1);
+    } else if (!left.mayEqual(right)) {
+      return T(0);
+    }
+    break;
+  }
+  case Expr::FOLt:
+  case Expr::FOGt: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    FloatRange left = evaluateFloat(be->left);
+    FloatRange right = evaluateFloat(be->right);
+    if (e->getKind() == Expr::FOGt)
+      std::swap(left, right);
+
+    if (left.mustBeLessThan(right)) {
+      return T(1);
+    } else if (!left.mayBeLessThan(right)) {
+      return T(0);
+    }
+    break;
+  }
+  case Expr::FOLe:
+  case Expr::FOGe: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    FloatRange left = evaluateFloat(be->left);
+    FloatRange right = evaluateFloat(be->right);
+    if (e->getKind() == Expr::FOGe)
+      std::swap(left, right);
+
+    if (left.mustBeLessOrEqual(right)) {
+      return T(1);
+    } else if (!left.mayBeLessOrEqual(right)) {
+      return T(0);
+    }
+    break;
+  }
+
+    // Floating point predicates
+
+  case Expr::IsNaN: {
+    FloatRange arg = evaluateFloat(e->getKid(0));
+    if (arg.mustBeNaN()) {
+      return T(1);
+    } else if (!arg.mayBeNaN()) {
+      return T(0);
+    }
+    break;
+  }
+  case Expr::IsInfinite: {
+    FloatRange arg = evaluateFloat(e->getKid(0));
+    if (arg.mustBeInfinite()) {
+      return T(1);
+    } else if (!arg.mayBeInfinite()) {
+      return T(0);
+    }
+    break;
+  }
+  case Expr::IsNormal: {
+    FloatRange arg = evaluateFloat(e->getKid(0));
+    if (arg.mustBeNormal()) {
+      return T(1);
+    } else if (!arg.mayBeNormal()) {
+      return T(0);
+    }
+    break;
+  }
+  case Expr::IsSubnormal: {
+    FloatRange arg = evaluateFloat(e->getKid(0));
+    if (arg.mustBeSubnormal()) {
+      return T(1);
+    } else if (!arg.mayBeSubnormal()) {
+      return T(0);
+    }
+    break;
+  }
+
   case Expr::Ne:
   case Expr::Ugt:
   case Expr::Uge:
@@ -280,6 +378,87 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
   return T(0, bits64::maxValueOfNBits(e->getWidth()));
 }
 
+template<class T>
+FloatRange ExprRangeEvaluator<T>::evaluateFloat(const ref<Expr> &e) {
+  const llvm::fltSemantics &sem =
+      ConstantExpr::widthToFloatSemantics(e->getWidth());
+  assert(&sem != &(llvm::APFloat::Bogus) && "not a floating point width");
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    // x87 unnormals, pseudo-infinities and pseudo-NaNs have no IEEE-754
+    // interpretation.
+    const llvm::APInt &bits = CE->getAPValue();
+    if (e->getWidth() == Expr::Fl80 && !bits[63] &&
+        bits.lshr(64).trunc(15) != 0)
+      return FloatRange::full(sem);
+    return FloatRange(CE->getAPFloatValue());
+  }
+
+  FloatRange res = FloatRange::full(sem);
+  switch (e->getKind()) {
+  case Expr::Select: {
+    // Only trust constant conditions, integer ranges may be imprecise.
+    const SelectExpr *se = cast<SelectExpr>(e);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(se->cond)) {
+      res = evaluateFloat(CE->isTrue() ? se->trueExpr : se->falseExpr);
+    } else {
+      res = evaluateFloat(se->trueExpr).set_union(
+          evaluateFloat(se->falseExpr));
+    }
+    break;
+  }
+
+  case Expr::FAdd: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    res = evaluateFloat(be->left).add(evaluateFloat(be->right));
+    break;
+  }
+  case Expr::FSub: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    res = evaluateFloat(be->left).sub(evaluateFloat(be->right));
+    break;
+  }
+  case Expr::FMul: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    res = evaluateFloat(be->left).mul(evaluateFloat(be->right));
+    break;
+  }
+  case Expr::FDiv: {
+    const BinaryExpr *be = cast<BinaryExpr>(e);
+    res = evaluateFloat(be->left).div(evaluateFloat(be->right));
+    break;
+  }
+  case Expr::FSqrt:
+    res = evaluateFloat(e->getKid(0)).sqrt();
+    break;
+  case Expr::FAbs:
+    res = evaluateFloat(e->getKid(0)).abs();
+    break;
+
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+    res = evaluateFloat(e->getKid(0)).convert(sem);
+    break;
+  case Expr::UIToFP: {
+    unsigned bits = e->getKid(0)->getWidth();
+    res = FloatRange::fromUnsigned(llvm::APInt::getMinValue(bits),
+                                   llvm::APInt::getMaxValue(bits), sem);
+    break;
+  }
+  case Expr::SIToFP: {
+    unsigned bits = e->getKid(0)->getWidth();
+    res = FloatRange::fromSigned(llvm::APInt::getSignedMinValue(bits),
+                                 llvm::APInt::getSignedMaxValue(bits), sem);
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  return res.set_intersection(getKnownFloatRange(e));
+}
+
 }
 
 #endif
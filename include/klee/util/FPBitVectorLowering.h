@@ -0,0 +1,41 @@
+//===-- FPBitVectorLowering.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FPBITVECTORLOWERING_H
+#define KLEE_FPBITVECTORLOWERING_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprVisitor.h"
+
+namespace klee {
+
+/// FPBitVectorLowering - Rewrite floating point expressions into expressions
+/// that only use bit-vector operations so that solvers without a floating
+/// point theory (STP and the metaSMT backends) can reason about them.
+///
+/// The encoding is bit-precise IEEE-754 in the style of a software floating
+/// point library and supports every rounding mode and the half, single,
+/// double, x87 extended and quad formats. To agree with the Z3 backend NaN
+/// results use the bit pattern of ConstantExpr::GetNaN(), and the explicit
+/// integer bit of x87 extended values is ignored in operands and recomputed
+/// in results. Float to integer conversions that are out of range give zero
+/// here. Their result is unspecified, and the Z3 backend may pick any value.
+class FPBitVectorLowering : public ExprVisitor {
+protected:
+  Action visitExprPost(const Expr &e);
+
+public:
+  FPBitVectorLowering() {}
+
+  /// Return \a e with every floating point operation lowered.
+  ref<Expr> lower(const ref<Expr> &e) { return visit(e); }
+};
+}
+
+#endif
@@ -0,0 +1,125 @@
+//===-- FloatRange.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FLOATRANGE_H
+#define KLEE_FLOATRANGE_H
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APInt.h"
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace klee {
+
+/// FloatRange - An over-approximation of a set of IEEE-754 values of a single
+/// format. The set is a closed interval of non-NaN values plus a flag that
+/// says whether NaN is a member.
+///
+/// Interval bounds are ordered with -0 below +0 so the sign of zero is
+/// tracked: [-0,-0] only contains negative zero, [-0,+0] contains both.
+/// Infinities are ordinary bounds. Arithmetic rounds the lower bound toward
+/// negative and the upper bound toward positive infinity, so results contain
+/// the value computed under any rounding mode.
+class FloatRange {
+private:
+  const llvm::fltSemantics *semantics;
+  llvm::APFloat m_min, m_max;
+  bool m_hasNumbers;
+  bool m_mayBeNaN;
+
+public:
+  /// Construct the empty range.
+  explicit FloatRange(const llvm::fltSemantics &sem);
+  explicit FloatRange(const llvm::APFloat &value);
+  FloatRange(const llvm::APFloat &_min, const llvm::APFloat &_max,
+             bool mayBeNaN);
+
+  /// Every value of the format, including NaN.
+  static FloatRange full(const llvm::fltSemantics &sem);
+  /// Only NaN.
+  static FloatRange nan(const llvm::fltSemantics &sem);
+  /// The values of the format that an integer in [min, max] converts to.
+  static FloatRange fromUnsigned(const llvm::APInt &min, const llvm::APInt &max,
+                                 const llvm::fltSemantics &sem);
+  static FloatRange fromSigned(const llvm::APInt &min, const llvm::APInt &max,
+                               const llvm::fltSemantics &sem);
+
+  const llvm::fltSemantics &getSemantics() const { return *semantics; }
+
+  void print(llvm::raw_ostream &os) const;
+
+  bool isEmpty() const { return !m_hasNumbers && !m_mayBeNaN; }
+  bool hasNumbers() const { return m_hasNumbers; }
+  bool mayBeNaN() const { return m_mayBeNaN; }
+  bool mustBeNaN() const { return m_mayBeNaN && !m_hasNumbers; }
+  bool isFixed() const;
+  bool contains(const llvm::APFloat &value) const;
+
+  /// Smallest and largest non-NaN member, only valid if hasNumbers().
+  const llvm::APFloat &min() const;
+  const llvm::APFloat &max() const;
+
+  /// Return some member of the range, preferring simple values.
+  llvm::APFloat pickValue() const;
+
+  FloatRange withNaN(bool mayBeNaN) const;
+  FloatRange set_union(const FloatRange &b) const;
+  FloatRange set_intersection(const FloatRange &b) const;
+
+  FloatRange add(const FloatRange &b) const;
+  FloatRange sub(const FloatRange &b) const;
+  FloatRange mul(const FloatRange &b) const;
+  FloatRange div(const FloatRange &b) const;
+  FloatRange sqrt() const;
+  FloatRange abs() const;
+  FloatRange convert(const llvm::fltSemantics &sem) const;
+
+  // IEEE-754 comparisons between members of two ranges. NaN compares unordered
+  // and -0 compares equal to +0.
+  bool mayEqual(const FloatRange &b) const;
+  bool mustEqual(const FloatRange &b) const;
+  bool mayBeLessThan(const FloatRange &b) const;
+  bool mustBeLessThan(const FloatRange &b) const;
+  bool mayBeLessOrEqual(const FloatRange &b) const;
+  bool mustBeLessOrEqual(const FloatRange &b) const;
+
+  bool mayBeInfinite() const;
+  bool mustBeInfinite() const;
+  bool mayBeNormal() const;
+  bool mustBeNormal() const;
+  bool mayBeSubnormal() const;
+  bool mustBeSubnormal() const;
+
+  // Members of this range that satisfy the comparison with some member of
+  // \a b. These never contain NaN.
+  FloatRange restrictToEqual(const FloatRange &b) const;
+  FloatRange restrictToLessThan(const FloatRange &b) const;
+  FloatRange restrictToLessOrEqual(const FloatRange &b) const;
+  FloatRange restrictToGreaterThan(const FloatRange &b) const;
+  FloatRange restrictToGreaterOrEqual(const FloatRange &b) const;
+
+  /// Members of this range that are infinite (or, if \a infinite is false,
+  /// that are not).
+  FloatRange restrictToInfinite(bool infinite) const;
+
+private:
+  bool mayIntersect(const llvm::APFloat &lo, const llvm::APFloat &hi) const;
+  bool isWithin(const llvm::APFloat &lo, const llvm::APFloat &hi) const;
+};
+
+inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
+                                     const FloatRange &fr) {
+  fr.print(os);
+  return os;
+}
+}
+
+#endif
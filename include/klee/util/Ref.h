@@ -10,6 +10,8 @@
 #ifndef KLEE_REF_H
 #define KLEE_REF_H
 
+#include "klee/util/Atomic.h"
+
 #include "llvm/Support/Casting.h"
 using llvm::isa;
 using llvm::cast;
@@ -38,11 +40,11 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->refCount;
+      atomicIncrement(ptr->refCount);
   }
 
   void dec() const {
-    if (ptr && --ptr->refCount == 0)
+    if (ptr && atomicDecrement(ptr->refCount) == 0)
       delete ptr;
   }
 
@@ -21,6 +21,13 @@ UseFastCexSolver("use-fast-cex-solver",
 		 llvm::cl::init(false),
 		 llvm::cl::desc("(default=off)"));
 
+llvm::cl::opt<bool>
+UseFPFuzzSolver("use-fp-fuzz-solver",
+                llvm::cl::init(false),
+                llvm::cl::desc("Try to find models for floating point queries "
+                               "by fuzzing before invoking the core solver "
+                               "(default=off)"));
+
 llvm::cl::opt<bool>
 UseCexCache("use-cex-cache",
             llvm::cl::init(true),
@@ -36,6 +43,22 @@ UseIndependentSolver("use-independent-solver",
                      llvm::cl::init(true),
                      llvm::cl::desc("Use constraint independence (default=on)"));
 
+llvm::cl::opt<std::string>
+SolverCacheFile("solver-cache-file",
+                llvm::cl::init(""),
+                llvm::cl::value_desc("path"),
+                llvm::cl::desc("Keep solver results in a persistent cache file "
+                               "that is shared across runs and between "
+                               "concurrent processes (default=off)"));
+
+llvm::cl::opt<unsigned>
+SolverCacheSize("solver-cache-size",
+                llvm::cl::init(256),
+                llvm::cl::value_desc("MiB"),
+                llvm::cl::desc("Size of a newly created persistent solver "
+                               "cache. The oldest entries are evicted once it "
+                               "is full (default=256)"));
+
 llvm::cl::opt<bool>
 DebugValidateSolver("debug-validate-solver",
 		             llvm::cl::init(false));
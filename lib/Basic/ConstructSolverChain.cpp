@@ -43,6 +43,16 @@ Solver *constructSolverChain(Solver *coreSolver,
   if (UseFastCexSolver)
     solver = createFastCexSolver(solver);
 
+  if (UseFPFuzzSolver)
+    solver = createFPFuzzSolver(solver);
+
+  if (!SolverCacheFile.empty()) {
+    solver = createPersistentCachingSolver(
+        solver, SolverCacheFile, (uint64_t)SolverCacheSize << 20);
+    klee_message("Using persistent solver cache %s\n",
+                 SolverCacheFile.c_str());
+  }
+
   if (UseCexCache)
     solver = createCexCachingSolver(solver);
 
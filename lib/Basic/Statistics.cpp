@@ -13,6 +13,10 @@
 
 using namespace klee;
 
+#ifdef KLEE_THREAD_SAFE_EXPR
+__thread bool StatisticManager::threadDisabled = false;
+#endif
+
 StatisticManager::StatisticManager()
   : enabled(true),
     globalStats(0),
@@ -12,21 +12,56 @@
 #include "Memory.h"
 #include "TimingSolver.h"
 
+#include "klee/ExecutionState.h"
 #include "klee/Expr.h"
 #include "klee/TimerStatIncrementer.h"
+#include "klee/Internal/System/SoftDirty.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
 
 using namespace klee;
 
+namespace {
+  llvm::cl::opt<bool>
+  SoftDirtyExternalCalls("soft-dirty-external-calls",
+                         llvm::cl::init(true),
+                         llvm::cl::desc("After an external call, only compare "
+                                        "the pages of large objects which "
+                                        "the kernel reports as written to. "
+                                        "Requires Linux with soft-dirty page "
+                                        "tracking (default=on)"));
+
+  llvm::cl::opt<bool>
+  CacheResolutions("cache-resolutions",
+                   llvm::cl::init(true),
+                   llvm::cl::desc("Remember the objects a symbolic pointer "
+                                  "resolved to until the path constraints "
+                                  "or the allocated objects change "
+                                  "(default=on)"));
+}
+
+/// Objects smaller than this are compared in full after an external call,
+/// which is cheaper than asking the kernel about their pages.
+static const unsigned SoftDirtyMinObjectSize = 1 << 20;
+
+/// Bound on the pointers whose resolution is remembered per state, since
+/// the cache is copied whenever the state forks.
+static const unsigned MaxCachedResolutions = 64;
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, os));
+  resolutionCache.clear();
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   objects = objects.remove(mo);
+  resolutionCache.clear();
 }
 
 const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
@@ -160,6 +195,59 @@ bool AddressSpace::resolveOne(ExecutionState &state,
   }
 }
 
+/// Find the objects in [begin, end) of \a objects, which are ordered by
+/// address, that \a p may point into. A range is only split in two once
+/// \a p may point into the interval it spans, so a whole range of objects
+/// out of reach costs a single query. \a example is a value of \a p, ranges
+/// containing it need no query.
+///
+/// \return true iff the search was cut short.
+static bool searchObjects(ExecutionState &state, TimingSolver *solver,
+                          ref<Expr> p, uint64_t example,
+                          const std::vector<const MemoryObject*> &objects,
+                          unsigned begin, unsigned end,
+                          std::vector<const MemoryObject*> &found,
+                          unsigned maxResolutions,
+                          TimerStatIncrementer &timer, uint64_t timeout_us) {
+  if (begin == end)
+    return false;
+  if (timeout_us && timeout_us < timer.check())
+    return true;
+
+  const MemoryObject *first = objects[begin];
+  if (end - begin == 1) {
+    bool mayBeTrue = (first->size == 0 && example == first->address) ||
+                     example - first->address < first->size;
+    if (!mayBeTrue &&
+        !solver->mayBeTrue(state, first->getBoundsCheckPointer(p), mayBeTrue))
+      return true;
+    if (!mayBeTrue)
+      return false;
+    found.push_back(first);
+    return found.size() == maxResolutions;
+  }
+
+  const MemoryObject *last = objects[end - 1];
+  uint64_t lastEnd = last->address + std::max(last->size, 1u);
+  bool mayBeTrue = first->address <= example && example < lastEnd;
+  if (!mayBeTrue) {
+    ref<Expr> inRange = AndExpr::create(
+        UgeExpr::create(p, first->getBaseExpr()),
+        UltExpr::create(p, ConstantExpr::create(
+                               lastEnd, Context::get().getPointerWidth())));
+    if (!solver->mayBeTrue(state, inRange, mayBeTrue))
+      return true;
+    if (!mayBeTrue)
+      return false;
+  }
+
+  unsigned mid = begin + (end - begin) / 2;
+  return searchObjects(state, solver, p, example, objects, begin, mid, found,
+                       maxResolutions, timer, timeout_us) ||
+         searchObjects(state, solver, p, example, objects, mid, end, found,
+                       maxResolutions, timer, timeout_us);
+}
+
 bool AddressSpace::resolve(ExecutionState &state,
                            TimingSolver *solver, 
                            ref<Expr> p, 
@@ -175,114 +263,68 @@ bool AddressSpace::resolve(ExecutionState &state,
     TimerStatIncrementer timer(stats::resolveTime);
     uint64_t timeout_us = (uint64_t) (timeout*1000000.);
 
-    // XXX in general this isn't exactly what we want... for
-    // a multiple resolution case (or for example, a \in {b,c,0})
-    // we want to find the first object, find a cex assuming
-    // not the first, find a cex assuming not the second...
-    // etc.
-    
-    // XXX how do we smartly amortize the cost of checking to
-    // see if we need to keep searching up/down, in bad cases?
-    // maybe we don't care?
-    
-    // XXX we really just need a smart place to start (although
-    // if its a known solution then the code below is guaranteed
-    // to hit the fast path with exactly 2 queries). we could also
-    // just get this by inspection of the expr.
-    
+    if (CacheResolutions) {
+      if (!(resolutionConstraints == state.constraints)) {
+        resolutionCache.clear();
+        resolutionConstraints = state.constraints;
+      }
+
+      ExprHashMap<std::vector<const MemoryObject*> >::iterator it =
+        resolutionCache.find(p);
+      if (it != resolutionCache.end()) {
+        const std::vector<const MemoryObject*> &mos = it->second;
+        for (unsigned i = 0; i != mos.size(); ++i) {
+          if (i == maxResolutions && maxResolutions)
+            return true;
+          rl.push_back(ObjectPair(mos[i], findObject(mos[i])));
+        }
+        return false;
+      }
+    }
+
     ref<ConstantExpr> cex;
     if (!solver->getValue(state, p, cex))
       return true;
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-    
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-      
-    // XXX in the common case we can save one query if we ask
-    // mustBeTrue before mayBeTrue for the first result. easy
-    // to add I just want to have a nice symbolic test case first.
-      
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries (XXX can be better,
-    // no?)
-    while (oi!=begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout_us && timeout_us < timer.check())
-        return true;
 
-      // XXX I think there is some query wasteage here?
-      ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
-        return true;
-      if (mayBeTrue) {
-        rl.push_back(*oi);
-        
-        // fast path check
-        unsigned size = rl.size();
-        if (size==1) {
-          bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
-            return true;
-          if (mustBeTrue)
-            return false;
-        } else if (size==maxResolutions) {
-          return true;
-        }
-      }
-        
+    std::vector<const MemoryObject*> found;
+
+    // fast path: the pointer is in bounds of the object the example is in
+    ObjectPair res;
+    if (resolveOne(cex, res)) {
       bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UgeExpr::create(p, mo->getBaseExpr()),
+      if (!solver->mustBeTrue(state, res.first->getBoundsCheckPointer(p),
                               mustBeTrue))
         return true;
       if (mustBeTrue)
-        break;
+        found.push_back(res.first);
     }
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const MemoryObject *mo = oi->first;
-      if (timeout_us && timeout_us < timer.check())
-        return true;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
-        return true;
-      if (mustBeTrue)
-        break;
-      
-      // XXX I think there is some query wasteage here?
-      ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
+    if (found.empty()) {
+      std::vector<const MemoryObject*> mos;
+      mos.reserve(objects.size());
+      for (MemoryMap::iterator oi = objects.begin(), oe = objects.end();
+           oi != oe; ++oi)
+        mos.push_back(oi->first);
+
+      bool incomplete = searchObjects(state, solver, p, example, mos, 0,
+                                      mos.size(), found, maxResolutions,
+                                      timer, timeout_us);
+      for (unsigned i = 0; i != found.size(); ++i)
+        rl.push_back(ObjectPair(found[i], findObject(found[i])));
+      if (incomplete)
         return true;
-      if (mayBeTrue) {
-        rl.push_back(*oi);
-        
-        // fast path check
-        unsigned size = rl.size();
-        if (size==1) {
-          bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
-            return true;
-          if (mustBeTrue)
-            return false;
-        } else if (size==maxResolutions) {
-          return true;
-        }
-      }
+    } else {
+      rl.push_back(res);
     }
-  }
 
-  return false;
+    if (CacheResolutions) {
+      if (resolutionCache.size() >= MaxCachedResolutions)
+        resolutionCache.clear();
+      resolutionCache.insert(std::make_pair(p, found));
+    }
+    return false;
+  }
 }
 
 // These two are pretty big hack so we can sort of pass memory back
@@ -292,6 +334,7 @@ bool AddressSpace::resolve(ExecutionState &state,
 // then its concrete cache byte isn't being used) but is just a hack.
 
 void AddressSpace::copyOutConcretes() {
+  bool trackable = false;
   for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
        it != ie; ++it) {
     const MemoryObject *mo = it->first;
@@ -300,27 +343,70 @@ void AddressSpace::copyOutConcretes() {
       ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+      // Objects at fixed addresses, such as errno, are shared with KLEE
+      // itself and may have changed since they were copied out.
+      if (!os->readOnly &&
+          (mo->isFixed || mo->nativeVersion != os->version)) {
+        os->readConcreteStore(0, mo->size, address);
+        mo->nativeVersion = os->version;
+      }
+      trackable |= mo->size >= SoftDirtyMinObjectSize;
     }
   }
+
+  nativeWritesTracked =
+      SoftDirtyExternalCalls && trackable && util::clearSoftDirtyPages();
+}
+
+bool AddressSpace::copyInConcretes(const MemoryObject *mo,
+                                   const ObjectState *&os,
+                                   unsigned offset, unsigned size) {
+  uint8_t *address = (uint8_t*) (unsigned long) mo->address + offset;
+  if (os->isConcreteStoreEqual(offset, size, address))
+    return true;
+  if (os->readOnly)
+    return false;
+
+  ObjectState *wos = getWriteable(mo, os);
+  wos->writeConcreteStore(offset, size, address);
+  mo->nativeVersion = wos->version;
+  os = wos;
+  return true;
 }
 
 bool AddressSpace::copyInConcretes() {
+  size_t pageSize = util::getPageSize();
+  std::vector<bool> dirty;
   for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
        it != ie; ++it) {
     const MemoryObject *mo = it->first;
 
     if (!mo->isUserSpecified) {
       const ObjectState *os = it->second;
-      uint8_t *address = (uint8_t*) (unsigned long) mo->address;
+      uint64_t address = mo->address;
+
+      if (!nativeWritesTracked || mo->size < SoftDirtyMinObjectSize ||
+          !util::getSoftDirtyPages((void*) (unsigned long) address, mo->size,
+                                   dirty)) {
+        if (!copyInConcretes(mo, os, 0, mo->size)) {
+          discardCopiedOutConcretes();
+          return false;
+        }
+        continue;
+      }
 
-      if (memcmp(address, os->concreteStore, mo->size)!=0) {
-        if (os->readOnly) {
+      // Pages not written to by the external call still hold the values
+      // copied out.
+      uint64_t firstPage = address - address % pageSize;
+      for (unsigned i = 0; i != dirty.size(); ++i) {
+        if (!dirty[i])
+          continue;
+        uint64_t begin = std::max(firstPage + i * pageSize, address);
+        uint64_t end = std::min(firstPage + (i + 1) * pageSize,
+                                address + mo->size);
+        if (!copyInConcretes(mo, os, begin - address, end - begin)) {
+          discardCopiedOutConcretes();
           return false;
-        } else {
-          ObjectState *wos = getWriteable(mo, os);
-          memcpy(wos->concreteStore, address, mo->size);
         }
       }
     }
@@ -329,6 +415,12 @@ bool AddressSpace::copyInConcretes() {
   return true;
 }
 
+void AddressSpace::discardCopiedOutConcretes() {
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
+       it != ie; ++it)
+    it->first->nativeVersion = 0;
+}
+
 /***/
 
 bool MemoryObjectLT::operator()(const MemoryObject *a, const MemoryObject *b) const {
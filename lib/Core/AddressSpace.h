@@ -12,8 +12,10 @@
 
 #include "ObjectHolder.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/util/ExprHashMap.h"
 
 namespace klee {
   class ExecutionState;
@@ -38,6 +40,16 @@ namespace klee {
     /// Epoch counter used to control ownership of objects.
     mutable unsigned cowKey;
 
+    /// Whether the kernel tracks the pages written to since the last
+    /// copyOutConcretes().
+    bool nativeWritesTracked;
+
+    /// The objects symbolic pointers were found to resolve to. The entries
+    /// are valid as long as the set of objects does not change and the
+    /// path constraints are resolutionConstraints.
+    ExprHashMap<std::vector<const MemoryObject*> > resolutionCache;
+    ConstraintManager resolutionConstraints;
+
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace&); 
     
@@ -52,8 +64,12 @@ namespace klee {
     MemoryMap objects;
     
   public:
-    AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    AddressSpace() : cowKey(1), nativeWritesTracked(false) {}
+    AddressSpace(const AddressSpace &b)
+      : cowKey(++b.cowKey), nativeWritesTracked(false),
+        resolutionCache(b.resolutionCache),
+        resolutionConstraints(b.resolutionConstraints),
+        objects(b.objects) { }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
@@ -80,6 +96,9 @@ namespace klee {
     /// maxResolutions is non-zero then no more than that many pairs
     /// will be returned. 
     ///
+    /// The objects are found by repeatedly halving the range of objects
+    /// the address may point into, and are returned ordered by address.
+    ///
     /// \return true iff the resolution is incomplete (maxResolutions
     /// is non-zero and the search terminated early, or a query timed out).
     bool resolve(ExecutionState &state,
@@ -113,7 +132,8 @@ namespace klee {
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os);
 
     /// Copy the concrete values of all managed ObjectStates into the
-    /// actual system memory location they were allocated at.
+    /// actual system memory location they were allocated at. Objects whose
+    /// concrete values are already there are skipped.
     void copyOutConcretes();
 
     /// Copy the concrete values of all managed ObjectStates back from
@@ -125,6 +145,20 @@ namespace klee {
     /// \retval true The copy succeeded. 
     /// \retval false The copy failed because a read-only object was modified.
     bool copyInConcretes();
+
+    /// Forget which concrete values were copied out, so that the next
+    /// copyOutConcretes() copies all of them again. Used when an external
+    /// call left the system memory in an unknown state.
+    void discardCopiedOutConcretes();
+
+  private:
+    /// Copy \a size bytes at \a offset of the concrete values of \a mo back
+    /// from system memory if they differ, updating \a os to the writeable
+    /// copy if one is made.
+    ///
+    /// \return false if the values differ but \a os is read-only.
+    bool copyInConcretes(const MemoryObject *mo, const ObjectState *&os,
+                         unsigned offset, unsigned size);
   };
 } // End klee namespace
 
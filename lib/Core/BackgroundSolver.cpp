@@ -0,0 +1,125 @@
+//===-- BackgroundSolver.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BackgroundSolver.h"
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+#include "klee/Statistics.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <cstring>
+
+using namespace klee;
+
+BackgroundSolver::BackgroundSolver(Solver *_solver, double timeout)
+  : solver(_solver), lastSubmitted(0), lastAnswered(0), stopping(false),
+    numResults(0) {
+  solver->setCoreSolverTimeout(timeout);
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&changed, 0);
+  if (int err = pthread_create(&thread, 0, threadMain, this))
+    klee_error("unable to start the background solver thread: %s",
+               strerror(err));
+}
+
+BackgroundSolver::~BackgroundSolver() {
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  // Nobody is interested in the answers any more.
+  for (std::deque<Job*>::iterator it = jobs.begin(), ie = jobs.end();
+       it != ie; ++it)
+    delete *it;
+  jobs.clear();
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(thread, 0);
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+  delete solver;
+}
+
+void *BackgroundSolver::threadMain(void *self) {
+  static_cast<BackgroundSolver *>(self)->loop();
+  return 0;
+}
+
+void BackgroundSolver::loop() {
+  StatisticManager::disableForThread();
+
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (jobs.empty() && !stopping)
+      pthread_cond_wait(&changed, &lock);
+    if (stopping)
+      break;
+
+    Job *job = jobs.front();
+    jobs.pop_front();
+    pthread_mutex_unlock(&lock);
+
+    Result result;
+    result.id = job->id;
+    result.success = solver->evaluate(Query(job->constraints, job->condition),
+                                      result.validity);
+    if (!result.success) {
+      result.constraints = job->constraints;
+      result.condition = job->condition;
+    }
+    delete job;
+
+    pthread_mutex_lock(&lock);
+    results.push_back(result);
+    numResults = results.size();
+    lastAnswered = result.id;
+    pthread_cond_broadcast(&changed);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+unsigned BackgroundSolver::submit(const ConstraintManager &constraints,
+                                  ref<Expr> condition) {
+  pthread_mutex_lock(&lock);
+  unsigned id = ++lastSubmitted;
+  jobs.push_back(new Job(id, constraints, condition));
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  return id;
+}
+
+unsigned BackgroundSolver::getNumPending() {
+  pthread_mutex_lock(&lock);
+  unsigned n = lastSubmitted - lastAnswered;
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+void BackgroundSolver::collect(std::vector<Result> &out) {
+  pthread_mutex_lock(&lock);
+  out.insert(out.end(), results.begin(), results.end());
+  results.clear();
+  numResults = 0;
+  pthread_mutex_unlock(&lock);
+}
+
+void BackgroundSolver::waitFor(unsigned id) {
+  assert(id <= lastSubmitted && "waiting for a query never submitted");
+  pthread_mutex_lock(&lock);
+  while (lastAnswered < id)
+    pthread_cond_wait(&changed, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+void BackgroundSolver::waitForAll() {
+  pthread_mutex_lock(&lock);
+  while (lastAnswered < lastSubmitted)
+    pthread_cond_wait(&changed, &lock);
+  pthread_mutex_unlock(&lock);
+}
+#endif
@@ -0,0 +1,99 @@
+//===-- BackgroundSolver.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BACKGROUNDSOLVER_H
+#define KLEE_BACKGROUNDSOLVER_H
+
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+namespace klee {
+  /// BackgroundSolver - Evaluates branch conditions on a helper thread, so
+  /// that the executor can continue while a query is being solved. It owns
+  /// its own solver chain, as solvers must not be shared between threads.
+  ///
+  /// Queries are answered in the order they were submitted. Statistics are
+  /// not updated for them.
+  class BackgroundSolver {
+  public:
+    struct Result {
+      unsigned id;
+      /// False if the solver failed or timed out.
+      bool success;
+      Solver::Validity validity;
+      /// The query, only kept when it failed so that it can be asked again.
+      ConstraintManager constraints;
+      ref<Expr> condition;
+    };
+
+  private:
+    struct Job {
+      unsigned id;
+      ConstraintManager constraints;
+      ref<Expr> condition;
+
+      Job(unsigned _id, const ConstraintManager &_constraints,
+          ref<Expr> _condition)
+        : id(_id), constraints(_constraints), condition(_condition) {}
+    };
+
+    Solver *solver;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    // Guarded by lock.
+    std::deque<Job*> jobs;
+    std::vector<Result> results;
+    unsigned lastSubmitted, lastAnswered;
+    bool stopping;
+
+    /// A copy of results.size() which may be read without the lock.
+    volatile unsigned numResults;
+
+    static void *threadMain(void *self);
+    void loop();
+
+  public:
+    /// Construct a background solver which takes ownership of \a _solver,
+    /// and uses \a timeout (in seconds, 0 for none) for every query.
+    BackgroundSolver(Solver *_solver, double timeout);
+    ~BackgroundSolver();
+
+    /// Queue the evaluation of \a condition under \a constraints and return
+    /// a ticket which identifies the result. Tickets start at 1.
+    unsigned submit(const ConstraintManager &constraints, ref<Expr> condition);
+
+    /// The number of queries submitted but not yet answered.
+    unsigned getNumPending();
+
+    /// Whether \ref collect would return anything. Does not lock.
+    bool hasResults() const { return numResults != 0; }
+
+    /// Move the answers which arrived since the last call into \a out.
+    void collect(std::vector<Result> &out);
+
+    /// Block until the query with ticket \a id, and so every query submitted
+    /// before it, has been answered.
+    void waitFor(unsigned id);
+
+    /// Block until every query submitted so far has been answered.
+    void waitForAll();
+  };
+}
+#endif
+
+#endif
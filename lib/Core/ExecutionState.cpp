@@ -126,7 +126,9 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     symbolics(state.symbolics),
     arrayNames(state.arrayNames),
     roundingMode(state.roundingMode),
-    openMergeStack(state.openMergeStack)
+    symbolicRoundingMode(state.symbolicRoundingMode),
+    openMergeStack(state.openMergeStack),
+    speculations(state.speculations)
 {
   for (unsigned int i=0; i<symbolics.size(); i++)
     symbolics[i].first->refCount++;
@@ -205,6 +207,12 @@ bool ExecutionState::merge(const ExecutionState &b) {
   if (symbolics!=b.symbolics)
     return false;
 
+  if (roundingMode != b.roundingMode ||
+      symbolicRoundingMode.isNull() != b.symbolicRoundingMode.isNull() ||
+      (!symbolicRoundingMode.isNull() &&
+       symbolicRoundingMode != b.symbolicRoundingMode))
+    return false;
+
   {
     std::vector<StackFrame>::const_iterator itA = stack.begin();
     std::vector<StackFrame>::const_iterator itB = b.stack.begin();
@@ -317,13 +325,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      ref<Expr> av = af.locals[i].getValue();
+      ref<Expr> bv = bf.locals[i].getValue();
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        af.locals[i].setValue(SelectExpr::create(inA, av, bv));
       }
     }
   }
@@ -376,7 +384,7 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].getValue();
       if (value.get() && isa<ConstantExpr>(value))
         out << "=" << value;
     }
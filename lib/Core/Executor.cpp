@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Executor.h"
+#include "BackgroundSolver.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExternalDispatcher.h"
@@ -36,8 +37,10 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Internal/Support/FloatEvaluation.h"
+#include "klee/Internal/Support/IntEvaluation.h"
 #include "klee/Internal/Support/ModuleUtil.h"
 #include "klee/Internal/Support/RoundingModeUtil.h"
+#include "klee/Internal/Support/WorkerPool.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/System/MemoryUsage.h"
 #include "klee/Internal/System/Time.h"
@@ -49,6 +52,7 @@
 #include "klee/util/ExprSMTLIBPrinter.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/GetElementPtrTypeIterator.h"
+#include "klee/klee.h" // For KLEE_FP_* constants
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
@@ -168,6 +172,39 @@ namespace {
   cl::opt<bool>
   DebugCheckForImpliedValues("debug-check-for-implied-values");
 
+  cl::opt<bool>
+  SpeculativeFork("speculative-fork",
+                  cl::init(false),
+                  cl::desc("At symbolic branches continue on both sides while "
+                           "a background thread checks their feasibility, and "
+                           "discard the infeasible side later. Requires a "
+                           "build with ENABLE_THREAD_SAFE_EXPR (default=off)"));
+
+  cl::opt<bool>
+  FPWordArrays("fp-word-arrays",
+               cl::init(false),
+               cl::desc("Make float and double objects symbolic as arrays of "
+                        "words rather than bytes, so that solvers with "
+                        "floating point support see each value as a single "
+                        "variable (default=off)"));
+
+  cl::opt<unsigned>
+  MaxSpeculativeQueries("max-speculative-queries",
+                        cl::init(16),
+                        cl::desc("With --speculative-fork, the number of "
+                                 "feasibility queries which may be pending "
+                                 "before branches are checked synchronously "
+                                 "again (default=16)"));
+
+  cl::opt<double>
+  MaxSpeculativeSolverTime("max-speculative-solver-time",
+                           cl::init(0),
+                           cl::desc("With --speculative-fork, the time "
+                                    "(in seconds) after which a feasibility "
+                                    "query in the background is given up "
+                                    "and asked again synchronously. 0 uses "
+                                    "--max-solver-time (default=0)"));
+
 
   cl::opt<bool>
   SimplifySymIndices("simplify-sym-indices",
@@ -350,7 +387,8 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
     : Interpreter(opts), kmodule(0), interpreterHandler(ih), searcher(0),
       externalDispatcher(new ExternalDispatcher(ctx)), statsTracker(0),
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0),
-      processTree(0), replayKTest(0), replayPath(0), usingSeeds(0),
+      processTree(0), replayKTest(0), replayPath(0), workerPool(0),
+      workPrefixPosition(0), backgroundSolver(0), usingSeeds(0),
       atMemoryLimit(false), inhibitForking(false), haltExecution(false),
       ivcEnabled(false),
       coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
@@ -374,6 +412,33 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
   this->solver = new TimingSolver(solver, this, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
 
+  if (SpeculativeFork) {
+#ifdef KLEE_THREAD_SAFE_EXPR
+    // Z3 keeps all of its state in a context per solver; STP and metaSMT
+    // are not safe to use from two threads.
+    if (CoreSolverToUse != Z3_SOLVER)
+      klee_error("--speculative-fork requires --solver-backend=z3");
+    Solver *backgroundCoreSolver = klee::createCoreSolver(CoreSolverToUse);
+    if (!backgroundCoreSolver)
+      klee_error("Failed to create core solver\n");
+    // Only the caches which keep to the solver instance; the query logs and
+    // the persistent cache belong to the main chain.
+    Solver *backgroundChain = backgroundCoreSolver;
+    if (UseCexCache)
+      backgroundChain = createCexCachingSolver(backgroundChain);
+    if (UseCache)
+      backgroundChain = createCachingSolver(backgroundChain);
+    if (UseIndependentSolver)
+      backgroundChain = createIndependentSolver(backgroundChain);
+    backgroundSolver = new BackgroundSolver(
+        backgroundChain, MaxSpeculativeSolverTime > 0 ? MaxSpeculativeSolverTime
+                                                      : coreSolverTimeout);
+#else
+    klee_error("--speculative-fork requires a build with "
+               "ENABLE_THREAD_SAFE_EXPR");
+#endif
+  }
+
   initializeSearchOptions();
 
   if (optionIsSet(DebugPrintInstructions, FILE_ALL) ||
@@ -447,6 +512,9 @@ Executor::~Executor() {
     delete specialFunctionHandler;
   if (statsTracker)
     delete statsTracker;
+#ifdef KLEE_THREAD_SAFE_EXPR
+  delete backgroundSolver;
+#endif
   delete solver;
   delete kmodule;
   while(!timers.empty()) {
@@ -704,7 +772,10 @@ void Executor::branch(ExecutionState &state,
   unsigned N = conditions.size();
   assert(N);
 
-  if (MaxForks!=~0u && stats::forks >= MaxForks) {
+  // The splits on a work prefix were made by the worker that gave the path
+  // away, so they are followed even when this worker could not fork.
+  if (MaxForks!=~0u && stats::forks >= MaxForks &&
+      workPrefixPosition >= workPrefix.size()) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
       if (i == next) {
@@ -714,12 +785,31 @@ void Executor::branch(ExecutionState &state,
       }
     }
   } else {
-    stats::forks += N-1;
-
     // XXX do proper balance or keep random?
     result.push_back(&state);
     for (unsigned i=1; i<N; ++i) {
-      ExecutionState *es = result[theRNG.getInt32() % i];
+      // Workers must split the same way so that a stolen path can be
+      // replayed, so they use a balanced tree instead of a random one.
+      unsigned parent = workerPool ? (i - 1) / 2 : theRNG.getInt32() % i;
+      ExecutionState *es = result[parent];
+      if (!es) {
+        result.push_back(NULL);
+        continue;
+      }
+      if (workPrefixPosition < workPrefix.size()) {
+        // This split was made by the worker that gave the path away; keep
+        // only the side it recorded.
+        ++es->depth;
+        if (workPrefix[workPrefixPosition++]) {
+          result.push_back(NULL);
+        } else {
+          result[parent] = NULL;
+          result.push_back(es);
+        }
+        continue;
+      }
+
+      ++stats::forks;
       ExecutionState *ns = es->branch();
       addedStates.push_back(ns);
       result.push_back(ns);
@@ -790,7 +880,10 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     seedMap.find(&current);
   bool isSeeding = it != seedMap.end();
 
-  if (!isSeeding && !isa<ConstantExpr>(condition) && 
+  // Concretizing the condition would lose a split recorded in the work
+  // prefix, so the static fork limits only apply once it is followed.
+  if (!isSeeding && !isa<ConstantExpr>(condition) &&
+      workPrefixPosition >= workPrefix.size() &&
       (MaxStaticForkPct!=1. || MaxStaticSolvePct != 1. ||
        MaxStaticCPForkPct!=1. || MaxStaticCPSolvePct != 1.) &&
       statsTracker->elapsed() > 60.) {
@@ -817,16 +910,22 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
   }
 
-  double timeout = coreSolverTimeout;
-  if (isSeeding)
-    timeout *= it->second.size();
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current, condition, res);
-  solver->setTimeout(0);
-  if (!success) {
-    current.pc = current.prevPC;
-    terminateStateEarly(current, "Query timed out (fork).");
-    return StatePair(0, 0);
+  bool speculative = false;
+  if (!isSeeding && !isInternal &&
+      evaluateSpeculatively(current, condition, res)) {
+    speculative = res == Solver::Unknown;
+  } else {
+    double timeout = coreSolverTimeout;
+    if (isSeeding)
+      timeout *= it->second.size();
+    solver->setTimeout(timeout);
+    bool success = solver->evaluate(current, condition, res);
+    solver->setTimeout(0);
+    if (!success) {
+      current.pc = current.prevPC;
+      terminateStateEarly(current, "Query timed out (fork).");
+      return StatePair(0, 0);
+    }
   }
 
   if (!isSeeding) {
@@ -851,8 +950,18 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
     } else if (res==Solver::Unknown) {
       assert(!replayKTest && "in replay mode, only one branch can be true.");
-      
-      if ((MaxMemoryInhibit && atMemoryLimit) || 
+
+      if (workPrefixPosition < workPrefix.size()) {
+        // Follow the path given away by another worker instead of splitting.
+        ++current.depth;
+        if (workPrefix[workPrefixPosition++]) {
+          addConstraint(current, condition);
+          res = Solver::True;
+        } else {
+          addConstraint(current, Expr::createIsZero(condition));
+          res = Solver::False;
+        }
+      } else if ((MaxMemoryInhibit && atMemoryLimit) || 
           current.forkDisabled ||
           inhibitForking || 
           (MaxForks!=~0u && stats::forks >= MaxForks)) {
@@ -998,6 +1107,16 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
     }
 
+#ifdef KLEE_THREAD_SAFE_EXPR
+    if (speculative) {
+      unsigned id = backgroundSolver->submit(current.constraints, condition);
+      trueState->speculations.push_back(std::make_pair(id, true));
+      falseState->speculations.push_back(std::make_pair(id, false));
+    }
+#else
+    assert(!speculative && "speculation requires thread-safe expressions");
+#endif
+
     addConstraint(*trueState, condition);
     addConstraint(*falseState, Expr::createIsZero(condition));
 
@@ -1013,6 +1132,12 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
 }
 
 void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
+  // The solver does not look at the constraints of a state which took an
+  // unconfirmed speculative branch (see waitForSpeculations), so they need
+  // not stay satisfiable. The state is terminated after the instruction.
+  if (isSpeculationInfeasible(state) || isSpeculationFailed(state))
+    return;
+
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
     if (!CE->isTrue())
       llvm::report_fatal_error("attempt to add invalid constraint");
@@ -1046,6 +1171,182 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
                                  ConstantExpr::alloc(1, Expr::Bool));
 }
 
+bool Executor::evaluateSpeculatively(ExecutionState &current,
+                                     ref<Expr> condition,
+                                     Solver::Validity &res) {
+  // Only plain two-way splits are speculated on; replaying, following a
+  // work prefix and the fork limits all need to know the answer.
+  if (!backgroundSolver || isa<ConstantExpr>(condition) || replayPath ||
+      replayKTest || workPrefixPosition < workPrefix.size() ||
+      (MaxMemoryInhibit && atMemoryLimit) || current.forkDisabled ||
+      inhibitForking || (MaxForks!=~0u && stats::forks >= MaxForks))
+    return false;
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+  if (backgroundSolver->getNumPending() >= MaxSpeculativeQueries)
+    return false;
+#endif
+
+  // A side which reduces the constraints to false is infeasible; the
+  // constraint manager would refuse to add it to the speculative state.
+  ConstraintManager trueConstraints(current.constraints);
+  if (!trueConstraints.tryAddConstraint(condition)) {
+    res = Solver::False;
+    return true;
+  }
+  ConstraintManager falseConstraints(current.constraints);
+  if (!falseConstraints.tryAddConstraint(Expr::createIsZero(condition))) {
+    res = Solver::True;
+    return true;
+  }
+
+  res = Solver::Unknown;
+  return true;
+}
+
+bool Executor::isSpeculationInfeasible(const ExecutionState &state) const {
+  for (std::vector<std::pair<unsigned, bool> >::const_iterator
+         it = state.speculations.begin(), ie = state.speculations.end();
+       it != ie; ++it) {
+    std::map<unsigned, Solver::Validity>::const_iterator ait =
+        speculationAnswers.find(it->first);
+    if (ait != speculationAnswers.end() &&
+        ait->second == (it->second ? Solver::False : Solver::True))
+      return true;
+  }
+  return false;
+}
+
+bool Executor::isSpeculationFailed(const ExecutionState &state) const {
+  for (std::vector<std::pair<unsigned, bool> >::const_iterator
+         it = state.speculations.begin(), ie = state.speculations.end();
+       it != ie; ++it)
+    if (failedSpeculations.count(it->first))
+      return true;
+  return false;
+}
+
+void Executor::collectSpeculationAnswers() {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  std::vector<BackgroundSolver::Result> results;
+  backgroundSolver->collect(results);
+  for (std::vector<BackgroundSolver::Result>::iterator it = results.begin(),
+         ie = results.end(); it != ie; ++it) {
+    Solver::Validity validity = it->validity;
+    if (!it->success) {
+      // The background solver may give up sooner than this one, see
+      // --max-speculative-solver-time.
+      klee_warning_once(0, "speculative query failed, asking it again");
+      TimerStatIncrementer timer(stats::solverTime);
+      solver->setTimeout(coreSolverTimeout);
+      bool success = solver->solver->evaluate(
+          Query(it->constraints, it->condition), validity);
+      solver->setTimeout(0);
+      if (!success) {
+        failedSpeculations.insert(it->id);
+        continue;
+      }
+    }
+    speculationAnswers[it->id] = validity;
+  }
+#endif
+}
+
+void Executor::processSpeculations() {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  if (backgroundSolver->hasResults())
+    collectSpeculationAnswers();
+#endif
+  if (speculationAnswers.empty() && failedSpeculations.empty())
+    return;
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+  // A state on an undecided side is only terminated if its other
+  // speculations do not make it infeasible, so settle them all.
+  if (!failedSpeculations.empty()) {
+    backgroundSolver->waitForAll();
+    collectSpeculationAnswers();
+  }
+#endif
+
+  std::vector<ExecutionState *> candidates(states.begin(), states.end());
+  candidates.insert(candidates.end(), addedStates.begin(), addedStates.end());
+  for (std::vector<ExecutionState *>::iterator it = candidates.begin(),
+         ie = candidates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es->speculations.empty() ||
+        std::find(removedStates.begin(), removedStates.end(), es) !=
+            removedStates.end())
+      continue;
+
+    if (isSpeculationInfeasible(*es)) {
+      // The subtree below the branch inherited the same speculation, so it
+      // goes away as well.
+      discardState(*es);
+      continue;
+    }
+    if (isSpeculationFailed(*es)) {
+      confirmState(*es);
+      continue;
+    }
+
+    std::vector<std::pair<unsigned, bool> > pending;
+    for (std::vector<std::pair<unsigned, bool> >::iterator
+           sit = es->speculations.begin(), sie = es->speculations.end();
+         sit != sie; ++sit)
+      if (!speculationAnswers.count(sit->first))
+        pending.push_back(*sit);
+    if (pending.size() == es->speculations.size())
+      continue;
+    es->speculations.swap(pending);
+
+    // States not yet seen by the searcher are routed when they are added.
+    if (es->speculations.empty() &&
+        std::find(addedStates.begin(), addedStates.end(), es) ==
+            addedStates.end())
+      continueState(*es);
+  }
+  speculationAnswers.clear();
+  failedSpeculations.clear();
+}
+
+bool Executor::waitForSpeculations(const ExecutionState &state) {
+  if (state.speculations.empty())
+    return true;
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+  // Queries are answered in order, so waiting for the latest is enough.
+  unsigned latest = 0;
+  for (std::vector<std::pair<unsigned, bool> >::const_iterator
+         it = state.speculations.begin(), ie = state.speculations.end();
+       it != ie; ++it)
+    latest = std::max(latest, it->first);
+  backgroundSolver->waitFor(latest);
+  collectSpeculationAnswers();
+#endif
+
+  return !isSpeculationInfeasible(state) && !isSpeculationFailed(state);
+}
+
+bool Executor::confirmState(ExecutionState &state) {
+  if (waitForSpeculations(state))
+    return true;
+
+  // Other states are left to processSpeculations, as the caller may still
+  // refer to them.
+  if (isSpeculationInfeasible(state)) {
+    discardState(state);
+    return false;
+  }
+
+  // Neither side of a branch which could not be decided is known to be
+  // feasible, so both are terminated as fork() does with the parent. All
+  // speculations of the state have been answered by now.
+  state.speculations.clear();
+  terminateStateEarly(state, "Query timed out (fork).");
+  return false;
+}
+
 ref<klee::ConstantExpr> Executor::evalConstant(const Constant *c,
                                                llvm::APFloat::roundingMode rm) {
   if (const llvm::ConstantExpr *ce = dyn_cast<llvm::ConstantExpr>(c)) {
@@ -1137,12 +1438,105 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
 
 void Executor::bindLocal(KInstruction *target, ExecutionState &state, 
                          ref<Expr> value) {
-  getDestCell(state, target).value = value;
+  getDestCell(state, target).setValue(value);
 }
 
 void Executor::bindArgument(KFunction *kf, unsigned index, 
                             ExecutionState &state, ref<Expr> value) {
-  getArgumentCell(state, kf, index).value = value;
+  getArgumentCell(state, kf, index).setValue(value);
+}
+
+bool Executor::evalUnboxedBinary(KInstruction *ki, ExecutionState &state,
+                                 Expr::Kind kind) {
+  const Cell &left = eval(ki, 0, state);
+  const Cell &right = eval(ki, 1, state);
+  if (!left.isUnboxedConstant() || !right.isUnboxedConstant())
+    return false;
+
+  uint64_t l = left.getConstantBits();
+  uint64_t r = right.getConstantBits();
+  Expr::Width width = left.getConstantWidth();
+  assert(width == right.getConstantWidth() && "operand widths differ");
+  uint64_t result = 0;
+  Expr::Width resultWidth = width;
+  switch (kind) {
+  case Expr::Add: result = ints::add(l, r, width); break;
+  case Expr::Sub: result = ints::sub(l, r, width); break;
+  case Expr::Mul: result = ints::mul(l, r, width); break;
+  case Expr::UDiv:
+  case Expr::URem:
+  case Expr::SDiv:
+  case Expr::SRem:
+    // Leave division by zero and the overflowing INT_MIN / -1 (which traps
+    // on the host) to the Expr library.
+    if (r == 0 || ((kind == Expr::SDiv || kind == Expr::SRem) &&
+                   r == bits64::maxValueOfNBits(width)))
+      return false;
+    if (kind == Expr::UDiv)
+      result = ints::udiv(l, r, width);
+    else if (kind == Expr::URem)
+      result = ints::urem(l, r, width);
+    else if (kind == Expr::SDiv)
+      result = ints::sdiv(l, r, width);
+    else
+      result = ints::srem(l, r, width);
+    break;
+  case Expr::And: result = ints::land(l, r, width); break;
+  case Expr::Or: result = ints::lor(l, r, width); break;
+  case Expr::Xor: result = ints::lxor(l, r, width); break;
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+    if (r >= width)
+      return false;
+    if (kind == Expr::Shl)
+      result = ints::shl(l, r, width);
+    else if (kind == Expr::LShr)
+      result = ints::lshr(l, r, width);
+    else
+      result = ints::ashr(l, r, width);
+    break;
+  default:
+    resultWidth = Expr::Bool;
+    switch (kind) {
+    case Expr::Eq: result = ints::eq(l, r, width); break;
+    case Expr::Ne: result = ints::ne(l, r, width); break;
+    case Expr::Ult: result = ints::ult(l, r, width); break;
+    case Expr::Ule: result = ints::ule(l, r, width); break;
+    case Expr::Ugt: result = ints::ugt(l, r, width); break;
+    case Expr::Uge: result = ints::uge(l, r, width); break;
+    case Expr::Slt: result = ints::slt(l, r, width); break;
+    case Expr::Sle: result = ints::sle(l, r, width); break;
+    case Expr::Sgt: result = ints::sgt(l, r, width); break;
+    case Expr::Sge: result = ints::sge(l, r, width); break;
+    default:
+      return false;
+    }
+  }
+
+  getDestCell(state, ki).setConstant(result, resultWidth);
+  return true;
+}
+
+bool Executor::evalUnboxedCast(KInstruction *ki, ExecutionState &state,
+                               Expr::Kind kind, Expr::Width width) {
+  const Cell &arg = eval(ki, 0, state);
+  if (!arg.isUnboxedConstant() || width > 64)
+    return false;
+
+  uint64_t v = arg.getConstantBits();
+  Expr::Width inWidth = arg.getConstantWidth();
+  uint64_t result = 0;
+  switch (kind) {
+  case Expr::Extract: result = ints::trunc(v, width, inWidth); break;
+  case Expr::ZExt: result = ints::zext(v, width, inWidth); break;
+  case Expr::SExt: result = ints::sext(v, width, inWidth); break;
+  default:
+    return false;
+  }
+
+  getDestCell(state, ki).setConstant(result, width);
+  return true;
 }
 
 ref<Expr> Executor::toUnique(const ExecutionState &state, 
@@ -1165,6 +1559,59 @@ ref<Expr> Executor::toUnique(const ExecutionState &state,
 }
 
 
+static ref<Expr> buildRoundedExpr(Expr::Kind kind, const ref<Expr> &left,
+                                  const ref<Expr> &right, Expr::Width width,
+                                  llvm::APFloat::roundingMode rm) {
+  switch (kind) {
+  case Expr::FAdd:
+    return FAddExpr::create(left, right, rm);
+  case Expr::FSub:
+    return FSubExpr::create(left, right, rm);
+  case Expr::FMul:
+    return FMulExpr::create(left, right, rm);
+  case Expr::FDiv:
+    return FDivExpr::create(left, right, rm);
+  case Expr::FSqrt:
+    return FSqrtExpr::create(left, rm);
+  case Expr::FPTrunc:
+    return FPTruncExpr::create(left, width, rm);
+  case Expr::UIToFP:
+    return UIToFPExpr::create(left, width, rm);
+  case Expr::SIToFP:
+    return SIToFPExpr::create(left, width, rm);
+  default:
+    llvm_unreachable("not a rounded floating point operation");
+  }
+}
+
+ref<Expr> Executor::createRoundedExpr(const ExecutionState &state,
+                                      Expr::Kind kind, ref<Expr> left,
+                                      ref<Expr> right, Expr::Width width) {
+  if (state.symbolicRoundingMode.isNull())
+    return buildRoundedExpr(kind, left, right, width, state.roundingMode);
+
+  // Select between the results under every rounding mode. The symbolic
+  // rounding mode is known to be one of KLEE_FP_RNE to KLEE_FP_RZ (see
+  // SpecialFunctionHandler::handleSetSymbolicRoundingMode()) so the result
+  // for the last one needs no condition. The Z3 backend turns these selects
+  // back into a single operation with a symbolic rounding mode term.
+  ref<Expr> rmExpr = state.symbolicRoundingMode;
+  llvm::APFloat::roundingMode rm;
+  bool valid = KleeRoundingModeToLLVMRoundingMode(KLEE_FP_RZ, rm);
+  assert(valid && "invalid rounding mode");
+  ref<Expr> result = buildRoundedExpr(kind, left, right, width, rm);
+  for (int kleeRM = KLEE_FP_RZ - 1; kleeRM >= KLEE_FP_RNE; --kleeRM) {
+    valid = KleeRoundingModeToLLVMRoundingMode(kleeRM, rm);
+    assert(valid && "invalid rounding mode");
+    result = SelectExpr::create(
+        EqExpr::create(ConstantExpr::create(kleeRM, rmExpr->getWidth()),
+                       rmExpr),
+        buildRoundedExpr(kind, left, right, width, rm), result);
+  }
+  (void) valid;
+  return result;
+}
+
 /* Concretize the given expression, and return a possible constant value. 
    'reason' is just a documentation string stating the reason for concretization. */
 ref<klee::ConstantExpr> 
@@ -1553,7 +2000,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     ref<Expr> result = ConstantExpr::alloc(0, Expr::Bool);
     
     if (!isVoidReturn) {
-      result = eval(ki, 0, state).value;
+      result = eval(ki, 0, state).getValue();
     }
     
     if (state.stack.size() <= 1) {
@@ -1642,7 +2089,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) &&
              "Wrong operand index!");
-      ref<Expr> cond = eval(ki, 0, state).value;
+      ref<Expr> cond = eval(ki, 0, state).getValue();
       Executor::StatePair branches = fork(state, cond, false);
 
       // NOTE: There is a hidden dependency here, markBranchVisited
@@ -1661,7 +2108,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::Switch: {
     SwitchInst *si = cast<SwitchInst>(i);
-    ref<Expr> cond = eval(ki, 0, state).value;
+    ref<Expr> cond = eval(ki, 0, state).getValue();
     BasicBlock *bb = si->getParent();
 
     cond = toUnique(state, cond);
@@ -1814,7 +2261,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     arguments.reserve(numArgs);
 
     for (unsigned j=0; j<numArgs; ++j)
-      arguments.push_back(eval(ki, j+1, state).value);
+      arguments.push_back(eval(ki, j+1, state).getValue());
 
     if (f) {
       const FunctionType *fType = 
@@ -1861,7 +2308,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
       executeCall(state, ki, f, arguments);
     } else {
-      ref<Expr> v = eval(ki, 0, state).value;
+      ref<Expr> v = eval(ki, 0, state).getValue();
 
       ExecutionState *free = &state;
       bool hasInvalid = false, first = true;
@@ -1902,20 +2349,26 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     break;
   }
   case Instruction::PHI: {
+    // Copy the cell so unboxed constants stay unboxed.
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
-    ref<Expr> result = eval(ki, state.incomingBBIndex, state).value;
+    getDestCell(state, ki) = eval(ki, state.incomingBBIndex, state);
 #else
-    ref<Expr> result = eval(ki, state.incomingBBIndex * 2, state).value;
+    getDestCell(state, ki) = eval(ki, state.incomingBBIndex * 2, state);
 #endif
-    bindLocal(ki, state, result);
     break;
   }
 
     // Special instructions
   case Instruction::Select: {
-    ref<Expr> cond = eval(ki, 0, state).value;
-    ref<Expr> tExpr = eval(ki, 1, state).value;
-    ref<Expr> fExpr = eval(ki, 2, state).value;
+    const Cell &condCell = eval(ki, 0, state);
+    if (condCell.isUnboxedConstant()) {
+      getDestCell(state, ki) =
+          eval(ki, condCell.getConstantBits() ? 1 : 2, state);
+      break;
+    }
+    ref<Expr> cond = condCell.getValue();
+    ref<Expr> tExpr = eval(ki, 1, state).getValue();
+    ref<Expr> fExpr = eval(ki, 2, state).getValue();
     ref<Expr> result = SelectExpr::create(cond, tExpr, fExpr);
     bindLocal(ki, state, result);
     break;
@@ -1928,101 +2381,127 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Arithmetic / logical
 
   case Instruction::Add: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Add))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, AddExpr::create(left, right));
     break;
   }
 
   case Instruction::Sub: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Sub))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, SubExpr::create(left, right));
     break;
   }
  
   case Instruction::Mul: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Mul))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, MulExpr::create(left, right));
     break;
   }
 
   case Instruction::UDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::UDiv))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = UDivExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::SDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::SDiv))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = SDivExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::URem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::URem))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = URemExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
  
   case Instruction::SRem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::SRem))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = SRemExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::And: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::And))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = AndExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Or: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Or))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = OrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Xor: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Xor))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = XorExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Shl: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::Shl))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ShlExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::LShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::LShr))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = LShrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::AShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (evalUnboxedBinary(ki, state, Expr::AShr))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = AShrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
@@ -2036,80 +2515,100 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
  
     switch(ii->getPredicate()) {
     case ICmpInst::ICMP_EQ: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Eq))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = EqExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_NE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Ne))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = NeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_UGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Ugt))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UgtExpr::create(left, right);
       bindLocal(ki, state,result);
       break;
     }
 
     case ICmpInst::ICMP_UGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Uge))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Ult))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Ule))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Sgt))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SgtExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Sge))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Slt))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      if (evalUnboxedBinary(ki, state, Expr::Sle))
+        break;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
@@ -2137,7 +2636,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         kmodule->targetData->getTypeAllocSize(ai->getAllocatedType());
     ref<Expr> size = Expr::createPointer(elementSize);
     if (ai->isArrayAllocation()) {
-      ref<Expr> count = eval(ki, 0, state).value;
+      ref<Expr> count = eval(ki, 0, state).getValue();
       count = Expr::createZExtToPointerWidth(count);
       size = MulExpr::create(size, count);
     }
@@ -2146,26 +2645,26 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Load: {
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
     executeMemoryOperation(state, false, base, 0, ki);
     break;
   }
   case Instruction::Store: {
-    ref<Expr> base = eval(ki, 1, state).value;
-    ref<Expr> value = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 1, state).getValue();
+    ref<Expr> value = eval(ki, 0, state).getValue();
     executeMemoryOperation(state, true, base, value, 0);
     break;
   }
 
   case Instruction::GetElementPtr: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
 
     for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
            it = kgepi->indices.begin(), ie = kgepi->indices.end(); 
          it != ie; ++it) {
       uint64_t elementSize = it->second;
-      ref<Expr> index = eval(ki, it->first, state).value;
+      ref<Expr> index = eval(ki, it->first, state).getValue();
       base = AddExpr::create(base,
                              MulExpr::create(Expr::createSExtToPointerWidth(index),
                                              Expr::createPointer(elementSize)));
@@ -2180,7 +2679,10 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Conversion
   case Instruction::Trunc: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value,
+    if (evalUnboxedCast(ki, state, Expr::Extract,
+                        getWidthForLLVMType(ci->getType())))
+      break;
+    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).getValue(),
                                            0,
                                            getWidthForLLVMType(ci->getType()));
     bindLocal(ki, state, result);
@@ -2188,14 +2690,20 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::ZExt: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value,
+    if (evalUnboxedCast(ki, state, Expr::ZExt,
+                        getWidthForLLVMType(ci->getType())))
+      break;
+    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).getValue(),
                                         getWidthForLLVMType(ci->getType()));
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::SExt: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value,
+    if (evalUnboxedCast(ki, state, Expr::SExt,
+                        getWidthForLLVMType(ci->getType())))
+      break;
+    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).getValue(),
                                         getWidthForLLVMType(ci->getType()));
     bindLocal(ki, state, result);
     break;
@@ -2204,73 +2712,72 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::IntToPtr: {
     CastInst *ci = cast<CastInst>(i);
     Expr::Width pType = getWidthForLLVMType(ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, pType));
     break;
   } 
   case Instruction::PtrToInt: {
     CastInst *ci = cast<CastInst>(i);
     Expr::Width iType = getWidthForLLVMType(ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, iType));
     break;
   }
 
   case Instruction::BitCast: {
-    ref<Expr> result = eval(ki, 0, state).value;
-    bindLocal(ki, state, result);
+    getDestCell(state, ki) = eval(ki, 0, state);
     break;
   }
 
     // Floating point instructions
 
   case Instruction::FAdd: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FAdd operation");
-    ref<Expr> result = FAddExpr::create(left, right, state.roundingMode);
+    ref<Expr> result = createRoundedExpr(state, Expr::FAdd, left, right, 0);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::FSub: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FSub operation");
-    ref<Expr> result = FSubExpr::create(left, right, state.roundingMode);
+    ref<Expr> result = createRoundedExpr(state, Expr::FSub, left, right, 0);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::FMul: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FMul operation");
-    ref<Expr> result = FMulExpr::create(left, right, state.roundingMode);
+    ref<Expr> result = createRoundedExpr(state, Expr::FMul, left, right, 0);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::FDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FDiv operation");
-    ref<Expr> result = FDivExpr::create(left, right, state.roundingMode);
+    ref<Expr> result = createRoundedExpr(state, Expr::FDiv, left, right, 0);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::FRem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FRem operation");
@@ -2332,12 +2839,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::FPTrunc: {
     FPTruncInst *fi = cast<FPTruncInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     if (!fpWidthToSemantics(arg->getWidth()) || !fpWidthToSemantics(resultType))
       return terminateStateOnExecError(state, "Unsupported FPTrunc operation");
     if (arg->getWidth() <= resultType)
       return terminateStateOnExecError(state, "Invalid FPTrunc");
-    ref<Expr> result = FPTruncExpr::create(arg, resultType, state.roundingMode);
+    ref<Expr> result =
+        createRoundedExpr(state, Expr::FPTrunc, arg, 0, resultType);
     bindLocal(ki, state, result);
     break;
   }
@@ -2345,7 +2853,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::FPExt: {
     FPExtInst *fi = cast<FPExtInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     if (!fpWidthToSemantics(arg->getWidth()) || !fpWidthToSemantics(resultType))
       return terminateStateOnExecError(state, "Unsupported FPExt operation");
     if (arg->getWidth() >= resultType)
@@ -2358,7 +2866,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::FPToUI: {
     FPToUIInst *fi = cast<FPToUIInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     if (!fpWidthToSemantics(arg->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FPToUI operation");
     // LLVM IR Ref manual says that it rounds toward zero
@@ -2371,7 +2879,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::FPToSI: {
     FPToSIInst *fi = cast<FPToSIInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     if (!fpWidthToSemantics(arg->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FPToSI operation");
     // LLVM IR Ref manual says that it rounds toward zero
@@ -2384,11 +2892,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::UIToFP: {
     UIToFPInst *fi = cast<UIToFPInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
     if (!semantics)
       return terminateStateOnExecError(state, "Unsupported UIToFP operation");
-    ref<Expr> result = UIToFPExpr::create(arg, resultType, state.roundingMode);
+    ref<Expr> result =
+        createRoundedExpr(state, Expr::UIToFP, arg, 0, resultType);
     bindLocal(ki, state, result);
     break;
   }
@@ -2396,19 +2905,20 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::SIToFP: {
     SIToFPInst *fi = cast<SIToFPInst>(i);
     Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
     if (!semantics)
       return terminateStateOnExecError(state, "Unsupported SIToFP operation");
-    ref<Expr> result = SIToFPExpr::create(arg, resultType, state.roundingMode);
+    ref<Expr> result =
+        createRoundedExpr(state, Expr::SIToFP, arg, 0, resultType);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::FCmp: {
     FCmpInst *fi = cast<FCmpInst>(i);
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FCmp operation");
@@ -2420,8 +2930,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::InsertValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
-    ref<Expr> val = eval(ki, 1, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
+    ref<Expr> val = eval(ki, 1, state).getValue();
 
     ref<Expr> l = NULL, r = NULL;
     unsigned lOffset = kgepi->offset*8, rOffset = kgepi->offset*8 + val->getWidth();
@@ -2447,7 +2957,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::ExtractValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
 
     ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, getWidthForLLVMType(i->getType()));
 
@@ -2462,9 +2972,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 #endif
   case Instruction::InsertElement: {
     InsertElementInst *iei = cast<InsertElementInst>(i);
-    ref<Expr> vec = eval(ki, 0, state).value;
-    ref<Expr> newElt = eval(ki, 1, state).value;
-    ref<Expr> idx = eval(ki, 2, state).value;
+    ref<Expr> vec = eval(ki, 0, state).getValue();
+    ref<Expr> newElt = eval(ki, 1, state).getValue();
+    ref<Expr> idx = eval(ki, 2, state).getValue();
 
     if (!isa<ConstantExpr>(idx)) {
       terminateStateOnError(state, "InsertElement, support for symbolic index not implemented", Unhandled);
@@ -2505,8 +3015,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::ExtractElement: {
     ExtractElementInst *eei = cast<ExtractElementInst>(i);
-    ref<Expr> vec = eval(ki, 0, state).value;
-    ref<Expr> idx = eval(ki, 1, state).value;
+    ref<Expr> vec = eval(ki, 0, state).getValue();
+    ref<Expr> idx = eval(ki, 1, state).getValue();
 
     if (!isa<ConstantExpr>(idx)) {
       terminateStateOnError(state, "ExtractElement, support for symbolic index not implemented", Unhandled);
@@ -2639,7 +3149,7 @@ void Executor::bindModuleConstants() {
   for (unsigned i=0; i<kmodule->constants.size(); ++i) {
     Cell &c = kmodule->constantTable[i];
     // Correct rounding mode?
-    c.value = evalConstant(kmodule->constants[i], llvm::APFloat::rmNearestTiesToEven);
+    c.setValue(evalConstant(kmodule->constants[i], llvm::APFloat::rmNearestTiesToEven));
   }
 }
 
@@ -2778,6 +3288,7 @@ void Executor::run(ExecutionState &initialState) {
   while (!states.empty() && !haltExecution) {
     ExecutionState &state = searcher->selectState();
     KInstruction *ki = state.pc;
+
     stepInstruction(state);
 
     executeInstruction(state, ki);
@@ -2785,6 +3296,9 @@ void Executor::run(ExecutionState &initialState) {
 
     checkMemoryUsage();
 
+    if (backgroundSolver)
+      processSpeculations();
+
     updateStates(&state);
   }
 
@@ -2875,7 +3389,10 @@ void Executor::terminateState(ExecutionState &state) {
   }
 
   interpreterHandler->incPathsExplored();
+  discardState(state);
+}
 
+void Executor::discardState(ExecutionState &state) {
   std::vector<ExecutionState *>::iterator it =
       std::find(addedStates.begin(), addedStates.end(), &state);
   if (it==addedStates.end()) {
@@ -2894,8 +3411,55 @@ void Executor::terminateState(ExecutionState &state) {
   }
 }
 
+void Executor::getWorkPath(const ExecutionState &state,
+                           std::vector<bool> &path) {
+  assert(workPrefixPosition == workPrefix.size() &&
+         "process tree splits before the work prefix was followed");
+  path = workPrefix;
+  unsigned prefixSize = path.size();
+  for (PTree::Node *n = state.ptreeNode; n->parent; n = n->parent)
+    path.push_back(n == n->parent->right);
+  std::reverse(path.begin() + prefixSize, path.end());
+}
+
+void Executor::donateState() {
+  ExecutionState *donated = 0;
+  unsigned candidates = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    // A speculative path may be infeasible, which the receiving worker could
+    // not replay.
+    if (!es->speculations.empty() ||
+        std::find(removedStates.begin(), removedStates.end(), es) !=
+        removedStates.end())
+      continue;
+    ++candidates;
+    // The state closest to the root is likely to have the largest subtree.
+    if (!donated || es->depth < donated->depth)
+      donated = es;
+  }
+
+  // Keep at least one state to work on.
+  if (candidates < 2) {
+    workerPool->decline();
+    return;
+  }
+
+  std::vector<bool> path;
+  getWorkPath(*donated, path);
+  workerPool->donate(path);
+
+  // The path is explored by another worker now, so neither count it nor
+  // generate a test case for it.
+  donated->pc = donated->prevPC;
+  removedStates.push_back(donated);
+}
+
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  if (!confirmState(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -2904,6 +3468,8 @@ void Executor::terminateStateEarly(ExecutionState &state,
 }
 
 void Executor::terminateStateOnExit(ExecutionState &state) {
+  if (!confirmState(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew || 
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, 0, 0);
@@ -2969,6 +3535,10 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      enum TerminateReason termReason,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  // Errors on infeasible paths are not reported.
+  if (!confirmState(state))
+    return;
+
   std::string message = messaget.str();
   static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
@@ -3031,6 +3601,10 @@ void Executor::callExternalFunction(ExecutionState &state,
   // check if specialFunctionHandler wants it
   if (specialFunctionHandler->handle(state, function, target, arguments))
     return;
+
+  // Do not let an infeasible path have effects outside KLEE.
+  if (!confirmState(state))
+    return;
   
   if (NoExternals && !okExternals.count(function->getName())) {
     klee_warning("Calling not-OK external function : %s\n",
@@ -3090,6 +3664,17 @@ void Executor::callExternalFunction(ExecutionState &state,
       klee_warning_once(function, "%s", os.str().c_str());
   }
 
+  if (!state.symbolicRoundingMode.isNull()) {
+    // The host FPU needs a concrete rounding mode.
+    ref<ConstantExpr> value = toConstant(state, state.symbolicRoundingMode,
+                                         "rounding mode for external call");
+    bool valid = KleeRoundingModeToLLVMRoundingMode(value->getZExtValue(),
+                                                    state.roundingMode);
+    assert(valid && "invalid symbolic rounding mode");
+    (void) valid;
+    state.symbolicRoundingMode = 0;
+  }
+
   int roundingMode = LLVMRoundingModeToCRoundingMode(state.roundingMode);
   if (roundingMode == -1) {
     std::string msg("Cannot set rounding mode for external call to ");
@@ -3101,6 +3686,7 @@ void Executor::callExternalFunction(ExecutionState &state,
   bool success = externalDispatcher->executeCall(function, target->inst, args,
                                                  roundingMode);
   if (!success) {
+    state.addressSpace.discardCopiedOutConcretes();
     terminateStateOnError(state, "failed external call: " + function->getName(),
                           External);
     return;
@@ -3470,7 +4056,9 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
     while (!state.arrayNames.insert(uniqueName).second) {
       uniqueName = name + "_" + llvm::utostr(++id);
     }
-    const Array *array = arrayCache.CreateArray(uniqueName, mo->size);
+    Expr::Width range = getSymbolicElementWidth(mo);
+    const Array *array = arrayCache.CreateArray(
+        uniqueName, mo->size / (range / 8), 0, 0, Expr::Int32, range);
     bindObjectInState(state, mo, false, array);
     state.addSymbolic(mo, array);
     
@@ -3632,6 +4220,11 @@ void Executor::runFunctionAsMain(Function *f,
   delete processTree;
   processTree = 0;
 
+  // A worker halting on its own (e.g. --max-time or --stop-after-n-tests)
+  // stops the whole pool.
+  if (workerPool && haltExecution)
+    workerPool->halt();
+
   // hack to clear memory objects
   delete memory;
   memory = new MemoryManager(NULL);
@@ -3787,6 +4380,32 @@ Expr::Width Executor::getWidthForLLVMType(LLVM_TYPE_Q llvm::Type *type) const {
   return kmodule->targetData->getTypeSizeInBits(type);
 }
 
+Expr::Width Executor::getSymbolicElementWidth(const MemoryObject *mo) const {
+  // The solvers return the elements of an array little-endian.
+  if (!FPWordArrays || !Context::get().isLittleEndian() || !mo->allocSite)
+    return Expr::Int8;
+
+  LLVM_TYPE_Q llvm::Type *type = NULL;
+  if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(mo->allocSite))
+    type = cast<llvm::PointerType>(GV->getType())->getElementType();
+  else if (const AllocaInst *AI = dyn_cast<AllocaInst>(mo->allocSite))
+    type = AI->getAllocatedType();
+  else
+    return Expr::Int8;
+
+  while (LLVM_TYPE_Q llvm::ArrayType *AT = dyn_cast<llvm::ArrayType>(type))
+    type = AT->getElementType();
+  // Long doubles are stored in more bytes than they have bits so are left
+  // as bytes.
+  if (!type->isFloatTy() && !type->isDoubleTy())
+    return Expr::Int8;
+
+  Expr::Width width = getWidthForLLVMType(type);
+  if (mo->size % (width / 8))
+    return Expr::Int8;
+  return width;
+}
+
 size_t Executor::getAllocationAlignment(const llvm::Value *allocSite) const {
   // FIXME: 8 was the previous default. We shouldn't hard code this
   // and should fetch the default from elsewhere.
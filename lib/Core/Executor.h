@@ -20,6 +20,7 @@
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
+#include "klee/Solver.h"
 #include "klee/util/ArrayCache.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -53,6 +54,7 @@ namespace llvm {
 
 namespace klee {  
   class Array;
+  class BackgroundSolver;
   struct Cell;
   class ExecutionState;
   class ExternalDispatcher;
@@ -74,6 +76,7 @@ namespace klee {
   class TimingSolver;
   class TreeStreamWriter;
   class MergeHandler;
+  class WorkerPool;
   template<class T> class ref;
 
 
@@ -89,6 +92,7 @@ class Executor : public Interpreter {
   friend class SpecialFunctionHandler;
   friend class StatsTracker;
   friend class MergeHandler;
+  friend class WorkStealingTimer;
 
 public:
   class Timer {
@@ -183,6 +187,31 @@ private:
   /// object.
   unsigned replayPosition;
 
+  /// When non-null the pool of processes sharing the exploration. States
+  /// are given away when another worker runs out of work.
+  WorkerPool *workerPool;
+
+  /// The decisions at process tree splits which lead from the initial
+  /// state to the subtree this process explores, see \ref setWorkPrefix.
+  std::vector<bool> workPrefix;
+
+  /// The number of decisions of \ref workPrefix followed so far. While
+  /// it is below the size of the prefix, forks keep only the recorded side.
+  unsigned workPrefixPosition;
+
+  /// When non-null (with --speculative-fork) the solver checking the
+  /// feasibility of speculatively forked states, see \ref ExecutionState's
+  /// speculations.
+  BackgroundSolver *backgroundSolver;
+
+  /// Answers of the background solver not yet applied to the states, by
+  /// query ticket.
+  std::map<unsigned, Solver::Validity> speculationAnswers;
+
+  /// Tickets of the background queries which could not be answered, not
+  /// yet applied to the states.
+  std::set<unsigned> failedSpeculations;
+
   /// When non-null a list of "seed" inputs which will be used to
   /// drive execution.
   const std::vector<struct KTest *> *usingSeeds;  
@@ -359,6 +388,17 @@ private:
                     ExecutionState &state,
                     ref<Expr> value);
 
+  /// Evaluate the integer binary operation or comparison \a kind of
+  /// instruction \a ki on unboxed operands without allocating an Expr.
+  /// Returns false (and does nothing) if an operand is not an unboxed
+  /// constant or the result has to be computed by the Expr library.
+  bool evalUnboxedBinary(KInstruction *ki, ExecutionState &state,
+                         Expr::Kind kind);
+  /// Like evalUnboxedBinary() for the casts Extract (truncation), ZExt and
+  /// SExt to \a width bits.
+  bool evalUnboxedCast(KInstruction *ki, ExecutionState &state,
+                       Expr::Kind kind, Expr::Width width);
+
   ref<klee::ConstantExpr> evalConstantExpr(const llvm::ConstantExpr *ce, llvm::APFloat::roundingMode rm);
   ref<Expr> evaluateFCmp(unsigned int predicate, ref<Expr> left,
                          ref<Expr> right) const;
@@ -377,6 +417,14 @@ private:
   ref<klee::ConstantExpr> toConstant(ExecutionState &state, ref<Expr> e, 
                                      const char *purpose);
 
+  /// Create the floating point operation \a kind (FAdd, FSub, FMul, FDiv,
+  /// FSqrt, FPTrunc, UIToFP or SIToFP) rounded according to the rounding
+  /// mode of \a state. \a right is only used by binary operations and
+  /// \a width only by casts.
+  ref<Expr> createRoundedExpr(const ExecutionState &state, Expr::Kind kind,
+                              ref<Expr> left, ref<Expr> right,
+                              Expr::Width width);
+
   /// Bind a constant value for e to the given target. NOTE: This
   /// function may fork state if the state has multiple seeds.
   void executeGetValue(ExecutionState &state, ref<Expr> e, KInstruction *target);
@@ -397,6 +445,8 @@ private:
   void continueState(ExecutionState& state);
   // remove state from queue and delete
   void terminateState(ExecutionState &state);
+  // remove state from queue and delete without counting it as a path
+  void discardState(ExecutionState &state);
   // call exit handler and terminate state
   void terminateStateEarly(ExecutionState &state, const llvm::Twine &message);
   // call exit handler and terminate state
@@ -443,6 +493,46 @@ private:
   void initTimers();
   void processTimers(ExecutionState *current,
                      double maxInstTime);
+
+  /// Return the decisions at process tree splits which lead from the
+  /// initial state to \a state, starting with \ref workPrefix.
+  void getWorkPath(const ExecutionState &state, std::vector<bool> &path);
+
+  /// Decide whether \a current may branch on \a condition without waiting
+  /// for the solver. Returns false if the condition must be evaluated as
+  /// usual. Otherwise \a res is True or False if one side is trivially
+  /// infeasible, and Unknown if both sides should be explored speculatively.
+  bool evaluateSpeculatively(ExecutionState &current, ref<Expr> condition,
+                             Solver::Validity &res);
+
+  /// Whether one of the speculative branches of \a state is known to be
+  /// infeasible from \ref speculationAnswers.
+  bool isSpeculationInfeasible(const ExecutionState &state) const;
+
+  /// Whether the feasibility of one of the speculative branches of \a state
+  /// could not be decided, see \ref failedSpeculations.
+  bool isSpeculationFailed(const ExecutionState &state) const;
+
+  /// Move the answers of the background solver which have arrived into
+  /// \ref speculationAnswers. A query which failed in the background is
+  /// asked again synchronously, and recorded in \ref failedSpeculations if
+  /// that fails as well.
+  void collectSpeculationAnswers();
+
+  /// Apply the answers of the background solver: discard the states on
+  /// infeasible sides, terminate those on undecided sides and hand the
+  /// states which are now confirmed back to the searcher. Must only be
+  /// called between instructions.
+  void processSpeculations();
+
+  /// Wait until the feasibility of every speculative branch of \a state is
+  /// known and terminate it if it turned out infeasible or undecided.
+  /// Returns false in that case, and the state must not be used any more.
+  bool confirmState(ExecutionState &state);
+
+  /// Answer a steal request of the worker pool by handing over the state
+  /// closest to the root of the process tree and dropping it here.
+  void donateState();
   void checkMemoryUsage();
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
@@ -456,6 +546,18 @@ public:
     return *interpreterHandler;
   }
 
+  /// Whether symbolic branches are explored before their feasibility is
+  /// known, see --speculative-fork.
+  bool isForkingSpeculatively() const {
+    return backgroundSolver != 0;
+  }
+
+  /// Wait until the feasibility of every speculative branch of \a state is
+  /// known. Returns false if one of them is infeasible or undecided, in
+  /// which case the constraints of \a state may be unsatisfiable. The state
+  /// is terminated after the current instruction then.
+  bool waitForSpeculations(const ExecutionState &state);
+
   // XXX should just be moved out to utility module
   ref<klee::ConstantExpr> evalConstant(const llvm::Constant *c, llvm::APFloat::roundingMode rm);
 
@@ -478,6 +580,13 @@ public:
     replayPosition = 0;
   }
 
+  virtual void setWorkerPool(WorkerPool *pool);
+
+  virtual void setWorkPrefix(const std::vector<bool> &prefix) {
+    workPrefix = prefix;
+    workPrefixPosition = 0;
+  }
+
   virtual const llvm::Module *
   setModule(llvm::Module *module, const ModuleOptions &opts);
 
@@ -522,6 +631,10 @@ public:
   Expr::Width getWidthForLLVMType(LLVM_TYPE_Q llvm::Type *type) const;
   size_t getAllocationAlignment(const llvm::Value *allocSite) const;
 
+  /// Return the range of the array used to make \a mo symbolic, which is
+  /// wider than a byte for float and double objects with --fp-word-arrays.
+  Expr::Width getSymbolicElementWidth(const MemoryObject *mo) const;
+
   // Return the halt timer if it exists.
   virtual const TimerInfo* getHaltTimer() const;
   virtual double getCoreSolverTimeout() const;
@@ -19,6 +19,7 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/WorkerPool.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
@@ -59,6 +60,28 @@ public:
 
 ///
 
+namespace klee {
+/// Hands states to other workers of the pool when asked, and stops when the
+/// pool was halted.
+class WorkStealingTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  WorkStealingTimer(Executor *_executor) : executor(_executor) {}
+  ~WorkStealingTimer() {}
+
+  void run() {
+    WorkerPool *pool = executor->workerPool;
+    if (pool->isHalted())
+      executor->setHaltExecution(true);
+    else if (pool->isStealRequested())
+      executor->donateState();
+  }
+};
+}
+
+///
+
 static const double kSecondsPerTick = .1;
 static volatile unsigned timerTicks = 0;
 
@@ -122,6 +145,13 @@ void Executor::initTimers() {
   }
 }
 
+void Executor::setWorkerPool(WorkerPool *pool) {
+  assert(!workerPool && "worker pool already set");
+  workerPool = pool;
+  if (pool)
+    addTimer(new WorkStealingTimer(this), kSecondsPerTick);
+}
+
 ///
 
 Executor::Timer::Timer() {}
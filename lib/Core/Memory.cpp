@@ -32,6 +32,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
@@ -46,6 +47,57 @@ namespace {
 
 /***/
 
+uint64_t ObjectState::lastVersion = 0;
+const unsigned ObjectState::ChunkSize;
+
+/// A piece of the contents of an object state. As for whole objects before,
+/// the masks and known symbolics are only created once needed.
+struct ObjectState::Chunk {
+  unsigned refCount;
+  unsigned size;
+
+  uint8_t *concreteStore;
+  // XXX cleanup name of flushMask (its backwards or something)
+  BitArray *concreteMask;
+  BitArray *flushMask;
+  ref<Expr> *knownSymbolics;
+
+  explicit Chunk(unsigned _size)
+    : refCount(1),
+      size(_size),
+      concreteStore(new uint8_t[_size]),
+      concreteMask(0),
+      flushMask(0),
+      knownSymbolics(0) {
+    memset(concreteStore, 0, size);
+  }
+
+  Chunk(const Chunk &c)
+    : refCount(1),
+      size(c.size),
+      concreteStore(new uint8_t[c.size]),
+      concreteMask(c.concreteMask ? new BitArray(*c.concreteMask, c.size) : 0),
+      flushMask(c.flushMask ? new BitArray(*c.flushMask, c.size) : 0),
+      knownSymbolics(0) {
+    memcpy(concreteStore, c.concreteStore, size);
+    if (c.knownSymbolics) {
+      knownSymbolics = new ref<Expr>[size];
+      for (unsigned i=0; i<size; i++)
+        knownSymbolics[i] = c.knownSymbolics[i];
+    }
+  }
+
+  ~Chunk() {
+    delete concreteMask;
+    delete flushMask;
+    delete[] knownSymbolics;
+    delete[] concreteStore;
+  }
+
+private:
+  Chunk &operator=(const Chunk &);
+};
+
 ObjectHolder::ObjectHolder(const ObjectHolder &b) : os(b.os) { 
   if (os) ++os->refCount; 
 }
@@ -102,11 +154,9 @@ ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    chunks(0),
     updates(0, 0),
+    version(++lastVersion),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
@@ -116,7 +166,7 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  initializeChunks();
 }
 
 
@@ -124,47 +174,43 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    chunks(0),
     updates(array, 0),
+    version(++lastVersion),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
-  makeSymbolic();
-  memset(concreteStore, 0, size);
+  initializeChunks();
+  if (array->getRange() == Expr::Int8)
+    makeSymbolic();
+  else
+    makeSymbolicWords(array);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    chunks(new Chunk*[os.getNumChunks()]),
     updates(os.updates),
+    version(os.version),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
   if (object)
     object->refCount++;
 
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    chunks[i] = os.chunks[i];
+    ++chunks[i]->refCount;
   }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
 ObjectState::~ObjectState() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i)
+    if (--chunks[i]->refCount == 0)
+      delete chunks[i];
+  delete[] chunks;
 
   if (object)
   {
@@ -182,6 +228,61 @@ ArrayCache *ObjectState::getArrayCache() const {
   return object->parent->getArrayCache();
 }
 
+void ObjectState::initializeChunks() {
+  unsigned numChunks = getNumChunks();
+  chunks = new Chunk*[numChunks];
+  for (unsigned i = 0; i != numChunks; ++i)
+    chunks[i] = new Chunk(std::min(ChunkSize, size - i * ChunkSize));
+}
+
+ObjectState::Chunk *ObjectState::getWriteableChunk(unsigned offset) const {
+  Chunk *&chunk = chunks[offset / ChunkSize];
+  if (chunk->refCount > 1) {
+    --chunk->refCount;
+    chunk = new Chunk(*chunk);
+  }
+  return chunk;
+}
+
+void ObjectState::readConcreteStore(unsigned offset, unsigned n,
+                                    uint8_t *dst) const {
+  while (n) {
+    const Chunk *chunk = chunks[offset / ChunkSize];
+    unsigned i = offset % ChunkSize, count = std::min(n, chunk->size - i);
+    memcpy(dst, chunk->concreteStore + i, count);
+    offset += count;
+    dst += count;
+    n -= count;
+  }
+}
+
+bool ObjectState::isConcreteStoreEqual(unsigned offset, unsigned n,
+                                       const uint8_t *src) const {
+  while (n) {
+    const Chunk *chunk = chunks[offset / ChunkSize];
+    unsigned i = offset % ChunkSize, count = std::min(n, chunk->size - i);
+    if (memcmp(src, chunk->concreteStore + i, count) != 0)
+      return false;
+    offset += count;
+    src += count;
+    n -= count;
+  }
+  return true;
+}
+
+void ObjectState::writeConcreteStore(unsigned offset, unsigned n,
+                                     const uint8_t *src) {
+  while (n) {
+    Chunk *chunk = getWriteableChunk(offset);
+    unsigned i = offset % ChunkSize, count = std::min(n, chunk->size - i);
+    memcpy(chunk->concreteStore + i, src, count);
+    offset += count;
+    src += count;
+    n -= count;
+  }
+  version = ++lastVersion;
+}
+
 /***/
 
 const UpdateList &ObjectState::getUpdates() const {
@@ -236,12 +337,18 @@ const UpdateList &ObjectState::getUpdates() const {
 }
 
 void ObjectState::makeConcrete() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    if (!chunks[i]->concreteMask && !chunks[i]->flushMask &&
+        !chunks[i]->knownSymbolics)
+      continue;
+    Chunk *chunk = getWriteableChunk(i * ChunkSize);
+    delete chunk->concreteMask;
+    delete chunk->flushMask;
+    delete[] chunk->knownSymbolics;
+    chunk->concreteMask = 0;
+    chunk->flushMask = 0;
+    chunk->knownSymbolics = 0;
+  }
 }
 
 void ObjectState::makeSymbolic() {
@@ -256,17 +363,49 @@ void ObjectState::makeSymbolic() {
   }
 }
 
+void ObjectState::makeSymbolicWords(const Array *array) {
+  assert(array->getSizeInBytes() == size && "array does not cover the object");
+
+  // The bytes cannot be flushed into the update list of a word array, they
+  // are flushed into a byte array of their own instead.
+  updates = UpdateList(0, 0);
+  if (!UseConstantArrays) {
+    static unsigned id = 0;
+    const Array *bytes =
+        getArrayCache()->CreateArray("word_arr" + llvm::utostr(++id), size);
+    updates = UpdateList(bytes, 0);
+  }
+
+  // Each byte is known to be part of an element, reading the bytes of an
+  // element back in order folds into a single read of the element.
+  unsigned bytesPerElement = array->getRange() / 8;
+  UpdateList ul(array, 0);
+  for (unsigned i = 0; i != size; ++i) {
+    ref<Expr> element = ReadExpr::create(
+        ul, ConstantExpr::create(i / bytesPerElement, Expr::Int32));
+    markByteSymbolic(i);
+    setKnownSymbolic(i, ExtractExpr::create(element, 8 * (i % bytesPerElement),
+                                            Expr::Int8).get());
+  }
+}
+
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    Chunk *chunk = getWriteableChunk(i * ChunkSize);
+    memset(chunk->concreteStore, 0, chunk->size);
+  }
+  version = ++lastVersion;
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    Chunk *chunk = getWriteableChunk(i * ChunkSize);
     // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
+    memset(chunk->concreteStore, 0xAB, chunk->size);
   }
+  version = ++lastVersion;
 }
 
 /*
@@ -286,42 +425,44 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
- 
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
+      const Chunk *chunk = chunks[offset / ChunkSize];
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(
+                           chunk->concreteStore[offset % ChunkSize],
+                           Expr::Int8));
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       chunk->knownSymbolics[offset % ChunkSize]);
       }
 
-      flushMask->unset(offset);
+      markByteFlushed(offset);
     }
   } 
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
-
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
+      const Chunk *chunk = chunks[offset / ChunkSize];
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(
+                           chunk->concreteStore[offset % ChunkSize],
+                           Expr::Int8));
         markByteSymbolic(offset);
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       chunk->knownSymbolics[offset % ChunkSize]);
         setKnownSymbolic(offset, 0);
       }
 
-      flushMask->unset(offset);
+      markByteFlushed(offset);
     } else {
       // flushed bytes that are written over still need
       // to be marked out
@@ -335,60 +476,70 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
+  const Chunk *chunk = chunks[offset / ChunkSize];
+  return !chunk->concreteMask || chunk->concreteMask->get(offset % ChunkSize);
 }
 
 bool ObjectState::isByteFlushed(unsigned offset) const {
-  return flushMask && !flushMask->get(offset);
+  const Chunk *chunk = chunks[offset / ChunkSize];
+  return chunk->flushMask && !chunk->flushMask->get(offset % ChunkSize);
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  const Chunk *chunk = chunks[offset / ChunkSize];
+  return chunk->knownSymbolics &&
+         chunk->knownSymbolics[offset % ChunkSize].get();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
-  if (concreteMask)
-    concreteMask->set(offset);
+  if (!isByteConcrete(offset))
+    getWriteableChunk(offset)->concreteMask->set(offset % ChunkSize);
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+  if (!isByteConcrete(offset))
+    return;
+  Chunk *chunk = getWriteableChunk(offset);
+  if (!chunk->concreteMask)
+    chunk->concreteMask = new BitArray(chunk->size, true);
+  chunk->concreteMask->unset(offset % ChunkSize);
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
-  if (flushMask)
-    flushMask->set(offset);
+  if (isByteFlushed(offset))
+    getWriteableChunk(offset)->flushMask->set(offset % ChunkSize);
 }
 
-void ObjectState::markByteFlushed(unsigned offset) {
-  if (!flushMask) {
-    flushMask = new BitArray(size, false);
-  } else {
-    flushMask->unset(offset);
-  }
+void ObjectState::markByteFlushed(unsigned offset) const {
+  if (isByteFlushed(offset))
+    return;
+  Chunk *chunk = getWriteableChunk(offset);
+  if (!chunk->flushMask)
+    chunk->flushMask = new BitArray(chunk->size, true);
+  chunk->flushMask->unset(offset % ChunkSize);
 }
 
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
-  } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
-  }
+  const Chunk *chunk = chunks[offset / ChunkSize];
+  if (!chunk->knownSymbolics ? !value
+      : chunk->knownSymbolics[offset % ChunkSize].get() == value)
+    return;
+  Chunk *wchunk = getWriteableChunk(offset);
+  if (!wchunk->knownSymbolics)
+    wchunk->knownSymbolics = new ref<Expr>[wchunk->size];
+  wchunk->knownSymbolics[offset % ChunkSize] = value;
 }
 
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
+  const Chunk *chunk = chunks[offset / ChunkSize];
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(chunk->concreteStore[offset % ChunkSize],
+                                Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return chunk->knownSymbolics[offset % ChunkSize];
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
@@ -416,7 +567,8 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  getWriteableChunk(offset)->concreteStore[offset % ChunkSize] = value;
+  version = ++lastVersion;
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
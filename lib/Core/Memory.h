@@ -67,6 +67,10 @@ public:
   /// should sensibly be only at creation time).
   mutable std::vector< ref<Expr> > cexPreferences;
 
+  /// The ObjectState::version whose concrete contents were last copied out
+  /// to the memory at \a address for an external call, or 0 if unknown.
+  mutable uint64_t nativeVersion;
+
   // DO NOT IMPLEMENT
   MemoryObject(const MemoryObject &b);
   MemoryObject &operator=(const MemoryObject &b);
@@ -81,7 +85,8 @@ public:
       size(0),
       isFixed(true),
       parent(NULL),
-      allocSite(0) {
+      allocSite(0),
+      nativeVersion(0) {
   }
 
   MemoryObject(uint64_t _address, unsigned _size, 
@@ -99,7 +104,8 @@ public:
       fake_object(false),
       isUserSpecified(false),
       parent(_parent), 
-      allocSite(_allocSite) {
+      allocSite(_allocSite),
+      nativeVersion(0) {
   }
 
   ~MemoryObject();
@@ -156,18 +162,23 @@ private:
 
   const MemoryObject *object;
 
-  uint8_t *concreteStore;
-  // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
-
-  // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
+  /// The contents of the object are kept in chunks of ChunkSize bytes. A
+  /// copy of the object state shares its chunks with the original until one
+  /// of them writes to a chunk, so that only that chunk is copied.
+  struct Chunk;
+  static const unsigned ChunkSize = 4096;
 
-  ref<Expr> *knownSymbolics;
+  // mutable because chunks may need to be flushed during read of const
+  mutable Chunk **chunks;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// Object states with the same version have the same concrete store. A new
+  /// version is taken whenever the concrete store changes.
+  uint64_t version;
+  static uint64_t lastVersion;
+
 public:
   unsigned size;
 
@@ -180,7 +191,8 @@ public:
   ObjectState(const MemoryObject *mo);
 
   /// Create a new object state for the given memory object with symbolic
-  /// contents.
+  /// contents. If the range of \a array is wider than a byte, each element
+  /// covers as many bytes of the object, stored little-endian.
   ObjectState(const MemoryObject *mo, const Array *array);
 
   ObjectState(const ObjectState &os);
@@ -211,9 +223,22 @@ public:
 private:
   const UpdateList &getUpdates() const;
 
+  unsigned getNumChunks() const { return (size + ChunkSize - 1) / ChunkSize; }
+  void initializeChunks();
+  /// Return the chunk containing \a offset, copying it first if it is
+  /// shared with another object state.
+  Chunk *getWriteableChunk(unsigned offset) const;
+
+  // Access to the concrete store, for copying it to and from native memory.
+  void readConcreteStore(unsigned offset, unsigned n, uint8_t *dst) const;
+  bool isConcreteStoreEqual(unsigned offset, unsigned n,
+                            const uint8_t *src) const;
+  void writeConcreteStore(unsigned offset, unsigned n, const uint8_t *src);
+
   void makeConcrete();
 
   void makeSymbolic();
+  void makeSymbolicWords(const Array *array);
 
   ref<Expr> read8(ref<Expr> offset) const;
   void write8(unsigned offset, ref<Expr> value);
@@ -230,7 +255,7 @@ private:
 
   void markByteConcrete(unsigned offset);
   void markByteSymbolic(unsigned offset);
-  void markByteFlushed(unsigned offset);
+  void markByteFlushed(unsigned offset) const;
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
 
@@ -406,6 +406,70 @@ void IterativeDeepeningTimeSearcher::update(
 
 /***/
 
+SpeculativeSearcher::SpeculativeSearcher(Searcher *_baseSearcher)
+  : baseSearcher(_baseSearcher) {
+}
+
+SpeculativeSearcher::~SpeculativeSearcher() {
+  delete baseSearcher;
+}
+
+ExecutionState &SpeculativeSearcher::selectState() {
+  if (!baseSearcher->empty())
+    return baseSearcher->selectState();
+
+  // The state with the fewest open branches is the most likely to survive.
+  assert(!speculativeStates.empty() && "no state to select");
+  ExecutionState *best = 0;
+  for (std::set<ExecutionState*>::iterator it = speculativeStates.begin(),
+         ie = speculativeStates.end(); it != ie; ++it)
+    if (!best || (*it)->speculations.size() < best->speculations.size())
+      best = *it;
+  return *best;
+}
+
+void SpeculativeSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  bool currentInBase = current && !speculativeStates.count(current);
+  std::vector<ExecutionState *> baseAdded, baseRemoved;
+
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+         ie = addedStates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (speculativeStates.count(es)) {
+      // Added again by the executor once confirmed.
+      if (es->speculations.empty()) {
+        speculativeStates.erase(es);
+        baseAdded.push_back(es);
+      }
+    } else if (!es->speculations.empty()) {
+      speculativeStates.insert(es);
+    } else {
+      baseAdded.push_back(es);
+    }
+  }
+
+  for (std::vector<ExecutionState *>::const_iterator
+         it = removedStates.begin(), ie = removedStates.end();
+       it != ie; ++it) {
+    if (!speculativeStates.erase(*it))
+      baseRemoved.push_back(*it);
+  }
+
+  // The current state has just branched speculatively.
+  if (currentInBase && !current->speculations.empty() &&
+      std::find(removedStates.begin(), removedStates.end(), current) ==
+          removedStates.end()) {
+    baseRemoved.push_back(current);
+    speculativeStates.insert(current);
+  }
+
+  baseSearcher->update(currentInBase ? current : 0, baseAdded, baseRemoved);
+}
+
+/***/
+
 InterleavedSearcher::InterleavedSearcher(const std::vector<Searcher*> &_searchers)
   : searchers(_searchers),
     index(1) {
@@ -247,6 +247,32 @@ public:
     }
   };
 
+  /// SpeculativeSearcher - Keeps the states which took a branch whose
+  /// feasibility is still unknown (see --speculative-fork) away from the base
+  /// searcher until they are confirmed. They only run while the base
+  /// searcher has nothing else to offer.
+  class SpeculativeSearcher : public Searcher {
+    Searcher *baseSearcher;
+    std::set<ExecutionState*> speculativeStates;
+
+  public:
+    SpeculativeSearcher(Searcher *baseSearcher);
+    ~SpeculativeSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() {
+      return baseSearcher->empty() && speculativeStates.empty();
+    }
+    void printName(llvm::raw_ostream &os) {
+      os << "<SpeculativeSearcher> baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</SpeculativeSearcher>\n";
+    }
+  };
+
   class InterleavedSearcher : public Searcher {
     typedef std::vector<Searcher*> searchers_ty;
 
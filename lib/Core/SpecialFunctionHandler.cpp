@@ -18,6 +18,7 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/RoundingModeUtil.h"
 
 #include "Executor.h"
 #include "MemoryManager.h"
@@ -60,6 +61,14 @@ namespace {
                    cl::desc("Silently terminate paths with an infeasible "
                             "condition given to klee_assume() rather than "
                             "emitting an error (default=false)"));
+
+  cl::opt<bool>
+  SymbolicRoundingMode("symbolic-rounding-mode",
+                       cl::init(false),
+                       cl::desc("Keep a symbolic rounding mode set by the "
+                                "program as an expression instead of forking "
+                                "a state for every rounding mode "
+                                "(default=false)"));
 }
 
 
@@ -163,6 +172,8 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
     add("klee_get_rounding_mode", handleGetRoundingMode, true),
     add("klee_set_rounding_mode_internal", handleSetConcreteRoundingMode,
         false),
+    add("klee_set_symbolic_rounding_mode_internal",
+        handleSetSymbolicRoundingMode, true),
 
     // square root
     add("klee_sqrt_float", handleSqrt, true),
@@ -884,6 +895,10 @@ void SpecialFunctionHandler::handleGetRoundingMode(
     std::vector<ref<Expr> > &arguments) {
   assert(arguments.size() == 0 &&
          "invalid number of arguments to GetRoundingMode");
+  if (!state.symbolicRoundingMode.isNull()) {
+    executor.bindLocal(target, state, state.symbolicRoundingMode);
+    return;
+  }
   unsigned returnValue = 0;
   switch (state.roundingMode) {
   case llvm::APFloat::rmNearestTiesToEven:
@@ -924,35 +939,61 @@ void SpecialFunctionHandler::handleSetConcreteRoundingMode(
     return;
   }
   const ConstantExpr* CE = dyn_cast<ConstantExpr>(roundingModeArg);
-  switch (CE->getZExtValue()) {
-    case KLEE_FP_RNE:
-      newRoundingMode = llvm::APFloat::rmNearestTiesToEven;
-      break;
-    case KLEE_FP_RNA:
-      newRoundingMode = llvm::APFloat::rmNearestTiesToAway;
-      break;
-    case KLEE_FP_RU:
-      newRoundingMode = llvm::APFloat::rmTowardPositive;
-      break;
-    case KLEE_FP_RD:
-      newRoundingMode = llvm::APFloat::rmTowardNegative;
-      break;
-    case KLEE_FP_RZ:
-      newRoundingMode = llvm::APFloat::rmTowardZero;
-      break;
-    default:
-      executor.terminateStateOnError(state, "Invalid rounding mode",
-                                     Executor::User);
-      return;
+  if (!KleeRoundingModeToLLVMRoundingMode(CE->getZExtValue(),
+                                          newRoundingMode)) {
+    executor.terminateStateOnError(state, "Invalid rounding mode",
+                                   Executor::User);
+    return;
   }
   state.roundingMode = newRoundingMode;
+  state.symbolicRoundingMode = 0;
+}
+
+void SpecialFunctionHandler::handleSetSymbolicRoundingMode(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 &&
+         "invalid number of arguments to SetSymbolicRoundingMode");
+  // Returning false makes klee_set_rounding_mode() fork a state for each
+  // rounding mode instead.
+  if (!SymbolicRoundingMode) {
+    executor.bindLocal(target, state, ConstantExpr::create(0, Expr::Int32));
+    return;
+  }
+
+  // Operations under a symbolic rounding mode select between the results for
+  // KLEE_FP_RNE to KLEE_FP_RZ, so only accept rounding modes that must be one
+  // of these.
+  ref<Expr> roundingMode = ZExtExpr::create(arguments[0], Expr::Int32);
+  bool isValid;
+  executor.solver->setTimeout(executor.getCoreSolverTimeout());
+  bool success = executor.solver->mustBeTrue(
+      state,
+      UleExpr::create(roundingMode,
+                      ConstantExpr::create(KLEE_FP_RZ, Expr::Int32)),
+      isValid);
+  executor.solver->setTimeout(0);
+  if (!success) {
+    state.pc = state.prevPC;
+    executor.terminateStateEarly(state,
+                                 "Query timed out (set rounding mode).");
+    return;
+  }
+  if (!isValid) {
+    executor.bindLocal(target, state, ConstantExpr::create(0, Expr::Int32));
+    return;
+  }
+
+  state.symbolicRoundingMode = roundingMode;
+  executor.bindLocal(target, state, ConstantExpr::create(1, Expr::Int32));
 }
 
 void SpecialFunctionHandler::handleSqrt(ExecutionState &state,
                                         KInstruction *target,
                                         std::vector<ref<Expr> > &arguments) {
   assert(arguments.size() == 1 && "invalid number of arguments to sqrt");
-  ref<Expr> result = FSqrtExpr::create(arguments[0], state.roundingMode);
+  ref<Expr> result =
+      executor.createRoundedExpr(state, Expr::FSqrt, arguments[0], 0, 0);
   executor.bindLocal(target, state, result);
 }
 
@@ -144,6 +144,7 @@ namespace klee {
     HANDLER(handleIsSubnormal);
     HANDLER(handleGetRoundingMode);
     HANDLER(handleSetConcreteRoundingMode);
+    HANDLER(handleSetSymbolicRoundingMode);
     HANDLER(handleSqrt);
     HANDLER(handleFAbs);
 #undef HANDLER
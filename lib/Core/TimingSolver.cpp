@@ -193,6 +193,14 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  // A state on an infeasible or undecided speculative branch may have
+  // unsatisfiable constraints, which imply anything. It is terminated after
+  // the current instruction.
+  if (!executor->waitForSpeculations(state)) {
+    result = Solver::True;
+    return true;
+  }
+
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -219,6 +227,11 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  if (!executor->waitForSpeculations(state)) {
+    result = true;
+    return true;
+  }
+
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -267,6 +280,11 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     result = CE;
     return true;
   }
+
+  if (!executor->waitForSpeculations(state)) {
+    result = ConstantExpr::create(0, expr->getWidth());
+    return true;
+  }
   
   sys::TimeValue now = util::getWallTimeVal();
 
@@ -295,6 +313,15 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   if (objects.empty())
     return true;
 
+  if (!executor->waitForSpeculations(state)) {
+    result.clear();
+    for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                    ie = objects.end();
+         it != ie; ++it)
+      result.push_back(std::vector<unsigned char>((*it)->size, 0));
+    return true;
+  }
+
   sys::TimeValue now = util::getWallTimeVal();
 
   if (!setDynamicTimeout(this)) {
@@ -314,6 +341,10 @@ TimingSolver::getInitialValues(const ExecutionState& state,
 
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
+  if (!executor->waitForSpeculations(state)) {
+    ref<Expr> zero = ConstantExpr::create(0, expr->getWidth());
+    return std::make_pair(zero, zero);
+  }
   if (!setDynamicTimeout(this)) {
     // FIXME: Implementation doesn't actually define how to handle the solver
     // not succeeding. Just do this for now. If we do this we will likely
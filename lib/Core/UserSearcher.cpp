@@ -125,6 +125,12 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
   }
 
+  if (executor.isForkingSpeculatively()) {
+    if (UseMerge)
+      klee_error("speculative-fork currently does not support use-merge");
+    searcher = new SpeculativeSearcher(searcher);
+  }
+
   llvm::raw_ostream &os = executor.getHandler().getInfoStream();
 
   os << "BEGIN searcher description\n";
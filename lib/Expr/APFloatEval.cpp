@@ -74,6 +74,13 @@ llvm::APFloat evalSqrt(llvm::APFloat v, llvm::APFloat::roundingMode rm) {
   // We should figure out how to implement sqrt using APFloat only and
   // upstream the implementation.
 
+  // The square root of a binary floating point number is never exactly half
+  // way between two representable numbers, so ties never happen and rounding
+  // to nearest with ties away from zero is the same as with ties to even.
+  // This avoids the native rounding modes, which cannot express the former.
+  if (rm == llvm::APFloat::rmNearestTiesToAway)
+    rm = llvm::APFloat::rmNearestTiesToEven;
+
   // Store the old floating point environment.
   fenv_t oldEnv;
   int result = fegetenv(&oldEnv);
@@ -2,6 +2,12 @@
 
 namespace klee {
 
+ArrayCache::ArrayCache() {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  pthread_mutex_init(&lock, 0);
+#endif
+}
+
 ArrayCache::~ArrayCache() {
   // Free Allocated Array objects
   for (ArrayHashMap::iterator ai = cachedSymbolicArrays.begin(),
@@ -14,6 +20,9 @@ ArrayCache::~ArrayCache() {
        ai != e; ++ai) {
     delete *ai;
   }
+#ifdef KLEE_THREAD_SAFE_EXPR
+  pthread_mutex_destroy(&lock);
+#endif
 }
 
 const Array *
@@ -22,26 +31,30 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
                         const ref<ConstantExpr> *constantValuesEnd,
                         Expr::Width _domain, Expr::Width _range) {
 
+  // The array is built outside the lock, which only guards the containers.
   const Array *array = new Array(_name, _size, constantValuesBegin,
                                  constantValuesEnd, _domain, _range);
+#ifdef KLEE_THREAD_SAFE_EXPR
+  pthread_mutex_lock(&lock);
+#endif
   if (array->isSymbolicArray()) {
     std::pair<ArrayHashMap::const_iterator, bool> success =
         cachedSymbolicArrays.insert(array);
-    if (success.second) {
-      // Cache miss
-      return array;
+    if (!success.second) {
+      // Cache hit
+      delete array;
+      array = *(success.first);
+      assert(array->isSymbolicArray() &&
+             "Cached symbolic array is no longer symbolic");
     }
-    // Cache hit
-    delete array;
-    array = *(success.first);
-    assert(array->isSymbolicArray() &&
-           "Cached symbolic array is no longer symbolic");
-    return array;
   } else {
     // Treat every constant array as distinct so we never cache them
     assert(array->isConstantArray());
     concreteArrays.push_back(array); // For deletion later
-    return array;
   }
+#ifdef KLEE_THREAD_SAFE_EXPR
+  pthread_mutex_unlock(&lock);
+#endif
+  return array;
 }
 }
@@ -23,19 +23,27 @@ void Assignment::dump() {
   }
 }
 
+void Assignment::setValue(const Array *array, unsigned index, uint64_t value) {
+  bindings_ty::iterator it = bindings.find(array);
+  assert(it != bindings.end() && "array is not bound");
+  unsigned bytes = array->getRange() / 8;
+  if (it->second.size() < (index + 1) * bytes)
+    it->second.resize((index + 1) * bytes);
+  for (unsigned i = 0; i != bytes; ++i)
+    it->second[index * bytes + i] = (unsigned char)(value >> (8 * i));
+}
+
 void Assignment::createConstraintsFromAssignment(
     std::vector<ref<Expr> > &out) const {
   assert(out.size() == 0 && "out should be empty");
   for (bindings_ty::const_iterator it = bindings.begin(), ie = bindings.end();
        it != ie; ++it) {
     const Array *array = it->first;
-    const std::vector<unsigned char> &values = it->second;
     for (unsigned arrayIndex = 0; arrayIndex < array->size; ++arrayIndex) {
-      unsigned char value = values[arrayIndex];
       out.push_back(EqExpr::create(
           ReadExpr::create(UpdateList(array, 0),
                            ConstantExpr::alloc(arrayIndex, array->getDomain())),
-          ConstantExpr::alloc(value, array->getRange())));
+          evaluate(array, arrayIndex)));
     }
   }
 }
@@ -77,7 +77,7 @@ public:
 
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
   ConstraintManager::constraints_ty old;
-  bool changed = false;
+  bool consistent = true;
 
   constraints.swap(old);
   for (ConstraintManager::constraints_ty::iterator 
@@ -86,14 +86,15 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
     ref<Expr> e = visitor.visit(ce);
 
     if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
+      // enable further reductions
+      if (!addConstraintInternal(e))
+        consistent = false;
     } else {
       constraints.push_back(ce);
     }
   }
 
-  return changed;
+  return consistent;
 }
 
 void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
@@ -125,24 +126,23 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
   return ExprReplaceVisitor2(equalities).visit(e);
 }
 
-void ConstraintManager::addConstraintInternal(ref<Expr> e) {
+bool ConstraintManager::addConstraintInternal(ref<Expr> e) {
   // rewrite any known equalities and split Ands into different conjuncts
 
   switch (e->getKind()) {
   case Expr::Constant:
-    assert(cast<ConstantExpr>(e)->isTrue() && 
-           "attempt to add invalid (false) constraint");
-    break;
+    return cast<ConstantExpr>(e)->isTrue();
     
     // split to enable finer grained independence and other optimizations
   case Expr::And: {
     BinaryExpr *be = cast<BinaryExpr>(e);
-    addConstraintInternal(be->left);
-    addConstraintInternal(be->right);
-    break;
+    bool left = addConstraintInternal(be->left);
+    bool right = addConstraintInternal(be->right);
+    return left && right;
   }
 
   case Expr::Eq: {
+    bool consistent = true;
     if (RewriteEqualities) {
       // XXX: should profile the effects of this and the overhead.
       // traversing the constraints looking for equalities is hardly the
@@ -152,20 +152,30 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
       BinaryExpr *be = cast<BinaryExpr>(e);
       if (isa<ConstantExpr>(be->left)) {
 	ExprReplaceVisitor visitor(be->right, be->left);
-	rewriteConstraints(visitor);
+	consistent = rewriteConstraints(visitor);
       }
     }
     constraints.push_back(e);
-    break;
+    return consistent;
   }
     
   default:
     constraints.push_back(e);
-    break;
+    return true;
   }
 }
 
 void ConstraintManager::addConstraint(ref<Expr> e) {
   e = simplifyExpr(e);
-  addConstraintInternal(e);
+  bool consistent = addConstraintInternal(e);
+  assert(consistent && "attempt to add invalid (false) constraint");
+  (void) consistent;
+}
+
+bool ConstraintManager::tryAddConstraint(ref<Expr> e) {
+  constraints_ty old = constraints;
+  if (addConstraintInternal(simplifyExpr(e)))
+    return true;
+  constraints.swap(old);
+  return false;
 }
@@ -25,8 +25,20 @@
 #include "klee/util/APFloatEval.h"
 #include "klee/util/ExprPPrinter.h"
 
+#include <ciso646>
 #include <fenv.h>
 #include <sstream>
+#include <string.h>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_multimap std::unordered_multimap
+#else
+#include <tr1/unordered_map>
+#define unordered_multimap std::tr1::unordered_multimap
+#endif
+#ifdef __x86_64__
+#include <xmmintrin.h>
+#endif
 
 using namespace klee;
 using namespace llvm;
@@ -41,11 +53,83 @@ namespace {
       SingleReprForNaN("single-repr-for-nan", cl::init(true),
                        cl::desc("When constant folding produce a consistent "
                                 "bit pattern for NaN (default=true)."));
+
+  cl::opt<bool>
+      NativeFPEval("native-fp-eval", cl::init(true),
+                   cl::desc("When constant folding float and double "
+                            "arithmetic use the host FPU instead of "
+                            "llvm::APFloat where the result is known to "
+                            "match (default=true)."));
+
+  cl::opt<bool>
+      HashConsExprs("hash-cons-exprs", cl::init(false),
+                    cl::desc("Share a single node between all structurally "
+                             "equal expressions. Not available with "
+                             "ENABLE_THREAD_SAFE_EXPR (default=false)."));
 }
 
 /***/
 
+#ifdef KLEE_THREAD_SAFE_EXPR
+__thread unsigned Expr::count = 0;
+#else
 unsigned Expr::count = 0;
+#endif
+
+#ifndef KLEE_THREAD_SAFE_EXPR
+typedef unordered_multimap<unsigned, Expr *> ExprUniqueTable;
+
+/// The unique expressions by hash. It is never freed, as expressions held
+/// by static variables can be destroyed after it would be.
+static ExprUniqueTable *uniqueTable = 0;
+#endif
+
+ref<Expr> Expr::createCachedExpr(const ref<Expr> &e) {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  // Another thread could find an expression in the table while its last
+  // reference is being dropped, so the table is not used in this build.
+  return e;
+#else
+  if (!HashConsExprs)
+    return e;
+  if (!uniqueTable)
+    uniqueTable = new ExprUniqueTable();
+
+  Expr *expr = e.get();
+  std::pair<ExprUniqueTable::iterator, ExprUniqueTable::iterator> range =
+      uniqueTable->equal_range(expr->hashValue);
+  for (ExprUniqueTable::iterator it = range.first; it != range.second; ++it) {
+    Expr *cached = it->second;
+    if (cached->compare(*expr))
+      continue;
+    // Constants which only differ in how they print are kept apart.
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr))
+      if (CE->isFloat() != cast<ConstantExpr>(cached)->isFloat())
+        continue;
+    return cached;
+  }
+
+  uniqueTable->insert(std::make_pair(expr->hashValue, expr));
+  expr->isCached = true;
+  return e;
+#endif
+}
+
+void Expr::removeCachedExpr(Expr *e) {
+#ifndef KLEE_THREAD_SAFE_EXPR
+  // The derived parts of e are already destroyed, so it is found by
+  // address rather than compared.
+  std::pair<ExprUniqueTable::iterator, ExprUniqueTable::iterator> range =
+      uniqueTable->equal_range(e->hashValue);
+  for (ExprUniqueTable::iterator it = range.first; it != range.second; ++it) {
+    if (it->second == e) {
+      uniqueTable->erase(it);
+      return;
+    }
+  }
+  assert(0 && "cached expression not in the unique table");
+#endif
+}
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -108,7 +192,19 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
 }
 
 int Expr::compare(const Expr &b) const {
+  if (this == &b)
+    return 0;
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+  // Expressions are compared on several threads, each needs its own set. The
+  // set is kept for the lifetime of the thread to avoid reallocating it.
+  static __thread ExprEquivSet *threadEquivs = 0;
+  if (!threadEquivs)
+    threadEquivs = new ExprEquivSet();
+  ExprEquivSet &equivs = *threadEquivs;
+#else
   static ExprEquivSet equivs;
+#endif
   int r = compare(b, equivs);
   equivs.clear();
   return r;
@@ -902,6 +998,109 @@ ref<ConstantExpr> TryNativeX87FP80EvalCast(const ConstantExpr *ce,
 #endif
 }
 
+#ifdef __x86_64__
+template <typename FloatTy, typename BitsTy>
+llvm::APInt NativeIEEEEvalArith(const ConstantExpr *lhs,
+                                const ConstantExpr *rhs, Expr::Kind op,
+                                unsigned roundingBits, bool &isNaN) {
+  BitsTy lhsBits = (BitsTy)lhs->getZExtValue(sizeof(BitsTy) * 8);
+  BitsTy rhsBits = (BitsTy)rhs->getZExtValue(sizeof(BitsTy) * 8);
+  // The operands and the result are volatile so the compiler can neither fold
+  // the operation nor move it across the MXCSR updates.
+  volatile FloatTy lhsAsNative;
+  volatile FloatTy rhsAsNative;
+  volatile FloatTy nativeResult;
+  FloatTy tmp;
+  memcpy(&tmp, &lhsBits, sizeof(tmp));
+  lhsAsNative = tmp;
+  memcpy(&tmp, &rhsBits, sizeof(tmp));
+  rhsAsNative = tmp;
+
+  unsigned oldCSR = _mm_getcsr();
+  unsigned newCSR = (oldCSR & ~_MM_ROUND_MASK) | roundingBits;
+  if (newCSR != oldCSR)
+    _mm_setcsr(newCSR);
+  switch (op) {
+  case Expr::FAdd:
+    nativeResult = lhsAsNative + rhsAsNative;
+    break;
+  case Expr::FSub:
+    nativeResult = lhsAsNative - rhsAsNative;
+    break;
+  case Expr::FMul:
+    nativeResult = lhsAsNative * rhsAsNative;
+    break;
+  case Expr::FDiv:
+    nativeResult = lhsAsNative / rhsAsNative;
+    break;
+  default:
+    llvm_unreachable("Unhandled Expr kind");
+  }
+  if (newCSR != oldCSR)
+    _mm_setcsr(oldCSR);
+
+  tmp = nativeResult;
+  isNaN = (tmp != tmp);
+  BitsTy resultBits;
+  memcpy(&resultBits, &tmp, sizeof(resultBits));
+  return llvm::APInt(sizeof(BitsTy) * 8, (uint64_t)resultBits);
+}
+#endif
+
+// Evaluate float and double arithmetic with the host's SSE unit which is much
+// faster than llvm::APFloat. SSE arithmetic is correctly rounded IEEE-754 at
+// the operand width (unlike x87 there is no double rounding) so the result is
+// the same as APFloat's except for the bit pattern of NaNs. To keep NaNs
+// consistent with the rest of the constant folder we leave any operation that
+// produces a NaN to APFloat.
+ref<ConstantExpr> TryNativeIEEEEvalArith(const ConstantExpr *lhs,
+                                         const ConstantExpr *rhs,
+                                         Expr::Kind op,
+                                         llvm::APFloat::roundingMode rm) {
+  if (!NativeFPEval)
+    return NULL;
+  Expr::Width width = lhs->getWidth();
+  if ((width != Expr::Int32 && width != Expr::Int64) ||
+      rhs->getWidth() != width)
+    return NULL;
+#ifdef __x86_64__
+  unsigned roundingBits = 0;
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+    roundingBits = _MM_ROUND_NEAREST;
+    break;
+  case llvm::APFloat::rmTowardPositive:
+    roundingBits = _MM_ROUND_UP;
+    break;
+  case llvm::APFloat::rmTowardNegative:
+    roundingBits = _MM_ROUND_DOWN;
+    break;
+  case llvm::APFloat::rmTowardZero:
+    roundingBits = _MM_ROUND_TOWARD_ZERO;
+    break;
+  default:
+    // SSE has no round to nearest, ties away from zero.
+    return NULL;
+  }
+  // Flushing subnormals to zero is not IEEE-754 behaviour.
+  if (_mm_getcsr() & (_MM_FLUSH_ZERO_MASK | 0x0040 /* DAZ */))
+    return NULL;
+
+  bool isNaN = false;
+  llvm::APInt apint =
+      (width == Expr::Int32)
+          ? NativeIEEEEvalArith<float, uint32_t>(lhs, rhs, op, roundingBits,
+                                                 isNaN)
+          : NativeIEEEEvalArith<double, uint64_t>(lhs, rhs, op, roundingBits,
+                                                  isNaN);
+  if (isNaN)
+    return NULL;
+  return ConstantExpr::alloc(apint);
+#else
+  return NULL;
+#endif
+}
+
 // This is a hack to by-pass evaluation of NaN arguments by APFloat.  We need
 // to do this in-order to have the semantics of KLEE's Expr language co-incide
 // with Z3's. This is a delicate balencing act (native vs KLEE Expr vs Z3 Expr)
@@ -1033,6 +1232,9 @@ ref<ConstantExpr> ConstantExpr::FAdd(const ref<ConstantExpr> &RHS,
       TryNativeX87FP80EvalArith(this, RHS.get(), Expr::FAdd, rm);
   if (nativeEval.get())
     return nativeEval;
+  nativeEval = TryNativeIEEEEvalArith(this, RHS.get(), Expr::FAdd, rm);
+  if (nativeEval.get())
+    return nativeEval;
 
   APFloat result(this->getAPFloatValue());
   // Should we use the status?
@@ -1049,6 +1251,9 @@ ref<ConstantExpr> ConstantExpr::FSub(const ref<ConstantExpr> &RHS,
       TryNativeX87FP80EvalArith(this, RHS.get(), Expr::FSub, rm);
   if (nativeEval.get())
     return nativeEval;
+  nativeEval = TryNativeIEEEEvalArith(this, RHS.get(), Expr::FSub, rm);
+  if (nativeEval.get())
+    return nativeEval;
 
   APFloat result(this->getAPFloatValue());
   // Should we use the status?
@@ -1065,6 +1270,9 @@ ref<ConstantExpr> ConstantExpr::FMul(const ref<ConstantExpr> &RHS,
       TryNativeX87FP80EvalArith(this, RHS.get(), Expr::FMul, rm);
   if (nativeEval.get())
     return nativeEval;
+  nativeEval = TryNativeIEEEEvalArith(this, RHS.get(), Expr::FMul, rm);
+  if (nativeEval.get())
+    return nativeEval;
 
   APFloat result(this->getAPFloatValue());
   // Should we use the status?
@@ -1081,6 +1289,9 @@ ref<ConstantExpr> ConstantExpr::FDiv(const ref<ConstantExpr> &RHS,
       TryNativeX87FP80EvalArith(this, RHS.get(), Expr::FDiv, rm);
   if (nativeEval.get())
     return nativeEval;
+  nativeEval = TryNativeIEEEEvalArith(this, RHS.get(), Expr::FDiv, rm);
+  if (nativeEval.get())
+    return nativeEval;
 
   APFloat result(this->getAPFloatValue());
   // Should we use the status?
@@ -1204,6 +1415,7 @@ Array::Array(const std::string &_name, uint64_t _size,
 
   assert((isSymbolicArray() || constantValues.size() == size) &&
          "Invalid size for constant array!");
+  assert(range % 8 == 0 && "Array range must be a whole number of bytes!");
   computeHash();
 #ifndef NDEBUG
   for (const ref<ConstantExpr> *it = constantValuesBegin;
@@ -1953,7 +2165,7 @@ CMPCREATE(UleExpr, Ule)
 CMPCREATE(SltExpr, Slt)
 CMPCREATE(SleExpr, Sle)
 
-#define FOCMPCREATE(_e_op, _op)                                                \
+#define FOCMPCREATE(_e_op, _op, _create)                                       \
   ref<Expr> _e_op::create(const ref<Expr> &l, const ref<Expr> &r) {            \
     assert(l->getWidth() == r->getWidth() && "type mismatch");                 \
     if (ConstantExpr *cl = dyn_cast<ConstantExpr>(l)) {                        \
@@ -1965,14 +2177,27 @@ CMPCREATE(SleExpr, Sle)
       if (cr->getAPFloatValue().isNaN())                                       \
         return ConstantExpr::alloc(0, Expr::Bool);                             \
     }                                                                          \
-    return _e_op::alloc(l, r);                                                 \
+    return _create(l, r);                                                      \
   }
 
-FOCMPCREATE(FOEqExpr, FOEq)
-FOCMPCREATE(FOLtExpr, FOLt)
-FOCMPCREATE(FOLeExpr, FOLe)
-FOCMPCREATE(FOGtExpr, FOGt)
-FOCMPCREATE(FOGeExpr, FOGe)
+static ref<Expr> FOEqExpr_create(const ref<Expr> &l, const ref<Expr> &r) {
+  // Equality is symmetric, so order the operands to give both spellings the
+  // same cache key. As for Eq, a constant goes on the LHS.
+  if (isa<ConstantExpr>(r) || (!isa<ConstantExpr>(l) && r < l))
+    return FOEqExpr::alloc(r, l);
+  return FOEqExpr::alloc(l, r);
+}
+
+FOCMPCREATE(FOEqExpr, FOEq, FOEqExpr_create)
+FOCMPCREATE(FOLtExpr, FOLt, FOLtExpr::alloc)
+FOCMPCREATE(FOLeExpr, FOLe, FOLeExpr::alloc)
+
+ref<Expr> FOGtExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
+  return FOLtExpr::create(r, l);
+}
+ref<Expr> FOGeExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
+  return FOLeExpr::create(r, l);
+}
 
 #define FARITHCREATE(_e_op, _op)                                               \
   ref<Expr> _e_op::create(const ref<Expr> &l, const ref<Expr> &r,              \
@@ -1989,32 +2214,53 @@ FARITHCREATE(FSubExpr, FSub)
 FARITHCREATE(FMulExpr, FMul)
 FARITHCREATE(FDivExpr, FDiv)
 
+/// Strip the operations that cannot change the class of a floating point
+/// value. The sign never matters, and widening preserves NaN and infinity
+/// but may turn a subnormal into a normal. The x87 format is not widened
+/// because its unnormals have no counterpart in the IEEE formats.
+static ref<Expr> stripClassPreserving(ref<Expr> e, bool throughFPExt) {
+  for (;;) {
+    if (FAbsExpr *fabs = dyn_cast<FAbsExpr>(e)) {
+      e = fabs->expr;
+    } else if (FPExtExpr *fpext = dyn_cast<FPExtExpr>(e)) {
+      if (!throughFPExt || fpext->src->getWidth() == Expr::Fl80)
+        return e;
+      e = fpext->src;
+    } else {
+      return e;
+    }
+  }
+}
+
 ref<Expr> IsNaNExpr::create(const ref<Expr> &e) {
   if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
     return ConstantExpr::alloc(ce->getAPFloatValue().isNaN(), Expr::Bool);
   }
-  return IsNaNExpr::alloc(e);
+  ref<Expr> src = stripClassPreserving(e, true);
+  if (isa<UIToFPExpr>(src) || isa<SIToFPExpr>(src))
+    return ConstantExpr::alloc(0, Expr::Bool);
+  return IsNaNExpr::alloc(src);
 }
 
 ref<Expr> IsInfiniteExpr::create(const ref<Expr> &e) {
   if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
     return ConstantExpr::alloc(ce->getAPFloatValue().isInfinity(), Expr::Bool);
   }
-  return IsInfiniteExpr::alloc(e);
+  return IsInfiniteExpr::alloc(stripClassPreserving(e, true));
 }
 
 ref<Expr> IsNormalExpr::create(const ref<Expr> &e) {
   if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
     return ConstantExpr::alloc(ce->getAPFloatValue().isNormal(), Expr::Bool);
   }
-  return IsNormalExpr::alloc(e);
+  return IsNormalExpr::alloc(stripClassPreserving(e, false));
 }
 
 ref<Expr> IsSubnormalExpr::create(const ref<Expr> &e) {
   if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
     return ConstantExpr::alloc(ce->getAPFloatValue().isDenormal(), Expr::Bool);
   }
-  return IsSubnormalExpr::alloc(e);
+  return IsSubnormalExpr::alloc(stripClassPreserving(e, false));
 }
 
 ref<Expr> FSqrtExpr::create(klee::ref<klee::Expr> const &e,
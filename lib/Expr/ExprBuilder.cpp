@@ -149,6 +149,100 @@ namespace {
     virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
       return SgeExpr::alloc(LHS, RHS);
     }
+
+    virtual ref<Expr> FPExt(const ref<Expr> &LHS, Expr::Width W) {
+      return FPExtExpr::alloc(LHS, W);
+    }
+
+    virtual ref<Expr> FPTrunc(const ref<Expr> &LHS, Expr::Width W,
+                              llvm::APFloat::roundingMode RM) {
+      return FPTruncExpr::alloc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FPToUI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      return FPToUIExpr::alloc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FPToSI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      return FPToSIExpr::alloc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> UIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      return UIToFPExpr::alloc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> SIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      return SIToFPExpr::alloc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FAdd(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      return FAddExpr::alloc(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FSub(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      return FSubExpr::alloc(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FMul(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      return FMulExpr::alloc(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FDiv(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      return FDivExpr::alloc(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FSqrt(const ref<Expr> &LHS,
+                            llvm::APFloat::roundingMode RM) {
+      return FSqrtExpr::alloc(LHS, RM);
+    }
+
+    virtual ref<Expr> FAbs(const ref<Expr> &LHS) {
+      return FAbsExpr::alloc(LHS);
+    }
+
+    virtual ref<Expr> IsNaN(const ref<Expr> &LHS) {
+      return IsNaNExpr::alloc(LHS);
+    }
+
+    virtual ref<Expr> IsInfinite(const ref<Expr> &LHS) {
+      return IsInfiniteExpr::alloc(LHS);
+    }
+
+    virtual ref<Expr> IsNormal(const ref<Expr> &LHS) {
+      return IsNormalExpr::alloc(LHS);
+    }
+
+    virtual ref<Expr> IsSubnormal(const ref<Expr> &LHS) {
+      return IsSubnormalExpr::alloc(LHS);
+    }
+
+    virtual ref<Expr> FOEq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return FOEqExpr::alloc(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOLt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return FOLtExpr::alloc(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOLe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return FOLeExpr::alloc(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOGt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return FOGtExpr::alloc(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOGe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return FOGeExpr::alloc(LHS, RHS);
+    }
   };
 
   /// ChainedBuilder - Helper class for construct specialized expression
@@ -298,6 +392,99 @@ namespace {
     ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
       return Base->Sge(LHS, RHS);
     }
+
+    ref<Expr> FPExt(const ref<Expr> &LHS, Expr::Width W) {
+      return Base->FPExt(LHS, W);
+    }
+
+    ref<Expr> FPTrunc(const ref<Expr> &LHS, Expr::Width W,
+                      llvm::APFloat::roundingMode RM) {
+      return Base->FPTrunc(LHS, W, RM);
+    }
+
+    ref<Expr> FPToUI(const ref<Expr> &LHS, Expr::Width W,
+                     llvm::APFloat::roundingMode RM) {
+      return Base->FPToUI(LHS, W, RM);
+    }
+
+    ref<Expr> FPToSI(const ref<Expr> &LHS, Expr::Width W,
+                     llvm::APFloat::roundingMode RM) {
+      return Base->FPToSI(LHS, W, RM);
+    }
+
+    ref<Expr> UIToFP(const ref<Expr> &LHS, Expr::Width W,
+                     llvm::APFloat::roundingMode RM) {
+      return Base->UIToFP(LHS, W, RM);
+    }
+
+    ref<Expr> SIToFP(const ref<Expr> &LHS, Expr::Width W,
+                     llvm::APFloat::roundingMode RM) {
+      return Base->SIToFP(LHS, W, RM);
+    }
+
+    ref<Expr> FAdd(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      return Base->FAdd(LHS, RHS, RM);
+    }
+
+    ref<Expr> FSub(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      return Base->FSub(LHS, RHS, RM);
+    }
+
+    ref<Expr> FMul(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      return Base->FMul(LHS, RHS, RM);
+    }
+
+    ref<Expr> FDiv(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      return Base->FDiv(LHS, RHS, RM);
+    }
+
+    ref<Expr> FSqrt(const ref<Expr> &LHS, llvm::APFloat::roundingMode RM) {
+      return Base->FSqrt(LHS, RM);
+    }
+
+    ref<Expr> FAbs(const ref<Expr> &LHS) {
+      return Base->FAbs(LHS);
+    }
+
+    ref<Expr> IsNaN(const ref<Expr> &LHS) {
+      return Base->IsNaN(LHS);
+    }
+
+    ref<Expr> IsInfinite(const ref<Expr> &LHS) {
+      return Base->IsInfinite(LHS);
+    }
+
+    ref<Expr> IsNormal(const ref<Expr> &LHS) {
+      return Base->IsNormal(LHS);
+    }
+
+    ref<Expr> IsSubnormal(const ref<Expr> &LHS) {
+      return Base->IsSubnormal(LHS);
+    }
+
+    ref<Expr> FOEq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->FOEq(LHS, RHS);
+    }
+
+    ref<Expr> FOLt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->FOLt(LHS, RHS);
+    }
+
+    ref<Expr> FOLe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->FOLe(LHS, RHS);
+    }
+
+    ref<Expr> FOGt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->FOGt(LHS, RHS);
+    }
+
+    ref<Expr> FOGe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->FOGe(LHS, RHS);
+    }
   };
 
   /// ConstantSpecializedExprBuilder - A base expression builder class which
@@ -688,6 +875,174 @@ namespace {
       return Builder.Sge(cast<NonConstantExpr>(LHS),
                          cast<NonConstantExpr>(RHS));
     }
+
+    // Floating point expressions are only folded when all operands are
+    // constant.
+    virtual ref<Expr> FPExt(const ref<Expr> &LHS, Expr::Width W) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FPExt(W);
+
+      return Builder.FPExt(LHS, W);
+    }
+
+    virtual ref<Expr> FPTrunc(const ref<Expr> &LHS, Expr::Width W,
+                              llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FPTrunc(W, RM);
+
+      return Builder.FPTrunc(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FPToUI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FPToUI(W, RM);
+
+      return Builder.FPToUI(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FPToSI(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FPToSI(W, RM);
+
+      return Builder.FPToSI(LHS, W, RM);
+    }
+
+    virtual ref<Expr> UIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->UIToFP(W, RM);
+
+      return Builder.UIToFP(LHS, W, RM);
+    }
+
+    virtual ref<Expr> SIToFP(const ref<Expr> &LHS, Expr::Width W,
+                             llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->SIToFP(W, RM);
+
+      return Builder.SIToFP(LHS, W, RM);
+    }
+
+    virtual ref<Expr> FAdd(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FAdd(RCE, RM);
+
+      return Builder.FAdd(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FSub(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FSub(RCE, RM);
+
+      return Builder.FSub(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FMul(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FMul(RCE, RM);
+
+      return Builder.FMul(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FDiv(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                           llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FDiv(RCE, RM);
+
+      return Builder.FDiv(LHS, RHS, RM);
+    }
+
+    virtual ref<Expr> FSqrt(const ref<Expr> &LHS,
+                            llvm::APFloat::roundingMode RM) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FSqrt(RM);
+
+      return Builder.FSqrt(LHS, RM);
+    }
+
+    virtual ref<Expr> FAbs(const ref<Expr> &LHS) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        return CE->FAbs();
+
+      return Builder.FAbs(LHS);
+    }
+
+    virtual ref<Expr> IsNaN(const ref<Expr> &LHS) {
+      if (isa<ConstantExpr>(LHS))
+        return IsNaNExpr::create(LHS);
+
+      return Builder.IsNaN(LHS);
+    }
+
+    virtual ref<Expr> IsInfinite(const ref<Expr> &LHS) {
+      if (isa<ConstantExpr>(LHS))
+        return IsInfiniteExpr::create(LHS);
+
+      return Builder.IsInfinite(LHS);
+    }
+
+    virtual ref<Expr> IsNormal(const ref<Expr> &LHS) {
+      if (isa<ConstantExpr>(LHS))
+        return IsNormalExpr::create(LHS);
+
+      return Builder.IsNormal(LHS);
+    }
+
+    virtual ref<Expr> IsSubnormal(const ref<Expr> &LHS) {
+      if (isa<ConstantExpr>(LHS))
+        return IsSubnormalExpr::create(LHS);
+
+      return Builder.IsSubnormal(LHS);
+    }
+
+    virtual ref<Expr> FOEq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FOEq(RCE);
+
+      return Builder.FOEq(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOLt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FOLt(RCE);
+
+      return Builder.FOLt(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOLe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FOLe(RCE);
+
+      return Builder.FOLe(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOGt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FOGt(RCE);
+
+      return Builder.FOGt(LHS, RHS);
+    }
+
+    virtual ref<Expr> FOGe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (ConstantExpr *LCE = dyn_cast<ConstantExpr>(LHS))
+        if (ConstantExpr *RCE = dyn_cast<ConstantExpr>(RHS))
+          return LCE->FOGe(RCE);
+
+      return Builder.FOGe(LHS, RHS);
+    }
   };
 
   class ConstantFoldingBuilder :
@@ -1048,6 +1403,173 @@ namespace {
       // X s>= Y ==> Y s<= X
       return Builder->Sle(RHS, LHS);
     }
+
+    // The floating point rewrites below must give the same bits as the
+    // original expression in every solver. Operations on a NaN produce
+    // ConstantExpr::GetNaN(), so a rewrite that forwards an operand X uses
+    // canonicalNaN(X) unless X is known not to be a NaN. The x87 format is
+    // left alone because operations also recompute its explicit integer bit.
+
+    ref<Expr> FPTrunc(const ref<Expr> &LHS, Expr::Width W,
+                      llvm::APFloat::roundingMode RM) {
+      // fptrunc(fpext(X)) ==> X, extending is exact.
+      if (const FPExtExpr *FE = dyn_cast<FPExtExpr>(LHS))
+        if (FE->src->getWidth() == W && isIEEEWidth(W))
+          return canonicalNaN(FE->src);
+      return Base->FPTrunc(LHS, W, RM);
+    }
+
+    ref<Expr> FAdd(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      // X + -0.0 ==> X, except when rounding down where +0.0 + -0.0 is
+      // -0.0. There X + +0.0 ==> X instead.
+      if (isIEEEWidth(LHS->getWidth())) {
+        bool NegZero = RM != llvm::APFloat::rmTowardNegative;
+        if (isZero(RHS, NegZero))
+          return canonicalNaN(LHS);
+        if (isZero(LHS, NegZero))
+          return canonicalNaN(RHS);
+      }
+      return Base->FAdd(LHS, RHS, RM);
+    }
+
+    ref<Expr> FSub(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      // X - +0.0 ==> X, or X - -0.0 ==> X when rounding down.
+      if (isIEEEWidth(LHS->getWidth()) &&
+          isZero(RHS, RM == llvm::APFloat::rmTowardNegative))
+        return canonicalNaN(LHS);
+      return Base->FSub(LHS, RHS, RM);
+    }
+
+    ref<Expr> FMul(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      // X * 1.0 ==> X
+      if (isIEEEWidth(LHS->getWidth())) {
+        if (isOne(RHS))
+          return canonicalNaN(LHS);
+        if (isOne(LHS))
+          return canonicalNaN(RHS);
+      }
+      return Base->FMul(LHS, RHS, RM);
+    }
+
+    ref<Expr> FDiv(const ref<Expr> &LHS, const ref<Expr> &RHS,
+                   llvm::APFloat::roundingMode RM) {
+      // X / 1.0 ==> X
+      if (isIEEEWidth(LHS->getWidth()) && isOne(RHS))
+        return canonicalNaN(LHS);
+      return Base->FDiv(LHS, RHS, RM);
+    }
+
+    ref<Expr> FAbs(const ref<Expr> &LHS) {
+      // fabs(fabs(X)) ==> fabs(X)
+      if (isa<FAbsExpr>(LHS))
+        return LHS;
+      return Base->FAbs(LHS);
+    }
+
+    ref<Expr> IsNaN(const ref<Expr> &LHS) {
+      if (cannotBeNaN(LHS))
+        return Builder->False();
+      // isnan(fabs(X)) ==> isnan(X), isnan(fpext(X)) ==> isnan(X)
+      if (const FAbsExpr *AE = dyn_cast<FAbsExpr>(LHS))
+        return Builder->IsNaN(AE->expr);
+      if (const FPExtExpr *FE = dyn_cast<FPExtExpr>(LHS))
+        return Builder->IsNaN(FE->src);
+      return Base->IsNaN(LHS);
+    }
+
+    ref<Expr> FOGt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X > Y ==> Y < X
+      return Builder->FOLt(RHS, LHS);
+    }
+
+    ref<Expr> FOGe(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X >= Y ==> Y <= X
+      return Builder->FOLe(RHS, LHS);
+    }
+
+  private:
+    static bool isIEEEWidth(Expr::Width W) {
+      return W == Expr::Int16 || W == Expr::Int32 || W == Expr::Int64 ||
+             W == Expr::Int128;
+    }
+
+    static bool isZero(const ref<Expr> &E, bool Negative) {
+      const ConstantExpr *CE = dyn_cast<ConstantExpr>(E);
+      if (!CE)
+        return false;
+      llvm::APFloat F = CE->getAPFloatValue();
+      return F.isZero() && F.isNegative() == Negative;
+    }
+
+    static bool isOne(const ref<Expr> &E) {
+      const ConstantExpr *CE = dyn_cast<ConstantExpr>(E);
+      return CE && CE->getAPFloatValue().isExactlyValue(1.0);
+    }
+
+    /// cannotBeNaN - Return true if \a E is never a NaN. Only a few levels
+    /// are inspected so that large expression DAGs stay cheap to build.
+    static bool cannotBeNaN(const ref<Expr> &E, unsigned Depth = 4) {
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(E))
+        return !CE->getAPFloatValue().isNaN();
+      if (Depth == 0)
+        return false;
+      switch (E->getKind()) {
+      case Expr::UIToFP:
+      case Expr::SIToFP:
+        return true;
+      case Expr::FAbs:
+      case Expr::FPExt:
+      case Expr::FPTrunc:
+        return cannotBeNaN(E->getKid(0), Depth - 1);
+      case Expr::FSqrt:
+        // Only negative operands give a NaN.
+        return cannotBeNaN(E->getKid(0), Depth - 1) &&
+               (isa<FAbsExpr>(E->getKid(0)) || isa<UIToFPExpr>(E->getKid(0)));
+      case Expr::FAdd:
+      case Expr::FSub:
+      case Expr::FMul:
+        // Only infinities (inf - inf, 0 * inf) turn non-NaNs into a NaN.
+        return isFinite(E->getKid(0), Depth - 1) &&
+               isFinite(E->getKid(1), Depth - 1);
+      case Expr::Select:
+        return cannotBeNaN(E->getKid(1), Depth - 1) &&
+               cannotBeNaN(E->getKid(2), Depth - 1);
+      default:
+        return false;
+      }
+    }
+
+    /// isFinite - Return true if \a E is never a NaN or an infinity.
+    static bool isFinite(const ref<Expr> &E, unsigned Depth) {
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(E))
+        return CE->getAPFloatValue().isFinite();
+      if (Depth == 0)
+        return false;
+      switch (E->getKind()) {
+      case Expr::UIToFP:
+      case Expr::SIToFP:
+        // 2^64 rounds to a finite single or wider value.
+        return E->getKid(0)->getWidth() <= Expr::Int64 &&
+               E->getWidth() >= Expr::Int32;
+      case Expr::FAbs:
+      case Expr::FPExt:
+        return isFinite(E->getKid(0), Depth - 1);
+      default:
+        return false;
+      }
+    }
+
+    /// canonicalNaN - Return \a E with every NaN replaced by the NaN that
+    /// floating point operations produce.
+    ref<Expr> canonicalNaN(const ref<Expr> &E) {
+      if (cannotBeNaN(E))
+        return E;
+      return Builder->Select(Builder->IsNaN(E),
+                             ConstantExpr::GetNaN(E->getWidth()), E);
+    }
   };
 
   typedef ConstantSpecializedExprBuilder<SimplifyingBuilder>
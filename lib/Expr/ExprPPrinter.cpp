@@ -11,6 +11,7 @@
 #include "klee/util/ExprPPrinter.h"
 
 #include "klee/Constraints.h"
+#include "klee/Internal/Support/RoundingModeUtil.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
@@ -188,6 +189,48 @@ private:
     PC << " @ " << updates.root->name;
   }
 
+  /// printRoundingMode - Print the rounding mode of floating point
+  /// expressions which have one.
+  void printRoundingMode(PrintContext &PC, const ref<Expr> &e) {
+    llvm::APFloat::roundingMode rm;
+    switch (e->getKind()) {
+    case Expr::FPTrunc: rm = cast<FPTruncExpr>(e)->roundingMode; break;
+    case Expr::FPToUI: rm = cast<FPToUIExpr>(e)->roundingMode; break;
+    case Expr::FPToSI: rm = cast<FPToSIExpr>(e)->roundingMode; break;
+    case Expr::UIToFP: rm = cast<UIToFPExpr>(e)->roundingMode; break;
+    case Expr::SIToFP: rm = cast<SIToFPExpr>(e)->roundingMode; break;
+    case Expr::FAdd: rm = cast<FAddExpr>(e)->roundingMode; break;
+    case Expr::FSub: rm = cast<FSubExpr>(e)->roundingMode; break;
+    case Expr::FMul: rm = cast<FMulExpr>(e)->roundingMode; break;
+    case Expr::FDiv: rm = cast<FDivExpr>(e)->roundingMode; break;
+    case Expr::FSqrt: rm = cast<FSqrtExpr>(e)->roundingMode; break;
+    default: return;
+    }
+    PC << ' ' << LLVMRoundingModeToString(rm);
+  }
+
+  /// hasUntypedArgs - True for expressions whose argument widths cannot be
+  /// inferred from the expression, so constant arguments need their width.
+  bool hasUntypedArgs(const ref<Expr> &e) {
+    switch (e->getKind()) {
+    case Expr::Concat:
+    case Expr::SExt:
+    case Expr::FPExt:
+    case Expr::FPTrunc:
+    case Expr::FPToUI:
+    case Expr::FPToSI:
+    case Expr::UIToFP:
+    case Expr::SIToFP:
+    case Expr::IsNaN:
+    case Expr::IsInfinite:
+    case Expr::IsNormal:
+    case Expr::IsSubnormal:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   void printWidth(PrintContext &PC, ref<Expr> e) {
     if (!shouldPrintWidth(e))
       return;
@@ -362,16 +405,16 @@ public:
         }
         PC << "]";
       }
-      else if (e->getWidth() <= 64 && !(e->isFloat())) {
-        PC << e->getZExtValue();
-      } else {
+      else if (e->isFloat() && e->getAPFloatValue().isFinite()) {
         std::string S;
-        if (e->isFloat()) {
-          e->toString(S, /*radix=*/(PCFloatConstantsAsHexFloat ? 16 : 10));
-        } else {
-          e->toString(S);
-        }
+        e->toString(S, /*radix=*/(PCFloatConstantsAsHexFloat ? 16 : 10));
         PC << S;
+      } else if (e->getWidth() <= 64) {
+        // Infinities and NaNs are printed as their bit pattern since the
+        // decimal form does not keep the sign and payload of NaNs.
+        PC << e->getZExtValue();
+      } else {
+        PC << e->getAPValue().toString(10, /*Signed=*/false);
       }
 
       if (printWidth)
@@ -416,6 +459,7 @@ public:
 
 	PC << '(' << e->getKind();
         printWidth(PC, e);
+        printRoundingMode(PC, e);
         PC << ' ';
 
         // Indent at first argument and dispatch to appropriate print
@@ -425,7 +469,7 @@ public:
           printRead(re, PC, indent);
         } else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
           printExtract(ee, PC, indent);
-        } else if (e->getKind() == Expr::Concat || e->getKind() == Expr::SExt)
+        } else if (hasUntypedArgs(e))
 	  printExpr(e.get(), PC, indent, true);
 	else
           printExpr(e.get(), PC, indent);	
@@ -0,0 +1,701 @@
+//===-- FPBitVectorLowering.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/FPBitVectorLowering.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+/// Unbiased exponents are kept in signed bit-vectors of this width, which is
+/// wide enough for the intermediate results of every supported format.
+const Expr::Width ExponentWidth = 32;
+
+struct FloatFormat {
+  Expr::Width width;
+  unsigned exponentBits;
+  /// The number of stored fraction bits, not counting the integer bit.
+  unsigned fractionBits;
+  /// True for x87 extended precision which stores the integer bit.
+  bool explicitIntegerBit;
+
+  int bias() const { return (1 << (exponentBits - 1)) - 1; }
+  int minExponent() const { return 1 - bias(); }
+  int maxExponent() const { return bias(); }
+};
+
+FloatFormat getFormat(Expr::Width width) {
+  FloatFormat fmt;
+  fmt.width = width;
+  fmt.explicitIntegerBit = false;
+  switch (width) {
+  case Expr::Int16:
+    fmt.exponentBits = 5;
+    fmt.fractionBits = 10;
+    break;
+  case Expr::Int32:
+    fmt.exponentBits = 8;
+    fmt.fractionBits = 23;
+    break;
+  case Expr::Int64:
+    fmt.exponentBits = 11;
+    fmt.fractionBits = 52;
+    break;
+  case Expr::Fl80:
+    fmt.exponentBits = 15;
+    fmt.fractionBits = 63;
+    fmt.explicitIntegerBit = true;
+    break;
+  case Expr::Int128:
+    fmt.exponentBits = 15;
+    fmt.fractionBits = 112;
+    break;
+  default:
+    llvm_unreachable("Unsupported floating point width");
+  }
+  return fmt;
+}
+
+// Helpers to keep the encodings below readable.
+
+ref<Expr> boolConst(bool b) { return ConstantExpr::alloc(b, Expr::Bool); }
+
+ref<Expr> zeros(Expr::Width w) {
+  return ConstantExpr::alloc(llvm::APInt(w, 0));
+}
+
+ref<Expr> ones(Expr::Width w) {
+  return ConstantExpr::alloc(llvm::APInt::getAllOnesValue(w));
+}
+
+ref<Expr> powerOfTwo(Expr::Width w, unsigned n) {
+  return ConstantExpr::alloc(llvm::APInt::getOneBitSet(w, n));
+}
+
+ref<Expr> expConst(int value) {
+  return ConstantExpr::alloc(
+      llvm::APInt(ExponentWidth, (uint64_t)(int64_t)value, /*isSigned=*/true));
+}
+
+ref<Expr> bit(const ref<Expr> &e, unsigned index) {
+  return ExtractExpr::create(e, index, 1);
+}
+
+ref<Expr> lnot(const ref<Expr> &e) { return Expr::createIsZero(e); }
+
+ref<Expr> land(const ref<Expr> &a, const ref<Expr> &b) {
+  return AndExpr::create(a, b);
+}
+
+ref<Expr> lor(const ref<Expr> &a, const ref<Expr> &b) {
+  return OrExpr::create(a, b);
+}
+
+ref<Expr> ite(const ref<Expr> &c, const ref<Expr> &t, const ref<Expr> &f) {
+  return SelectExpr::create(c, t, f);
+}
+
+ref<Expr> isZero(const ref<Expr> &e) { return Expr::createIsZero(e); }
+
+/// Shift \a e left by the constant \a amount.
+ref<Expr> shiftLeft(const ref<Expr> &e, unsigned amount) {
+  Expr::Width w = e->getWidth();
+  if (amount == 0)
+    return e;
+  if (amount >= w)
+    return zeros(w);
+  return ConcatExpr::create(ExtractExpr::create(e, 0, w - amount),
+                            zeros(amount));
+}
+
+/// Convert the exponent-width \a amount to a shift amount for a \a w bit
+/// value, clamped to [0, w - 1].
+ref<Expr> toShiftAmount(const ref<Expr> &amount, Expr::Width w) {
+  ref<Expr> limit = expConst(w - 1);
+  ref<Expr> clamped =
+      ite(SltExpr::create(amount, expConst(0)), expConst(0),
+          ite(SltExpr::create(limit, amount), limit, amount));
+  return ZExtExpr::create(clamped, w);
+}
+
+/// Shift \a e right by \a amount, ORing the bits that are shifted out into
+/// the least significant bit.
+ref<Expr> shiftRightSticky(const ref<Expr> &e, const ref<Expr> &amount) {
+  Expr::Width w = e->getWidth();
+  ref<Expr> shift = toShiftAmount(amount, w);
+  ref<Expr> shifted = LShrExpr::create(e, shift);
+  ref<Expr> lost = NeExpr::create(ShlExpr::create(shifted, shift), e);
+  return OrExpr::create(shifted, ZExtExpr::create(lost, w));
+}
+
+/// Shift \a sig left until its most significant bit is set, adjusting \a exp
+/// to keep the value unchanged.
+void normalize(ref<Expr> &sig, ref<Expr> &exp) {
+  Expr::Width w = sig->getWidth();
+  unsigned k = 1;
+  while (k * 2 <= w)
+    k *= 2;
+  for (; k; k /= 2) {
+    ref<Expr> topIsZero =
+        isZero(k == w ? sig : ExtractExpr::create(sig, w - k, k));
+    sig = ite(topIsZero, shiftLeft(sig, k), sig);
+    exp = ite(topIsZero, SubExpr::create(exp, expConst(k)), exp);
+  }
+}
+
+/// Like normalize() for a \a sig that needs at most one shift.
+void normalizeOnce(ref<Expr> &sig, ref<Expr> &exp) {
+  ref<Expr> top = bit(sig, sig->getWidth() - 1);
+  sig = ite(top, sig, shiftLeft(sig, 1));
+  exp = ite(top, exp, SubExpr::create(exp, expConst(1)));
+}
+
+/// The fields and class of a floating point bit pattern.
+struct ClassifiedFloat {
+  ref<Expr> sign;
+  ref<Expr> exponentField;
+  ref<Expr> fraction;
+  ref<Expr> exponentIsZero;
+  ref<Expr> isNaN;
+  ref<Expr> isInf;
+  ref<Expr> isZero;
+};
+
+ClassifiedFloat classify(const FloatFormat &fmt, const ref<Expr> &bits) {
+  ClassifiedFloat c;
+  c.sign = bit(bits, fmt.width - 1);
+  c.exponentField =
+      ExtractExpr::create(bits, fmt.width - 1 - fmt.exponentBits,
+                          fmt.exponentBits);
+  c.fraction = ExtractExpr::create(bits, 0, fmt.fractionBits);
+  c.exponentIsZero = isZero(c.exponentField);
+  ref<Expr> exponentIsOnes =
+      EqExpr::create(c.exponentField, ones(fmt.exponentBits));
+  ref<Expr> fractionIsZero = isZero(c.fraction);
+  c.isNaN = land(exponentIsOnes, lnot(fractionIsZero));
+  c.isInf = land(exponentIsOnes, fractionIsZero);
+  c.isZero = land(c.exponentIsZero, fractionIsZero);
+  return c;
+}
+
+/// A finite value (-1)^sign * significand * 2^(exponent - fractionBits) with
+/// the significand normalized so its top bit is set unless it is zero.
+struct UnpackedFloat : public ClassifiedFloat {
+  ref<Expr> exponent;
+  ref<Expr> significand;
+};
+
+UnpackedFloat unpack(const FloatFormat &fmt, const ref<Expr> &bits) {
+  UnpackedFloat u;
+  static_cast<ClassifiedFloat &>(u) = classify(fmt, bits);
+  u.significand = ConcatExpr::create(lnot(u.exponentIsZero), u.fraction);
+  u.exponent = ite(u.exponentIsZero, expConst(fmt.minExponent()),
+                   SubExpr::create(ZExtExpr::create(u.exponentField,
+                                                    ExponentWidth),
+                                   expConst(fmt.bias())));
+  normalize(u.significand, u.exponent);
+  return u;
+}
+
+ref<Expr> pack(const FloatFormat &fmt, const ref<Expr> &sign,
+               const ref<Expr> &exponentField, const ref<Expr> &fraction,
+               const ref<Expr> &integerBit) {
+  ref<Expr> result = ConcatExpr::create(sign, exponentField);
+  if (fmt.explicitIntegerBit)
+    result = ConcatExpr::create(result, integerBit);
+  return ConcatExpr::create(result, fraction);
+}
+
+ref<Expr> packZero(const FloatFormat &fmt, const ref<Expr> &sign) {
+  return pack(fmt, sign, zeros(fmt.exponentBits), zeros(fmt.fractionBits),
+              boolConst(false));
+}
+
+ref<Expr> packInf(const FloatFormat &fmt, const ref<Expr> &sign) {
+  return pack(fmt, sign, ones(fmt.exponentBits), zeros(fmt.fractionBits),
+              boolConst(true));
+}
+
+ref<Expr> packMaxFinite(const FloatFormat &fmt, const ref<Expr> &sign) {
+  return pack(fmt, sign,
+              ConstantExpr::alloc(
+                  llvm::APInt::getAllOnesValue(fmt.exponentBits) - 1),
+              ones(fmt.fractionBits), boolConst(true));
+}
+
+ref<Expr> packNaN(const FloatFormat &fmt) {
+  return ConstantExpr::GetNaN(fmt.width);
+}
+
+/// Whether to increment the truncated magnitude whose last kept bit is
+/// \a lsb, given the first discarded bit \a guard and the OR of the rest.
+ref<Expr> roundingIncrement(llvm::APFloat::roundingMode rm,
+                            const ref<Expr> &sign, const ref<Expr> &lsb,
+                            const ref<Expr> &guard, const ref<Expr> &sticky) {
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+    return land(guard, lor(sticky, lsb));
+  case llvm::APFloat::rmNearestTiesToAway:
+    return guard;
+  case llvm::APFloat::rmTowardPositive:
+    return land(lnot(sign), lor(guard, sticky));
+  case llvm::APFloat::rmTowardNegative:
+    return land(sign, lor(guard, sticky));
+  case llvm::APFloat::rmTowardZero:
+    return boolConst(false);
+  }
+  llvm_unreachable("Unhandled rounding mode");
+}
+
+ref<Expr> overflowResult(const FloatFormat &fmt, llvm::APFloat::roundingMode rm,
+                         const ref<Expr> &sign) {
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+  case llvm::APFloat::rmNearestTiesToAway:
+    return packInf(fmt, sign);
+  case llvm::APFloat::rmTowardZero:
+    return packMaxFinite(fmt, sign);
+  case llvm::APFloat::rmTowardPositive:
+    return ite(sign, packMaxFinite(fmt, sign), packInf(fmt, sign));
+  case llvm::APFloat::rmTowardNegative:
+    return ite(sign, packInf(fmt, sign), packMaxFinite(fmt, sign));
+  }
+  llvm_unreachable("Unhandled rounding mode");
+}
+
+/// Round the non-zero value (-1)^sign * sig * 2^(exp - (width(sig) - 1)),
+/// where the top bit of \a sig is set, to \a fmt.
+ref<Expr> roundAndPack(const FloatFormat &fmt, const ref<Expr> &sign,
+                       ref<Expr> exp, ref<Expr> sig,
+                       llvm::APFloat::roundingMode rm) {
+  unsigned F = fmt.fractionBits;
+  if (sig->getWidth() < F + 3)
+    sig = ConcatExpr::create(sig, zeros(F + 3 - sig->getWidth()));
+  Expr::Width w = sig->getWidth();
+
+  // Values below the smallest normal number are shifted right so that they
+  // have the minimum exponent and are rounded as subnormals.
+  ref<Expr> minExp = expConst(fmt.minExponent());
+  ref<Expr> tiny = SltExpr::create(exp, minExp);
+  sig = ite(tiny, shiftRightSticky(sig, SubExpr::create(minExp, exp)), sig);
+  exp = ite(tiny, minExp, exp);
+
+  ref<Expr> mantissa = ExtractExpr::create(sig, w - (F + 1), F + 1);
+  ref<Expr> guard = bit(sig, w - F - 2);
+  ref<Expr> sticky = lnot(isZero(ExtractExpr::create(sig, 0, w - F - 2)));
+  ref<Expr> increment =
+      roundingIncrement(rm, sign, bit(mantissa, 0), guard, sticky);
+  ref<Expr> rounded = AddExpr::create(ZExtExpr::create(mantissa, F + 2),
+                                      ZExtExpr::create(increment, F + 2));
+  ref<Expr> carry = bit(rounded, F + 1);
+  mantissa = ite(carry, powerOfTwo(F + 1, F),
+                 ExtractExpr::create(rounded, 0, F + 1));
+  exp = ite(carry, AddExpr::create(exp, expConst(1)), exp);
+
+  // A subnormal that rounds up to the smallest normal number gets its
+  // integer bit set here and so is packed with the right exponent.
+  ref<Expr> isNormal = bit(mantissa, F);
+  ref<Expr> exponentField =
+      ite(isNormal,
+          ExtractExpr::create(AddExpr::create(exp, expConst(fmt.bias())), 0,
+                              fmt.exponentBits),
+          zeros(fmt.exponentBits));
+  ref<Expr> result = pack(fmt, sign, exponentField,
+                          ExtractExpr::create(mantissa, 0, F), isNormal);
+  return ite(SltExpr::create(expConst(fmt.maxExponent()), exp),
+             overflowResult(fmt, rm, sign), result);
+}
+
+ref<Expr> lowerAdd(const FloatFormat &fmt, const ref<Expr> &left,
+                   const ref<Expr> &right, llvm::APFloat::roundingMode rm,
+                   bool subtract) {
+  UnpackedFloat x = unpack(fmt, left);
+  UnpackedFloat y = unpack(fmt, right);
+  if (subtract)
+    y.sign = lnot(y.sign);
+
+  // Order the operands by magnitude and align the smaller one to the larger
+  // one, keeping three extra bits for rounding.
+  ref<Expr> xIsBigger =
+      lor(SltExpr::create(y.exponent, x.exponent),
+          land(EqExpr::create(x.exponent, y.exponent),
+               UleExpr::create(y.significand, x.significand)));
+  ref<Expr> bigSign = ite(xIsBigger, x.sign, y.sign);
+  ref<Expr> smallSign = ite(xIsBigger, y.sign, x.sign);
+  ref<Expr> bigExp = ite(xIsBigger, x.exponent, y.exponent);
+  ref<Expr> smallExp = ite(xIsBigger, y.exponent, x.exponent);
+  ref<Expr> bigSig = ConcatExpr::create(
+      ite(xIsBigger, x.significand, y.significand), zeros(3));
+  ref<Expr> smallSig = ConcatExpr::create(
+      ite(xIsBigger, y.significand, x.significand), zeros(3));
+  smallSig = shiftRightSticky(smallSig, SubExpr::create(bigExp, smallExp));
+
+  Expr::Width w = bigSig->getWidth() + 1;
+  ref<Expr> sameSign = EqExpr::create(bigSign, smallSign);
+  ref<Expr> wideBig = ZExtExpr::create(bigSig, w);
+  ref<Expr> wideSmall = ZExtExpr::create(smallSig, w);
+  ref<Expr> sum = ite(sameSign, AddExpr::create(wideBig, wideSmall),
+                      SubExpr::create(wideBig, wideSmall));
+  ref<Expr> sig = sum;
+  ref<Expr> exp = AddExpr::create(bigExp, expConst(1));
+  normalize(sig, exp);
+  ref<Expr> result = roundAndPack(fmt, bigSign, exp, sig, rm);
+
+  // An exact zero is negative only if both operands are or if rounding
+  // toward negative infinity.
+  ref<Expr> zeroSign =
+      ite(sameSign, bigSign,
+          boolConst(rm == llvm::APFloat::rmTowardNegative));
+  result = ite(isZero(sum), packZero(fmt, zeroSign), result);
+  result = ite(y.isInf, packInf(fmt, y.sign), result);
+  result = ite(x.isInf, packInf(fmt, x.sign), result);
+  ref<Expr> isNaN =
+      lor(lor(x.isNaN, y.isNaN),
+          land(land(x.isInf, y.isInf), lnot(EqExpr::create(x.sign, y.sign))));
+  return ite(isNaN, packNaN(fmt), result);
+}
+
+ref<Expr> lowerMul(const FloatFormat &fmt, const ref<Expr> &left,
+                   const ref<Expr> &right, llvm::APFloat::roundingMode rm) {
+  UnpackedFloat x = unpack(fmt, left);
+  UnpackedFloat y = unpack(fmt, right);
+  ref<Expr> sign = XorExpr::create(x.sign, y.sign);
+
+  Expr::Width w = 2 * (fmt.fractionBits + 1);
+  ref<Expr> sig = MulExpr::create(ZExtExpr::create(x.significand, w),
+                                  ZExtExpr::create(y.significand, w));
+  ref<Expr> exp = AddExpr::create(AddExpr::create(x.exponent, y.exponent),
+                                  expConst(1));
+  normalizeOnce(sig, exp);
+  ref<Expr> result = roundAndPack(fmt, sign, exp, sig, rm);
+
+  result = ite(lor(x.isZero, y.isZero), packZero(fmt, sign), result);
+  result = ite(lor(x.isInf, y.isInf), packInf(fmt, sign), result);
+  ref<Expr> isNaN = lor(lor(x.isNaN, y.isNaN),
+                        lor(land(x.isInf, y.isZero), land(x.isZero, y.isInf)));
+  return ite(isNaN, packNaN(fmt), result);
+}
+
+ref<Expr> lowerDiv(const FloatFormat &fmt, const ref<Expr> &left,
+                   const ref<Expr> &right, llvm::APFloat::roundingMode rm) {
+  UnpackedFloat x = unpack(fmt, left);
+  UnpackedFloat y = unpack(fmt, right);
+  ref<Expr> sign = XorExpr::create(x.sign, y.sign);
+  unsigned F = fmt.fractionBits;
+
+  // The quotient of the significands scaled by 2^(F+3) has F+3 or F+4
+  // significant bits, enough to round once the remainder is folded in.
+  Expr::Width w = 2 * F + 4;
+  ref<Expr> dividend = ConcatExpr::create(x.significand, zeros(F + 3));
+  // Avoid dividing by zero, the result is not used in that case.
+  ref<Expr> divisor = ite(y.isZero, ConstantExpr::alloc(1, w),
+                          ZExtExpr::create(y.significand, w));
+  ref<Expr> quotient = UDivExpr::create(dividend, divisor);
+  ref<Expr> remainder = URemExpr::create(dividend, divisor);
+  ref<Expr> sig = OrExpr::create(
+      ExtractExpr::create(quotient, 0, F + 4),
+      ZExtExpr::create(lnot(isZero(remainder)), F + 4));
+  ref<Expr> exp = SubExpr::create(x.exponent, y.exponent);
+  normalizeOnce(sig, exp);
+  ref<Expr> result = roundAndPack(fmt, sign, exp, sig, rm);
+
+  result = ite(lor(x.isZero, y.isInf), packZero(fmt, sign), result);
+  result = ite(lor(x.isInf, y.isZero), packInf(fmt, sign), result);
+  ref<Expr> isNaN = lor(lor(x.isNaN, y.isNaN),
+                        lor(land(x.isZero, y.isZero), land(x.isInf, y.isInf)));
+  return ite(isNaN, packNaN(fmt), result);
+}
+
+ref<Expr> lowerSqrt(const FloatFormat &fmt, const ref<Expr> &arg,
+                    llvm::APFloat::roundingMode rm) {
+  UnpackedFloat x = unpack(fmt, arg);
+  unsigned F = fmt.fractionBits;
+
+  // Scale the significand by an even power of two so that its integer
+  // square root has F+3 bits with the top one set.
+  ref<Expr> oddExponent = bit(x.exponent, 0);
+  ref<Expr> radicand =
+      ite(oddExponent, ConcatExpr::create(x.significand, zeros(F + 5)),
+          ConcatExpr::create(ConcatExpr::create(zeros(1), x.significand),
+                             zeros(F + 4)));
+
+  // Restoring square root, one result bit per step.
+  unsigned n = F + 3;
+  ref<Expr> remainder = zeros(F + 6);
+  ref<Expr> root = zeros(n);
+  for (int i = n - 1; i >= 0; --i) {
+    remainder = ConcatExpr::create(ExtractExpr::create(remainder, 0, F + 4),
+                                   ExtractExpr::create(radicand, 2 * i, 2));
+    ref<Expr> trial = ConcatExpr::create(ZExtExpr::create(root, F + 4),
+                                         ConstantExpr::alloc(1, 2));
+    ref<Expr> fits = UleExpr::create(trial, remainder);
+    remainder = ite(fits, SubExpr::create(remainder, trial), remainder);
+    root = ConcatExpr::create(ExtractExpr::create(root, 0, n - 1), fits);
+  }
+  ref<Expr> sig = ConcatExpr::create(root, lnot(isZero(remainder)));
+  ref<Expr> exp = AShrExpr::create(x.exponent, expConst(1));
+  ref<Expr> result = roundAndPack(fmt, boolConst(false), exp, sig, rm);
+
+  result = ite(x.isInf, packInf(fmt, boolConst(false)), result);
+  result = ite(x.isZero, packZero(fmt, x.sign), result);
+  ref<Expr> isNaN = lor(x.isNaN, land(x.sign, lnot(x.isZero)));
+  return ite(isNaN, packNaN(fmt), result);
+}
+
+ref<Expr> lowerConvert(const FloatFormat &srcFmt, const FloatFormat &dstFmt,
+                       const ref<Expr> &arg, llvm::APFloat::roundingMode rm) {
+  UnpackedFloat x = unpack(srcFmt, arg);
+  ref<Expr> result =
+      roundAndPack(dstFmt, x.sign, x.exponent, x.significand, rm);
+  result = ite(x.isZero, packZero(dstFmt, x.sign), result);
+  result = ite(x.isInf, packInf(dstFmt, x.sign), result);
+  return ite(x.isNaN, packNaN(dstFmt), result);
+}
+
+ref<Expr> lowerIntToFP(const FloatFormat &fmt, const ref<Expr> &arg,
+                       bool isSigned, llvm::APFloat::roundingMode rm) {
+  Expr::Width w = arg->getWidth();
+  ref<Expr> sign = isSigned ? bit(arg, w - 1) : boolConst(false);
+  ref<Expr> sig =
+      isSigned ? ite(sign, SubExpr::create(zeros(w), arg), arg) : arg;
+  ref<Expr> exp = expConst(w - 1);
+  normalize(sig, exp);
+  ref<Expr> result = roundAndPack(fmt, sign, exp, sig, rm);
+  return ite(isZero(arg), packZero(fmt, boolConst(false)), result);
+}
+
+ref<Expr> lowerFPToInt(const FloatFormat &fmt, const ref<Expr> &arg,
+                       Expr::Width w, bool isSigned,
+                       llvm::APFloat::roundingMode rm) {
+  UnpackedFloat x = unpack(fmt, arg);
+  unsigned F = fmt.fractionBits;
+  // Wide enough for any in range magnitude plus one bit to detect overflow
+  // and two bits for rounding.
+  Expr::Width t = std::max(w, (Expr::Width)(F + 1)) + 3;
+  ref<Expr> fractionExp = expConst(F);
+
+  // Values with fraction bits are shifted right and rounded to an integer.
+  ref<Expr> scaled = ConcatExpr::create(
+      ZExtExpr::create(x.significand, t - 2), zeros(2));
+  ref<Expr> shifted =
+      shiftRightSticky(scaled, SubExpr::create(fractionExp, x.exponent));
+  ref<Expr> intPart = ExtractExpr::create(shifted, 2, t - 2);
+  ref<Expr> increment = roundingIncrement(rm, x.sign, bit(intPart, 0),
+                                          bit(shifted, 1), bit(shifted, 0));
+  ref<Expr> roundedMagnitude =
+      AddExpr::create(ZExtExpr::create(intPart, t),
+                      ZExtExpr::create(increment, t));
+  // Others are integers already and are shifted left.
+  ref<Expr> exactMagnitude = ShlExpr::create(
+      ZExtExpr::create(x.significand, t),
+      toShiftAmount(SubExpr::create(x.exponent, fractionExp), t));
+  ref<Expr> magnitude = ite(SltExpr::create(x.exponent, fractionExp),
+                            roundedMagnitude, exactMagnitude);
+
+  ref<Expr> inRange;
+  ref<Expr> result;
+  if (isSigned) {
+    ref<Expr> limit = powerOfTwo(t, w - 1);
+    inRange = ite(x.sign, UleExpr::create(magnitude, limit),
+                  UltExpr::create(magnitude, limit));
+    result = ExtractExpr::create(
+        ite(x.sign, SubExpr::create(zeros(t), magnitude), magnitude), 0, w);
+  } else {
+    inRange = land(UltExpr::create(magnitude, powerOfTwo(t, w)),
+                   lor(lnot(x.sign), isZero(magnitude)));
+    result = ExtractExpr::create(magnitude, 0, w);
+  }
+  // Magnitudes of at least 2^w never fit and would not fit in ``t`` bits.
+  ref<Expr> tooBig = SleExpr::create(expConst(w), x.exponent);
+  ref<Expr> valid =
+      land(lnot(lor(lor(x.isNaN, x.isInf), tooBig)), inRange);
+  return ite(valid, result, zeros(w));
+}
+
+/// Drop the explicit integer bit of x87 extended values so that bit patterns
+/// can be compared.
+ref<Expr> withoutIntegerBit(const FloatFormat &fmt, const ref<Expr> &bits) {
+  if (!fmt.explicitIntegerBit)
+    return bits;
+  return ConcatExpr::create(
+      ExtractExpr::create(bits, fmt.fractionBits + 1,
+                          fmt.exponentBits + 1),
+      ExtractExpr::create(bits, 0, fmt.fractionBits));
+}
+
+ref<Expr> lowerFOEq(const FloatFormat &fmt, const ref<Expr> &left,
+                    const ref<Expr> &right) {
+  ClassifiedFloat x = classify(fmt, left);
+  ClassifiedFloat y = classify(fmt, right);
+  ref<Expr> equal = lor(EqExpr::create(withoutIntegerBit(fmt, left),
+                                       withoutIntegerBit(fmt, right)),
+                        land(x.isZero, y.isZero));
+  return land(lnot(lor(x.isNaN, y.isNaN)), equal);
+}
+
+ref<Expr> lowerFOLt(const FloatFormat &fmt, const ref<Expr> &left,
+                    const ref<Expr> &right) {
+  ClassifiedFloat x = classify(fmt, left);
+  ClassifiedFloat y = classify(fmt, right);
+  ref<Expr> xBits = withoutIntegerBit(fmt, left);
+  ref<Expr> yBits = withoutIntegerBit(fmt, right);
+  ref<Expr> xMagnitude = ExtractExpr::create(xBits, 0, xBits->getWidth() - 1);
+  ref<Expr> yMagnitude = ExtractExpr::create(yBits, 0, yBits->getWidth() - 1);
+  ref<Expr> less =
+      ite(x.sign,
+          ite(y.sign, UltExpr::create(yMagnitude, xMagnitude), boolConst(true)),
+          ite(y.sign, boolConst(false),
+              UltExpr::create(xMagnitude, yMagnitude)));
+  return land(lnot(lor(lor(x.isNaN, y.isNaN), land(x.isZero, y.isZero))),
+              less);
+}
+
+ref<Expr> lowerFAbs(const FloatFormat &fmt, const ref<Expr> &arg) {
+  ClassifiedFloat x = classify(fmt, arg);
+  return ite(x.isNaN, packNaN(fmt),
+             pack(fmt, boolConst(false), x.exponentField, x.fraction,
+                  lnot(x.exponentIsZero)));
+}
+}
+
+ExprVisitor::Action FPBitVectorLowering::visitExprPost(const Expr &e) {
+  ref<Expr> result;
+  switch (e.getKind()) {
+  case Expr::FPExt: {
+    const FPExtExpr &ce = static_cast<const FPExtExpr &>(e);
+    // Extending is exact so the rounding mode does not matter.
+    result = lowerConvert(getFormat(ce.src->getWidth()),
+                          getFormat(ce.getWidth()), ce.src,
+                          llvm::APFloat::rmNearestTiesToEven);
+    break;
+  }
+  case Expr::FPTrunc: {
+    const FPTruncExpr &ce = static_cast<const FPTruncExpr &>(e);
+    result = lowerConvert(getFormat(ce.src->getWidth()),
+                          getFormat(ce.getWidth()), ce.src, ce.roundingMode);
+    break;
+  }
+  case Expr::FPToUI: {
+    const FPToUIExpr &ce = static_cast<const FPToUIExpr &>(e);
+    result = lowerFPToInt(getFormat(ce.src->getWidth()), ce.src,
+                          ce.getWidth(), false, ce.roundingMode);
+    break;
+  }
+  case Expr::FPToSI: {
+    const FPToSIExpr &ce = static_cast<const FPToSIExpr &>(e);
+    result = lowerFPToInt(getFormat(ce.src->getWidth()), ce.src,
+                          ce.getWidth(), true, ce.roundingMode);
+    break;
+  }
+  case Expr::UIToFP: {
+    const UIToFPExpr &ce = static_cast<const UIToFPExpr &>(e);
+    result = lowerIntToFP(getFormat(ce.getWidth()), ce.src, false,
+                          ce.roundingMode);
+    break;
+  }
+  case Expr::SIToFP: {
+    const SIToFPExpr &ce = static_cast<const SIToFPExpr &>(e);
+    result = lowerIntToFP(getFormat(ce.getWidth()), ce.src, true,
+                          ce.roundingMode);
+    break;
+  }
+  case Expr::FAdd: {
+    const FAddExpr &be = static_cast<const FAddExpr &>(e);
+    result = lowerAdd(getFormat(be.getWidth()), be.left, be.right,
+                      be.roundingMode, false);
+    break;
+  }
+  case Expr::FSub: {
+    const FSubExpr &be = static_cast<const FSubExpr &>(e);
+    result = lowerAdd(getFormat(be.getWidth()), be.left, be.right,
+                      be.roundingMode, true);
+    break;
+  }
+  case Expr::FMul: {
+    const FMulExpr &be = static_cast<const FMulExpr &>(e);
+    result = lowerMul(getFormat(be.getWidth()), be.left, be.right,
+                      be.roundingMode);
+    break;
+  }
+  case Expr::FDiv: {
+    const FDivExpr &be = static_cast<const FDivExpr &>(e);
+    result = lowerDiv(getFormat(be.getWidth()), be.left, be.right,
+                      be.roundingMode);
+    break;
+  }
+  case Expr::FSqrt: {
+    const FSqrtExpr &ue = static_cast<const FSqrtExpr &>(e);
+    result = lowerSqrt(getFormat(ue.getWidth()), ue.expr, ue.roundingMode);
+    break;
+  }
+  case Expr::FAbs: {
+    const FAbsExpr &ue = static_cast<const FAbsExpr &>(e);
+    result = lowerFAbs(getFormat(ue.getWidth()), ue.expr);
+    break;
+  }
+  case Expr::FOEq: {
+    const FOEqExpr &ce = static_cast<const FOEqExpr &>(e);
+    result = lowerFOEq(getFormat(ce.left->getWidth()), ce.left, ce.right);
+    break;
+  }
+  case Expr::FOLt: {
+    const FOLtExpr &ce = static_cast<const FOLtExpr &>(e);
+    result = lowerFOLt(getFormat(ce.left->getWidth()), ce.left, ce.right);
+    break;
+  }
+  case Expr::FOLe: {
+    const FOLeExpr &ce = static_cast<const FOLeExpr &>(e);
+    FloatFormat fmt = getFormat(ce.left->getWidth());
+    result = lor(lowerFOLt(fmt, ce.left, ce.right),
+                 lowerFOEq(fmt, ce.left, ce.right));
+    break;
+  }
+  case Expr::FOGt: {
+    const FOGtExpr &ce = static_cast<const FOGtExpr &>(e);
+    result = lowerFOLt(getFormat(ce.left->getWidth()), ce.right, ce.left);
+    break;
+  }
+  case Expr::FOGe: {
+    const FOGeExpr &ce = static_cast<const FOGeExpr &>(e);
+    FloatFormat fmt = getFormat(ce.left->getWidth());
+    result = lor(lowerFOLt(fmt, ce.right, ce.left),
+                 lowerFOEq(fmt, ce.left, ce.right));
+    break;
+  }
+  case Expr::IsNaN: {
+    const IsNaNExpr &pe = static_cast<const IsNaNExpr &>(e);
+    result = classify(getFormat(pe.expr->getWidth()), pe.expr).isNaN;
+    break;
+  }
+  case Expr::IsInfinite: {
+    const IsInfiniteExpr &pe = static_cast<const IsInfiniteExpr &>(e);
+    result = classify(getFormat(pe.expr->getWidth()), pe.expr).isInf;
+    break;
+  }
+  case Expr::IsNormal: {
+    const IsNormalExpr &pe = static_cast<const IsNormalExpr &>(e);
+    ClassifiedFloat c = classify(getFormat(pe.expr->getWidth()), pe.expr);
+    result = land(lnot(c.exponentIsZero), lnot(lor(c.isNaN, c.isInf)));
+    break;
+  }
+  case Expr::IsSubnormal: {
+    const IsSubnormalExpr &pe = static_cast<const IsSubnormalExpr &>(e);
+    ClassifiedFloat c = classify(getFormat(pe.expr->getWidth()), pe.expr);
+    result = land(c.exponentIsZero, lnot(c.isZero));
+    break;
+  }
+  default:
+    return Action::skipChildren();
+  }
+  return Action::changeTo(result);
+}
@@ -18,6 +18,21 @@ ref<Expr> getFirstExpr(const ExprHashSet &hs) {
   }
   return *e;
 }
+
+/// Returns true if \a re reads the initial contents of its array at a
+/// constant index. This is the case when none of the updates can have written
+/// to the index read, i.e. every update is to a different constant index.
+bool readsInitialContents(const ReadExpr &re) {
+  ConstantExpr *index = dyn_cast<ConstantExpr>(re.index);
+  if (!index)
+    return false;
+  for (const UpdateNode *un = re.updates.head; un; un = un->next) {
+    ConstantExpr *updateIndex = dyn_cast<ConstantExpr>(un->index);
+    if (!updateIndex || updateIndex->getZExtValue() == index->getZExtValue())
+      return false;
+  }
+  return true;
+}
 }
 
 namespace klee {
@@ -119,9 +134,21 @@ FindArrayAckermannizationVisitor::getOrInsertAckermannizationInfo(
   return &((pair.first)->second);
 }
 
-/* This method looks for nested concatenated ReadExpr that don't involve
- * updates or constant arrays that are contigous. We look for ConcatExpr
- * unbalanced to the right that operate on the same array. E.g.
+void FindArrayAckermannizationVisitor::visitUpdates(const UpdateList &ul) {
+  // The updates are translated whenever the read using them is not replaced,
+  // so the arrays read in them must be looked at too. Update lists share
+  // their tails, so stop at the first node we have already seen.
+  for (const UpdateNode *un = ul.head; un; un = un->next) {
+    if (!visitedUpdates.insert(un).second)
+      break;
+    visit(un->index);
+    visit(un->value);
+  }
+}
+
+/* This method looks for nested concatenated ReadExpr of a symbolic array that
+ * are contigous. We look for ConcatExpr unbalanced to the right that operate
+ * on the same array. E.g.
  *
  *                  ConcatExpr
  *                 /       \
@@ -133,6 +160,13 @@ FindArrayAckermannizationVisitor::getOrInsertAckermannizationInfo(
  *                              /        \
  *                             /          \
  *                ReadExpr 1bv32 Ar       ReadExpr 0bv32 Ar
+ *
+ * The reads may go through updates as long as these are to other constant
+ * indices (see `readsInitialContents()`).
+ *
+ * If the pattern does not match the children are visited instead, so that
+ * nested concatenations and the individual reads can still be ackermannized.
+ * Whether the array can be ackermannized at all is decided by `visitRead()`.
  */
 ExprVisitor::Action
 FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
@@ -143,36 +177,23 @@ FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
   std::vector<ref<ReadExpr> > reads;
   ref<Expr> toReplace = ref<Expr>(const_cast<ConcatExpr *>(&ce));
   bool isFirst = true;
+  bool wasInsert = true;
   unsigned MSBitIndex = 0;
   unsigned LSBitIndex = 0;
-  unsigned widthReadSoFar = 0; // In bits
-
-  // I'm sorry about the use of goto here but without having lambdas (we're
-  // using C++03) it's kind of hard to have readable and efficient code that
-  // handles the case when we fail to match without using gotos.
 
   // Try to find the array
   if (ReadExpr *lhsRead = dyn_cast<ReadExpr>(ce.getKid(0))) {
     theArray = lhsRead->updates.root;
     assert(theArray && "theArray cannot be NULL");
 
-    // Try getting existing ArrayAckermannizationInfos
-    bool wasInsert = true;
-    ackInfos = getOrInsertAckermannizationInfo(theArray, &wasInsert);
-    if (!wasInsert && ackInfos->size() == 0) {
-      // We've seen this array before and it can't be ackermannized
-      goto failedMatch;
-    }
-
     // We don't try to ackermannize these because reads of a constant
     // array at a constant index should have been constant folded
     // away already.
     if (theArray->isConstantArray()) {
-      goto failedMatch;
+      return Action::doChildren();
     }
-
   } else {
-    goto failedMatch;
+    return Action::doChildren();
   }
 
   // Collect the ordered ReadExprs
@@ -184,7 +205,7 @@ FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
     if (ReadExpr *lhsre = dyn_cast<ReadExpr>(lhs)) {
       reads.push_back(lhsre);
     } else {
-      goto failedMatch;
+      return Action::doChildren();
     }
 
     // Rhs must be a ConcatExpr or ReadExpr
@@ -195,55 +216,51 @@ FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
       currentConcat = rhsconcat;
       continue;
     }
-    goto failedMatch;
+    return Action::doChildren();
   }
 
   // Go through the ordered reads checking they match the expected pattern
-  assert(isFirst);
   for (std::vector<ref<ReadExpr> >::const_iterator bi = reads.begin(),
                                                    be = reads.end();
        bi != be; ++bi) {
 
     ref<ReadExpr> read = *bi;
-    // Check we are looking at the same array that we found earlier
-    if (theArray != read->updates.root) {
-      goto failedMatch;
+    // Check we are looking at the same array that we found earlier and that
+    // the read isn't affected by the updates.
+    if (theArray != read->updates.root || !readsInitialContents(*read)) {
+      return Action::doChildren();
     }
 
-    // FIXME: Figure out how to handle updates. For now pretend we can't
-    // ackermannize this array
-    if (read->updates.head != NULL) {
-      goto failedMatch;
-    }
-
-    widthReadSoFar += read->getWidth();
-
-    // Check index is constant and that we are doing contiguous reads
-    if (ConstantExpr *index = dyn_cast<ConstantExpr>(read->index)) {
-      if (!isFirst) {
-        // Check we are reading the next region along in the array. This
-        // implementation supports ReadExpr of different sizes although
-        // currently in KLEE they are always 8-bits (1 byte).
-        unsigned difference =
-            LSBitIndex - (index->getZExtValue() * read->getWidth());
-        if (difference != read->getWidth()) {
-          goto failedMatch;
-        }
-      } else {
-        // Compute most significant bit
-        // E.g. if index was 2 and width is 8 then this is a byte read
-        // but the most significant bit read is not 16, it is 23.
-        MSBitIndex = (index->getZExtValue() * read->getWidth()) + (read->getWidth() -1);
+    // Check we are doing contiguous reads
+    ConstantExpr *index = cast<ConstantExpr>(read->index);
+    if (!isFirst) {
+      // Check we are reading the next region along in the array. This
+      // implementation supports ReadExpr of different sizes although
+      // currently in KLEE they are always 8-bits (1 byte).
+      unsigned difference =
+          LSBitIndex - (index->getZExtValue() * read->getWidth());
+      if (difference != read->getWidth()) {
+        return Action::doChildren();
       }
-      // Record the least significant bit read
-      LSBitIndex = index->getZExtValue() * read->getWidth();
     } else {
-      goto failedMatch;
+      // Compute most significant bit
+      // E.g. if index was 2 and width is 8 then this is a byte read
+      // but the most significant bit read is not 16, it is 23.
+      MSBitIndex = (index->getZExtValue() * read->getWidth()) + (read->getWidth() -1);
     }
+    // Record the least significant bit read
+    LSBitIndex = index->getZExtValue() * read->getWidth();
 
     isFirst = false;
   }
 
+  // Try getting existing ArrayAckermannizationInfos
+  ackInfos = getOrInsertAckermannizationInfo(theArray, &wasInsert);
+  if (!wasInsert && ackInfos->size() == 0) {
+    // We've seen this array before and it can't be ackermannized
+    return Action::doChildren();
+  }
+
   // We found a match
   ackInfo.toReplace.insert(toReplace);
   ackInfo.contiguousMSBitIndex = MSBitIndex;
@@ -253,10 +270,11 @@ FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
   // FIXME: This needs re-thinking. We should allow overlapping regions
   // (especially regions where the regions are completly inside another).
   // `ArrayAckermannizationInfo` needs to be worked to convey this information
-  // better. For now disallow overlapping regions.
-  for (std::vector<ArrayAckermannizationInfo>::iterator i = ackInfos->begin(),
-                                                        ie = ackInfos->end();
-       i != ie; ++i) {
+  // better. For now disallow overlapping regions. An overlapping concatenation
+  // falls back to its individual reads, which `visitRead()` will reject.
+  std::vector<ArrayAckermannizationInfo>::iterator i = ackInfos->begin(),
+                                                   ie = ackInfos->end();
+  for (; i != ie; ++i) {
     if (i->hasSameBounds(ackInfo)) {
       // We already have an `ArrayAckermannizationInfo` with the
       // same bounds. Just add this replacement expression to that.
@@ -264,23 +282,23 @@ FindArrayAckermannizationVisitor::visitConcat(const ConcatExpr &ce) {
       // We don't need to check overlap conflicts because we are just
       // adding to an existing `ArrayAckermannizationInfo` where we
       // have already checked for this.
-      return Action::skipChildren();
+      break;
     }
     if (i->overlapsWith(ackInfo)) {
-      goto failedMatch;
+      return Action::doChildren();
     }
   }
+  if (i == ie)
+    ackInfos->push_back(ackInfo);
 
-  ackInfos->push_back(ackInfo);
-  // We know the indices are simple constants so no need to traverse children
+  // We know the indices are simple constants so there is no need to traverse
+  // children, but the updates still have to be looked at.
+  for (std::vector<ref<ReadExpr> >::const_iterator bi = reads.begin(),
+                                                   be = reads.end();
+       bi != be; ++bi) {
+    visitUpdates((*bi)->updates);
+  }
   return Action::skipChildren();
-
-failedMatch :
-  // Any empty list of ArrayAckermannizationInfo indicates that the array cannot
-  // be ackermannized.
-  if (ackInfos)
-    ackInfos->clear();
-  return Action::doChildren();
 }
 
 ExprVisitor::Action
@@ -296,6 +314,8 @@ FindArrayAckermannizationVisitor::visitRead(const ReadExpr &re) {
   // using C++03) it's kind of hard to have readable and efficient code that
   // handles the case when we fail to match without using gotos.
 
+  visitUpdates(re.updates);
+
   if (!wasInsert && ackInfos->size() == 0) {
     // We've seen this array before and it can't be ackermannized.
     goto failedMatch;
@@ -308,21 +328,19 @@ FindArrayAckermannizationVisitor::visitRead(const ReadExpr &re) {
     goto failedMatch;
   }
 
-  // FIXME: Figure out how to handle updates to the array. I think we can
-  // handle this using bitwise masking and or'ing and shifting. For now pretend
-  // that they can't be ackermannized.
-  if (re.updates.head != NULL) {
+  // Updates to other constant indices can be ignored. Anything else would
+  // need the array theory.
+  if (!readsInitialContents(re)) {
     goto failedMatch;
   }
 
-  if (ConstantExpr *index = dyn_cast<ConstantExpr>(re.index)) {
+  {
+    ConstantExpr *index = cast<ConstantExpr>(re.index);
     ackInfo.contiguousLSBitIndex = index->getZExtValue() * re.getWidth();
     ackInfo.contiguousMSBitIndex = ((index->getZExtValue() + 1) * re.getWidth()) -1;
-  } else {
-    goto failedMatch;
   }
 
-  // This is an array read without constants values or updates so we
+  // This is an array read of the initial contents of a symbolic array so we
   // can definitely ackermannize this based on what we've seen so far.
   ackInfo.toReplace.insert(toReplace);
 
@@ -357,7 +375,10 @@ failedMatch :
   return Action::doChildren(); // Traverse index expression
 }
 
-void FindArrayAckermannizationVisitor::clear() { ackermannizationInfo.clear(); }
+void FindArrayAckermannizationVisitor::clear() {
+  ackermannizationInfo.clear();
+  visitedUpdates.clear();
+}
 
 void FindArrayAckermannizationVisitor::dump() const {
   llvm::errs() << "[FindArrayAckermannizationVisitor: "
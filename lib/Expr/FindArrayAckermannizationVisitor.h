@@ -13,6 +13,7 @@
 #include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprVisitor.h"
 #include <map>
+#include <set>
 
 namespace klee {
 
@@ -36,6 +37,10 @@ struct ArrayAckermannizationInfo {
 /// into uses of bitvector variables. Note this visitor doesn't actually
 /// modify the expressions given to it, instead it just looks for
 /// opportunities to apply the reduction.
+///
+/// Reads through an update list can be ackermannized when every update is to
+/// a different constant index. The indices and values of update lists are
+/// visited as well since they may contain reads of other arrays.
 class FindArrayAckermannizationVisitor : public ExprVisitor {
 public:
   FindArrayAckermannizationVisitor(bool recursive);
@@ -58,6 +63,11 @@ public:
 protected:
   Action visitConcat(const ConcatExpr &);
   Action visitRead(const ReadExpr &);
+
+private:
+  /// Update nodes whose index and value have already been visited.
+  std::set<const UpdateNode *> visitedUpdates;
+  void visitUpdates(const UpdateList &ul);
 };
 }
 
@@ -0,0 +1,493 @@
+//===-- FloatRange.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/FloatRange.h"
+#include "klee/util/APFloatEval.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cassert>
+
+using namespace klee;
+using llvm::APFloat;
+
+namespace {
+/// Total order used for interval bounds: IEEE order with -0 below +0.
+bool lessTotal(const APFloat &a, const APFloat &b) {
+  if (a.isZero() && b.isZero())
+    return a.isNegative() && !b.isNegative();
+  return a.compare(b) == APFloat::cmpLessThan;
+}
+
+const APFloat &minTotal(const APFloat &a, const APFloat &b) {
+  return lessTotal(b, a) ? b : a;
+}
+
+const APFloat &maxTotal(const APFloat &a, const APFloat &b) {
+  return lessTotal(a, b) ? b : a;
+}
+
+bool ieeeLess(const APFloat &a, const APFloat &b) {
+  return a.compare(b) == APFloat::cmpLessThan;
+}
+
+bool ieeeLessOrEqual(const APFloat &a, const APFloat &b) {
+  APFloat::cmpResult r = a.compare(b);
+  return r == APFloat::cmpLessThan || r == APFloat::cmpEqual;
+}
+
+bool isNegativeInfinity(const APFloat &v) {
+  return v.isInfinity() && v.isNegative();
+}
+
+bool isPositiveInfinity(const APFloat &v) {
+  return v.isInfinity() && !v.isNegative();
+}
+
+/// Largest value that compares IEEE-less than \a v, which must not be -inf.
+APFloat below(const APFloat &v) {
+  if (v.isZero())
+    return APFloat::getSmallest(v.getSemantics(), /*Negative=*/true);
+  APFloat r(v);
+  r.next(/*nextDown=*/true);
+  return r;
+}
+
+/// Smallest value that compares IEEE-greater than \a v, which must not be
+/// +inf.
+APFloat above(const APFloat &v) {
+  if (v.isZero())
+    return APFloat::getSmallest(v.getSemantics(), /*Negative=*/false);
+  APFloat r(v);
+  r.next(/*nextDown=*/false);
+  return r;
+}
+
+/// Bounds that include both zeros when a comparison against zero is not
+/// strict.
+APFloat lowerInclusive(const APFloat &v) {
+  return v.isZero() ? APFloat::getZero(v.getSemantics(), /*Negative=*/true)
+                    : v;
+}
+
+APFloat upperInclusive(const APFloat &v) {
+  return v.isZero() ? APFloat::getZero(v.getSemantics(), /*Negative=*/false)
+                    : v;
+}
+
+bool hasNativeSqrt(const llvm::fltSemantics &sem) {
+  if (&sem == &(APFloat::IEEEsingle) || &sem == &(APFloat::IEEEdouble))
+    return true;
+#if defined(__x86_64__) || defined(__i386__)
+  if (&sem == &(APFloat::x87DoubleExtended))
+    return true;
+#endif
+  return false;
+}
+
+typedef APFloat::opStatus (APFloat::*BinaryOp)(const APFloat &,
+                                               APFloat::roundingMode);
+
+/// Evaluate a binary operation that is monotonic in each argument on the
+/// corners of the input intervals, rounding outward.
+FloatRange evalCorners(const FloatRange &a, const FloatRange &b,
+                       BinaryOp op) {
+  FloatRange res(a.getSemantics());
+  res = res.withNaN(a.mayBeNaN() || b.mayBeNaN());
+  if (!a.hasNumbers() || !b.hasNumbers())
+    return res;
+
+  const APFloat *as[2] = { &a.min(), &a.max() };
+  const APFloat *bs[2] = { &b.min(), &b.max() };
+  for (unsigned i = 0; i != 2; ++i) {
+    for (unsigned j = 0; j != 2; ++j) {
+      APFloat lo(*as[i]);
+      (lo.*op)(*bs[j], APFloat::rmTowardNegative);
+      if (lo.isNaN()) {
+        // inf - inf, 0 * inf, inf / inf
+        res = res.withNaN(true);
+        continue;
+      }
+      APFloat hi(*as[i]);
+      (hi.*op)(*bs[j], APFloat::rmTowardPositive);
+      res = res.set_union(FloatRange(lo, hi, false));
+    }
+  }
+  return res;
+}
+
+bool containsZero(const FloatRange &r) {
+  const llvm::fltSemantics &sem = r.getSemantics();
+  return r.contains(APFloat::getZero(sem, false)) ||
+         r.contains(APFloat::getZero(sem, true));
+}
+}
+
+/***/
+
+FloatRange::FloatRange(const llvm::fltSemantics &sem)
+    : semantics(&sem), m_min(APFloat::getZero(sem)),
+      m_max(APFloat::getZero(sem)), m_hasNumbers(false), m_mayBeNaN(false) {}
+
+FloatRange::FloatRange(const APFloat &value)
+    : semantics(&value.getSemantics()), m_min(value), m_max(value),
+      m_hasNumbers(!value.isNaN()), m_mayBeNaN(value.isNaN()) {}
+
+FloatRange::FloatRange(const APFloat &_min, const APFloat &_max,
+                       bool mayBeNaN)
+    : semantics(&_min.getSemantics()), m_min(_min), m_max(_max),
+      m_hasNumbers(!lessTotal(_max, _min)), m_mayBeNaN(mayBeNaN) {
+  assert(&_min.getSemantics() == &_max.getSemantics() &&
+         "float semantics mismatch");
+  assert(!_min.isNaN() && !_max.isNaN() && "NaN is not a valid bound");
+}
+
+FloatRange FloatRange::full(const llvm::fltSemantics &sem) {
+  return FloatRange(APFloat::getInf(sem, /*Negative=*/true),
+                    APFloat::getInf(sem, /*Negative=*/false), true);
+}
+
+FloatRange FloatRange::nan(const llvm::fltSemantics &sem) {
+  return FloatRange(sem).withNaN(true);
+}
+
+FloatRange FloatRange::fromUnsigned(const llvm::APInt &min,
+                                    const llvm::APInt &max,
+                                    const llvm::fltSemantics &sem) {
+  APFloat lo = APFloat::getZero(sem), hi = APFloat::getZero(sem);
+  lo.convertFromAPInt(min, /*isSigned=*/false, APFloat::rmTowardNegative);
+  hi.convertFromAPInt(max, /*isSigned=*/false, APFloat::rmTowardPositive);
+  return FloatRange(lo, hi, false);
+}
+
+FloatRange FloatRange::fromSigned(const llvm::APInt &min,
+                                  const llvm::APInt &max,
+                                  const llvm::fltSemantics &sem) {
+  APFloat lo = APFloat::getZero(sem), hi = APFloat::getZero(sem);
+  lo.convertFromAPInt(min, /*isSigned=*/true, APFloat::rmTowardNegative);
+  hi.convertFromAPInt(max, /*isSigned=*/true, APFloat::rmTowardPositive);
+  return FloatRange(lo, hi, false);
+}
+
+void FloatRange::print(llvm::raw_ostream &os) const {
+  if (isEmpty()) {
+    os << "{}";
+    return;
+  }
+  if (m_hasNumbers) {
+    llvm::SmallVector<char, 16> lo, hi;
+    m_min.toString(lo);
+    m_max.toString(hi);
+    os << "[" << std::string(lo.begin(), lo.end()) << ","
+       << std::string(hi.begin(), hi.end()) << "]";
+    if (m_mayBeNaN)
+      os << "|";
+  }
+  if (m_mayBeNaN)
+    os << "NaN";
+}
+
+bool FloatRange::isFixed() const {
+  return m_hasNumbers && !m_mayBeNaN && m_min.bitwiseIsEqual(m_max);
+}
+
+bool FloatRange::contains(const APFloat &value) const {
+  if (value.isNaN())
+    return m_mayBeNaN;
+  return m_hasNumbers && !lessTotal(value, m_min) && !lessTotal(m_max, value);
+}
+
+const APFloat &FloatRange::min() const {
+  assert(m_hasNumbers && "cannot get minimum of range without numbers");
+  return m_min;
+}
+
+const APFloat &FloatRange::max() const {
+  assert(m_hasNumbers && "cannot get maximum of range without numbers");
+  return m_max;
+}
+
+APFloat FloatRange::pickValue() const {
+  assert(!isEmpty() && "cannot pick value from empty range");
+  if (!m_hasNumbers)
+    return APFloat::getNaN(*semantics);
+
+  APFloat zero = APFloat::getZero(*semantics);
+  if (contains(zero))
+    return zero;
+
+  bool losesInfo = false;
+  APFloat one(1.0);
+  one.convert(*semantics, APFloat::rmNearestTiesToEven, &losesInfo);
+  if (contains(one))
+    return one;
+  one.changeSign();
+  if (contains(one))
+    return one;
+
+  if (!m_min.isInfinity())
+    return m_min;
+  return m_max;
+}
+
+FloatRange FloatRange::withNaN(bool mayBeNaN) const {
+  FloatRange res(*this);
+  res.m_mayBeNaN = mayBeNaN;
+  return res;
+}
+
+FloatRange FloatRange::set_union(const FloatRange &b) const {
+  assert(semantics == b.semantics && "float semantics mismatch");
+  FloatRange res(*this);
+  res.m_mayBeNaN = m_mayBeNaN || b.m_mayBeNaN;
+  if (!b.m_hasNumbers)
+    return res;
+  if (!m_hasNumbers) {
+    res.m_min = b.m_min;
+    res.m_max = b.m_max;
+  } else {
+    res.m_min = minTotal(m_min, b.m_min);
+    res.m_max = maxTotal(m_max, b.m_max);
+  }
+  res.m_hasNumbers = true;
+  return res;
+}
+
+FloatRange FloatRange::set_intersection(const FloatRange &b) const {
+  assert(semantics == b.semantics && "float semantics mismatch");
+  FloatRange res(*this);
+  res.m_mayBeNaN = m_mayBeNaN && b.m_mayBeNaN;
+  if (!m_hasNumbers || !b.m_hasNumbers) {
+    res.m_hasNumbers = false;
+    return res;
+  }
+  res.m_min = maxTotal(m_min, b.m_min);
+  res.m_max = minTotal(m_max, b.m_max);
+  res.m_hasNumbers = !lessTotal(res.m_max, res.m_min);
+  return res;
+}
+
+FloatRange FloatRange::add(const FloatRange &b) const {
+  return evalCorners(*this, b, &APFloat::add);
+}
+
+FloatRange FloatRange::sub(const FloatRange &b) const {
+  return evalCorners(*this, b, &APFloat::subtract);
+}
+
+FloatRange FloatRange::mul(const FloatRange &b) const {
+  FloatRange res = evalCorners(*this, b, &APFloat::multiply);
+  // A zero in the interior of one range times an infinity in the other does
+  // not show up on the corners.
+  if ((containsZero(*this) && b.mayBeInfinite()) ||
+      (containsZero(b) && mayBeInfinite()))
+    res = res.withNaN(true);
+  return res;
+}
+
+FloatRange FloatRange::div(const FloatRange &b) const {
+  // Division is not monotonic if the divisor can change sign.
+  if (containsZero(b))
+    return full(*semantics);
+  return evalCorners(*this, b, &APFloat::divide);
+}
+
+FloatRange FloatRange::sqrt() const {
+  FloatRange res = FloatRange(*semantics).withNaN(m_mayBeNaN);
+  if (!m_hasNumbers)
+    return res;
+
+  APFloat negZero = APFloat::getZero(*semantics, /*Negative=*/true);
+  if (lessTotal(m_min, negZero))
+    res = res.withNaN(true);
+  if (lessTotal(m_max, negZero))
+    return res;
+
+  APFloat lo = maxTotal(m_min, negZero);
+  APFloat hi = m_max;
+  if (hasNativeSqrt(*semantics)) {
+    lo = evalSqrt(lo, APFloat::rmTowardNegative);
+    hi = evalSqrt(hi, APFloat::rmTowardPositive);
+  } else {
+    lo = lo.isZero() ? lo : APFloat::getZero(*semantics);
+    hi = APFloat::getInf(*semantics);
+  }
+  return res.set_union(FloatRange(lo, hi, false));
+}
+
+FloatRange FloatRange::abs() const {
+  if (!m_hasNumbers)
+    return *this;
+
+  APFloat lo = m_min, hi = m_max;
+  if (!m_min.isNegative())
+    return *this;
+  if (m_max.isNegative()) {
+    lo.changeSign();
+    hi.changeSign();
+    return FloatRange(hi, lo, m_mayBeNaN);
+  }
+  lo.changeSign();
+  return FloatRange(APFloat::getZero(*semantics), maxTotal(lo, hi),
+                    m_mayBeNaN);
+}
+
+FloatRange FloatRange::convert(const llvm::fltSemantics &sem) const {
+  FloatRange res = FloatRange(sem).withNaN(m_mayBeNaN);
+  if (!m_hasNumbers)
+    return res;
+
+  bool losesInfo = false;
+  APFloat lo(m_min), hi(m_max);
+  lo.convert(sem, APFloat::rmTowardNegative, &losesInfo);
+  hi.convert(sem, APFloat::rmTowardPositive, &losesInfo);
+  return res.set_union(FloatRange(lo, hi, false));
+}
+
+bool FloatRange::mayEqual(const FloatRange &b) const {
+  return m_hasNumbers && b.m_hasNumbers &&
+         ieeeLessOrEqual(m_min, b.m_max) && ieeeLessOrEqual(b.m_min, m_max);
+}
+
+bool FloatRange::mustEqual(const FloatRange &b) const {
+  return !m_mayBeNaN && !b.m_mayBeNaN && m_hasNumbers && b.m_hasNumbers &&
+         m_min.compare(m_max) == APFloat::cmpEqual &&
+         b.m_min.compare(b.m_max) == APFloat::cmpEqual &&
+         m_min.compare(b.m_min) == APFloat::cmpEqual;
+}
+
+bool FloatRange::mayBeLessThan(const FloatRange &b) const {
+  return m_hasNumbers && b.m_hasNumbers && ieeeLess(m_min, b.m_max);
+}
+
+bool FloatRange::mustBeLessThan(const FloatRange &b) const {
+  return !m_mayBeNaN && !b.m_mayBeNaN && m_hasNumbers && b.m_hasNumbers &&
+         ieeeLess(m_max, b.m_min);
+}
+
+bool FloatRange::mayBeLessOrEqual(const FloatRange &b) const {
+  return m_hasNumbers && b.m_hasNumbers && ieeeLessOrEqual(m_min, b.m_max);
+}
+
+bool FloatRange::mustBeLessOrEqual(const FloatRange &b) const {
+  return !m_mayBeNaN && !b.m_mayBeNaN && m_hasNumbers && b.m_hasNumbers &&
+         ieeeLessOrEqual(m_max, b.m_min);
+}
+
+bool FloatRange::mayIntersect(const APFloat &lo, const APFloat &hi) const {
+  return m_hasNumbers && !lessTotal(m_max, lo) && !lessTotal(hi, m_min);
+}
+
+bool FloatRange::isWithin(const APFloat &lo, const APFloat &hi) const {
+  return !m_mayBeNaN && m_hasNumbers && !lessTotal(m_min, lo) &&
+         !lessTotal(hi, m_max);
+}
+
+bool FloatRange::mayBeInfinite() const {
+  return m_hasNumbers && (m_min.isInfinity() || m_max.isInfinity());
+}
+
+bool FloatRange::mustBeInfinite() const {
+  return !m_mayBeNaN && m_hasNumbers && m_min.isInfinity() &&
+         m_max.isInfinity() && m_min.isNegative() == m_max.isNegative();
+}
+
+bool FloatRange::mayBeNormal() const {
+  APFloat p = APFloat::getSmallestNormalized(*semantics, false);
+  APFloat q = APFloat::getLargest(*semantics, false);
+  APFloat np = APFloat::getSmallestNormalized(*semantics, true);
+  APFloat nq = APFloat::getLargest(*semantics, true);
+  return mayIntersect(p, q) || mayIntersect(nq, np);
+}
+
+bool FloatRange::mustBeNormal() const {
+  APFloat p = APFloat::getSmallestNormalized(*semantics, false);
+  APFloat q = APFloat::getLargest(*semantics, false);
+  APFloat np = APFloat::getSmallestNormalized(*semantics, true);
+  APFloat nq = APFloat::getLargest(*semantics, true);
+  return isWithin(p, q) || isWithin(nq, np);
+}
+
+bool FloatRange::mayBeSubnormal() const {
+  APFloat p = APFloat::getSmallest(*semantics, false);
+  APFloat q = below(APFloat::getSmallestNormalized(*semantics, false));
+  APFloat np = APFloat::getSmallest(*semantics, true);
+  APFloat nq = above(APFloat::getSmallestNormalized(*semantics, true));
+  return mayIntersect(p, q) || mayIntersect(nq, np);
+}
+
+bool FloatRange::mustBeSubnormal() const {
+  APFloat p = APFloat::getSmallest(*semantics, false);
+  APFloat q = below(APFloat::getSmallestNormalized(*semantics, false));
+  APFloat np = APFloat::getSmallest(*semantics, true);
+  APFloat nq = above(APFloat::getSmallestNormalized(*semantics, true));
+  return isWithin(p, q) || isWithin(nq, np);
+}
+
+FloatRange FloatRange::restrictToEqual(const FloatRange &b) const {
+  if (!b.m_hasNumbers)
+    return FloatRange(*semantics);
+  return withNaN(false).set_intersection(FloatRange(
+      lowerInclusive(b.m_min), upperInclusive(b.m_max), false));
+}
+
+FloatRange FloatRange::restrictToLessThan(const FloatRange &b) const {
+  if (!b.m_hasNumbers || isNegativeInfinity(b.m_max))
+    return FloatRange(*semantics);
+  return withNaN(false).set_intersection(
+      FloatRange(APFloat::getInf(*semantics, true), below(b.m_max), false));
+}
+
+FloatRange FloatRange::restrictToLessOrEqual(const FloatRange &b) const {
+  if (!b.m_hasNumbers)
+    return FloatRange(*semantics);
+  return withNaN(false).set_intersection(FloatRange(
+      APFloat::getInf(*semantics, true), upperInclusive(b.m_max), false));
+}
+
+FloatRange FloatRange::restrictToGreaterThan(const FloatRange &b) const {
+  if (!b.m_hasNumbers || isPositiveInfinity(b.m_min))
+    return FloatRange(*semantics);
+  return withNaN(false).set_intersection(
+      FloatRange(above(b.m_min), APFloat::getInf(*semantics, false), false));
+}
+
+FloatRange FloatRange::restrictToGreaterOrEqual(const FloatRange &b) const {
+  if (!b.m_hasNumbers)
+    return FloatRange(*semantics);
+  return withNaN(false).set_intersection(FloatRange(
+      lowerInclusive(b.m_min), APFloat::getInf(*semantics, false), false));
+}
+
+FloatRange FloatRange::restrictToInfinite(bool infinite) const {
+  if (!m_hasNumbers)
+    return infinite ? FloatRange(*semantics) : *this;
+
+  if (infinite) {
+    bool low = isNegativeInfinity(m_min), high = isPositiveInfinity(m_max);
+    if (low && high)
+      return withNaN(false);
+    if (low)
+      return FloatRange(m_min, m_min, false);
+    if (high)
+      return FloatRange(m_max, m_max, false);
+    return FloatRange(*semantics);
+  }
+
+  APFloat lo = isNegativeInfinity(m_min)
+                   ? APFloat::getLargest(*semantics, /*Negative=*/true)
+                   : m_min;
+  APFloat hi = isPositiveInfinity(m_max)
+                   ? APFloat::getLargest(*semantics, /*Negative=*/false)
+                   : m_max;
+  // If the range only held one infinity the bounds are now inverted, which
+  // leaves no numbers.
+  return FloatRange(lo, hi, m_mayBeNaN);
+}
@@ -194,8 +194,20 @@ void Lexer::SkipToEndOfLine() {
 }
 
 Token &Lexer::LexNumber(Token &Result) {
-  while (isalnum(PeekNextChar()) || PeekNextChar()=='_')
-    GetNextChar();
+  for (;;) {
+    int Char = PeekNextChar();
+    // Floating point constants have a fraction and a signed exponent, as in
+    // 1.5E+0 or 0x1.8p-3.
+    if (isalnum(Char) || Char == '_' || Char == '.') {
+      GetNextChar();
+    } else if ((Char == '+' || Char == '-') &&
+               (BufferPos[-1] == 'E' || BufferPos[-1] == 'e' ||
+                BufferPos[-1] == 'p' || BufferPos[-1] == 'P')) {
+      GetNextChar();
+    } else {
+      break;
+    }
+  }
   return SetTokenKind(Result, Token::Number);
 }
 
@@ -14,10 +14,12 @@
 #include "klee/Config/Version.h"
 #include "klee/Constraints.h"
 #include "klee/ExprBuilder.h"
+#include "klee/Internal/Support/RoundingModeUtil.h"
 #include "klee/Solver.h"
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ArrayCache.h"
 
+#include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
@@ -296,10 +298,12 @@ namespace {
     ExprResult ParseParenExpr(TypeResult ExpectedType);
     ExprResult ParseUnaryParenExpr(const Token &Name,
                                    unsigned Kind, bool IsFixed,
-                                   Expr::Width ResTy);
+                                   Expr::Width ResTy,
+                                   llvm::APFloat::roundingMode RM);
     ExprResult ParseBinaryParenExpr(const Token &Name,
                                     unsigned Kind, bool IsFixed,
-                                    Expr::Width ResTy);
+                                    Expr::Width ResTy,
+                                    llvm::APFloat::roundingMode RM);
     ExprResult ParseSelectParenExpr(const Token &Name, Expr::Width ResTy);
     ExprResult ParseConcatParenExpr(const Token &Name, Expr::Width ResTy);
     ExprResult ParseExtractParenExpr(const Token &Name, Expr::Width ResTy);
@@ -311,6 +315,8 @@ namespace {
                                 ExprResult &LHS, ExprResult &RHS);
     ExprResult ParseNumber(Expr::Width Width);
     ExprResult ParseNumberToken(Expr::Width Width, const Token &Tok);
+    ExprResult ParseFloatToken(Expr::Width Width, const Token &Tok);
+    bool ParseRoundingMode(llvm::APFloat::roundingMode &RM);
 
     VersionResult ParseVersionSpecifier();
     VersionResult ParseVersion();
@@ -876,6 +882,37 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
       return SetOK(Expr::SExt, false, 1);
     if (memcmp(Tok.start, "ZExt", 4) == 0)
       return SetOK(Expr::ZExt, false, 1);
+
+    if (memcmp(Tok.start, "FAdd", 4) == 0)
+      return SetOK(Expr::FAdd, true, 2);
+    if (memcmp(Tok.start, "FSub", 4) == 0)
+      return SetOK(Expr::FSub, true, 2);
+    if (memcmp(Tok.start, "FMul", 4) == 0)
+      return SetOK(Expr::FMul, true, 2);
+    if (memcmp(Tok.start, "FDiv", 4) == 0)
+      return SetOK(Expr::FDiv, true, 2);
+    if (memcmp(Tok.start, "FAbs", 4) == 0)
+      return SetOK(Expr::FAbs, true, 1);
+
+    if (memcmp(Tok.start, "FOEq", 4) == 0)
+      return SetOK(Expr::FOEq, false, 2);
+    if (memcmp(Tok.start, "FOLt", 4) == 0)
+      return SetOK(Expr::FOLt, false, 2);
+    if (memcmp(Tok.start, "FOLe", 4) == 0)
+      return SetOK(Expr::FOLe, false, 2);
+    if (memcmp(Tok.start, "FOGt", 4) == 0)
+      return SetOK(Expr::FOGt, false, 2);
+    if (memcmp(Tok.start, "FOGe", 4) == 0)
+      return SetOK(Expr::FOGe, false, 2);
+    break;
+
+  case 5:
+    if (memcmp(Tok.start, "FPExt", 5) == 0)
+      return SetOK(Expr::FPExt, false, 1);
+    if (memcmp(Tok.start, "FSqrt", 5) == 0)
+      return SetOK(Expr::FSqrt, true, 1);
+    if (memcmp(Tok.start, "IsNaN", 5) == 0)
+      return SetOK(Expr::IsNaN, false, 1);
     break;
     
   case 6:
@@ -883,6 +920,15 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
       return SetOK(eMacroKind_Concat, false, -1); 
     if (memcmp(Tok.start, "Select", 6) == 0)
       return SetOK(Expr::Select, false, 3);
+
+    if (memcmp(Tok.start, "FPToUI", 6) == 0)
+      return SetOK(Expr::FPToUI, false, 1);
+    if (memcmp(Tok.start, "FPToSI", 6) == 0)
+      return SetOK(Expr::FPToSI, false, 1);
+    if (memcmp(Tok.start, "UIToFP", 6) == 0)
+      return SetOK(Expr::UIToFP, false, 1);
+    if (memcmp(Tok.start, "SIToFP", 6) == 0)
+      return SetOK(Expr::SIToFP, false, 1);
     break;
     
   case 7:
@@ -892,6 +938,23 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
       return SetOK(eMacroKind_ReadLSB, true, -1);
     if (memcmp(Tok.start, "ReadMSB", 7) == 0)
       return SetOK(eMacroKind_ReadMSB, true, -1);
+    if (memcmp(Tok.start, "FPTrunc", 7) == 0)
+      return SetOK(Expr::FPTrunc, false, 1);
+    break;
+
+  case 8:
+    if (memcmp(Tok.start, "IsNormal", 8) == 0)
+      return SetOK(Expr::IsNormal, false, 1);
+    break;
+
+  case 10:
+    if (memcmp(Tok.start, "IsInfinite", 10) == 0)
+      return SetOK(Expr::IsInfinite, false, 1);
+    break;
+
+  case 11:
+    if (memcmp(Tok.start, "IsSubnormal", 11) == 0)
+      return SetOK(Expr::IsSubnormal, false, 1);
     break;
   }
 
@@ -899,6 +962,41 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
 #undef SetOK
 }
 
+/// HasRoundingMode - True if expressions of the given kind are written
+/// with a rounding mode after their type.
+static bool HasRoundingMode(unsigned Kind) {
+  switch (Kind) {
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// IsFloatWidth - True if there is a floating point format of the given
+/// width.
+static bool IsFloatWidth(Expr::Width W) {
+  switch (W) {
+  case Expr::Int16:
+  case Expr::Int32:
+  case Expr::Int64:
+  case Expr::Fl80:
+  case Expr::Int128:
+    return true;
+  default:
+    return false;
+  }
+}
+
 /// ParseParenExpr - Parse a parenthesized expression with the given
 /// \arg ExpectedType. \arg ExpectedType can be invalid if the type
 /// cannot be inferred from the context.
@@ -971,6 +1069,13 @@ ExprResult ParserImpl::ParseParenExpr(TypeResult FIXME_UNUSED) {
     return ExprResult();
   }
 
+  // Floating point operations name their rounding mode after the type.
+  llvm::APFloat::roundingMode RM = llvm::APFloat::rmNearestTiesToEven;
+  if (HasRoundingMode(ExprKind) && !ParseRoundingMode(RM)) {
+    SkipUntilRParen();
+    return ExprResult();
+  }
+
   // See if we have to parse this form specially.
   if (NumArgs == -1) {
     switch (ExprKind) {
@@ -994,9 +1099,9 @@ ExprResult ParserImpl::ParseParenExpr(TypeResult FIXME_UNUSED) {
 
   switch (NumArgs) {
   case 1:
-    return ParseUnaryParenExpr(Name, ExprKind, IsFixed, ResTy);
+    return ParseUnaryParenExpr(Name, ExprKind, IsFixed, ResTy, RM);
   case 2:
-    return ParseBinaryParenExpr(Name, ExprKind, IsFixed, ResTy);
+    return ParseBinaryParenExpr(Name, ExprKind, IsFixed, ResTy, RM);
   case 3:
     if (ExprKind == Expr::Select)
       return ParseSelectParenExpr(Name, ResTy);
@@ -1006,9 +1111,24 @@ ExprResult ParserImpl::ParseParenExpr(TypeResult FIXME_UNUSED) {
   }
 }
 
+/// ParseRoundingMode - Parse the rounding mode of a floating point
+/// expression.
+///
+/// rounding-mode = 'RNE' | 'RNA' | 'RU' | 'RD' | 'RZ'
+bool ParserImpl::ParseRoundingMode(llvm::APFloat::roundingMode &RM) {
+  if (Tok.kind != Token::Identifier ||
+      !StringToLLVMRoundingMode(StringRef(Tok.start, Tok.length), RM)) {
+    Error("expected rounding mode.");
+    return false;
+  }
+  ConsumeToken();
+  return true;
+}
+
 ExprResult ParserImpl::ParseUnaryParenExpr(const Token &Name,
                                            unsigned Kind, bool IsFixed,
-                                           Expr::Width ResTy) {
+                                           Expr::Width ResTy,
+                                           llvm::APFloat::roundingMode RM) {
   if (Tok.kind == Token::RParen) {
     Error("unexpected end of arguments.", Name);
     ConsumeRParen();
@@ -1021,6 +1141,38 @@ ExprResult ParserImpl::ParseUnaryParenExpr(const Token &Name,
 
   ExpectRParen("unexpected argument in unary expression.");  
   ExprHandle E = Arg.get();
+
+  // Check the types of floating point operands and results.
+  switch (Kind) {
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FSqrt:
+  case Expr::FAbs:
+    if (!IsFloatWidth(E->getWidth()) || !IsFloatWidth(ResTy)) {
+      Error("invalid floating point type.", Name);
+      return Builder->Constant(0, ResTy);
+    }
+    break;
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal:
+    if (!IsFloatWidth(E->getWidth())) {
+      Error("invalid floating point type.", Name);
+      return Builder->Constant(0, ResTy);
+    }
+    break;
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+    if (!IsFloatWidth(ResTy)) {
+      Error("invalid floating point type.", Name);
+      return Builder->Constant(0, ResTy);
+    }
+    break;
+  }
+
   switch (Kind) {
   case eMacroKind_Neg:
     return Builder->Sub(Builder->Constant(0, E->getWidth()), E);
@@ -1033,6 +1185,30 @@ ExprResult ParserImpl::ParseUnaryParenExpr(const Token &Name,
   case Expr::ZExt:
     // FIXME: Type check arguments.
     return Builder->ZExt(E, ResTy);
+  case Expr::FPExt:
+    return Builder->FPExt(E, ResTy);
+  case Expr::FPTrunc:
+    return Builder->FPTrunc(E, ResTy, RM);
+  case Expr::FPToUI:
+    return Builder->FPToUI(E, ResTy, RM);
+  case Expr::FPToSI:
+    return Builder->FPToSI(E, ResTy, RM);
+  case Expr::UIToFP:
+    return Builder->UIToFP(E, ResTy, RM);
+  case Expr::SIToFP:
+    return Builder->SIToFP(E, ResTy, RM);
+  case Expr::FSqrt:
+    return Builder->FSqrt(E, RM);
+  case Expr::FAbs:
+    return Builder->FAbs(E);
+  case Expr::IsNaN:
+    return Builder->IsNaN(E);
+  case Expr::IsInfinite:
+    return Builder->IsInfinite(E);
+  case Expr::IsNormal:
+    return Builder->IsNormal(E);
+  case Expr::IsSubnormal:
+    return Builder->IsSubnormal(E);
   default:
     Error("internal error, unhandled kind.", Name);
     return Builder->Constant(0, ResTy);
@@ -1099,7 +1275,8 @@ void ParserImpl::ParseMatchedBinaryArgs(const Token &Name,
 
 ExprResult ParserImpl::ParseBinaryParenExpr(const Token &Name,
                                            unsigned Kind, bool IsFixed,
-                                           Expr::Width ResTy) {
+                                           Expr::Width ResTy,
+                                           llvm::APFloat::roundingMode RM) {
   ExprResult LHS, RHS;
   ParseMatchedBinaryArgs(Name, IsFixed ? TypeResult(ResTy) : TypeResult(), 
                          LHS, RHS);
@@ -1112,6 +1289,14 @@ ExprResult ParserImpl::ParseBinaryParenExpr(const Token &Name,
     return Builder->Constant(0, ResTy);
   }
 
+  if ((Kind >= Expr::FAdd && Kind <= Expr::FDiv) ||
+      (Kind >= Expr::FOEq && Kind <= Expr::FOGe)) {
+    if (!IsFloatWidth(LHS_E->getWidth())) {
+      Error("invalid floating point type.", Name);
+      return Builder->Constant(0, ResTy);
+    }
+  }
+
   switch (Kind) {    
   case Expr::Add: return Builder->Add(LHS_E, RHS_E);
   case Expr::Sub: return Builder->Sub(LHS_E, RHS_E);
@@ -1139,6 +1324,17 @@ ExprResult ParserImpl::ParseBinaryParenExpr(const Token &Name,
   case Expr::Sle: return Builder->Sle(LHS_E, RHS_E);
   case Expr::Sgt: return Builder->Sgt(LHS_E, RHS_E);
   case Expr::Sge: return Builder->Sge(LHS_E, RHS_E);
+
+  case Expr::FAdd: return Builder->FAdd(LHS_E, RHS_E, RM);
+  case Expr::FSub: return Builder->FSub(LHS_E, RHS_E, RM);
+  case Expr::FMul: return Builder->FMul(LHS_E, RHS_E, RM);
+  case Expr::FDiv: return Builder->FDiv(LHS_E, RHS_E, RM);
+
+  case Expr::FOEq: return Builder->FOEq(LHS_E, RHS_E);
+  case Expr::FOLt: return Builder->FOLt(LHS_E, RHS_E);
+  case Expr::FOLe: return Builder->FOLe(LHS_E, RHS_E);
+  case Expr::FOGt: return Builder->FOGt(LHS_E, RHS_E);
+  case Expr::FOGe: return Builder->FOGe(LHS_E, RHS_E);
   default:
     Error("FIXME: unhandled kind.", Name);
     return Builder->Constant(0, ResTy);
@@ -1422,6 +1618,60 @@ VersionResult ParserImpl::ParseVersion() {
   return Base;
 }
 
+/// IsFloatLiteral - True if the number token has a fraction or an exponent,
+/// as printed for floating point constants.
+static bool IsFloatLiteral(const char *S, unsigned N) {
+  if (N && (S[0] == '+' || S[0] == '-'))
+    ++S, --N;
+  bool IsHex = N >= 2 && S[0] == '0' && S[1] == 'x';
+  for (unsigned i = 0; i != N; ++i) {
+    if (S[i] == '.')
+      return true;
+    if (IsHex ? (S[i] == 'p' || S[i] == 'P') : (S[i] == 'e' || S[i] == 'E'))
+      return true;
+  }
+  return false;
+}
+
+/// IsValidFloatLiteral - Check the syntax of a floating point number, which
+/// APFloat does not diagnose.
+static bool IsValidFloatLiteral(const char *S, unsigned N) {
+  const char *End = S + N;
+  if (S != End && (*S == '+' || *S == '-'))
+    ++S;
+  bool IsHex = End - S >= 2 && S[0] == '0' && S[1] == 'x';
+  if (IsHex)
+    S += 2;
+
+  unsigned Digits = 0;
+  bool SeenDot = false;
+  for (; S != End; ++S) {
+    if (*S == '.' && !SeenDot)
+      SeenDot = true;
+    else if (IsHex ? isxdigit(*S) : isdigit(*S))
+      ++Digits;
+    else
+      break;
+  }
+  if (!Digits)
+    return false;
+
+  // Hexadecimal floats require an exponent.
+  if (S == End)
+    return !IsHex;
+  if (IsHex ? (*S != 'p' && *S != 'P') : (*S != 'e' && *S != 'E'))
+    return false;
+  ++S;
+  if (S != End && (*S == '+' || *S == '-'))
+    ++S;
+  if (S == End)
+    return false;
+  for (; S != End; ++S)
+    if (!isdigit(*S))
+      return false;
+  return true;
+}
+
 /// ParseNumber - Parse a number of the given type.
 ExprResult ParserImpl::ParseNumber(Expr::Width Type) {
   ExprResult Res = ParseNumberToken(Type, Tok);
@@ -1437,6 +1687,9 @@ ExprResult ParserImpl::ParseNumberToken(Expr::Width Type, const Token &Tok) {
   unsigned Radix = 10, RadixBits = 4;
   bool HasMinus = false;
 
+  if (IsFloatLiteral(S, N))
+    return ParseFloatToken(Type, Tok);
+
   // Detect +/- (a number token cannot have both).
   if (S[0] == '+') {
     ++S;
@@ -1512,6 +1765,28 @@ ExprResult ParserImpl::ParseNumberToken(Expr::Width Type, const Token &Tok) {
   return ExprResult(Builder->Constant(Val));
 }
 
+/// ParseFloatToken - Parse a floating point number of the given type from
+/// the given token.
+///
+/// float = [+-]? [0-9]* '.'? [0-9]* ([eE] [+-]? [0-9]+)?
+/// float = [+-]? '0x' [0-9a-fA-F]* '.'? [0-9a-fA-F]* [pP] [+-]? [0-9]+
+ExprResult ParserImpl::ParseFloatToken(Expr::Width Type, const Token &Tok) {
+  if (!IsFloatWidth(Type)) {
+    Error("floating point constant of non floating point type.", Tok);
+    return Builder->Constant(0, Type);
+  }
+  if (!IsValidFloatLiteral(Tok.start, Tok.length)) {
+    Error("invalid floating point constant.", Tok);
+    return Builder->Constant(0, Type);
+  }
+
+  APFloat Val(ConstantExpr::widthToFloatSemantics(Type));
+  Val.convertFromString(StringRef(Tok.start, Tok.length),
+                        APFloat::rmNearestTiesToEven);
+  // Build the constant directly so that it is printed as a float again.
+  return ExprResult(ConstantExpr::alloc(Val));
+}
+
 /// ParseTypeSpecifier - Parse a type specifier.
 ///
 /// type = w[0-9]+
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Expr.h"
+#include "klee/util/Atomic.h"
 
 #include <cassert>
 
@@ -30,7 +31,7 @@ UpdateNode::UpdateNode(const UpdateNode *_next,
   */
   computeHash();
   if (next) {
-    ++next->refCount;
+    atomicIncrement(next->refCount);
     size = 1 + next->size;
   }
   else size = 1;
@@ -64,13 +65,13 @@ unsigned UpdateNode::computeHash() {
 UpdateList::UpdateList(const Array *_root, const UpdateNode *_head)
   : root(_root),
     head(_head) {
-  if (head) ++head->refCount;
+  if (head) atomicIncrement(head->refCount);
 }
 
 UpdateList::UpdateList(const UpdateList &b)
   : root(b.root),
     head(b.head) {
-  if (head) ++head->refCount;
+  if (head) atomicIncrement(head->refCount);
 }
 
 UpdateList::~UpdateList() {
@@ -127,7 +128,7 @@ void UpdateList::tryFreeNodes() {
   //  nullptr
   //  ^Head0
   //
-  while (head && --head->refCount==0) {
+  while (head && atomicDecrement(head->refCount) == 0) {
     const UpdateNode *n = head->next;
     delete head;
     head = n;
@@ -135,7 +136,7 @@ void UpdateList::tryFreeNodes() {
 }
 
 UpdateList &UpdateList::operator=(const UpdateList &b) {
-  if (b.head) ++b.head->refCount;
+  if (b.head) atomicIncrement(b.head->refCount);
   // Drop reference to the current head and free a chain of nodes
   // if we are the only UpdateList referencing them
   tryFreeNodes();
@@ -151,9 +152,12 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
     assert(root->getRange() == value->getWidth());
   }
 
-  if (head) --head->refCount;
-  head = new UpdateNode(head, index, value);
-  ++head->refCount;
+  // The new node takes its reference to the old head before we drop ours, so
+  // the old head stays alive even if another list releases it concurrently.
+  const UpdateNode *newHead = new UpdateNode(head, index, value);
+  if (head) atomicDecrement(head->refCount);
+  head = newHead;
+  atomicIncrement(head->refCount);
 }
 
 int UpdateList::compare(const UpdateList &b) const {
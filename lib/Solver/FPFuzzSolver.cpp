@@ -0,0 +1,507 @@
+//===-- FPFuzzSolver.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An incomplete solver that tries to find models for floating-point queries
+// by concretely evaluating the query under candidate assignments. Candidates
+// are produced by seeded random, boundary value and mutational search over
+// the bytes of the symbolic arrays. Only satisfying assignments are ever
+// reported, so a query for which no model is found within the budget simply
+// falls through to the next solver in the chain.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "fp-fuzz-solver"
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverStats.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/Internal/ADT/RNG.h"
+#include "klee/Internal/Support/Debug.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<unsigned> FPFuzzMaxIterations(
+    "fp-fuzz-solver-max-iterations",
+    llvm::cl::desc("Maximum number of candidate assignments the floating "
+                   "point fuzz solver evaluates per query before deferring "
+                   "to the next solver (default=1000)"),
+    llvm::cl::init(1000));
+
+llvm::cl::opt<unsigned> FPFuzzSeed(
+    "fp-fuzz-solver-seed",
+    llvm::cl::desc("Seed for the floating point fuzz solver's random number "
+                   "generator. The generator is reseeded for every query so "
+                   "results do not depend on query order (default=5489)"),
+    llvm::cl::init(5489));
+}
+
+/***/
+
+namespace {
+
+/// A little-endian region of a symbolic array that is used as a
+/// floating-point operand somewhere in the query.
+struct FPSlot {
+  const Array *array;
+  unsigned offset;
+  Expr::Width width;
+
+  FPSlot(const Array *_array, unsigned _offset, Expr::Width _width)
+      : array(_array), offset(_offset), width(_width) {}
+
+  bool operator<(const FPSlot &b) const {
+    if (array != b.array)
+      return array < b.array;
+    if (offset != b.offset)
+      return offset < b.offset;
+    return width < b.width;
+  }
+};
+
+/// Returns true if the kids of an expression of kind \a k are floating-point
+/// values.
+bool hasFPOperands(Expr::Kind k) {
+  switch (k) {
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::FSqrt:
+  case Expr::FAbs:
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FOEq:
+  case Expr::FOLt:
+  case Expr::FOLe:
+  case Expr::FOGt:
+  case Expr::FOGe:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool flattenConcat(const ref<Expr> &e, std::vector<const ReadExpr *> &reads) {
+  if (const ConcatExpr *ce = dyn_cast<ConcatExpr>(e)) {
+    return flattenConcat(ce->getLeft(), reads) &&
+           flattenConcat(ce->getRight(), reads);
+  }
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    reads.push_back(re);
+    return true;
+  }
+  return false;
+}
+
+/// FPQueryAnalysis - Walks a query and collects the array regions read as
+/// floating-point operands together with the floating-point constants the
+/// query compares against or computes with.
+class FPQueryAnalysis {
+  ExprHashSet visited;
+  std::set<FPSlot> seenSlots;
+
+  void visitOperand(const ref<Expr> &e) {
+    const llvm::fltSemantics &sem =
+        ConstantExpr::widthToFloatSemantics(e->getWidth());
+    if (&sem == &(llvm::APFloat::Bogus))
+      return;
+
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+      constants.push_back(CE->getAPFloatValue());
+      return;
+    }
+
+    // Match the little-endian byte concatenation that the executor produces
+    // for a load of a floating-point value from a symbolic object.
+    std::vector<const ReadExpr *> reads;
+    if (!flattenConcat(e, reads) || reads.empty())
+      return;
+    const Array *array = reads.back()->updates.root;
+    if (array->isConstantArray())
+      return;
+    const ConstantExpr *base = dyn_cast<ConstantExpr>(reads.back()->index);
+    if (!base)
+      return;
+    uint64_t first = base->getZExtValue();
+    unsigned n = reads.size();
+    for (unsigned i = 0; i != n; ++i) {
+      const ReadExpr *re = reads[i];
+      const ConstantExpr *index = dyn_cast<ConstantExpr>(re->index);
+      if (re->updates.root != array || re->getWidth() != array->getRange() ||
+          !index || index->getZExtValue() != first + (n - 1 - i))
+        return;
+    }
+    if (first + n > array->size)
+      return;
+
+    // Slots are byte offsets into the array's value.
+    FPSlot slot(array, first * (array->getRange() / 8), e->getWidth());
+    if (seenSlots.insert(slot).second)
+      slots.push_back(slot);
+  }
+
+public:
+  bool hasFP;
+  std::vector<FPSlot> slots;
+  std::vector<llvm::APFloat> constants;
+
+  FPQueryAnalysis() : hasFP(false) {}
+
+  void visit(const ref<Expr> &e) {
+    if (isa<ConstantExpr>(e) || !visited.insert(e).second)
+      return;
+
+    Expr::Kind k = e->getKind();
+    if (hasFPOperands(k) || k == Expr::UIToFP || k == Expr::SIToFP)
+      hasFP = true;
+
+    for (unsigned i = 0, N = e->getNumKids(); i != N; ++i) {
+      ref<Expr> kid = e->getKid(i);
+      if (hasFPOperands(k))
+        visitOperand(kid);
+      visit(kid);
+    }
+  }
+};
+
+/***/
+
+class FPFuzzSolver : public IncompleteSolver {
+  RNG rng;
+
+  const llvm::fltSemantics &getSemantics(const FPSlot &slot) const {
+    return ConstantExpr::widthToFloatSemantics(slot.width);
+  }
+
+  llvm::APFloat readSlot(const Assignment &a, const FPSlot &slot) const;
+  void writeSlot(Assignment &a, const FPSlot &slot, const llvm::APFloat &v);
+  void writeSlot(Assignment &a, const FPSlot &slot, const llvm::APInt &bits);
+
+  llvm::APFloat getBoundaryValue(const llvm::fltSemantics &sem);
+  bool mutateSlot(Assignment &a, const FPQueryAnalysis &analysis,
+                  const FPSlot &slot);
+  bool mutateByte(Assignment &a, const Array *array);
+
+  unsigned score(const Assignment &a, const std::vector<ref<Expr> > &goals);
+
+  /// Search for an assignment under which every expression in \a goals is
+  /// true. Returns false if the query has no floating-point operations or
+  /// the budget was exhausted.
+  bool findModel(const Query &query, const std::vector<ref<Expr> > &goals,
+                 const std::vector<const Array *> &objects, Assignment &model);
+
+public:
+  FPFuzzSolver() : rng(FPFuzzSeed) {}
+
+  IncompleteSolver::PartialValidity computeTruth(const Query &);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+
+llvm::APFloat FPFuzzSolver::readSlot(const Assignment &a,
+                                     const FPSlot &slot) const {
+  Assignment::bindings_ty::const_iterator it = a.bindings.find(slot.array);
+  assert(it != a.bindings.end() && "unbound array");
+  const std::vector<unsigned char> &bytes = it->second;
+  llvm::APInt bits(slot.width, 0);
+  for (unsigned i = 0; i != slot.width / 8; ++i)
+    bits |= llvm::APInt(slot.width, bytes[slot.offset + i]).shl(8 * i);
+  return llvm::APFloat(getSemantics(slot), bits);
+}
+
+void FPFuzzSolver::writeSlot(Assignment &a, const FPSlot &slot,
+                             const llvm::APInt &bits) {
+  assert(bits.getBitWidth() == slot.width && "width mismatch");
+  std::vector<unsigned char> &bytes = a.bindings[slot.array];
+  for (unsigned i = 0; i != slot.width / 8; ++i)
+    bytes[slot.offset + i] =
+        (unsigned char)bits.lshr(8 * i).trunc(8).getZExtValue();
+}
+
+void FPFuzzSolver::writeSlot(Assignment &a, const FPSlot &slot,
+                             const llvm::APFloat &v) {
+  writeSlot(a, slot, v.bitcastToAPInt());
+}
+
+llvm::APFloat FPFuzzSolver::getBoundaryValue(const llvm::fltSemantics &sem) {
+  bool negative = rng.getBool();
+  switch (rng.getInt32() % 9) {
+  case 0:
+    return llvm::APFloat::getZero(sem, negative);
+  case 1:
+    return llvm::APFloat::getInf(sem, negative);
+  case 2:
+    return llvm::APFloat::getNaN(sem, negative);
+  case 3:
+    // Smallest subnormal
+    return llvm::APFloat::getSmallest(sem, negative);
+  case 4: {
+    // Largest subnormal
+    llvm::APFloat v = llvm::APFloat::getSmallestNormalized(sem, negative);
+    v.next(/*nextDown=*/!negative);
+    return v;
+  }
+  case 5:
+    return llvm::APFloat::getSmallestNormalized(sem, negative);
+  case 6:
+    return llvm::APFloat::getLargest(sem, negative);
+  default: {
+    // +/-1.0 and +/-2.0
+    bool losesInfo = false;
+    llvm::APFloat v(rng.getBool() ? 1.0 : 2.0);
+    v.convert(sem, llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+    if (negative)
+      v.changeSign();
+    return v;
+  }
+  }
+}
+
+bool FPFuzzSolver::mutateSlot(Assignment &a, const FPQueryAnalysis &analysis,
+                              const FPSlot &slot) {
+  const llvm::fltSemantics &sem = getSemantics(slot);
+  bool losesInfo = false;
+  unsigned strategy = rng.getInt32() % 10;
+
+  if ((strategy == 4 || strategy == 5 || strategy == 6) &&
+      analysis.constants.empty())
+    strategy = 0;
+
+  switch (strategy) {
+  case 0:
+  case 1:
+  case 2:
+  case 3:
+    writeSlot(a, slot, getBoundaryValue(sem));
+    return true;
+  case 4:
+  case 5:
+  case 6: {
+    // A constant from the query, or one of its ULP neighbours.
+    llvm::APFloat v =
+        analysis.constants[rng.getInt32() % analysis.constants.size()];
+    v.convert(sem, llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+    if (strategy != 4 && !v.isNaN())
+      v.next(/*nextDown=*/strategy == 6);
+    writeSlot(a, slot, v);
+    return true;
+  }
+  case 7: {
+    // ULP neighbour of the current value.
+    llvm::APFloat v = readSlot(a, slot);
+    if (v.isNaN())
+      return false;
+    v.next(/*nextDown=*/rng.getBool());
+    writeSlot(a, slot, v);
+    return true;
+  }
+  case 8: {
+    // Copy the value of another slot, converting if necessary.
+    const FPSlot &other =
+        analysis.slots[rng.getInt32() % analysis.slots.size()];
+    llvm::APFloat v = readSlot(a, other);
+    v.convert(sem, llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+    writeSlot(a, slot, v);
+    return true;
+  }
+  default: {
+    // Random bit pattern
+    llvm::APInt bits(slot.width, 0);
+    for (unsigned i = 0; i < slot.width; i += 32)
+      bits |= llvm::APInt(slot.width, rng.getInt32()).shl(i);
+    writeSlot(a, slot, bits);
+    return true;
+  }
+  }
+}
+
+bool FPFuzzSolver::mutateByte(Assignment &a, const Array *array) {
+  if (array->size == 0)
+    return false;
+  std::vector<unsigned char> &bytes = a.bindings[array];
+  unsigned char &byte = bytes[rng.getInt32() % bytes.size()];
+  if (rng.getBool())
+    byte ^= (unsigned char)(1 << (rng.getInt32() % 8));
+  else
+    byte = (unsigned char)rng.getInt32();
+  return true;
+}
+
+unsigned FPFuzzSolver::score(const Assignment &a,
+                             const std::vector<ref<Expr> > &goals) {
+  AssignmentEvaluator evaluator(a);
+  unsigned satisfied = 0;
+  for (std::vector<ref<Expr> >::const_iterator it = goals.begin(),
+                                                ie = goals.end();
+       it != ie; ++it) {
+    ref<Expr> result = evaluator.visit(*it);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(result))
+      if (CE->isTrue())
+        ++satisfied;
+  }
+  return satisfied;
+}
+
+bool FPFuzzSolver::findModel(const Query &query,
+                             const std::vector<ref<Expr> > &goals,
+                             const std::vector<const Array *> &objects,
+                             Assignment &model) {
+  FPQueryAnalysis analysis;
+  for (ConstraintManager::constraint_iterator it = query.constraints.begin(),
+                                              ie = query.constraints.end();
+       it != ie; ++it)
+    analysis.visit(*it);
+  analysis.visit(query.expr);
+  if (!analysis.hasFP)
+    return false;
+
+  TimerStatIncrementer t(stats::fpFuzzTime);
+  rng.seed(FPFuzzSeed);
+
+  std::vector<const Array *> arrays;
+  std::vector<ref<Expr> > exprs(goals);
+  exprs.push_back(query.expr);
+  findSymbolicObjects(exprs.begin(), exprs.end(), arrays);
+  for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                  ie = objects.end();
+       it != ie; ++it)
+    if (std::find(arrays.begin(), arrays.end(), *it) == arrays.end())
+      arrays.push_back(*it);
+
+  model.bindings.clear();
+  for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                  ie = arrays.end();
+       it != ie; ++it)
+    model.bindings[*it] = std::vector<unsigned char>((*it)->getSizeInBytes(), 0);
+
+  unsigned best = score(model, goals);
+  for (unsigned i = 0; best != goals.size() && i != FPFuzzMaxIterations &&
+                       !arrays.empty();
+       ++i) {
+    // Every mutation touches a single array, so a rejected candidate is
+    // undone by restoring that array's bytes.
+    bool useSlot = !analysis.slots.empty() && rng.getInt32() % 8 != 0;
+    const FPSlot *slot = 0;
+    const Array *touched;
+    if (useSlot) {
+      slot = &analysis.slots[rng.getInt32() % analysis.slots.size()];
+      touched = slot->array;
+    } else {
+      touched = arrays[rng.getInt32() % arrays.size()];
+    }
+    std::vector<unsigned char> saved = model.bindings[touched];
+
+    bool mutated;
+    if (slot) {
+      mutated = mutateSlot(model, analysis, *slot);
+    } else {
+      mutated = mutateByte(model, touched);
+    }
+    if (!mutated)
+      continue;
+
+    // Accept sideways moves so the search can walk across plateaus.
+    unsigned candidate = score(model, goals);
+    if (candidate >= best)
+      best = candidate;
+    else
+      model.bindings[touched].swap(saved);
+  }
+
+  if (best == goals.size()) {
+    ++stats::queryFPFuzzHits;
+    return true;
+  }
+  ++stats::queryFPFuzzMisses;
+  KLEE_DEBUG(llvm::errs() << "FPFuzzSolver: no model after "
+                          << FPFuzzMaxIterations << " candidates ("
+                          << best << "/" << goals.size()
+                          << " constraints satisfied)\n");
+  return false;
+}
+
+IncompleteSolver::PartialValidity
+FPFuzzSolver::computeTruth(const Query &query) {
+  // A model of the constraints under which the expression is false proves
+  // the query invalid.
+  std::vector<ref<Expr> > goals(query.constraints.begin(),
+                                query.constraints.end());
+  goals.push_back(Expr::createIsZero(query.expr));
+
+  Assignment model;
+  if (findModel(query, goals, std::vector<const Array *>(), model))
+    return MayBeFalse;
+  return None;
+}
+
+bool FPFuzzSolver::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<ref<Expr> > goals(query.constraints.begin(),
+                                query.constraints.end());
+
+  Assignment model;
+  if (!findModel(query, goals, std::vector<const Array *>(), model))
+    return false;
+
+  ref<Expr> value = model.evaluate(query.expr);
+  if (!isa<ConstantExpr>(value))
+    return false;
+  result = value;
+  return true;
+}
+
+bool FPFuzzSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::vector<ref<Expr> > goals(query.constraints.begin(),
+                                query.constraints.end());
+  goals.push_back(Expr::createIsZero(query.expr));
+
+  Assignment model;
+  if (!findModel(query, goals, objects, model))
+    return false;
+
+  hasSolution = true;
+  for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                  ie = objects.end();
+       it != ie; ++it)
+    values.push_back(model.bindings[*it]);
+  return true;
+}
+
+} // end anonymous namespace
+
+Solver *klee::createFPFuzzSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new FPFuzzSolver(), s));
+}
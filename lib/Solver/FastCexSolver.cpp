@@ -14,6 +14,7 @@
 #include "klee/Expr.h"
 #include "klee/IncompleteSolver.h"
 #include "klee/util/ExprEvaluator.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprRangeEvaluator.h"
 #include "klee/util/ExprVisitor.h"
 // FIXME: Use APInt.
@@ -311,10 +312,12 @@ class CexObjectData {
   void operator=(const CexObjectData&); // DO NOT IMPLEMENT
 
 public:
-  CexObjectData(uint64_t size) : possibleContents(size), exactContents(size) {
+  CexObjectData(uint64_t size, Expr::Width range)
+      : possibleContents(size), exactContents(size) {
+    uint64_t max = bits64::maxValueOfNBits(range);
     for (uint64_t i = 0; i != size; ++i) {
-      possibleContents[i] = ValueRange(0, 255);
-      exactContents[i] = ValueRange(0, 255);
+      possibleContents[i] = ValueRange(0, max);
+      exactContents[i] = ValueRange(0, max);
     }
   }
 
@@ -324,7 +327,7 @@ public:
   void setPossibleValues(size_t index, CexValueData values) {
     possibleContents[index] = values;
   }
-  void setPossibleValue(size_t index, unsigned char value) {
+  void setPossibleValue(size_t index, uint64_t value) {
     possibleContents[index] = CexValueData(value);
   }
 
@@ -336,7 +339,7 @@ public:
   }
 
   /// getPossibleValue - Return some possible value.
-  unsigned char getPossibleValue(size_t index) const {
+  uint64_t getPossibleValue(size_t index) const {
     const CexValueData &cvd = possibleContents[index];
     return cvd.min() + (cvd.max() - cvd.min()) / 2;
   }
@@ -345,17 +348,26 @@ public:
 class CexRangeEvaluator : public ExprRangeEvaluator<ValueRange> {
 public:
   std::map<const Array*, CexObjectData*> &objects;
-  CexRangeEvaluator(std::map<const Array*, CexObjectData*> &_objects) 
-    : objects(_objects) {}
+  const ExprHashMap<FloatRange> &floats;
+  CexRangeEvaluator(std::map<const Array*, CexObjectData*> &_objects,
+                    const ExprHashMap<FloatRange> &_floats)
+    : objects(_objects), floats(_floats) {}
+
+  FloatRange getKnownFloatRange(const ref<Expr> &e) {
+    ExprHashMap<FloatRange>::const_iterator it = floats.find(e);
+    if (it != floats.end())
+      return it->second;
+    return ExprRangeEvaluator<ValueRange>::getKnownFloatRange(e);
+  }
 
   ValueRange getInitialReadRange(const Array &array, ValueRange index) {
     // Check for a concrete read of a constant array.
     if (array.isConstantArray() && 
         index.isFixed() && 
         index.min() < array.size)
-      return ValueRange(array.constantValues[index.min()]->getZExtValue(8));
+      return ValueRange(array.constantValues[index.min()]->getZExtValue());
 
-    return ValueRange(0, 255);
+    return ValueRange(0, bits64::maxValueOfNBits(array.getRange()));
   }
 };
 
@@ -408,15 +420,94 @@ public:
     : objects(_objects) {}
 };
 
+/// restrictFloatComparison - Given that the comparison \a left \a kind \a right
+/// evaluates to \a holds, compute the ranges the operands are restricted to.
+/// \a kind must be FOEq, FOLt or FOLe.
+static void restrictFloatComparison(Expr::Kind kind, bool holds,
+                                    const FloatRange &left,
+                                    const FloatRange &right,
+                                    FloatRange &newLeft,
+                                    FloatRange &newRight) {
+  newLeft = left;
+  newRight = right;
+
+  switch (kind) {
+  case Expr::FOEq:
+    // Nothing useful can be said about the operands of a false equality.
+    if (holds) {
+      newLeft = left.restrictToEqual(right);
+      newRight = right.restrictToEqual(left);
+    }
+    break;
+
+  case Expr::FOLt:
+    if (holds) {
+      newLeft = left.restrictToLessThan(right);
+      newRight = right.restrictToGreaterThan(left);
+    } else {
+      // !(a < b) holds if either side is NaN or a >= b.
+      if (!right.mayBeNaN())
+        newLeft =
+            left.restrictToGreaterOrEqual(right).withNaN(left.mayBeNaN());
+      if (!left.mayBeNaN())
+        newRight =
+            right.restrictToLessOrEqual(left).withNaN(right.mayBeNaN());
+    }
+    break;
+
+  case Expr::FOLe:
+    if (holds) {
+      newLeft = left.restrictToLessOrEqual(right);
+      newRight = right.restrictToGreaterOrEqual(left);
+    } else {
+      if (!right.mayBeNaN())
+        newLeft = left.restrictToGreaterThan(right).withNaN(left.mayBeNaN());
+      if (!left.mayBeNaN())
+        newRight = right.restrictToLessThan(left).withNaN(right.mayBeNaN());
+    }
+    break;
+
+  default:
+    assert(0 && "invalid floating point comparison");
+  }
+}
+
+/// restrictFloatPredicate - Given that the predicate \a kind of a value in
+/// \a arg evaluates to \a holds, compute the range the value is restricted
+/// to.
+static FloatRange restrictFloatPredicate(Expr::Kind kind, bool holds,
+                                         const FloatRange &arg) {
+  switch (kind) {
+  case Expr::IsNaN:
+    if (holds)
+      return arg.set_intersection(FloatRange::nan(arg.getSemantics()));
+    return arg.withNaN(false);
+
+  case Expr::IsInfinite:
+    return arg.restrictToInfinite(holds);
+
+  default:
+    return arg;
+  }
+}
+
 class CexData {
 public:
   std::map<const Array*, CexObjectData*> objects;
 
+  /// exactFloats - Conservative ranges for floating point valued expressions,
+  /// learned from the floating point comparisons in the constraints.
+  ExprHashMap<FloatRange> exactFloats;
+
+  /// floatConflict - Set when the learned floating point ranges show that the
+  /// constraints are unsatisfiable.
+  bool floatConflict;
+
   CexData(const CexData&); // DO NOT IMPLEMENT
   void operator=(const CexData&); // DO NOT IMPLEMENT
 
 public:
-  CexData() {}
+  CexData() : floatConflict(false) {}
   ~CexData() {
     for (std::map<const Array*, CexObjectData*>::iterator it = objects.begin(),
            ie = objects.end(); it != ie; ++it)
@@ -427,7 +518,7 @@ public:
     CexObjectData *&Entry = objects[A];
 
     if (!Entry)
-      Entry = new CexObjectData(A->size);
+      Entry = new CexObjectData(A->size, A->getRange());
 
     return *Entry;
   }
@@ -440,6 +531,59 @@ public:
     propogateExactValues(e, CexValueData(value,value));
   }
 
+  /// propogatePossibleFloat - Force a floating point valued expression to
+  /// some value of the given range.
+  void propogatePossibleFloat(ref<Expr> e, const FloatRange &range) {
+    if (range.isEmpty())
+      return;
+
+    llvm::APFloat value = range.pickValue();
+    switch (e->getKind()) {
+    case Expr::FPExt: {
+      // Only a guess, so an inexact conversion to the source format is fine.
+      ref<Expr> src = e->getKid(0);
+      bool losesInfo = false;
+      value.convert(ConstantExpr::widthToFloatSemantics(src->getWidth()),
+                    llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+      propogatePossibleFloat(src, FloatRange(value));
+      break;
+    }
+
+    case Expr::FAbs:
+      if (value.isNegative())
+        value.changeSign();
+      propogatePossibleFloat(e->getKid(0), FloatRange(value));
+      break;
+
+    default:
+      // FIXME: Support large widths.
+      if (e->getWidth() <= 64)
+        propogatePossibleValue(e, value.bitcastToAPInt().getZExtValue());
+      break;
+    }
+  }
+
+  void propogatePossibleFloatComparison(Expr::Kind kind, ref<Expr> left,
+                                        ref<Expr> right, bool holds) {
+    if (kind == Expr::FOGt || kind == Expr::FOGe) {
+      kind = kind == Expr::FOGt ? Expr::FOLt : Expr::FOLe;
+      std::swap(left, right);
+    }
+
+    FloatRange leftRange = evalFloatRangeForExpr(left);
+    FloatRange rightRange = evalFloatRangeForExpr(right);
+    FloatRange newLeft(leftRange), newRight(rightRange);
+    restrictFloatComparison(kind, holds, leftRange, rightRange, newLeft,
+                            newRight);
+
+    // XXX heuristic, only propogate into a side if the other one is known.
+    if (rightRange.isFixed() && !isa<ConstantExpr>(left)) {
+      propogatePossibleFloat(left, newLeft);
+    } else if (leftRange.isFixed() && !isa<ConstantExpr>(right)) {
+      propogatePossibleFloat(right, newRight);
+    }
+  }
+
   void propogatePossibleValues(ref<Expr> e, CexValueData range) {
     KLEE_DEBUG(llvm::errs() << "propogate: " << range << " for\n"
                << e << "\n");
@@ -768,6 +912,32 @@ public:
       break;
     }
 
+      // Floating point
+
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe: {
+      if (range.isFixed()) {
+        BinaryExpr *be = cast<BinaryExpr>(e);
+        propogatePossibleFloatComparison(e->getKind(), be->left, be->right,
+                                         range.min());
+      }
+      break;
+    }
+
+    case Expr::IsNaN:
+    case Expr::IsInfinite: {
+      if (range.isFixed()) {
+        ref<Expr> arg = e->getKid(0);
+        propogatePossibleFloat(
+            arg, restrictFloatPredicate(e->getKind(), range.min(),
+                                        evalFloatRangeForExpr(arg)));
+      }
+      break;
+    }
+
     case Expr::Ne:
     case Expr::Ugt:
     case Expr::Uge:
@@ -780,6 +950,41 @@ public:
     }
   }
 
+  /// propogateExactFloat - Record that the value of \a e is in \a range.
+  void propogateExactFloat(const ref<Expr> &e, const FloatRange &range) {
+    if (range.isEmpty()) {
+      floatConflict = true;
+      return;
+    }
+    if (isa<ConstantExpr>(e))
+      return;
+
+    ExprHashMap<FloatRange>::iterator it = exactFloats.find(e);
+    if (it == exactFloats.end()) {
+      exactFloats.insert(std::make_pair(e, range));
+    } else {
+      it->second = it->second.set_intersection(range);
+      if (it->second.isEmpty())
+        floatConflict = true;
+    }
+  }
+
+  void propogateExactFloatComparison(Expr::Kind kind, ref<Expr> left,
+                                     ref<Expr> right, bool holds) {
+    if (kind == Expr::FOGt || kind == Expr::FOGe) {
+      kind = kind == Expr::FOGt ? Expr::FOLt : Expr::FOLe;
+      std::swap(left, right);
+    }
+
+    FloatRange leftRange = evalFloatRangeForExpr(left);
+    FloatRange rightRange = evalFloatRangeForExpr(right);
+    FloatRange newLeft(leftRange), newRight(rightRange);
+    restrictFloatComparison(kind, holds, leftRange, rightRange, newLeft,
+                            newRight);
+    propogateExactFloat(left, newLeft);
+    propogateExactFloat(right, newRight);
+  }
+
   void propogateExactValues(ref<Expr> e, CexValueData range) {
     switch (e->getKind()) {
     case Expr::Constant: {
@@ -908,6 +1113,32 @@ public:
       break;
     }
 
+      // Floating point
+
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe: {
+      if (range.isFixed()) {
+        BinaryExpr *be = cast<BinaryExpr>(e);
+        propogateExactFloatComparison(e->getKind(), be->left, be->right,
+                                      range.min());
+      }
+      break;
+    }
+
+    case Expr::IsNaN:
+    case Expr::IsInfinite: {
+      if (range.isFixed()) {
+        ref<Expr> arg = e->getKid(0);
+        propogateExactFloat(
+            arg, restrictFloatPredicate(e->getKind(), range.min(),
+                                        evalFloatRangeForExpr(arg)));
+      }
+      break;
+    }
+
     case Expr::Ne:
     case Expr::Ugt:
     case Expr::Uge:
@@ -921,10 +1152,53 @@ public:
   }
 
   ValueRange evalRangeForExpr(const ref<Expr> &e) {
-    CexRangeEvaluator ce(objects);
+    CexRangeEvaluator ce(objects, exactFloats);
     return ce.evaluate(e);
   }
 
+  FloatRange evalFloatRangeForExpr(const ref<Expr> &e) {
+    CexRangeEvaluator ce(objects, exactFloats);
+    return ce.evaluateFloat(e);
+  }
+
+  /// evalFloatPredicate - Evaluate a boolean expression using only the exact
+  /// floating point ranges. Expressions which are not decided by floating
+  /// point ranges alone evaluate to [0,1].
+  ValueRange evalFloatPredicate(const ref<Expr> &e) {
+    switch (e->getKind()) {
+    case Expr::Not: {
+      ValueRange kid = evalFloatPredicate(e->getKid(0));
+      return kid.isFixed() ? ValueRange(!kid.min()) : kid;
+    }
+
+    case Expr::Eq: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(be->left);
+      if (!CE || CE->getWidth() != Expr::Bool)
+        break;
+      ValueRange right = evalFloatPredicate(be->right);
+      if (right.isFixed())
+        return ValueRange(right.min() == CE->getZExtValue());
+      break;
+    }
+
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe:
+    case Expr::IsNaN:
+    case Expr::IsInfinite:
+    case Expr::IsNormal:
+    case Expr::IsSubnormal:
+      return evalRangeForExpr(e);
+
+    default:
+      break;
+    }
+    return ValueRange(0, 1);
+  }
+
   /// evaluate - Try to evaluate the given expression using a consistent fixed
   /// value for the current set of possible ranges.
   ref<Expr> evaluatePossible(ref<Expr> e) {
@@ -960,6 +1234,13 @@ public:
       }
       llvm::errs() << "]\n";
     }
+    if (!exactFloats.empty()) {
+      llvm::errs() << "-- propogated float ranges --\n";
+      for (ExprHashMap<FloatRange>::iterator it = exactFloats.begin(),
+                                             ie = exactFloats.end();
+           it != ie; ++it)
+        llvm::errs() << it->second << " for\n" << it->first << "\n";
+    }
   }
 };
 
@@ -1010,7 +1291,14 @@ static bool propogateValues(const Query& query, CexData &cd,
   }
 
   KLEE_DEBUG(cd.dump());
-  
+
+  // The floating point ranges learned from the constraints can contradict
+  // each other even if no single byte is known.
+  if (cd.floatConflict) {
+    isValid = true;
+    return true;
+  }
+
   // Check the result.
   bool hasSatisfyingAssignment = true;
   if (checkExpr) {
@@ -1018,7 +1306,8 @@ static bool propogateValues(const Query& query, CexData &cd,
       hasSatisfyingAssignment = false;
 
     // If the query is known to be true, then we have proved validity.
-    if (cd.evaluateExact(query.expr)->isTrue()) {
+    if (cd.evaluateExact(query.expr)->isTrue() ||
+        cd.evalFloatPredicate(query.expr).mustEqual(1)) {
       isValid = true;
       return true;
     }
@@ -1031,7 +1320,8 @@ static bool propogateValues(const Query& query, CexData &cd,
 
     // If this constraint is known to be false, then we can prove anything, so
     // the query is valid.
-    if (cd.evaluateExact(*it)->isFalse()) {
+    if (cd.evaluateExact(*it)->isFalse() ||
+        cd.evalFloatPredicate(*it).mustEqual(0)) {
       isValid = true;
       return true;
     }
@@ -1109,7 +1399,7 @@ FastCexSolver::computeInitialValues(const Query& query,
     const Array *array = objects[i];
     assert(array);
     std::vector<unsigned char> data;
-    data.reserve(array->size);
+    data.reserve(array->getSizeInBytes());
 
     for (unsigned i=0; i < array->size; i++) {
       ref<Expr> read = 
@@ -1118,7 +1408,9 @@ FastCexSolver::computeInitialValues(const Query& query,
       ref<Expr> value = cd.evaluatePossible(read);
       
       if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
-        data.push_back((unsigned char) CE->getZExtValue(8));
+        uint64_t v = CE->getZExtValue();
+        for (unsigned b = 0; b != array->getRange() / 8; ++b)
+          data.push_back((unsigned char) (v >> (8 * b)));
       } else {
         // FIXME: When does this happen?
         return false;
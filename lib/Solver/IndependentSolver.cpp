@@ -536,7 +536,7 @@ bool IndependentSolver::computeInitialValues(const Query& query,
       // this means we have an array that is somehow related to the
       // constraint, but whose values aren't actually required to
       // satisfy the query.
-      std::vector<unsigned char> ret(arr->size);
+      std::vector<unsigned char> ret(arr->getSizeInBytes());
       values.push_back(ret);
     } else {
       values.push_back(retMap[arr]);
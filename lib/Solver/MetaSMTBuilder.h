@@ -22,6 +22,7 @@
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ArrayExprHash.h"
 #include "klee/util/ExprHashMap.h"
+#include "klee/util/FPBitVectorLowering.h"
 #include "ConstantDivision.h"
 
 #ifdef ENABLE_METASMT
@@ -68,8 +69,8 @@ public:
 template <typename SolverContext> class MetaSMTBuilder {
 public:
   MetaSMTBuilder(SolverContext &solver, bool optimizeDivides)
-      : _solver(solver), _optimizeDivides(optimizeDivides){};
-  virtual ~MetaSMTBuilder(){};
+      : _solver(solver), _optimizeDivides(optimizeDivides), _fpLowering(0){};
+  virtual ~MetaSMTBuilder() { delete _fpLowering; };
 
   typename SolverContext::result_type construct(ref<Expr> e);
 
@@ -145,6 +146,8 @@ private:
   bool _optimizeDivides;
   MetaSMTArrayExprHash<SolverContext> _arr_hash;
   MetaSMTExprHashMap _constructed;
+  // Created on demand for the floating point operations of one query.
+  FPBitVectorLowering *_fpLowering;
 
   typename SolverContext::result_type constructActual(ref<Expr> e,
                                                       int *width_out);
@@ -586,6 +589,8 @@ typename SolverContext::result_type
 MetaSMTBuilder<SolverContext>::construct(ref<Expr> e) {
   typename SolverContext::result_type res = construct(e, 0);
   _constructed.clear();
+  delete _fpLowering;
+  _fpLowering = 0;
   return res;
 }
 
@@ -1189,6 +1194,35 @@ MetaSMTBuilder<SolverContext>::constructActual(ref<Expr> e, int *width_out) {
         case Expr::Sge:
 #endif
 
+  // The metaSMT backends are used through the QF_BV frontend only, so
+  // floating point operations are encoded with bit-vector operations.
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+  case Expr::FAbs:
+  case Expr::FOEq:
+  case Expr::FOLt:
+  case Expr::FOLe:
+  case Expr::FOGt:
+  case Expr::FOGe:
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal: {
+    if (!_fpLowering)
+      _fpLowering = new FPBitVectorLowering();
+    res = construct(_fpLowering->lower(e), width_out);
+    break;
+  }
+
   default:
     assert(false);
     break;
@@ -224,14 +224,15 @@ SolverImpl::SolverRunStatus MetaSMTSolverImpl<SolverContext>::runAndGetCex(
           _builder->getInitialArray(array);
 
       std::vector<unsigned char> data;
-      data.reserve(array->size);
+      data.reserve(array->getSizeInBytes());
 
       for (unsigned offset = 0; offset < array->size; offset++) {
         typename SolverContext::result_type elem_exp = evaluate(
             _meta_solver, metaSMT::logic::Array::select(
                               array_exp, bvuint(offset, array->getDomain())));
-        unsigned char elem_value = metaSMT::read_value(_meta_solver, elem_exp);
-        data.push_back(elem_value);
+        uint64_t elem_value = metaSMT::read_value(_meta_solver, elem_exp);
+        for (unsigned b = 0; b != array->getRange() / 8; ++b)
+          data.push_back((unsigned char)(elem_value >> (8 * b)));
       }
 
       values.push_back(data);
@@ -258,7 +259,7 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
   for (std::vector<const Array *>::const_iterator it = objects.begin(),
                                                   ie = objects.end();
        it != ie; ++it) {
-    sum += (*it)->size;
+    sum += (*it)->getSizeInBytes();
   }
   // sum += sizeof(uint64_t);
   sum += sizeof(stats::queryConstructs);
@@ -308,9 +309,9 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
           typename SolverContext::result_type elem_exp = evaluate(
               _meta_solver, metaSMT::logic::Array::select(
                                 array_exp, bvuint(offset, array->getDomain())));
-          unsigned char elem_value =
-              metaSMT::read_value(_meta_solver, elem_exp);
-          *pos++ = elem_value;
+          uint64_t elem_value = metaSMT::read_value(_meta_solver, elem_exp);
+          for (unsigned b = 0; b != array->getRange() / 8; ++b)
+            *pos++ = (unsigned char)(elem_value >> (8 * b));
         }
       }
     }
@@ -363,8 +364,8 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
         const Array *array = *it;
         assert(array);
         std::vector<unsigned char> &data = values[i++];
-        data.insert(data.begin(), pos, pos + array->size);
-        pos += array->size;
+        data.insert(data.begin(), pos, pos + array->getSizeInBytes());
+        pos += array->getSizeInBytes();
       }
     }
     stats::queryConstructs += (*((uint64_t *)pos) - stats::queryConstructs);
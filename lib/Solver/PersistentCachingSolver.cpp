@@ -0,0 +1,474 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A solver cache kept in a memory-mapped file, so that results survive
+// across runs and are shared by concurrent KLEE processes on one machine.
+//
+// Queries are keyed on their KQuery serialization, which gives the
+// expression DAG a canonical textual form and identifies arrays by name,
+// size and contents. The file holds a fixed-size ring buffer of records and
+// an open-addressed table of slots that point into it. New records overwrite
+// the oldest ones, so entries are evicted in FIFO order once the cache is
+// full. Processes synchronise with flock(): lookups take a shared lock and
+// inserts an exclusive one.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ExprPPrinter.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// The header at the start of the cache file. Offsets into the ring are
+/// logical: they grow without bound and are taken modulo \c ringSize on
+/// access, so a record is intact as long as the tail is less than a ring
+/// size ahead of it.
+struct CacheHeader {
+  char magic[8];
+  uint64_t ringSize;
+  uint64_t numSlots;
+  uint64_t tail;
+};
+
+struct CacheSlot {
+  uint64_t hash;
+  /// Logical offset of the record plus one, or zero for an unused slot.
+  uint64_t offset;
+};
+
+struct RecordHeader {
+  uint64_t hash;
+  uint32_t keySize;
+  uint32_t valueSize;
+};
+
+const char CacheMagic[8] = { 'K', 'L', 'E', 'E', 'S', 'C', '0', '1' };
+
+/// Number of slots probed for a key before the oldest one is evicted.
+const unsigned MaxProbes = 16;
+
+/// Expected record size, used to size the slot table of a new cache.
+const uint64_t AverageRecordSize = 512;
+
+uint64_t alignTo8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+/// 64-bit FNV-1a.
+uint64_t hashKey(const std::string &key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::string::const_iterator it = key.begin(), ie = key.end(); it != ie;
+       ++it) {
+    hash ^= (unsigned char)*it;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Holds an flock() on a file descriptor for the lifetime of the object.
+class FileLock {
+  int fd;
+
+public:
+  FileLock(int _fd, int operation) : fd(_fd) {
+    while (flock(fd, operation) == -1 && errno == EINTR)
+      ;
+  }
+  ~FileLock() { flock(fd, LOCK_UN); }
+};
+
+/// A key-value store in a memory-mapped file.
+class MappedCache {
+  int fd;
+  char *base;
+  uint64_t mappedSize;
+
+  CacheHeader *header() const { return (CacheHeader *)base; }
+  CacheSlot *slots() const {
+    return (CacheSlot *)(base + sizeof(CacheHeader));
+  }
+  char *ring() const { return (char *)(slots() + header()->numSlots); }
+
+  bool isLive(const CacheSlot &slot) const {
+    return slot.offset != 0 &&
+           header()->tail - (slot.offset - 1) <= header()->ringSize;
+  }
+
+  const RecordHeader *getRecord(const CacheSlot &slot) const {
+    return (const RecordHeader *)(ring() +
+                                  (slot.offset - 1) % header()->ringSize);
+  }
+
+  /// Return the live slot holding \a key, or null.
+  CacheSlot *find(const std::string &key, uint64_t hash) const;
+
+public:
+  MappedCache() : fd(-1), base(0), mappedSize(0) {}
+  ~MappedCache();
+
+  /// Open the cache at \a path, creating it with a total size of \a capacity
+  /// bytes if it does not exist. The size of an existing cache is kept.
+  bool open(const std::string &path, uint64_t capacity, std::string &error);
+
+  bool lookup(const std::string &key, std::string &value);
+  void insert(const std::string &key, const std::string &value);
+};
+
+MappedCache::~MappedCache() {
+  if (base)
+    munmap(base, mappedSize);
+  if (fd != -1)
+    close(fd);
+}
+
+bool MappedCache::open(const std::string &path, uint64_t capacity,
+                       std::string &error) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    error = strerror(errno);
+    return false;
+  }
+  FileLock lock(fd, LOCK_EX);
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    error = strerror(errno);
+    return false;
+  }
+
+  // A valid cache always has its magic, which is written last when the file
+  // is created, so an empty file or one whose magic is still zero is new or
+  // was left behind by a process that died while creating it. Nobody else
+  // can have it mapped.
+  CacheHeader h;
+  memset(&h, 0, sizeof(h));
+  if (st.st_size != 0 &&
+      pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+    error = "not a solver cache file";
+    return false;
+  }
+  static const char noMagic[sizeof(CacheMagic)] = { 0 };
+  bool create = !memcmp(h.magic, noMagic, sizeof(noMagic));
+
+  if (create) {
+    h.numSlots = capacity / AverageRecordSize;
+    if (h.numSlots < MaxProbes)
+      h.numSlots = MaxProbes;
+    uint64_t tableSize = sizeof(CacheHeader) + h.numSlots * sizeof(CacheSlot);
+    if (capacity < 2 * tableSize) {
+      error = "cache size is too small";
+      return false;
+    }
+    h.ringSize = (capacity - tableSize) & ~(uint64_t)7;
+    h.tail = 0;
+    mappedSize = tableSize + h.ringSize;
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, mappedSize) == -1) {
+      error = strerror(errno);
+      return false;
+    }
+  } else {
+    mappedSize =
+        sizeof(CacheHeader) + h.numSlots * sizeof(CacheSlot) + h.ringSize;
+    if (memcmp(h.magic, CacheMagic, sizeof(CacheMagic)) ||
+        (uint64_t)st.st_size != mappedSize) {
+      error = "not a solver cache file";
+      return false;
+    }
+  }
+
+  void *p = mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    error = strerror(errno);
+    return false;
+  }
+  base = (char *)p;
+
+  if (create) {
+    header()->ringSize = h.ringSize;
+    header()->numSlots = h.numSlots;
+    header()->tail = 0;
+    memcpy(header()->magic, CacheMagic, sizeof(CacheMagic));
+    msync(base, sizeof(CacheHeader), MS_SYNC);
+  }
+  return true;
+}
+
+CacheSlot *MappedCache::find(const std::string &key, uint64_t hash) const {
+  for (unsigned i = 0; i != MaxProbes; ++i) {
+    CacheSlot &slot = slots()[(hash + i) % header()->numSlots];
+    // Slots are never cleared, so an unused one ends the probe sequence.
+    if (slot.offset == 0)
+      return 0;
+    if (slot.hash != hash || !isLive(slot))
+      continue;
+    const RecordHeader *record = getRecord(slot);
+    if (record->hash == hash && record->keySize == key.size() &&
+        !memcmp(record + 1, key.data(), key.size()))
+      return &slot;
+  }
+  return 0;
+}
+
+bool MappedCache::lookup(const std::string &key, std::string &value) {
+  uint64_t hash = hashKey(key);
+  FileLock lock(fd, LOCK_SH);
+  CacheSlot *slot = find(key, hash);
+  if (!slot)
+    return false;
+  const RecordHeader *record = getRecord(*slot);
+  value.assign((const char *)(record + 1) + record->keySize,
+               record->valueSize);
+  return true;
+}
+
+void MappedCache::insert(const std::string &key, const std::string &value) {
+  uint64_t hash = hashKey(key);
+  uint64_t size = alignTo8(sizeof(RecordHeader) + key.size() + value.size());
+  // Very large records would evict much of the cache for a single entry.
+  if (size > header()->ringSize / 4)
+    return;
+
+  FileLock lock(fd, LOCK_EX);
+  // Another process may have solved the same query in the meantime.
+  if (find(key, hash))
+    return;
+
+  // Pick an unused or dead slot, or failing that the one holding the oldest
+  // record.
+  CacheSlot *target = 0;
+  for (unsigned i = 0; i != MaxProbes; ++i) {
+    CacheSlot &slot = slots()[(hash + i) % header()->numSlots];
+    if (!isLive(slot)) {
+      target = &slot;
+      break;
+    }
+    if (!target || slot.offset < target->offset)
+      target = &slot;
+  }
+
+  // Records do not wrap around the end of the ring.
+  uint64_t tail = header()->tail;
+  uint64_t pos = tail % header()->ringSize;
+  if (pos + size > header()->ringSize) {
+    tail += header()->ringSize - pos;
+    pos = 0;
+  }
+
+  // Write the record before publishing it, so that a process dying halfway
+  // through leaves at worst an unreachable record behind.
+  RecordHeader *record = (RecordHeader *)(ring() + pos);
+  record->hash = hash;
+  record->keySize = key.size();
+  record->valueSize = value.size();
+  memcpy(record + 1, key.data(), key.size());
+  memcpy((char *)(record + 1) + key.size(), value.data(), value.size());
+  header()->tail = tail + size;
+  target->hash = hash;
+  target->offset = tail + 1;
+}
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  MappedCache cache;
+  bool enabled;
+
+  std::string getKey(char kind, const Query &query,
+                     const std::vector<const Array *> *objects = 0);
+
+  bool cacheLookup(const std::string &key, std::string &value) {
+    if (enabled && cache.lookup(key, value)) {
+      ++stats::queryPersistentCacheHits;
+      return true;
+    }
+    ++stats::queryPersistentCacheMisses;
+    return false;
+  }
+
+  void cacheInsert(const std::string &key, const std::string &value) {
+    if (enabled)
+      cache.insert(key, value);
+  }
+
+public:
+  PersistentCachingSolver(Solver *s, const std::string &path,
+                          uint64_t capacity);
+  ~PersistentCachingSolver() { delete solver; }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+};
+
+PersistentCachingSolver::PersistentCachingSolver(Solver *s,
+                                                 const std::string &path,
+                                                 uint64_t capacity)
+    : solver(s), enabled(true) {
+  std::string error;
+  if (!cache.open(path, capacity, error)) {
+    klee_warning("Could not open solver cache %s: %s, continuing without it",
+                 path.c_str(), error.c_str());
+    enabled = false;
+  }
+}
+
+/// The key is the query in KQuery format, preceded by the kind of request
+/// since the same query has a different answer for each.
+std::string
+PersistentCachingSolver::getKey(char kind, const Query &query,
+                                const std::vector<const Array *> *objects) {
+  std::string key(1, kind);
+  llvm::raw_string_ostream os(key);
+  os << '\n';
+  if (kind == 'X') {
+    ExprPPrinter::printQuery(os, query.constraints,
+                             ConstantExpr::alloc(false, Expr::Bool),
+                             &query.expr, &query.expr + 1);
+  } else if (objects && !objects->empty()) {
+    ExprPPrinter::printQuery(os, query.constraints, query.expr, 0, 0,
+                             &(*objects)[0],
+                             &(*objects)[0] + objects->size());
+  } else {
+    ExprPPrinter::printQuery(os, query.constraints, query.expr);
+  }
+  os.flush();
+  return key;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query, bool &isValid) {
+  std::string key = getKey('T', query), value;
+  if (cacheLookup(key, value) && value.size() == 1) {
+    isValid = value[0] == '1';
+    return true;
+  }
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  cacheInsert(key, isValid ? "1" : "0");
+  return true;
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  std::string key = getKey('V', query), value;
+  if (cacheLookup(key, value) && value.size() == 1) {
+    result = value[0] == '+' ? Solver::True
+                             : value[0] == '-' ? Solver::False
+                                               : Solver::Unknown;
+    return true;
+  }
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+  cacheInsert(key, result == Solver::True
+                       ? "+"
+                       : result == Solver::False ? "-" : "?");
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  // The value is stored as its width followed by the words of its APInt.
+  std::string key = getKey('X', query), value;
+  Expr::Width width = query.expr->getWidth();
+  unsigned numWords = (width + 63) / 64;
+  if (cacheLookup(key, value) &&
+      value.size() == sizeof(width) + numWords * sizeof(uint64_t) &&
+      !memcmp(value.data(), &width, sizeof(width))) {
+    std::vector<uint64_t> words(numWords);
+    memcpy(&words[0], value.data() + sizeof(width),
+           numWords * sizeof(uint64_t));
+    result = ConstantExpr::alloc(llvm::APInt(width, llvm::makeArrayRef(words)));
+    return true;
+  }
+  if (!solver->impl->computeValue(query, result))
+    return false;
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(result)) {
+    const llvm::APInt &v = CE->getAPValue();
+    value.assign((const char *)&width, sizeof(width));
+    value.append((const char *)v.getRawData(), numWords * sizeof(uint64_t));
+    cacheInsert(key, value);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  // The value is a solvability flag followed by the bytes of each object.
+  std::string key = getKey('I', query, &objects), value;
+  uint64_t size = 0;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    size += objects[i]->getSizeInBytes();
+  if (cacheLookup(key, value) && !value.empty() &&
+      value.size() == (value[0] == '1' ? 1 + size : 1)) {
+    hasSolution = value[0] == '1';
+    values.clear();
+    if (hasSolution) {
+      const unsigned char *data = (const unsigned char *)value.data() + 1;
+      for (unsigned i = 0; i != objects.size(); ++i) {
+        unsigned bytes = objects[i]->getSizeInBytes();
+        values.push_back(std::vector<unsigned char>(data, data + bytes));
+        data += bytes;
+      }
+    }
+    return true;
+  }
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+  value.assign(1, hasSolution ? '1' : '0');
+  if (hasSolution)
+    for (unsigned i = 0; i != values.size(); ++i)
+      value.append(values[i].begin(), values[i].end());
+  cacheInsert(key, value);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+}
+
+Solver *klee::createPersistentCachingSolver(Solver *s, const std::string &path,
+                                            uint64_t capacity) {
+  return new Solver(new PersistentCachingSolver(s, path, capacity));
+}
@@ -75,12 +75,12 @@ STPArrayExprHash::~STPArrayExprHash() {
 /***/
 
 STPBuilder::STPBuilder(::VC _vc, bool _optimizeDivides)
-  : vc(_vc), optimizeDivides(_optimizeDivides) {
+  : vc(_vc), optimizeDivides(_optimizeDivides), fpLowering(0) {
 
 }
 
 STPBuilder::~STPBuilder() {
-  
+  delete fpLowering;
 }
 
 ///
@@ -919,6 +919,34 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
   case Expr::Sge:
 #endif
 
+    // STP has no floating point theory, so floating point operations are
+    // encoded with bit-vector operations instead.
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+  case Expr::FAbs:
+  case Expr::FOEq:
+  case Expr::FOLt:
+  case Expr::FOLe:
+  case Expr::FOGt:
+  case Expr::FOGe:
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal: {
+    if (!fpLowering)
+      fpLowering = new FPBitVectorLowering();
+    return construct(fpLowering->lower(e), width_out);
+  }
+
   default: 
     assert(0 && "unhandled Expr type");
     return vc_trueExpr(vc);
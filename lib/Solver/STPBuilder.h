@@ -12,6 +12,7 @@
 
 #include "klee/util/ExprHashMap.h"
 #include "klee/util/ArrayExprHash.h"
+#include "klee/util/FPBitVectorLowering.h"
 #include "klee/Config/config.h"
 
 #include <vector>
@@ -73,6 +74,12 @@ class STPBuilder {
 
   STPArrayExprHash _arr_hash;
 
+  /// fpLowering - Rewrites floating point expressions into bit-vector
+  /// expressions. It is created on demand and, like \ref constructed, kept
+  /// while one expression is constructed so that its common floating point
+  /// subexpressions are only lowered once.
+  FPBitVectorLowering *fpLowering;
+
 private:  
 
   ExprHandle bvOne(unsigned width);
@@ -122,6 +129,8 @@ public:
   ExprHandle construct(ref<Expr> e) { 
     ExprHandle res = construct(e, 0);
     constructed.clear();
+    delete fpLowering;
+    fpLowering = 0;
     return res;
   }
 };
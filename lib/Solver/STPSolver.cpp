@@ -193,12 +193,13 @@ runAndGetCex(::VC vc, STPBuilder *builder, ::VCExpr q,
       const Array *array = *it;
       std::vector<unsigned char> data;
 
-      data.reserve(array->size);
+      data.reserve(array->getSizeInBytes());
       for (unsigned offset = 0; offset < array->size; offset++) {
         ExprHandle counter =
             vc_getCounterExample(vc, builder->getInitialRead(array, offset));
-        unsigned char val = getBVUnsigned(counter);
-        data.push_back(val);
+        unsigned long long val = getBVUnsignedLongLong(counter);
+        for (unsigned b = 0; b != array->getRange() / 8; ++b)
+          data.push_back((unsigned char)(val >> (8 * b)));
       }
 
       values.push_back(data);
@@ -224,7 +225,7 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
   for (std::vector<const Array *>::const_iterator it = objects.begin(),
                                                   ie = objects.end();
        it != ie; ++it)
-    sum += (*it)->size;
+    sum += (*it)->getSizeInBytes();
   if (sum >= shared_memory_size)
     llvm::report_fatal_error("not enough shared memory for counterexample");
 
@@ -253,7 +254,9 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
         for (unsigned offset = 0; offset < array->size; offset++) {
           ExprHandle counter =
               vc_getCounterExample(vc, builder->getInitialRead(array, offset));
-          *pos++ = getBVUnsigned(counter);
+          unsigned long long val = getBVUnsignedLongLong(counter);
+          for (unsigned b = 0; b != array->getRange() / 8; ++b)
+            *pos++ = (unsigned char)(val >> (8 * b));
         }
       }
     }
@@ -309,8 +312,8 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
            it != ie; ++it) {
         const Array *array = *it;
         std::vector<unsigned char> &data = values[i++];
-        data.insert(data.begin(), pos, pos + array->size);
-        pos += array->size;
+        data.insert(data.begin(), pos, pos + array->getSizeInBytes());
+        pos += array->getSizeInBytes();
       }
     }
 
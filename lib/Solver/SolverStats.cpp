@@ -12,17 +12,32 @@
 using namespace klee;
 
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
+Statistic stats::fpFuzzTime("FPFuzzTime", "FFtime");
 Statistic stats::queries("Queries", "Q");
 Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
+Statistic stats::queryAckermannizedArrays("QueryAckermannizedArrays",
+                                          "QAarrays");
+Statistic stats::queryArrays("QueryArrays", "Qarrays");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryConstructCacheHits("QueryConstructCacheHits", "QBChits");
+Statistic stats::queryConstructCacheMisses("QueryConstructCacheMisses",
+                                           "QBCmisses");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
+Statistic stats::queryFPFuzzHits("QueryFPFuzzHits", "QFFhits");
+Statistic stats::queryFPFuzzMisses("QueryFPFuzzMisses", "QFFmisses");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits",
+                                          "QPChits");
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses",
+                                            "QPCmisses");
 Statistic stats::queryTime("QueryTime", "Qtime");
+Statistic stats::queryZ3WorkerQueries("QueryZ3WorkerQueries", "QZWq");
+Statistic stats::queryZ3WorkerRestarts("QueryZ3WorkerRestarts", "QZWrestarts");
 
 #ifdef DEBUG
 Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
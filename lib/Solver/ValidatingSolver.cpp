@@ -9,6 +9,7 @@
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/util/Assignment.h"
 #include <vector>
 
 namespace klee {
@@ -92,17 +93,8 @@ bool ValidatingSolver::computeInitialValues(
     // Assert the bindings as constraints, and verify that the
     // conjunction of the actual constraints is satisfiable.
     std::vector<ref<Expr> > bindings;
-    for (unsigned i = 0; i != values.size(); ++i) {
-      const Array *array = objects[i];
-      assert(array);
-      for (unsigned j = 0; j < array->size; j++) {
-        unsigned char value = values[i][j];
-        bindings.push_back(EqExpr::create(
-            ReadExpr::create(UpdateList(array, 0),
-                             ConstantExpr::alloc(j, array->getDomain())),
-            ConstantExpr::alloc(value, array->getRange())));
-      }
-    }
+    Assignment assignment(objects, values);
+    assignment.createConstraintsFromAssignment(bindings);
     ConstraintManager tmp(bindings);
     ref<Expr> constraints = Expr::createIsZero(query.expr);
     for (ConstraintManager::const_iterator it = query.constraints.begin(),
@@ -19,6 +19,8 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+
 using namespace klee;
 
 namespace {
@@ -27,9 +29,59 @@ llvm::cl::opt<bool> UseConstructHashZ3(
     llvm::cl::desc("Use hash-consing during Z3 query construction."),
     llvm::cl::init(true));
 
+llvm::cl::opt<unsigned> Z3ConstructCacheSize(
+    "z3-construct-cache-size",
+    llvm::cl::desc("Maximum number of expressions whose Z3 translation is "
+                   "kept for later queries. Z3 does not report the memory "
+                   "used by individual expressions so this counts cache "
+                   "entries, not bytes. 0 clears the cache after every "
+                   "query (default=0)"),
+    llvm::cl::init(0));
+
 llvm::cl::opt<std::string> Z3LogInteractionFile(
     "z3-log-interaction", llvm::cl::init(""),
     llvm::cl::desc("Log interaction with Z3 to the specified path"));
+
+// Floating point expressions whose result depends on a rounding mode (apart
+// from the conversions to integers which always round toward zero).
+bool isRounded(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FPTrunc:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+    return true;
+  default:
+    return false;
+  }
+}
+
+llvm::APFloat::roundingMode getRoundingMode(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FPTrunc:
+    return cast<FPTruncExpr>(e)->roundingMode;
+  case Expr::UIToFP:
+    return cast<UIToFPExpr>(e)->roundingMode;
+  case Expr::SIToFP:
+    return cast<SIToFPExpr>(e)->roundingMode;
+  case Expr::FAdd:
+    return cast<FAddExpr>(e)->roundingMode;
+  case Expr::FSub:
+    return cast<FSubExpr>(e)->roundingMode;
+  case Expr::FMul:
+    return cast<FMulExpr>(e)->roundingMode;
+  case Expr::FDiv:
+    return cast<FDivExpr>(e)->roundingMode;
+  case Expr::FSqrt:
+    return cast<FSqrtExpr>(e)->roundingMode;
+  default:
+    llvm_unreachable("not a rounded floating point expression");
+  }
+}
 }
 
 namespace klee {
@@ -79,7 +131,7 @@ void Z3ArrayExprHash::clearUpdates() {
 }
 
 Z3Builder::Z3Builder(bool autoClearConstructCache)
-    : autoClearConstructCache(autoClearConstructCache) {
+    : queryLocalUses(0), autoClearConstructCache(autoClearConstructCache) {
   if (Z3LogInteractionFile.length() > 0) {
     llvm::errs() << "Logging Z3 interaction to \"" << Z3LogInteractionFile << "\"\n";
     Z3_open_log(Z3LogInteractionFile.c_str());
@@ -478,10 +530,25 @@ Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
     bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
 
     if (!hashed) {
+      unsigned queryLocalUsesBefore = queryLocalUses;
+      size_t sideConstraintsBefore = sideConstraints.size();
+      size_t readArraysBefore = readArrays.size();
       un_expr = writeExpr(getArrayForUpdate(root, un->next),
                           construct(un->index, 0), construct(un->value, 0));
 
       _arr_hash.hashUpdateNodeExpr(un, un_expr);
+      updateArrays[un] = uniqueReadArrays(readArraysBefore);
+      // The side constraints of the update are not emitted again when the
+      // hashed update is reused so expressions using it must not be cached
+      // across queries.
+      if (queryLocalUses != queryLocalUsesBefore ||
+          sideConstraints.size() != sideConstraintsBefore)
+        queryLocalUpdates.insert(un);
+    } else {
+      if (queryLocalUpdates.count(un))
+        ++queryLocalUses;
+      const std::vector<const Array *> &arrays = updateArrays[un];
+      readArrays.insert(readArrays.end(), arrays.begin(), arrays.end());
     }
 
     return (un_expr);
@@ -495,6 +562,7 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
   // the replacement expression.
   ExprHashMap<Z3ASTHandle>::iterator replIt = replaceWithExpr.find(e);
   if (replIt != replaceWithExpr.end()) {
+    ++queryLocalUses;
     if (width_out)
       *width_out = e->getWidth();
     return replIt->second;
@@ -504,23 +572,117 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
   if (!UseConstructHashZ3 || isa<ConstantExpr>(e)) {
     return constructActual(e, width_out);
   } else {
-    ExprHashMap<std::pair<Z3ASTHandle, unsigned> >::iterator it =
-        constructed.find(e);
-    if (it != constructed.end()) {
+    if (Z3ConstructCacheEntry *entry = lookupConstructCache(e)) {
+      ++stats::queryConstructCacheHits;
       if (width_out)
-        *width_out = it->second.second;
-      return it->second.first;
+        *width_out = entry->width;
+      return entry->ast;
+    }
+    ++stats::queryConstructCacheMisses;
+    int width;
+    if (!width_out)
+      width_out = &width;
+    unsigned queryLocalUsesBefore = queryLocalUses;
+    size_t sideConstraintsBefore = sideConstraints.size();
+    size_t readArraysBefore = readArrays.size();
+    Z3ASTHandle res = constructActual(e, width_out);
+    Z3ConstructCacheEntry entry(res, *width_out);
+    if (queryLocalUses != queryLocalUsesBefore) {
+      queryLocalConstructed.insert(std::make_pair(e, entry));
     } else {
-      int width;
-      if (!width_out)
-        width_out = &width;
-      Z3ASTHandle res = constructActual(e, width_out);
-      constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
-      return res;
+      entry.sideConstraints.assign(sideConstraints.begin() +
+                                       sideConstraintsBefore,
+                                   sideConstraints.end());
+      entry.arrays = uniqueReadArrays(readArraysBefore);
+      constructed.insert(std::make_pair(e, entry));
+    }
+    return res;
+  }
+}
+
+std::vector<const Array *>
+Z3Builder::uniqueReadArrays(size_t readArraysBefore) {
+  std::vector<const Array *>::iterator begin =
+      readArrays.begin() + readArraysBefore;
+  std::sort(begin, readArrays.end());
+  readArrays.erase(std::unique(begin, readArrays.end()), readArrays.end());
+  return std::vector<const Array *>(readArrays.begin() + readArraysBefore,
+                                    readArrays.end());
+}
+
+Z3ConstructCacheEntry *Z3Builder::lookupConstructCache(const ref<Expr> &e) {
+  ConstructCacheTy::iterator it = queryLocalConstructed.find(e);
+  if (it != queryLocalConstructed.end()) {
+    ++queryLocalUses;
+    return &(it->second);
+  }
+
+  it = constructed.find(e);
+  if (it == constructed.end()) {
+    ConstructCacheTy::iterator oldIt = constructedOld.find(e);
+    if (oldIt == constructedOld.end())
+      return NULL;
+    // Promote to the young generation.
+    it = constructed.insert(*oldIt).first;
+    constructedOld.erase(oldIt);
+  }
+
+  // The entry might have been constructed by a previous query so emit its
+  // side constraints again. This is also done for entries from the current
+  // query so that the side constraints recorded for any expression using
+  // this one are complete.
+  sideConstraints.insert(sideConstraints.end(),
+                         it->second.sideConstraints.begin(),
+                         it->second.sideConstraints.end());
+  readArrays.insert(readArrays.end(), it->second.arrays.begin(),
+                    it->second.arrays.end());
+  return &(it->second);
+}
+
+// Whether the sorted ``arrays`` contains any of ``changed``.
+static bool readsAnyOf(const std::vector<const Array *> &arrays,
+                       const std::set<const Array *> &changed) {
+  for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                  ie = arrays.end();
+       it != ie; ++it)
+    if (changed.count(*it))
+      return true;
+  return false;
+}
+
+void Z3Builder::invalidateConstructCache(
+    const std::set<const Array *> &arrays) {
+  if (arrays.empty())
+    return;
+  ConstructCacheTy *generations[] = {&constructed, &constructedOld};
+  for (unsigned i = 0; i != 2; ++i) {
+    ConstructCacheTy &cache = *generations[i];
+    for (ConstructCacheTy::iterator it = cache.begin(); it != cache.end();) {
+      if (readsAnyOf(it->second.arrays, arrays))
+        cache.erase(it++);
+      else
+        ++it;
     }
   }
 }
 
+void Z3Builder::trimConstructCache() {
+  queryLocalConstructed.clear();
+  readArrays.clear();
+  if (Z3ConstructCacheSize == 0) {
+    clearConstructCache();
+    return;
+  }
+  if (constructed.size() + constructedOld.size() <= Z3ConstructCacheSize)
+    return;
+  // Drop the old generation. The young generation becomes the old one unless
+  // it is over budget on its own.
+  constructedOld.clear();
+  if (constructed.size() <= Z3ConstructCacheSize)
+    constructedOld.swap(constructed);
+  constructed.clear();
+}
+
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
 Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
@@ -577,12 +739,16 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     ReadExpr *re = cast<ReadExpr>(e);
     assert(re && re->updates.root);
     *width_out = re->updates.root->getRange();
+    readArrays.push_back(re->updates.root);
     return readExpr(getArrayForUpdate(re->updates.root, re->updates.head),
                     construct(re->index, 0));
   }
 
   case Expr::Select: {
     SelectExpr *se = cast<SelectExpr>(e);
+    Z3ASTHandle rounded;
+    if (constructSymbolicRoundingSelect(se, width_out, rounded))
+      return rounded;
     Z3ASTHandle cond = construct(se->cond, 0);
     Z3ASTHandle tExpr = construct(se->trueExpr, width_out);
     Z3ASTHandle fExpr = construct(se->falseExpr, width_out);
@@ -658,21 +824,6 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
         ctx);
   }
 
-  case Expr::FPTrunc: {
-    int srcWidth;
-    FPTruncExpr *ce = cast<FPTruncExpr>(e);
-    Z3ASTHandle src = castToFloat(construct(ce->src, &srcWidth));
-    *width_out = ce->getWidth();
-    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
-               &(llvm::APFloat::Bogus) &&
-           "Invalid FPTrunc width");
-    assert(*width_out <= srcWidth && "Invalid FPTrunc");
-    return Z3ASTHandle(
-        Z3_mk_fpa_to_fp_float(ctx, getRoundingModeSort(ce->roundingMode), src,
-                              getFloatSortFromBitWidth(*width_out)),
-        ctx);
-  }
-
   case Expr::FPToUI: {
     int srcWidth;
     FPToUIExpr *ce = cast<FPToUIExpr>(e);
@@ -701,34 +852,6 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
                        ctx);
   }
 
-  case Expr::UIToFP: {
-    int srcWidth;
-    UIToFPExpr *ce = cast<UIToFPExpr>(e);
-    Z3ASTHandle src = castToBitVector(construct(ce->src, &srcWidth));
-    *width_out = ce->getWidth();
-    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
-               &(llvm::APFloat::Bogus) &&
-           "Invalid UIToFP width");
-    return Z3ASTHandle(
-        Z3_mk_fpa_to_fp_unsigned(ctx, getRoundingModeSort(ce->roundingMode),
-                                 src, getFloatSortFromBitWidth(*width_out)),
-        ctx);
-  }
-
-  case Expr::SIToFP: {
-    int srcWidth;
-    SIToFPExpr *ce = cast<SIToFPExpr>(e);
-    Z3ASTHandle src = castToBitVector(construct(ce->src, &srcWidth));
-    *width_out = ce->getWidth();
-    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
-               &(llvm::APFloat::Bogus) &&
-           "Invalid SIToFP width");
-    return Z3ASTHandle(
-        Z3_mk_fpa_to_fp_signed(ctx, getRoundingModeSort(ce->roundingMode), src,
-                               getFloatSortFromBitWidth(*width_out)),
-        ctx);
-  }
-
   // Arithmetic
   case Expr::Add: {
     AddExpr *ae = cast<AddExpr>(e);
@@ -1056,57 +1179,17 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     return Z3ASTHandle(Z3_mk_fpa_is_subnormal(ctx, arg), ctx);
   }
 
-  case Expr::FAdd: {
-    FAddExpr *fadd = cast<FAddExpr>(e);
-    Z3ASTHandle left = castToFloat(construct(fadd->left, width_out));
-    Z3ASTHandle right = castToFloat(construct(fadd->right, width_out));
-    assert(*width_out != 1 && "uncanonicalized FAdd");
-    return Z3ASTHandle(Z3_mk_fpa_add(ctx,
-                                     getRoundingModeSort(fadd->roundingMode),
-                                     left, right),
-                       ctx);
-  }
+  case Expr::FPTrunc:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+    return constructRounded(e, getRoundingModeSort(getRoundingMode(e)),
+                            width_out);
 
-  case Expr::FSub: {
-    FSubExpr *fsub = cast<FSubExpr>(e);
-    Z3ASTHandle left = castToFloat(construct(fsub->left, width_out));
-    Z3ASTHandle right = castToFloat(construct(fsub->right, width_out));
-    assert(*width_out != 1 && "uncanonicalized FSub");
-    return Z3ASTHandle(Z3_mk_fpa_sub(ctx,
-                                     getRoundingModeSort(fsub->roundingMode),
-                                     left, right),
-                       ctx);
-  }
-
-  case Expr::FMul: {
-    FMulExpr *fmul = cast<FMulExpr>(e);
-    Z3ASTHandle left = castToFloat(construct(fmul->left, width_out));
-    Z3ASTHandle right = castToFloat(construct(fmul->right, width_out));
-    assert(*width_out != 1 && "uncanonicalized FMul");
-    return Z3ASTHandle(Z3_mk_fpa_mul(ctx,
-                                     getRoundingModeSort(fmul->roundingMode),
-                                     left, right),
-                       ctx);
-  }
-
-  case Expr::FDiv: {
-    FDivExpr *fdiv = cast<FDivExpr>(e);
-    Z3ASTHandle left = castToFloat(construct(fdiv->left, width_out));
-    Z3ASTHandle right = castToFloat(construct(fdiv->right, width_out));
-    assert(*width_out != 1 && "uncanonicalized FDiv");
-    return Z3ASTHandle(Z3_mk_fpa_div(ctx,
-                                     getRoundingModeSort(fdiv->roundingMode),
-                                     left, right),
-                       ctx);
-  }
-  case Expr::FSqrt: {
-    FSqrtExpr *fsqrt = cast<FSqrtExpr>(e);
-    Z3ASTHandle arg = castToFloat(construct(fsqrt->expr, width_out));
-    assert(*width_out != 1 && "uncanonicalized FSqrt");
-    return Z3ASTHandle(
-        Z3_mk_fpa_sqrt(ctx, getRoundingModeSort(fsqrt->roundingMode), arg),
-        ctx);
-  }
   case Expr::FAbs: {
     FAbsExpr *fabsExpr = cast<FAbsExpr>(e);
     Z3ASTHandle arg = castToFloat(construct(fabsExpr->expr, width_out));
@@ -1375,6 +1458,135 @@ Z3SortHandle Z3Builder::getFloatSortFromBitWidth(unsigned bitWidth) {
   }
 }
 
+Z3ASTHandle Z3Builder::constructRounded(ref<Expr> e, Z3ASTHandle roundingMode,
+                                        int *width_out) {
+  switch (e->getKind()) {
+  case Expr::FPTrunc: {
+    int srcWidth;
+    FPTruncExpr *ce = cast<FPTruncExpr>(e);
+    Z3ASTHandle src = castToFloat(construct(ce->src, &srcWidth));
+    *width_out = ce->getWidth();
+    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
+               &(llvm::APFloat::Bogus) &&
+           "Invalid FPTrunc width");
+    assert(*width_out <= srcWidth && "Invalid FPTrunc");
+    return Z3ASTHandle(
+        Z3_mk_fpa_to_fp_float(ctx, roundingMode, src,
+                              getFloatSortFromBitWidth(*width_out)),
+        ctx);
+  }
+
+  case Expr::UIToFP: {
+    int srcWidth;
+    UIToFPExpr *ce = cast<UIToFPExpr>(e);
+    Z3ASTHandle src = castToBitVector(construct(ce->src, &srcWidth));
+    *width_out = ce->getWidth();
+    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
+               &(llvm::APFloat::Bogus) &&
+           "Invalid UIToFP width");
+    return Z3ASTHandle(
+        Z3_mk_fpa_to_fp_unsigned(ctx, roundingMode, src,
+                                 getFloatSortFromBitWidth(*width_out)),
+        ctx);
+  }
+
+  case Expr::SIToFP: {
+    int srcWidth;
+    SIToFPExpr *ce = cast<SIToFPExpr>(e);
+    Z3ASTHandle src = castToBitVector(construct(ce->src, &srcWidth));
+    *width_out = ce->getWidth();
+    assert(&(ConstantExpr::widthToFloatSemantics(*width_out)) !=
+               &(llvm::APFloat::Bogus) &&
+           "Invalid SIToFP width");
+    return Z3ASTHandle(
+        Z3_mk_fpa_to_fp_signed(ctx, roundingMode, src,
+                               getFloatSortFromBitWidth(*width_out)),
+        ctx);
+  }
+
+  case Expr::FAdd: {
+    FAddExpr *fadd = cast<FAddExpr>(e);
+    Z3ASTHandle left = castToFloat(construct(fadd->left, width_out));
+    Z3ASTHandle right = castToFloat(construct(fadd->right, width_out));
+    assert(*width_out != 1 && "uncanonicalized FAdd");
+    return Z3ASTHandle(Z3_mk_fpa_add(ctx, roundingMode, left, right), ctx);
+  }
+
+  case Expr::FSub: {
+    FSubExpr *fsub = cast<FSubExpr>(e);
+    Z3ASTHandle left = castToFloat(construct(fsub->left, width_out));
+    Z3ASTHandle right = castToFloat(construct(fsub->right, width_out));
+    assert(*width_out != 1 && "uncanonicalized FSub");
+    return Z3ASTHandle(Z3_mk_fpa_sub(ctx, roundingMode, left, right), ctx);
+  }
+
+  case Expr::FMul: {
+    FMulExpr *fmul = cast<FMulExpr>(e);
+    Z3ASTHandle left = castToFloat(construct(fmul->left, width_out));
+    Z3ASTHandle right = castToFloat(construct(fmul->right, width_out));
+    assert(*width_out != 1 && "uncanonicalized FMul");
+    return Z3ASTHandle(Z3_mk_fpa_mul(ctx, roundingMode, left, right), ctx);
+  }
+
+  case Expr::FDiv: {
+    FDivExpr *fdiv = cast<FDivExpr>(e);
+    Z3ASTHandle left = castToFloat(construct(fdiv->left, width_out));
+    Z3ASTHandle right = castToFloat(construct(fdiv->right, width_out));
+    assert(*width_out != 1 && "uncanonicalized FDiv");
+    return Z3ASTHandle(Z3_mk_fpa_div(ctx, roundingMode, left, right), ctx);
+  }
+  case Expr::FSqrt: {
+    FSqrtExpr *fsqrt = cast<FSqrtExpr>(e);
+    Z3ASTHandle arg = castToFloat(construct(fsqrt->expr, width_out));
+    assert(*width_out != 1 && "uncanonicalized FSqrt");
+    return Z3ASTHandle(Z3_mk_fpa_sqrt(ctx, roundingMode, arg), ctx);
+  }
+  default:
+    llvm_unreachable("not a rounded floating point expression");
+  }
+}
+
+bool Z3Builder::constructSymbolicRoundingSelect(SelectExpr *se,
+                                                int *width_out,
+                                                Z3ASTHandle &result) {
+  // Operations under a symbolic rounding mode are built by the Executor as
+  //   (Select c0 (Op rm0 a b) (Select c1 (Op rm1 a b) ... (Op rmN a b)))
+  // where only the rounding modes of the operations differ. Construct these
+  // as a single operation whose rounding mode is an ite over the rounding
+  // modes instead of constructing every operation.
+  std::vector<ref<Expr> > conds, ops;
+  ref<Expr> e = se;
+  while (SelectExpr *chain = dyn_cast<SelectExpr>(e)) {
+    conds.push_back(chain->cond);
+    ops.push_back(chain->trueExpr);
+    e = chain->falseExpr;
+  }
+  ops.push_back(e);
+
+  const ref<Expr> &first = ops[0];
+  if (!isRounded(first))
+    return false;
+  for (unsigned i = 1; i < ops.size(); ++i) {
+    const ref<Expr> &op = ops[i];
+    if (op->getKind() != first->getKind() ||
+        op->getWidth() != first->getWidth())
+      return false;
+    for (unsigned kid = 0; kid < first->getNumKids(); ++kid) {
+      if (op->getKid(kid) != first->getKid(kid))
+        return false;
+    }
+  }
+
+  Z3ASTHandle roundingMode = getRoundingModeSort(getRoundingMode(ops.back()));
+  for (int i = conds.size() - 1; i >= 0; --i) {
+    roundingMode = iteExpr(construct(conds[i], 0),
+                           getRoundingModeSort(getRoundingMode(ops[i])),
+                           roundingMode);
+  }
+  result = constructRounded(first, roundingMode, width_out);
+  return true;
+}
+
 Z3ASTHandle Z3Builder::getRoundingModeSort(llvm::APFloat::roundingMode rm) {
   // FIXME: Cache these
   switch(rm) {
@@ -1414,6 +1626,8 @@ void Z3Builder::clearReplacements() {
   // We have to clear the cached update expressions because they may
   // use replacement variables.
   _arr_hash.clearUpdates();
+  queryLocalUpdates.clear();
+  updateArrays.clear();
   replaceWithExpr.clear();
 }
 }
@@ -13,6 +13,8 @@
 #include "klee/util/ExprHashMap.h"
 #include "klee/util/ArrayExprHash.h"
 #include "klee/Config/config.h"
+#include <map>
+#include <set>
 #include <z3.h>
 
 namespace klee {
@@ -103,9 +105,45 @@ public:
   void clearUpdates();
 };
 
+struct Z3ConstructCacheEntry {
+  Z3ASTHandle ast;
+  unsigned width;
+  // Side constraints generated while constructing ``ast``. These have to be
+  // emitted again whenever the entry is reused.
+  std::vector<Z3ASTHandle> sideConstraints;
+  // The arrays read by ``ast``, sorted. Used to drop the entry when the way
+  // one of them is translated changes.
+  std::vector<const Array *> arrays;
+
+  Z3ConstructCacheEntry() : width(0) {}
+  Z3ConstructCacheEntry(Z3ASTHandle _ast, unsigned _width)
+      : ast(_ast), width(_width) {}
+};
+
 class Z3Builder {
   friend class Z3SolverImpl;
-  ExprHashMap<std::pair<Z3ASTHandle, unsigned> > constructed;
+  typedef ExprHashMap<Z3ConstructCacheEntry> ConstructCacheTy;
+  // The cache of constructed expressions is split into generations.
+  // ``constructed`` (young) and ``constructedOld`` (old) persist across
+  // queries, entries found in the old generation are promoted to the young
+  // one and the old generation is dropped when the cache grows too large.
+  // ``queryLocalConstructed`` holds expressions whose translation uses
+  // replacement variables and so is only valid for the current query.
+  ConstructCacheTy constructed;
+  ConstructCacheTy constructedOld;
+  ConstructCacheTy queryLocalConstructed;
+  // Incremented every time a query local translation is used so we can tell
+  // if the translation of an expression depends on one.
+  unsigned queryLocalUses;
+  // Update nodes whose translation is query local or generated side
+  // constraints.
+  std::set<const UpdateNode *> queryLocalUpdates;
+  // The arrays read while constructing the current expression. Every
+  // construction appends to it so the arrays read by an expression are the
+  // ones added since its construction started.
+  std::vector<const Array *> readArrays;
+  // The arrays read by the values and indices of hashed update nodes.
+  std::map<const UpdateNode *, std::vector<const Array *> > updateArrays;
   Z3ArrayExprHash _arr_hash;
   ExprHashMap<Z3ASTHandle> replaceWithExpr;
   // These are additional constraints that are generated during the
@@ -167,7 +205,17 @@ private:
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
 
   Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
+  // Construct the rounded floating point operation ``e`` using
+  // ``roundingMode`` instead of the rounding mode stored in ``e``.
+  Z3ASTHandle constructRounded(ref<Expr> e, Z3ASTHandle roundingMode,
+                               int *width_out);
+  bool constructSymbolicRoundingSelect(SelectExpr *se, int *width_out,
+                                       Z3ASTHandle &result);
   Z3ASTHandle construct(ref<Expr> e, int *width_out);
+  Z3ConstructCacheEntry *lookupConstructCache(const ref<Expr> &e);
+  // Replace the arrays read since ``readArraysBefore`` with their sorted,
+  // deduplicated list and return it.
+  std::vector<const Array *> uniqueReadArrays(size_t readArraysBefore);
 
   Z3ASTHandle buildArray(const char *name, unsigned indexWidth,
                          unsigned valueWidth);
@@ -202,7 +250,20 @@ public:
     return res;
   }
 
-  void clearConstructCache() { constructed.clear(); }
+  void clearConstructCache() {
+    constructed.clear();
+    constructedOld.clear();
+    queryLocalConstructed.clear();
+    readArrays.clear();
+  }
+  // Drop the cached translations that read any of ``arrays``.
+  void invalidateConstructCache(const std::set<const Array *> &arrays);
+  // Should be called at the end of every query. Drops the translations that
+  // are only valid for the current query and evicts entries so that at most
+  // ``-z3-construct-cache-size`` expressions are kept for later queries.
+  // Z3 does not report the size of individual ASTs so the budget is a number
+  // of entries, not of bytes.
+  void trimConstructCache();
   void clearSideConstraints() { sideConstraints.clear(); }
   void closeInteractionLog(); // Should be called before aborting
 
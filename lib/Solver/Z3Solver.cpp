@@ -10,16 +10,29 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #ifdef ENABLE_Z3
 #include "Z3Builder.h"
+#include "Z3WorkerPool.h"
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 #include "../Expr/FindArrayAckermannizationVisitor.h" // FIXME: No relative includes!
+#include "llvm/ADT/APInt.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+
 namespace {
 llvm::cl::opt<std::string> Z3QueryDumpFile(
     "z3-query-dump", llvm::cl::init(""),
@@ -33,6 +46,44 @@ llvm::cl::opt<bool> Z3AckermannizeArrays(
     "z3-array-ackermannize", llvm::cl::init(true),
     llvm::cl::desc("Try to ackermannize arrays before building Z3 queries "
                    "(experimental) (default false)"));
+
+llvm::cl::opt<bool> Z3Incremental(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Keep a single Z3 solver alive across queries and use "
+                   "push/pop to reuse the constraints shared with the "
+                   "previous query (experimental) (default false)"));
+
+llvm::cl::opt<unsigned> Z3PortfolioWorkers(
+    "z3-portfolio-workers", llvm::cl::init(0),
+    llvm::cl::desc("Solve each query by racing this many forked Z3 processes "
+                   "that use different strategies. The first definitive "
+                   "answer is used and the other workers are killed. Values "
+                   "below 2 disable the portfolio (experimental) (default 0)"));
+
+llvm::cl::opt<unsigned> Z3Workers(
+    "z3-workers", llvm::cl::init(0),
+    llvm::cl::desc("Solve queries in this many persistent Z3 processes "
+                   "instead of in KLEE's process. 0 solves in-process "
+                   "(experimental) (default 0)"));
+
+llvm::cl::opt<double> Z3WorkerHardTimeout(
+    "z3-worker-hard-timeout", llvm::cl::init(0.0),
+    llvm::cl::desc("Wall-clock limit in seconds after which a Z3 worker is "
+                   "killed. 0 uses the solver timeout plus one second "
+                   "(default 0)"));
+
+llvm::cl::opt<unsigned> Z3WorkerMaxMemory(
+    "z3-worker-max-memory", llvm::cl::init(0),
+    llvm::cl::desc("Private resident memory limit in megabytes after which a "
+                   "Z3 worker is killed, abandoning its query. 0 means no "
+                   "limit (default 0)"));
+
+llvm::cl::opt<unsigned> Z3WorkerRestartMemory(
+    "z3-worker-restart-memory", llvm::cl::init(0),
+    llvm::cl::desc("Private resident memory in megabytes that an idle Z3 "
+                   "worker may keep from earlier queries. A worker above it "
+                   "is restarted before its next query. 0 uses "
+                   "--z3-worker-max-memory (default 0)"));
 }
 
 
@@ -40,6 +91,13 @@ namespace klee {
 
 class Z3SolverImpl : public SolverImpl {
 private:
+  // An ackermannized region of an array given as
+  // (array, (least significant bit, most significant bit)).
+  typedef std::pair<const Array *, std::pair<unsigned, unsigned> >
+      ArrayRegionTy;
+  // The sorted list of all regions ackermannized in a query.
+  typedef std::vector<ArrayRegionTy> AckermannSignatureTy;
+
   Z3Builder *builder;
   double timeout;
   SolverRunStatus runStatusCode;
@@ -48,15 +106,69 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  // Replacement variables for ackermannized array regions. These are
+  // reused across queries with the same ``lastSignature`` so that the same
+  // region is always represented by the same Z3 variable. Only the regions
+  // of ``lastSignature`` are kept.
+  std::map<ArrayRegionTy, Z3ASTHandle> ackermannVariables;
+  AckermannSignatureTy lastSignature;
+
+  // State used when ``Z3Incremental`` is enabled. ``incrementalSolver`` has
+  // one scope pushed for each constraint in ``incrementalConstraints`` (in
+  // order). These constraints were translated using the array
+  // ackermannization described by ``incrementalSignature``.
+  ::Z3_solver incrementalSolver;
+  std::vector<ref<Expr> > incrementalConstraints;
+  AckermannSignatureTy incrementalSignature;
+
+  // Shared memory used when ``Z3PortfolioWorkers`` is enabled. Each worker
+  // writes its model into its own slot of ``portfolioSlotSize`` bytes.
+  unsigned char *portfolioMemory;
+  size_t portfolioSlotSize;
+
+  // Out-of-process workers used when ``Z3Workers`` is enabled.
+  Z3WorkerPool *workerPool;
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
+  ::Z3_solver getIncrementalSolver(const Query &query,
+                                   const AckermannSignatureTy &signature);
+  void assertWithSideConstraints(::Z3_solver theSolver, Z3ASTHandle expr);
+  Z3ASTHandle getInitialByteRead(const Array *array, unsigned offset);
+  Z3ASTHandle getArrayByteRead(
+      const Array *array, unsigned offset,
+      FindArrayAckermannizationVisitor &ffv,
+      std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+          &arrayReplacements);
+  void getArrayValues(::Z3_model theModel, const Array *array,
+                      FindArrayAckermannizationVisitor &ffv,
+                      std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+                          &arrayReplacements,
+                      std::vector<unsigned char> &data);
+  bool getArrayInterpretation(::Z3_model theModel, const Array *array,
+                              std::vector<unsigned char> &data);
+  unsigned char evaluateByte(::Z3_model theModel, Z3ASTHandle byte);
+  SolverRunStatus runInWorker(
+      ::Z3_solver theSolver, const std::vector<const Array *> *objects,
+      std::vector<std::vector<unsigned char> > *values, bool &hasSolution,
+      FindArrayAckermannizationVisitor &ffv,
+      std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+          &arrayReplacements);
+  ::Z3_solver getPortfolioWorkerSolver(::Z3_solver theSolver, unsigned index);
+  SolverRunStatus runPortfolio(
+      ::Z3_solver theSolver, const std::vector<const Array *> *objects,
+      std::vector<std::vector<unsigned char> > *values, bool &hasSolution,
+      FindArrayAckermannizationVisitor &ffv,
+      std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+          &arrayReplacements);
 bool validateZ3Model(::Z3_solver &theSolver, ::Z3_model &theModel);
 void ackermannizeArrays(Z3Builder *z3Builder, const Query &query,
                         FindArrayAckermannizationVisitor &faav,
                         std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
-                            &arrayReplacements);
+                            &arrayReplacements,
+                        AckermannSignatureTy &signature);
 
 public:
 Z3SolverImpl();
@@ -92,7 +204,9 @@ void setCoreSolverTimeout(double _timeout) {
 
 Z3SolverImpl::Z3SolverImpl()
     : builder(new Z3Builder(/*autoClearConstructCache=*/false)), timeout(0.0),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE), dumpedQueriesFile(0) {
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE), dumpedQueriesFile(0),
+      incrementalSolver(NULL), portfolioMemory(NULL), portfolioSlotSize(0),
+      workerPool(NULL) {
   assert(builder && "unable to create Z3Builder");
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
@@ -108,6 +222,31 @@ Z3SolverImpl::Z3SolverImpl()
   // https://github.com/Z3Prover/z3/issues/507
   Z3_global_param_set("rewriter.hi_fp_unspecified", "true");
 
+  if (Z3Workers > 0)
+    workerPool = new Z3WorkerPool(Z3Workers, Z3WorkerMaxMemory,
+                                  Z3WorkerRestartMemory ? Z3WorkerRestartMemory
+                                                        : Z3WorkerMaxMemory);
+
+  if (Z3PortfolioWorkers > 1) {
+#ifdef __APPLE__
+    // Darwin by default has a very small limit on the maximum amount of
+    // shared memory, which will quickly be exhausted by KLEE running its
+    // tests in parallel.
+    portfolioSlotSize = 1 << 16;
+#else
+    portfolioSlotSize = 1 << 20;
+#endif
+    int portfolioMemoryId =
+        shmget(IPC_PRIVATE, portfolioSlotSize * Z3PortfolioWorkers,
+               IPC_CREAT | 0700);
+    if (portfolioMemoryId < 0)
+      llvm::report_fatal_error("unable to allocate shared memory region");
+    portfolioMemory = (unsigned char *)shmat(portfolioMemoryId, NULL, 0);
+    if (portfolioMemory == (void *)-1)
+      llvm::report_fatal_error("unable to attach shared memory region");
+    shmctl(portfolioMemoryId, IPC_RMID, NULL);
+  }
+
   if (!Z3QueryDumpFile.empty()) {
     std::string error;
     // FIXME: This partially comes from KleeHandler::openOutputFile(). That
@@ -123,6 +262,12 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  delete workerPool;
+  if (portfolioMemory)
+    shmdt(portfolioMemory);
+  if (incrementalSolver)
+    Z3_solver_dec_ref(builder->ctx, incrementalSolver);
+  ackermannVariables.clear();
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 
@@ -221,27 +366,62 @@ bool Z3SolverImpl::internalRunSolver(
 
 
   TimerStatIncrementer t(stats::queryTime);
-  // TODO: Does making a new solver for each query have a performance
-  // impact vs making one global solver and using push and pop?
-  // TODO: is the "simple_solver" the right solver to use for
-  // best performance?
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
-
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
   // Try ackermannize the arrays
   std::map<const ArrayAckermannizationInfo*,Z3ASTHandle> arrayReplacements;
+  AckermannSignatureTy signature;
   FindArrayAckermannizationVisitor faav(/*recursive=*/false);
   if (Z3AckermannizeArrays) {
-    ackermannizeArrays(this->builder, query, faav, arrayReplacements);
+    ackermannizeArrays(this->builder, query, faav, arrayReplacements,
+                       signature);
   }
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+  if (signature != lastSignature) {
+    // Drop the variables of regions that are no longer ackermannized so the
+    // map does not grow with every signature seen during a run.
+    std::map<ArrayRegionTy, Z3ASTHandle>::iterator it =
+        ackermannVariables.begin();
+    while (it != ackermannVariables.end()) {
+      if (std::binary_search(signature.begin(), signature.end(), it->first))
+        ++it;
+      else
+        ackermannVariables.erase(it++);
+    }
+    // A translation kept from an earlier query may read an array that is
+    // ackermannized now, which would mix both representations of the array,
+    // so drop the translations reading an array whose regions changed.
+    AckermannSignatureTy changed;
+    std::set_symmetric_difference(signature.begin(), signature.end(),
+                                  lastSignature.begin(), lastSignature.end(),
+                                  std::back_inserter(changed));
+    std::set<const Array *> changedArrays;
+    for (AckermannSignatureTy::const_iterator ci = changed.begin(),
+                                              ce = changed.end();
+         ci != ce; ++ci)
+      changedArrays.insert(ci->first);
+    builder->invalidateConstructCache(changedArrays);
+    lastSignature = signature;
+  }
+
+  Z3_solver theSolver;
+  if (Z3Incremental) {
+    // Reuses the constraints asserted by previous queries and pushes a fresh
+    // scope for the query expression.
+    theSolver = getIncrementalSolver(query, signature);
+    Z3_solver_push(builder->ctx, theSolver);
+  } else {
+    // TODO: is the "simple_solver" the right solver to use for
+    // best performance?
+    theSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it) {
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+    }
   }
 
   ++stats::queries;
@@ -256,19 +436,13 @@ bool Z3SolverImpl::internalRunSolver(
   // but Z3 works in terms of satisfiability so instead we ask the
   // negation of the equivalent i.e.
   // ∃ X Constraints(X) ∧ ¬ query(X)
-  Z3_solver_assert(
-      builder->ctx, theSolver,
+  // Assert an generated side constraints we have after this so that all
+  // other constraints have been traversed so we have all the side
+  // constraints needed.
+  assertWithSideConstraints(
+      theSolver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
 
-  // Assert an generated side constraints we have to this last so that all other
-  // constraints have been traversed so we have all the side constraints needed.
-  for (std::vector<Z3ASTHandle>::iterator it = builder->sideConstraints.begin(),
-                                          ie = builder->sideConstraints.end();
-       it != ie; ++it) {
-    Z3ASTHandle sideConstraint = *it;
-    Z3_solver_assert(builder->ctx, theSolver, sideConstraint);
-  }
-
   if (dumpedQueriesFile) {
     *dumpedQueriesFile << "; start Z3 query\n";
     *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
@@ -278,9 +452,26 @@ bool Z3SolverImpl::internalRunSolver(
     dumpedQueriesFile->flush();
   }
 
-  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
-  runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
-                                       hasSolution, faav, arrayReplacements);
+  size_t modelSize = 0;
+  if (objects) {
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it)
+      modelSize += (*it)->getSizeInBytes();
+  }
+
+  if (workerPool) {
+    runStatusCode = runInWorker(theSolver, objects, values, hasSolution, faav,
+                                arrayReplacements);
+  } else if (portfolioMemory && modelSize <= portfolioSlotSize) {
+    runStatusCode = runPortfolio(theSolver, objects, values, hasSolution, faav,
+                                 arrayReplacements);
+  } else {
+    ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+    runStatusCode = handleSolverResponse(theSolver, satisfiable, objects,
+                                         values, hasSolution, faav,
+                                         arrayReplacements);
+  }
 
   if (Z3AckermannizeArrays) {
     // Remove any replacements we made as accumulating these across
@@ -288,17 +479,19 @@ bool Z3SolverImpl::internalRunSolver(
     builder->clearReplacements();
   }
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
+  if (Z3Incremental) {
+    // Drop the query expression but keep the constraints for the next query.
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  // Trim the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and trimming now
   // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
+  // ``Query`` (and with ``-z3-construct-cache-size`` across queries)
+  // rather than only sharing within a single call to
   // ``builder->construct()``.
-  builder->clearConstructCache();
-
-  // Clear any generated side constraints could break subsequent queries
-  // if we assert them in the future.
-  builder->clearSideConstraints();
+  builder->trimConstructCache();
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -312,6 +505,560 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
+void Z3SolverImpl::assertWithSideConstraints(::Z3_solver theSolver,
+                                             Z3ASTHandle expr) {
+  Z3_solver_assert(builder->ctx, theSolver, expr);
+  // The builder emits the side constraints of cached expressions every time
+  // they are reused so skip duplicates.
+  std::set< ::Z3_ast> asserted;
+  for (std::vector<Z3ASTHandle>::iterator it = builder->sideConstraints.begin(),
+                                          ie = builder->sideConstraints.end();
+       it != ie; ++it) {
+    Z3ASTHandle sideConstraint = *it;
+    if (asserted.insert(sideConstraint).second)
+      Z3_solver_assert(builder->ctx, theSolver, sideConstraint);
+  }
+  // Clear any generated side constraints could break subsequent queries
+  // if we assert them in the future.
+  builder->clearSideConstraints();
+}
+
+::Z3_solver
+Z3SolverImpl::getIncrementalSolver(const Query &query,
+                                   const AckermannSignatureTy &signature) {
+  if (!incrementalSolver) {
+    incrementalSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, incrementalSolver);
+  }
+  // The timeout might have changed since the last query.
+  Z3_solver_set_params(builder->ctx, incrementalSolver, solverParameters);
+
+  // Constraints asserted for a previous query are only reusable if they were
+  // translated with exactly the same array ackermannization. Otherwise the
+  // same array could be represented by both a Z3 array and a replacement
+  // variable.
+  if (signature != incrementalSignature) {
+    Z3_solver_reset(builder->ctx, incrementalSolver);
+    incrementalConstraints.clear();
+    incrementalSignature = signature;
+  }
+
+  // Find the longest prefix of the constraints that is already asserted.
+  unsigned prefix = 0;
+  ConstraintManager::const_iterator it = query.constraints.begin(),
+                                    ie = query.constraints.end();
+  for (; it != ie && prefix < incrementalConstraints.size(); ++it, ++prefix) {
+    if (*it != incrementalConstraints[prefix])
+      break;
+  }
+
+  if (prefix < incrementalConstraints.size()) {
+    Z3_solver_pop(builder->ctx, incrementalSolver,
+                  incrementalConstraints.size() - prefix);
+    incrementalConstraints.resize(prefix);
+  }
+
+  // Assert the remaining constraints, each in its own scope so they can be
+  // popped individually by later queries.
+  for (; it != ie; ++it) {
+    Z3_solver_push(builder->ctx, incrementalSolver);
+    assertWithSideConstraints(incrementalSolver, builder->construct(*it));
+    incrementalConstraints.push_back(*it);
+  }
+
+  return incrementalSolver;
+}
+
+Z3ASTHandle Z3SolverImpl::getInitialByteRead(const Array *array,
+                                             unsigned offset) {
+  if (array->getRange() == Expr::Int8)
+    return builder->getInitialRead(array, offset);
+  // Elements wider than a byte are stored little-endian.
+  unsigned bytes = array->getRange() / 8;
+  unsigned low = (offset % bytes) * 8;
+  return Z3ASTHandle(
+      Z3_mk_extract(builder->ctx, /*high=*/low + 7, low,
+                    builder->getInitialRead(array, offset / bytes)),
+      builder->ctx);
+}
+
+Z3ASTHandle Z3SolverImpl::getArrayByteRead(
+    const Array *array, unsigned offset,
+    FindArrayAckermannizationVisitor &ffv,
+    std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+        &arrayReplacements) {
+  // See if there is any ackermannization info for this array
+  FindArrayAckermannizationVisitor::ArrayToAckermannizationInfoMapTy::
+      const_iterator aiii = ffv.ackermannizationInfo.find(array);
+  if (aiii == ffv.ackermannizationInfo.end() || aiii->second.empty()) {
+    // This array wasn't ackermannized.
+    return getInitialByteRead(array, offset);
+  }
+
+  // Look through the possible ackermannized regions of the array
+  // and find the region that corresponds to this byte.
+  const std::vector<ArrayAckermannizationInfo> &aais = aiii->second;
+  for (std::vector<ArrayAckermannizationInfo>::const_iterator
+           i = aais.begin(),
+           ie = aais.end();
+       i != ie; ++i) {
+    const ArrayAckermannizationInfo* info = &(*i);
+    if (!(info->containsByte(offset))) {
+      continue;
+    }
+
+    // This is the ackermannized region for this offset.
+    Z3ASTHandle replacementVariable = arrayReplacements[info];
+    assert((offset*8) >= info->contiguousLSBitIndex);
+    unsigned bitOffsetToReadWithinVariable = (offset*8) - info->contiguousLSBitIndex;
+    assert(bitOffsetToReadWithinVariable < info->getWidth());
+    // Extract the byte
+    return Z3ASTHandle(
+        Z3_mk_extract(
+            builder->ctx, /*high=*/bitOffsetToReadWithinVariable + 7,
+            /*low=*/bitOffsetToReadWithinVariable, replacementVariable),
+        builder->ctx);
+  }
+  // The array was ackermannized but this byte wasn't.
+  return Z3ASTHandle();
+}
+
+SolverImpl::SolverRunStatus Z3SolverImpl::runInWorker(
+    ::Z3_solver theSolver, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution,
+    FindArrayAckermannizationVisitor &ffv,
+    std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+        &arrayReplacements) {
+  // Give every byte of the requested assignment a name the worker can look
+  // up in its model. Bytes that are not used by the query are pinned to zero
+  // like handleSolverResponse() does.
+  Z3WorkerPool::Request request;
+  if (objects) {
+    Z3SortHandle byteSort = builder->getBvSort(8);
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it) {
+      const Array *array = *it;
+      for (unsigned offset = 0; offset < array->getSizeInBytes(); offset++) {
+        std::string name =
+            Z3WorkerPool::getModelByteName(request.numModelBytes++);
+        Z3ASTHandle modelByte(
+            Z3_mk_const(builder->ctx,
+                        Z3_mk_string_symbol(builder->ctx, name.c_str()),
+                        byteSort),
+            builder->ctx);
+        Z3ASTHandle read =
+            getArrayByteRead(array, offset, ffv, arrayReplacements);
+        if (Z3_ast(read) == NULL)
+          read = Z3ASTHandle(Z3_mk_int(builder->ctx, 0, byteSort), builder->ctx);
+        Z3_solver_assert(
+            builder->ctx, theSolver,
+            Z3ASTHandle(Z3_mk_eq(builder->ctx, modelByte, read), builder->ctx));
+      }
+    }
+  }
+
+  request.smtlib = Z3_solver_to_string(builder->ctx, theSolver);
+  request.timeout = timeout;
+  if (Z3WorkerHardTimeout > 0)
+    request.hardTimeout = Z3WorkerHardTimeout;
+  else if (timeout > 0)
+    request.hardTimeout = timeout + 1.0;
+
+  int ticket = workerPool->submit(request);
+  if (ticket < 0)
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+  Z3WorkerPool::Response response = workerPool->wait(ticket);
+
+  switch (response.status) {
+  case Z3WorkerPool::SAT: {
+    hasSolution = true;
+    if (!objects)
+      return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+    assert(values && "values cannot be nullptr");
+    values->reserve(objects->size());
+    std::vector<unsigned char>::const_iterator pos = response.model.begin();
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it) {
+      values->push_back(
+          std::vector<unsigned char>(pos, pos + (*it)->getSizeInBytes()));
+      pos += (*it)->getSizeInBytes();
+    }
+    return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+  case Z3WorkerPool::UNSAT:
+    hasSolution = false;
+    return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  case Z3WorkerPool::TIMEOUT:
+    return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+  default:
+    return SolverImpl::SOLVER_RUN_STATUS_FAILURE;
+  }
+}
+
+::Z3_solver Z3SolverImpl::getPortfolioWorkerSolver(::Z3_solver theSolver,
+                                                   unsigned index) {
+  // This is only called in a forked worker which exits as soon as it has an
+  // answer, so nothing created here is released.
+  ::Z3_context ctx = builder->ctx;
+  if (index == 0) {
+    // Z3's default strategy.
+    return theSolver;
+  }
+
+  if (index == 1) {
+    // Eagerly lower floating point to bit-vectors and bit-blast to SAT. This
+    // tactic fails on goals that are not pure bit-vector after lowering
+    // (e.g. ones that still contain arrays) in which case Z3's default SMT
+    // core is used instead.
+    const char *eagerTactics[] = {"simplify", "fp2bv", "simplify",
+                                  "bit-blast", "sat"};
+    ::Z3_tactic eager = Z3_mk_tactic(ctx, eagerTactics[0]);
+    Z3_tactic_inc_ref(ctx, eager);
+    for (unsigned i = 1; i < sizeof(eagerTactics) / sizeof(eagerTactics[0]);
+         ++i) {
+      ::Z3_tactic next = Z3_mk_tactic(ctx, eagerTactics[i]);
+      Z3_tactic_inc_ref(ctx, next);
+      eager = Z3_tactic_and_then(ctx, eager, next);
+      Z3_tactic_inc_ref(ctx, eager);
+    }
+    ::Z3_tactic fallback = Z3_mk_tactic(ctx, "smt");
+    Z3_tactic_inc_ref(ctx, fallback);
+    ::Z3_tactic tactic = Z3_tactic_or_else(ctx, eager, fallback);
+    Z3_tactic_inc_ref(ctx, tactic);
+
+    ::Z3_solver workerSolver = Z3_mk_solver_from_tactic(ctx, tactic);
+    Z3_solver_inc_ref(ctx, workerSolver);
+    Z3_solver_set_params(ctx, workerSolver, solverParameters);
+    ::Z3_ast_vector assertions = Z3_solver_get_assertions(ctx, theSolver);
+    Z3_ast_vector_inc_ref(ctx, assertions);
+    for (unsigned i = 0, e = Z3_ast_vector_size(ctx, assertions); i != e; ++i)
+      Z3_solver_assert(ctx, workerSolver, Z3_ast_vector_get(ctx, assertions, i));
+    return workerSolver;
+  }
+
+  // The default strategy with a different random seed.
+  ::Z3_params seedParameters = Z3_mk_params(ctx);
+  Z3_params_inc_ref(ctx, seedParameters);
+  Z3_params_set_uint(ctx, seedParameters,
+                     Z3_mk_string_symbol(ctx, "random_seed"), index);
+  Z3_solver_set_params(ctx, theSolver, seedParameters);
+  return theSolver;
+}
+
+SolverImpl::SolverRunStatus Z3SolverImpl::runPortfolio(
+    ::Z3_solver theSolver, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution,
+    FindArrayAckermannizationVisitor &ffv,
+    std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
+        &arrayReplacements) {
+  fflush(stdout);
+  fflush(stderr);
+
+  // Start the workers. Each reports its answer through its exit code like
+  // the forked STP solver does: 0 for sat, 1 for unsat and 52 for a timeout.
+  // A satisfying assignment is written to the worker's shared memory slot.
+  std::vector<pid_t> workers;
+  for (unsigned index = 0; index < Z3PortfolioWorkers; ++index) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      klee_warning("fork failed (for Z3 portfolio worker)");
+      break;
+    }
+
+    if (pid == 0) {
+      ::Z3_solver workerSolver = getPortfolioWorkerSolver(theSolver, index);
+      ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, workerSolver);
+      if (satisfiable == Z3_L_UNDEF) {
+        ::Z3_string reason =
+            Z3_solver_get_reason_unknown(builder->ctx, workerSolver);
+        if (strcmp(reason, "timeout") == 0 ||
+            strcmp(reason, "canceled") == 0 ||
+            strcmp(reason, "(resource limits reached)") == 0)
+          _exit(52);
+        _exit(53);
+      }
+
+      std::vector<std::vector<unsigned char> > workerValues;
+      bool workerHasSolution;
+      handleSolverResponse(workerSolver, satisfiable, objects,
+                           objects ? &workerValues : NULL, workerHasSolution,
+                           ffv, arrayReplacements);
+      unsigned char *pos = portfolioMemory + index * portfolioSlotSize;
+      for (std::vector<std::vector<unsigned char> >::const_iterator
+               it = workerValues.begin(),
+               ie = workerValues.end();
+           it != ie; ++it) {
+        std::copy(it->begin(), it->end(), pos);
+        pos += it->size();
+      }
+      _exit(workerHasSolution ? 0 : 1);
+    }
+
+    workers.push_back(pid);
+  }
+
+  if (workers.empty())
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+
+  // Wait for the first definitive answer. Only the workers' own pids are
+  // waited for, as KLEE may have other children (Z3 worker pool processes,
+  // --workers processes) that are reaped by their owners.
+  int winner = -1;
+  int winnerExitCode = 0;
+  bool sawTimeout = false;
+  unsigned running = workers.size();
+  while (running && winner == -1) {
+    bool reaped = false;
+    for (unsigned i = 0; i < workers.size() && winner == -1; ++i) {
+      if (workers[i] == 0)
+        continue;
+      int status;
+      pid_t res = waitpid(workers[i], &status, WNOHANG);
+      if (res == 0 || (res < 0 && errno == EINTR))
+        continue;
+      reaped = true;
+      workers[i] = 0;
+      --running;
+      if (res < 0) {
+        klee_warning("waitpid() for Z3 portfolio worker failed");
+        continue;
+      }
+
+      if (!WIFEXITED(status))
+        continue;
+      int exitCode = WEXITSTATUS(status);
+      if (exitCode == 0 || exitCode == 1) {
+        winner = i;
+        winnerExitCode = exitCode;
+      } else if (exitCode == 52) {
+        sawTimeout = true;
+      }
+    }
+    if (!reaped && winner == -1)
+      usleep(1000);
+  }
+
+  // Kill the losers.
+  for (std::vector<pid_t>::iterator it = workers.begin(), ie = workers.end();
+       it != ie; ++it) {
+    if (*it == 0)
+      continue;
+    kill(*it, SIGKILL);
+    int status;
+    while (waitpid(*it, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  if (winner == -1) {
+    if (sawTimeout)
+      return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+    klee_warning("no Z3 portfolio worker returned a recognized answer");
+    return SolverImpl::SOLVER_RUN_STATUS_FAILURE;
+  }
+
+  if (winnerExitCode == 1) {
+    hasSolution = false;
+    return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  }
+
+  hasSolution = true;
+  if (objects) {
+    assert(values && "values cannot be nullptr");
+    values->reserve(objects->size());
+    const unsigned char *pos = portfolioMemory + winner * portfolioSlotSize;
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it) {
+      values->push_back(
+          std::vector<unsigned char>(pos, pos + (*it)->getSizeInBytes()));
+      pos += (*it)->getSizeInBytes();
+    }
+  }
+  return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+}
+
+unsigned char Z3SolverImpl::evaluateByte(::Z3_model theModel,
+                                         Z3ASTHandle byte) {
+  ::Z3_ast rawValue;
+  bool successfulEval = Z3_model_eval(builder->ctx, theModel, byte,
+                                      /*model_completion=*/Z3_TRUE, &rawValue);
+  assert(successfulEval && "Failed to evaluate model");
+  Z3ASTHandle value(rawValue, builder->ctx);
+  assert(Z3_get_ast_kind(builder->ctx, value) == Z3_NUMERAL_AST &&
+         "Evaluated expression has wrong sort");
+
+  int byteValue = 0;
+  bool successGet = Z3_get_numeral_int(builder->ctx, value, &byteValue);
+  assert(successGet && "failed to get value back");
+  assert(byteValue >= 0 && byteValue <= 255 &&
+         "Integer from model is out of range");
+  return byteValue;
+}
+
+/// Read a numeral from a model into \a out, returning false if \a node is
+/// not a numeral (for instance an unconstrained `else` of an interpretation).
+static bool getNumeral(Z3_context ctx, ::Z3_ast node, uint64_t &out) {
+  if (!node || Z3_get_ast_kind(ctx, node) != Z3_NUMERAL_AST)
+    return false;
+  return Z3_get_numeral_uint64(ctx, node, &out);
+}
+
+/// Set the elements [\a begin, \a end) of \a array to \a value in the byte
+/// representation \a data.
+static void fillElements(const Array *array, uint64_t begin, uint64_t end,
+                         uint64_t value, std::vector<unsigned char> &data) {
+  unsigned bytes = array->getRange() / 8;
+  for (uint64_t i = begin; i != end; ++i)
+    for (unsigned b = 0; b != bytes; ++b)
+      data[i * bytes + b] = value >> (8 * b);
+}
+
+bool Z3SolverImpl::getArrayInterpretation(::Z3_model theModel,
+                                          const Array *array,
+                                          std::vector<unsigned char> &data) {
+  Z3_context ctx = builder->ctx;
+  Z3ASTHandle arrayExpr = builder->getInitialArray(array);
+  ::Z3_func_decl decl = Z3_get_app_decl(ctx, Z3_to_app(ctx, arrayExpr));
+  if (!Z3_model_has_interp(ctx, theModel, decl)) {
+    // The array does not occur in the query so any value will do.
+    return true;
+  }
+
+  // The interpretation is a chain of stores on top of either a constant
+  // array or a reference to a function interpretation.
+  Z3ASTHandle node(Z3_model_get_const_interp(ctx, theModel, decl), ctx);
+  std::vector<std::pair<uint64_t, uint64_t> > stores;
+  for (;;) {
+    if (Z3_get_ast_kind(ctx, node) != Z3_APP_AST)
+      return false;
+    ::Z3_app app = Z3_to_app(ctx, node);
+    if (Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, app)) != Z3_OP_STORE)
+      break;
+    uint64_t index, value;
+    if (!getNumeral(ctx, Z3_get_app_arg(ctx, app, 1), index) ||
+        !getNumeral(ctx, Z3_get_app_arg(ctx, app, 2), value))
+      return false;
+    stores.push_back(std::make_pair(index, value));
+    node = Z3ASTHandle(Z3_get_app_arg(ctx, app, 0), ctx);
+  }
+
+  ::Z3_app app = Z3_to_app(ctx, node);
+  if (Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, app)) == Z3_OP_CONST_ARRAY) {
+    uint64_t value;
+    if (!getNumeral(ctx, Z3_get_app_arg(ctx, app, 0), value))
+      return false;
+    fillElements(array, 0, array->size, value, data);
+  } else if (Z3_is_as_array(ctx, node)) {
+    ::Z3_func_interp interp = Z3_model_get_func_interp(
+        ctx, theModel, Z3_get_as_array_func_decl(ctx, node));
+    if (!interp)
+      return false;
+    Z3_func_interp_inc_ref(ctx, interp);
+
+    uint64_t value;
+    bool success = getNumeral(ctx, Z3_func_interp_get_else(ctx, interp), value);
+    if (success)
+      fillElements(array, 0, array->size, value, data);
+    for (unsigned i = 0, e = Z3_func_interp_get_num_entries(ctx, interp);
+         success && i != e; ++i) {
+      ::Z3_func_entry entry = Z3_func_interp_get_entry(ctx, interp, i);
+      Z3_func_entry_inc_ref(ctx, entry);
+      uint64_t index;
+      success = getNumeral(ctx, Z3_func_entry_get_arg(ctx, entry, 0), index) &&
+                getNumeral(ctx, Z3_func_entry_get_value(ctx, entry), value);
+      if (success && index < array->size)
+        fillElements(array, index, index + 1, value, data);
+      Z3_func_entry_dec_ref(ctx, entry);
+    }
+    Z3_func_interp_dec_ref(ctx, interp);
+    if (!success)
+      return false;
+  } else {
+    return false;
+  }
+
+  // Apply the stores innermost first so that the outermost one wins.
+  for (std::vector<std::pair<uint64_t, uint64_t> >::reverse_iterator
+           it = stores.rbegin(),
+           ie = stores.rend();
+       it != ie; ++it) {
+    if (it->first < array->size)
+      fillElements(array, it->first, it->first + 1, it->second, data);
+  }
+  return true;
+}
+
+void Z3SolverImpl::getArrayValues(
+    ::Z3_model theModel, const Array *array,
+    FindArrayAckermannizationVisitor &ffv,
+    std::map<const ArrayAckermannizationInfo *, Z3ASTHandle> &arrayReplacements,
+    std::vector<unsigned char> &data) {
+  // Bytes which do not occur in the query can take any value, so they are
+  // left as zero without asking Z3.
+  data.assign(array->getSizeInBytes(), 0);
+
+  if (array->isConstantArray()) {
+    for (unsigned i = 0; i < array->size; ++i)
+      fillElements(array, i, i + 1, array->constantValues[i]->getZExtValue(),
+                   data);
+    return;
+  }
+
+  FindArrayAckermannizationVisitor::ArrayToAckermannizationInfoMapTy::
+      const_iterator aiii = ffv.ackermannizationInfo.find(array);
+  if (aiii != ffv.ackermannizationInfo.end() && !aiii->second.empty()) {
+    // Evaluate each replacement variable once and split it into bytes.
+    const std::vector<ArrayAckermannizationInfo> &aais = aiii->second;
+    for (std::vector<ArrayAckermannizationInfo>::const_iterator
+             i = aais.begin(),
+             ie = aais.end();
+         i != ie; ++i) {
+      const ArrayAckermannizationInfo *info = &(*i);
+      std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>::iterator
+          replacement = arrayReplacements.find(info);
+      assert(replacement != arrayReplacements.end() &&
+             "missing replacement variable");
+
+      ::Z3_ast rawValue;
+      bool successfulEval =
+          Z3_model_eval(builder->ctx, theModel, replacement->second,
+                        /*model_completion=*/Z3_TRUE, &rawValue);
+      assert(successfulEval && "Failed to evaluate model");
+      Z3ASTHandle value(rawValue, builder->ctx);
+      assert(Z3_get_ast_kind(builder->ctx, value) == Z3_NUMERAL_AST &&
+             "Evaluated expression has wrong sort");
+
+      unsigned width = info->getWidth();
+      llvm::APInt bits;
+      uint64_t smallValue;
+      if (width <= 64 &&
+          Z3_get_numeral_uint64(builder->ctx, value, &smallValue)) {
+        bits = llvm::APInt(width, smallValue);
+      } else {
+        bits = llvm::APInt(width, Z3_get_numeral_string(builder->ctx, value),
+                           10);
+      }
+
+      for (unsigned offset = (info->contiguousLSBitIndex + 7) / 8;
+           offset < data.size() && info->containsByte(offset); ++offset) {
+        unsigned bitOffset = (offset * 8) - info->contiguousLSBitIndex;
+        data[offset] = bits.lshr(bitOffset).trunc(8).getZExtValue();
+      }
+    }
+    return;
+  }
+
+  if (getArrayInterpretation(theModel, array, data))
+    return;
+
+  // The interpretation has a shape we don't understand so fall back to
+  // evaluating each byte separately.
+  for (unsigned offset = 0; offset < data.size(); offset++)
+    data[offset] = evaluateByte(theModel, getInitialByteRead(array, offset));
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const std::vector<const Array *> *objects,
@@ -334,79 +1081,8 @@ SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     for (std::vector<const Array *>::const_iterator it = objects->begin(),
                                                     ie = objects->end();
          it != ie; ++it) {
-      const Array *array = *it;
-      std::vector<unsigned char> data;
-
-      // See if there is any ackermannization info for this array
-      const std::vector<ArrayAckermannizationInfo>* aais = NULL;
-      FindArrayAckermannizationVisitor::ArrayToAckermannizationInfoMapTy::
-          const_iterator aiii = ffv.ackermannizationInfo.find(array);
-      if (aiii != ffv.ackermannizationInfo.end()) {
-        aais = &(aiii->second);
-      }
-
-      data.reserve(array->size);
-      for (unsigned offset = 0; offset < array->size; offset++) {
-        // We can't use Z3ASTHandle here so have to do ref counting manually
-        ::Z3_ast arrayElementExpr;
-        Z3ASTHandle initial_read = Z3ASTHandle();
-        if (aais && aais->size() > 0) {
-          // Look through the possible ackermannized regions of the array
-          // and find the region that corresponds to this byte.
-          for (std::vector<ArrayAckermannizationInfo>::const_iterator
-                   i = aais->begin(),
-                   ie = aais->end();
-               i != ie; ++i) {
-            const ArrayAckermannizationInfo* info = &(*i);
-            if (!(info->containsByte(offset))) {
-              continue;
-            }
-
-            // This is the ackermannized region for this offset.
-            Z3ASTHandle replacementVariable = arrayReplacements[info];
-            assert((offset*8) >= info->contiguousLSBitIndex);
-            unsigned bitOffsetToReadWithinVariable = (offset*8) - info->contiguousLSBitIndex;
-            assert(bitOffsetToReadWithinVariable < info->getWidth());
-            // Extract the byte
-            initial_read = Z3ASTHandle(
-                Z3_mk_extract(
-                    builder->ctx, /*high=*/bitOffsetToReadWithinVariable + 7,
-                    /*low=*/bitOffsetToReadWithinVariable, replacementVariable),
-                builder->ctx);
-            break;
-          }
-          if (Z3_ast(initial_read) == NULL) {
-            // The array was ackermannized but this particular byte
-            // wasn't which implies it wasn't used in the query.
-            // This implies the value for this byte doesn't matter
-            // so just assign zero for this byte.
-            data.push_back((unsigned char) 0);
-            continue;
-          }
-        } else {
-          // This array wasn't ackermannized.
-          initial_read = builder->getInitialRead(array, offset);
-        }
-
-        bool successfulEval =
-            Z3_model_eval(builder->ctx, theModel, initial_read,
-                          /*model_completion=*/Z3_TRUE, &arrayElementExpr);
-        assert(successfulEval && "Failed to evaluate model");
-        Z3_inc_ref(builder->ctx, arrayElementExpr);
-        assert(Z3_get_ast_kind(builder->ctx, arrayElementExpr) ==
-                   Z3_NUMERAL_AST &&
-               "Evaluated expression has wrong sort");
-
-        int arrayElementValue = 0;
-        bool successGet = Z3_get_numeral_int(builder->ctx, arrayElementExpr,
-                                             &arrayElementValue);
-        assert(successGet && "failed to get value back");
-        assert(arrayElementValue >= 0 && arrayElementValue <= 255 &&
-               "Integer from model is out of range");
-        data.push_back(arrayElementValue);
-        Z3_dec_ref(builder->ctx, arrayElementExpr);
-      }
-      values->push_back(data);
+      values->push_back(std::vector<unsigned char>());
+      getArrayValues(theModel, *it, ffv, arrayReplacements, values->back());
     }
 
     // Validate the model if requested
@@ -495,7 +1171,8 @@ void Z3SolverImpl::ackermannizeArrays(
     Z3Builder *z3Builder, const Query &query,
     FindArrayAckermannizationVisitor &faav,
     std::map<const ArrayAckermannizationInfo *, Z3ASTHandle>
-        &arrayReplacements) {
+        &arrayReplacements,
+    AckermannSignatureTy &signature) {
   for (ConstraintManager::const_iterator it = query.constraints.begin(),
                                          ie = query.constraints.end();
        it != ie; ++it) {
@@ -507,6 +1184,11 @@ void Z3SolverImpl::ackermannizeArrays(
                           aaie = faav.ackermannizationInfo.end();
        aaii != aaie; ++aaii) {
     const std::vector<ArrayAckermannizationInfo> &replacements = aaii->second;
+    if (!aaii->first->isConstantArray()) {
+      ++stats::queryArrays;
+      if (!replacements.empty())
+        ++stats::queryAckermannizedArrays;
+    }
     for (std::vector<ArrayAckermannizationInfo>::const_iterator
              i = replacements.begin(),
              ie = replacements.end();
@@ -519,7 +1201,12 @@ void Z3SolverImpl::ackermannizeArrays(
       llvm::raw_string_ostream os(str);
       os << aaInfo->getArray()->name << "_ackermann";
       assert(aaInfo->toReplace.size() > 0);
-      Z3ASTHandle replacementVar;
+      ArrayRegionTy region =
+          std::make_pair(aaInfo->getArray(),
+                         std::make_pair(aaInfo->contiguousLSBitIndex,
+                                        aaInfo->contiguousMSBitIndex));
+      signature.push_back(region);
+      Z3ASTHandle &replacementVar = ackermannVariables[region];
       for (ExprHashSet::const_iterator ei = aaInfo->toReplace.begin(),
                                        ee = aaInfo->toReplace.end();
            ei != ee; ++ei) {
@@ -534,6 +1221,7 @@ void Z3SolverImpl::ackermannizeArrays(
       arrayReplacements[aaInfo] = replacementVar;
     }
   }
+  std::sort(signature.begin(), signature.end());
 }
 
 SolverImpl::SolverRunStatus Z3SolverImpl::getOperationStatusCode() {
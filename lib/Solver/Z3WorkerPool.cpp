@@ -0,0 +1,396 @@
+//===-- Z3WorkerPool.cpp ---------------------------------------*- C++ -*-====//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "klee/Config/config.h"
+#ifdef ENABLE_Z3
+#include "Z3WorkerPool.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/SolverStats.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <z3.h>
+
+using namespace klee;
+
+namespace {
+// Worker exit code used when Z3 reports an error.
+const int WorkerErrorExitCode = 53;
+
+// How often a blocking wait() checks the worker's limits, in milliseconds.
+const int LimitCheckInterval = 50;
+
+bool writeAll(int fd, const void *data, size_t size) {
+  const char *pos = (const char *)data;
+  while (size) {
+    ssize_t res = write(fd, pos, size);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    pos += res;
+    size -= res;
+  }
+  return true;
+}
+
+bool readAll(int fd, void *data, size_t size) {
+  char *pos = (char *)data;
+  while (size) {
+    ssize_t res = read(fd, pos, size);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (res == 0)
+      return false; // EOF
+    pos += res;
+    size -= res;
+  }
+  return true;
+}
+
+void workerErrorHandler(Z3_context ctx, Z3_error_code ec) {
+  // A worker is only ever used for one query at a time, let the parent see
+  // the failure and start a fresh one.
+  _exit(WorkerErrorExitCode);
+}
+
+uint32_t solveInWorker(const std::string &smtlib, unsigned numModelBytes,
+                       unsigned timeoutInMilliSeconds,
+                       std::vector<unsigned char> &model) {
+  // Use a fresh context for each query so nothing accumulates in the
+  // worker between queries.
+  Z3_config cfg = Z3_mk_config();
+  Z3_context ctx = Z3_mk_context_rc(cfg);
+  Z3_del_config(cfg);
+  Z3_set_error_handler(ctx, workerErrorHandler);
+
+  Z3_solver solver = Z3_mk_solver(ctx);
+  Z3_solver_inc_ref(ctx, solver);
+  Z3_params params = Z3_mk_params(ctx);
+  Z3_params_inc_ref(ctx, params);
+  Z3_params_set_uint(ctx, params, Z3_mk_string_symbol(ctx, "timeout"),
+                     timeoutInMilliSeconds ? timeoutInMilliSeconds : UINT_MAX);
+  Z3_solver_set_params(ctx, solver, params);
+  Z3_solver_from_string(ctx, solver, smtlib.c_str());
+
+  uint32_t status;
+  switch (Z3_solver_check(ctx, solver)) {
+  case Z3_L_TRUE: {
+    status = Z3WorkerPool::SAT;
+    Z3_model theModel = Z3_solver_get_model(ctx, solver);
+    Z3_model_inc_ref(ctx, theModel);
+    Z3_sort byteSort = Z3_mk_bv_sort(ctx, 8);
+    model.resize(numModelBytes);
+    for (unsigned i = 0; i < numModelBytes; ++i) {
+      std::string name = Z3WorkerPool::getModelByteName(i);
+      Z3_ast byte =
+          Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, name.c_str()), byteSort);
+      Z3_inc_ref(ctx, byte);
+      Z3_ast value;
+      unsigned byteValue = 0;
+      if (!Z3_model_eval(ctx, theModel, byte, /*model_completion=*/Z3_TRUE,
+                         &value))
+        _exit(WorkerErrorExitCode);
+      Z3_inc_ref(ctx, value);
+      if (!Z3_get_numeral_uint(ctx, value, &byteValue) || byteValue > 255)
+        _exit(WorkerErrorExitCode);
+      model[i] = byteValue;
+      Z3_dec_ref(ctx, value);
+      Z3_dec_ref(ctx, byte);
+    }
+    Z3_model_dec_ref(ctx, theModel);
+    break;
+  }
+  case Z3_L_FALSE:
+    status = Z3WorkerPool::UNSAT;
+    break;
+  default: {
+    Z3_string reason = Z3_solver_get_reason_unknown(ctx, solver);
+    if (strcmp(reason, "timeout") == 0 || strcmp(reason, "canceled") == 0 ||
+        strcmp(reason, "(resource limits reached)") == 0)
+      status = Z3WorkerPool::TIMEOUT;
+    else
+      status = Z3WorkerPool::FAILURE;
+  }
+  }
+
+  Z3_params_dec_ref(ctx, params);
+  Z3_solver_dec_ref(ctx, solver);
+  Z3_del_context(ctx);
+  return status;
+}
+
+void runWorker(int requestFd, int responseFd) {
+  // The protocol is
+  //   request:  <u32 length> <SMT-LIBv2> <u32 model bytes> <u32 timeout ms>
+  //   response: <u32 status> [<model bytes> if SAT]
+  for (;;) {
+    uint32_t length, numModelBytes, timeoutInMilliSeconds;
+    if (!readAll(requestFd, &length, sizeof(length)))
+      _exit(0); // KLEE has gone away.
+    std::string smtlib(length, '\0');
+    if (length && !readAll(requestFd, &smtlib[0], length))
+      _exit(0);
+    if (!readAll(requestFd, &numModelBytes, sizeof(numModelBytes)) ||
+        !readAll(requestFd, &timeoutInMilliSeconds,
+                 sizeof(timeoutInMilliSeconds)))
+      _exit(0);
+
+    std::vector<unsigned char> model;
+    uint32_t status =
+        solveInWorker(smtlib, numModelBytes, timeoutInMilliSeconds, model);
+    if (!writeAll(responseFd, &status, sizeof(status)))
+      _exit(0);
+    if (status == Z3WorkerPool::SAT && !model.empty() &&
+        !writeAll(responseFd, &model[0], model.size()))
+      _exit(0);
+  }
+}
+
+// Sum the Private_Clean and Private_Dirty fields of the smaps file
+// \a path, in bytes. Returns false if the file cannot be read.
+bool sumPrivateMemory(const char *path, size_t &bytes) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+  bytes = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long kB;
+    if (sscanf(line, "Private_Clean: %lu kB", &kB) == 1 ||
+        sscanf(line, "Private_Dirty: %lu kB", &kB) == 1)
+      bytes += (size_t)kB << 10;
+  }
+  fclose(f);
+  return true;
+}
+
+// Return the resident memory of \a pid that is private to it, in bytes.
+// Workers are forked from KLEE, and the pages they inherit stay shared with
+// KLEE until one of them writes to a page, so these are not counted.
+size_t getPrivateResidentMemory(pid_t pid) {
+  char path[64];
+  size_t bytes;
+  snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+  if (sumPrivateMemory(path, bytes))
+    return bytes;
+  // Kernels before 4.14 only have the per mapping file.
+  snprintf(path, sizeof(path), "/proc/%d/smaps", (int)pid);
+  if (sumPrivateMemory(path, bytes))
+    return bytes;
+  return 0;
+}
+}
+
+Z3WorkerPool::Z3WorkerPool(unsigned numWorkers, unsigned maxMemoryMB,
+                           unsigned restartMemoryMB)
+    : maxMemory((size_t)maxMemoryMB << 20),
+      restartMemory((size_t)restartMemoryMB << 20) {
+  assert(numWorkers > 0 && "Z3WorkerPool needs at least one worker");
+  Worker w = {0, -1, -1, false, 0.0, 0};
+  workers.resize(numWorkers, w);
+}
+
+Z3WorkerPool::~Z3WorkerPool() {
+  for (std::vector<Worker>::iterator it = workers.begin(), ie = workers.end();
+       it != ie; ++it) {
+    if (it->pid)
+      kill(*it);
+  }
+}
+
+std::string Z3WorkerPool::getModelByteName(unsigned index) {
+  std::string name;
+  llvm::raw_string_ostream os(name);
+  os << "klee_model_byte_" << index;
+  return os.str();
+}
+
+bool Z3WorkerPool::spawn(Worker &w) {
+  int requestPipe[2], responsePipe[2];
+  if (pipe(requestPipe) != 0)
+    return false;
+  if (pipe(responsePipe) != 0) {
+    close(requestPipe[0]);
+    close(requestPipe[1]);
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    klee_warning("fork failed (for Z3 worker)");
+    close(requestPipe[0]);
+    close(requestPipe[1]);
+    close(responsePipe[0]);
+    close(responsePipe[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(requestPipe[1]);
+    close(responsePipe[0]);
+    // Don't hold on to the pipes of the other workers, otherwise they
+    // would not see KLEE going away.
+    for (std::vector<Worker>::iterator it = workers.begin(),
+                                       ie = workers.end();
+         it != ie; ++it) {
+      if (it->pid) {
+        close(it->requestFd);
+        close(it->responseFd);
+      }
+    }
+    // Interrupting KLEE should not kill a worker in the middle of a query,
+    // it exits once KLEE closes its end of the pipe.
+    signal(SIGINT, SIG_IGN);
+    runWorker(requestPipe[0], responsePipe[1]);
+    _exit(0);
+  }
+
+  close(requestPipe[0]);
+  close(responsePipe[1]);
+  w.pid = pid;
+  w.requestFd = requestPipe[1];
+  w.responseFd = responsePipe[0];
+  w.busy = false;
+  return true;
+}
+
+void Z3WorkerPool::kill(Worker &w) {
+  close(w.requestFd);
+  close(w.responseFd);
+  ::kill(w.pid, SIGKILL);
+  int status;
+  while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  w.pid = 0;
+  w.requestFd = w.responseFd = -1;
+  w.busy = false;
+}
+
+int Z3WorkerPool::submit(const Request &request) {
+  for (unsigned i = 0, e = workers.size(); i != e; ++i) {
+    Worker &w = workers[i];
+    if (w.busy)
+      continue;
+    // Restart a worker that kept too much memory from earlier queries, so
+    // that the next query starts with room to grow.
+    if (w.pid && restartMemory &&
+        getPrivateResidentMemory(w.pid) > restartMemory) {
+      klee_warning("Z3 worker kept too much memory, restarting it");
+      ++stats::queryZ3WorkerRestarts;
+      kill(w);
+    }
+    if (!w.pid && !spawn(w))
+      return -1;
+
+    uint32_t length = request.smtlib.size();
+    uint32_t numModelBytes = request.numModelBytes;
+    uint32_t timeoutInMilliSeconds =
+        (uint32_t)((request.timeout * 1000) + 0.5);
+    if (!writeAll(w.requestFd, &length, sizeof(length)) ||
+        !writeAll(w.requestFd, request.smtlib.data(), length) ||
+        !writeAll(w.requestFd, &numModelBytes, sizeof(numModelBytes)) ||
+        !writeAll(w.requestFd, &timeoutInMilliSeconds,
+                  sizeof(timeoutInMilliSeconds))) {
+      klee_warning("unable to send query to Z3 worker");
+      kill(w);
+      return -1;
+    }
+    w.busy = true;
+    w.deadline = request.hardTimeout > 0
+                     ? util::getWallTime() + request.hardTimeout
+                     : 0.0;
+    w.numModelBytes = numModelBytes;
+    ++stats::queryZ3WorkerQueries;
+    return i;
+  }
+  return -1;
+}
+
+bool Z3WorkerPool::checkLimits(Worker &w, Response &response) {
+  if (w.deadline > 0 && util::getWallTime() > w.deadline) {
+    klee_warning("Z3 worker exceeded its hard time limit, killing it");
+    ++stats::queryZ3WorkerRestarts;
+    kill(w);
+    response.status = TIMEOUT;
+    return true;
+  }
+  if (maxMemory && getPrivateResidentMemory(w.pid) > maxMemory) {
+    klee_warning("Z3 worker exceeded its memory limit, killing it");
+    ++stats::queryZ3WorkerRestarts;
+    kill(w);
+    response.status = FAILURE;
+    return true;
+  }
+  return false;
+}
+
+void Z3WorkerPool::readResponse(Worker &w, Response &response) {
+  uint32_t status;
+  if (!readAll(w.responseFd, &status, sizeof(status)) || status == PENDING ||
+      status > FAILURE) {
+    klee_warning("Z3 worker died");
+    kill(w);
+    response.status = FAILURE;
+    return;
+  }
+  response.status = (Status)status;
+  if (response.status == SAT) {
+    response.model.resize(w.numModelBytes);
+    if (!response.model.empty() &&
+        !readAll(w.responseFd, &response.model[0], response.model.size())) {
+      klee_warning("Z3 worker died");
+      kill(w);
+      response.status = FAILURE;
+      response.model.clear();
+      return;
+    }
+  }
+  w.busy = false;
+}
+
+Z3WorkerPool::Response Z3WorkerPool::wait(int ticket) {
+  assert(ticket >= 0 && (unsigned)ticket < workers.size() && "invalid ticket");
+  Worker &w = workers[ticket];
+  assert(w.busy && "no query outstanding for ticket");
+
+  Response response;
+  for (;;) {
+    struct pollfd pfd = {w.responseFd, POLLIN, 0};
+    int res = ::poll(&pfd, 1, LimitCheckInterval);
+    if (res > 0) {
+      readResponse(w, response);
+      return response;
+    }
+    if (res < 0 && errno != EINTR) {
+      klee_warning("poll() on Z3 worker failed");
+      kill(w);
+      response.status = FAILURE;
+      return response;
+    }
+    if (checkLimits(w, response))
+      return response;
+  }
+}
+#endif // ENABLE_Z3
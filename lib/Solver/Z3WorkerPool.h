@@ -0,0 +1,104 @@
+//===-- Z3WorkerPool.h -----------------------------------------*- C++ -*-====//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_Z3WORKERPOOL_H__
+#define __UTIL_Z3WORKERPOOL_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace klee {
+
+/// Z3WorkerPool - A pool of persistent processes that solve queries with Z3
+/// outside of KLEE's address space.
+///
+/// Queries are sent to a worker as SMT-LIBv2 assertions. A query that wants a
+/// model declares the 8-bit constants named by getModelByteName() and the
+/// worker sends back their values. Unlike Z3's own ``timeout`` parameter the
+/// limits enforced here are hard: a worker that runs past its wall-clock
+/// deadline or whose private resident memory grows past the limit is killed
+/// and replaced by a fresh one. An idle worker that kept too much memory
+/// from earlier queries is restarted before it gets another one.
+///
+/// submit() hands a query to an idle worker and returns immediately, and
+/// wait() blocks until it has been answered.
+class Z3WorkerPool {
+public:
+  enum Status { PENDING, SAT, UNSAT, TIMEOUT, FAILURE };
+
+  struct Request {
+    /// The assertions of the query in SMT-LIBv2.
+    std::string smtlib;
+    /// The number of model bytes to return if the query is satisfiable.
+    unsigned numModelBytes;
+    /// Z3's (soft) timeout in seconds, 0 for none.
+    double timeout;
+    /// Wall-clock limit in seconds after which the worker is killed, 0 for
+    /// none.
+    double hardTimeout;
+
+    Request() : numModelBytes(0), timeout(0.0), hardTimeout(0.0) {}
+  };
+
+  struct Response {
+    Status status;
+    std::vector<unsigned char> model;
+
+    Response() : status(PENDING) {}
+  };
+
+private:
+  struct Worker {
+    pid_t pid;
+    int requestFd;
+    int responseFd;
+    bool busy;
+    /// Wall-clock time at which the outstanding query is abandoned, 0 for
+    /// none.
+    double deadline;
+    /// The number of model bytes the outstanding query asked for.
+    unsigned numModelBytes;
+  };
+
+  std::vector<Worker> workers;
+  /// Limit on a worker's private resident memory in bytes, 0 for none.
+  size_t maxMemory;
+  /// Private resident memory in bytes above which an idle worker is
+  /// restarted, 0 for none.
+  size_t restartMemory;
+
+  bool spawn(Worker &w);
+  void kill(Worker &w);
+  /// Return true if the worker exceeded one of its limits (and was killed).
+  bool checkLimits(Worker &w, Response &response);
+  void readResponse(Worker &w, Response &response);
+
+public:
+  /// \param numWorkers The number of queries that can be outstanding at once.
+  /// \param maxMemoryMB The private resident memory limit of each worker in
+  /// megabytes, 0 for none.
+  /// \param restartMemoryMB The private resident memory in megabytes above
+  /// which an idle worker is restarted, 0 for none.
+  Z3WorkerPool(unsigned numWorkers, unsigned maxMemoryMB,
+               unsigned restartMemoryMB);
+  ~Z3WorkerPool();
+
+  /// Send \a request to an idle worker. Returns a ticket for the query or -1
+  /// if all workers are busy or a worker could not be started.
+  int submit(const Request &request);
+
+  /// Block until the query \a ticket has been answered.
+  Response wait(int ticket);
+
+  static std::string getModelByteName(unsigned index);
+};
+}
+
+#endif
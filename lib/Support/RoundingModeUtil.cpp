@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "klee/Internal/Support/RoundingModeUtil.h"
+#include "klee/klee.h" // For KLEE_FP_* constants
 #include "llvm/Support/ErrorHandling.h"
 #include <fenv.h>
 
@@ -47,4 +48,43 @@ const char *LLVMRoundingModeToString(llvm::APFloat::roundingMode rm) {
     llvm_unreachable("Invalid LLVM rounding mode");
   }
 }
+
+bool StringToLLVMRoundingMode(llvm::StringRef str,
+                              llvm::APFloat::roundingMode &rm) {
+  static const llvm::APFloat::roundingMode modes[] = {
+    llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmNearestTiesToAway,
+    llvm::APFloat::rmTowardPositive, llvm::APFloat::rmTowardNegative,
+    llvm::APFloat::rmTowardZero
+  };
+  for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+    if (str == LLVMRoundingModeToString(modes[i])) {
+      rm = modes[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool KleeRoundingModeToLLVMRoundingMode(uint64_t kleeRoundingMode,
+                                        llvm::APFloat::roundingMode &rm) {
+  switch (kleeRoundingMode) {
+  case KLEE_FP_RNE:
+    rm = llvm::APFloat::rmNearestTiesToEven;
+    return true;
+  case KLEE_FP_RNA:
+    rm = llvm::APFloat::rmNearestTiesToAway;
+    return true;
+  case KLEE_FP_RU:
+    rm = llvm::APFloat::rmTowardPositive;
+    return true;
+  case KLEE_FP_RD:
+    rm = llvm::APFloat::rmTowardNegative;
+    return true;
+  case KLEE_FP_RZ:
+    rm = llvm::APFloat::rmTowardZero;
+    return true;
+  default:
+    return false;
+  }
+}
 }
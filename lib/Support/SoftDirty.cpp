@@ -0,0 +1,98 @@
+//===-- SoftDirty.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/System/SoftDirty.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace klee;
+
+size_t util::getPageSize() {
+  static size_t pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+}
+
+#ifdef __linux__
+namespace {
+// See Documentation/vm/soft-dirty.txt and pagemap.txt in the kernel sources.
+const uint64_t PagemapSoftDirty = 1ULL << 55;
+
+int clearRefsFd = -1;
+int pagemapFd = -1;
+
+bool clear() {
+  return pwrite(clearRefsFd, "4", 1, 0) == 1;
+}
+
+bool readPagemap(const void *address, size_t size,
+                 std::vector<uint64_t> &entries) {
+  size_t pageSize = util::getPageSize();
+  uintptr_t first = (uintptr_t) address / pageSize;
+  uintptr_t last = ((uintptr_t) address + size - 1) / pageSize;
+  entries.resize(last - first + 1);
+  size_t bytes = entries.size() * sizeof(uint64_t);
+  return pread(pagemapFd, &entries[0], bytes, first * sizeof(uint64_t)) ==
+         (ssize_t) bytes;
+}
+
+/// Kernels without CONFIG_MEM_SOFT_DIRTY accept the request to clear the bits
+/// but never set them, so check that a write is actually noticed.
+bool isSupported() {
+  clearRefsFd = open("/proc/self/clear_refs", O_WRONLY);
+  pagemapFd = open("/proc/self/pagemap", O_RDONLY);
+  if (clearRefsFd < 0 || pagemapFd < 0)
+    return false;
+
+  size_t pageSize = util::getPageSize();
+  void *page = mmap(0, pageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED)
+    return false;
+  *(volatile char *) page = 1;
+
+  std::vector<uint64_t> entries;
+  bool supported = clear() && readPagemap(page, 1, entries) &&
+                   !(entries[0] & PagemapSoftDirty);
+  *(volatile char *) page = 2;
+  supported = supported && readPagemap(page, 1, entries) &&
+              (entries[0] & PagemapSoftDirty);
+  munmap(page, pageSize);
+  return supported;
+}
+}
+
+bool util::clearSoftDirtyPages() {
+  static bool supported = isSupported();
+  return supported && clear();
+}
+
+bool util::getSoftDirtyPages(const void *address, size_t size,
+                             std::vector<bool> &dirty) {
+  std::vector<uint64_t> entries;
+  if (!size || !readPagemap(address, size, entries))
+    return false;
+  dirty.resize(entries.size());
+  for (unsigned i = 0; i != entries.size(); ++i)
+    dirty[i] = entries[i] & PagemapSoftDirty;
+  return true;
+}
+#else
+bool util::clearSoftDirtyPages() {
+  return false;
+}
+
+bool util::getSoftDirtyPages(const void *address, size_t size,
+                             std::vector<bool> &dirty) {
+  return false;
+}
+#endif
@@ -0,0 +1,391 @@
+//===-- WorkerPool.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/WorkerPool.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+/* Messages are a type character followed by the payload size and the payload.
+
+   Worker to coordinator:
+     'I'  idle, waiting for a job
+     'J'  answer to a steal request: the branch decisions given away
+     'N'  answer to a steal request: nothing to give away
+     'D'  the final counters, after 'X' was received
+
+   Coordinator to worker:
+     'J'  a job: the branch decisions to replay
+     'S'  steal request
+     'X'  exit
+
+   Branch decisions are sent as '0' and '1' characters, like path files. */
+
+struct WorkerPool::Shared {
+  volatile unsigned testIDs;
+  volatile int halted;
+};
+
+/// Returns false if the other end was closed.
+static bool writeAll(int fd, const char *buf, size_t size) {
+  while (size) {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EPIPE)
+        return false;
+      klee_error("worker pool: write failed: %s", strerror(errno));
+    }
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Returns false if the other end was closed before \a size bytes arrived.
+static bool readAll(int fd, char *buf, size_t size) {
+  while (size) {
+    ssize_t n = read(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_error("worker pool: read failed: %s", strerror(errno));
+    }
+    if (n == 0)
+      return false;
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool sendMessage(int fd, char type, const std::vector<char> &payload) {
+  std::vector<char> message(1 + sizeof(uint32_t) + payload.size());
+  uint32_t size = payload.size();
+  message[0] = type;
+  memcpy(&message[1], &size, sizeof(size));
+  std::copy(payload.begin(), payload.end(),
+            message.begin() + 1 + sizeof(size));
+  return writeAll(fd, &message[0], message.size());
+}
+
+static bool receiveMessage(int fd, char &type, std::vector<char> &payload) {
+  uint32_t size;
+  if (!readAll(fd, &type, 1) ||
+      !readAll(fd, reinterpret_cast<char *>(&size), sizeof(size)))
+    return false;
+  payload.resize(size);
+  return !size || readAll(fd, &payload[0], size);
+}
+
+static bool sendMessage(int fd, char type) {
+  return sendMessage(fd, type, std::vector<char>());
+}
+
+WorkerPool::WorkerPool(unsigned _numWorkers)
+  : numWorkers(_numWorkers), workerID(-1), shared(0), input(-1), output(-1) {
+  assert(numWorkers && "a pool needs at least one worker");
+  void *mem = mmap(0, sizeof(Shared), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    klee_error("worker pool: unable to map shared memory: %s",
+               strerror(errno));
+  shared = static_cast<Shared *>(mem);
+  shared->testIDs = 0;
+  shared->halted = 0;
+}
+
+WorkerPool::~WorkerPool() {
+  for (std::vector<Worker>::iterator it = workers.begin(), ie = workers.end();
+       it != ie; ++it) {
+    close(it->toWorker);
+    close(it->fromWorker);
+  }
+  if (input >= 0)
+    close(input);
+  if (output >= 0)
+    close(output);
+  munmap(shared, sizeof(Shared));
+}
+
+void WorkerPool::start() {
+  assert(workers.empty() && "pool already started");
+
+  // Do not let the workers inherit buffered output.
+  fflush(0);
+
+  for (unsigned i = 0; i != numWorkers; ++i) {
+    int toWorker[2], fromWorker[2];
+    if (pipe(toWorker) < 0 || pipe(fromWorker) < 0)
+      klee_error("worker pool: unable to create pipe: %s", strerror(errno));
+
+    pid_t pid = fork();
+    if (pid < 0)
+      klee_error("worker pool: unable to fork worker: %s", strerror(errno));
+
+    if (pid == 0) {
+      for (std::vector<Worker>::iterator it = workers.begin(),
+             ie = workers.end(); it != ie; ++it) {
+        close(it->toWorker);
+        close(it->fromWorker);
+      }
+      workers.clear();
+      close(toWorker[1]);
+      close(fromWorker[0]);
+      workerID = i;
+      input = toWorker[0];
+      output = fromWorker[1];
+      return;
+    }
+
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    Worker w;
+    w.pid = pid;
+    w.toWorker = toWorker[1];
+    w.fromWorker = fromWorker[0];
+    w.idle = w.stealPending = w.exiting = w.exited = false;
+    workers.push_back(w);
+  }
+}
+
+unsigned WorkerPool::allocateTestID() {
+  return __sync_add_and_fetch(&shared->testIDs, 1);
+}
+
+unsigned WorkerPool::getNumTestIDs() const {
+  return shared->testIDs;
+}
+
+void WorkerPool::halt() {
+  shared->halted = 1;
+}
+
+bool WorkerPool::isHalted() const {
+  return shared->halted;
+}
+
+/***/
+
+void WorkerPool::sendToCoordinator(char type,
+                                   const std::vector<char> &payload) {
+  assert(isWorker());
+  if (!sendMessage(output, type, payload))
+    klee_error("worker pool: lost connection to the coordinator");
+}
+
+static std::vector<char> encodePrefix(const std::vector<bool> &prefix) {
+  std::vector<char> payload;
+  payload.reserve(prefix.size());
+  for (std::vector<bool>::const_iterator it = prefix.begin(),
+         ie = prefix.end(); it != ie; ++it)
+    payload.push_back(*it ? '1' : '0');
+  return payload;
+}
+
+bool WorkerPool::getJob(std::vector<bool> &prefix) {
+  sendToCoordinator('I', std::vector<char>());
+  for (;;) {
+    char type;
+    std::vector<char> payload;
+    if (!receiveMessage(input, type, payload))
+      klee_error("worker pool: lost connection to the coordinator");
+
+    switch (type) {
+    case 'S':
+      // The request crossed our idle message.
+      sendToCoordinator('N', std::vector<char>());
+      break;
+    case 'X':
+      return false;
+    case 'J':
+      prefix.clear();
+      prefix.reserve(payload.size());
+      for (std::vector<char>::iterator it = payload.begin(),
+             ie = payload.end(); it != ie; ++it)
+        prefix.push_back(*it == '1');
+      return true;
+    default:
+      klee_error("worker pool: unexpected message '%c'", type);
+    }
+  }
+}
+
+bool WorkerPool::isStealRequested() {
+  struct pollfd pfd;
+  pfd.fd = input;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0) <= 0)
+    return false;
+
+  char type;
+  std::vector<char> payload;
+  if (!receiveMessage(input, type, payload))
+    klee_error("worker pool: lost connection to the coordinator");
+  if (type != 'S')
+    klee_error("worker pool: unexpected message '%c'", type);
+  return true;
+}
+
+void WorkerPool::donate(const std::vector<bool> &prefix) {
+  sendToCoordinator('J', encodePrefix(prefix));
+}
+
+void WorkerPool::decline() {
+  sendToCoordinator('N', std::vector<char>());
+}
+
+void WorkerPool::finish(const std::vector<uint64_t> &counters) {
+  const char *data = reinterpret_cast<const char *>(&counters[0]);
+  sendToCoordinator(
+      'D', std::vector<char>(data, data + counters.size() * sizeof(uint64_t)));
+}
+
+/***/
+
+void WorkerPool::coordinate(std::vector<uint64_t> &totals) {
+  assert(!isWorker() && workers.size() == numWorkers);
+
+  // The first worker to ask explores the whole tree.
+  std::deque<std::vector<char> > jobs(1);
+  unsigned running = numWorkers;
+
+  // A worker which dies is noticed when reading from it; do not let writing
+  // to it first kill the coordinator.
+  signal(SIGPIPE, SIG_IGN);
+
+  while (running) {
+    if (isHalted())
+      jobs.clear();
+
+    unsigned idle = 0, busy = 0, stealsPending = 0;
+    for (std::vector<Worker>::iterator it = workers.begin(),
+           ie = workers.end(); it != ie; ++it) {
+      if (it->exiting)
+        continue;
+      if (it->idle && !jobs.empty()) {
+        sendMessage(it->toWorker, 'J', jobs.front());
+        jobs.pop_front();
+        it->idle = false;
+      }
+      idle += it->idle;
+      busy += !it->idle;
+      stealsPending += it->stealPending;
+    }
+
+    // Ask busy workers for work, at most one request per idle worker.
+    if (!isHalted()) {
+      for (std::vector<Worker>::iterator it = workers.begin(),
+             ie = workers.end(); it != ie && stealsPending < idle; ++it) {
+        if (!it->exiting && !it->idle && !it->stealPending) {
+          sendMessage(it->toWorker, 'S');
+          it->stealPending = true;
+          ++stealsPending;
+        }
+      }
+    }
+
+    // All work is done when every worker is idle and no work is in flight;
+    // after a halt idle workers are not given anything new.
+    if ((!busy && jobs.empty() && !stealsPending) || isHalted()) {
+      for (std::vector<Worker>::iterator it = workers.begin(),
+             ie = workers.end(); it != ie; ++it) {
+        if (it->idle && !it->exiting) {
+          sendMessage(it->toWorker, 'X');
+          it->exiting = true;
+        }
+      }
+    }
+
+    std::vector<struct pollfd> fds;
+    std::vector<unsigned> fdWorkers;
+    for (unsigned i = 0; i != numWorkers; ++i) {
+      if (workers[i].exited)
+        continue;
+      struct pollfd pfd;
+      pfd.fd = workers[i].fromWorker;
+      pfd.events = POLLIN;
+      fds.push_back(pfd);
+      fdWorkers.push_back(i);
+    }
+    if (fds.empty())
+      break;
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_error("worker pool: poll failed: %s", strerror(errno));
+    }
+
+    for (unsigned i = 0; i != fds.size(); ++i) {
+      if (!fds[i].revents)
+        continue;
+      Worker &w = workers[fdWorkers[i]];
+      char type;
+      std::vector<char> payload;
+      if (!receiveMessage(w.fromWorker, type, payload)) {
+        if (!w.exiting)
+          klee_warning("worker %u exited unexpectedly, its paths are lost",
+                       fdWorkers[i]);
+        w.idle = w.exiting = w.exited = true;
+        w.stealPending = false;
+        --running;
+        continue;
+      }
+
+      switch (type) {
+      case 'I':
+        w.idle = true;
+        break;
+      case 'J':
+        w.stealPending = false;
+        jobs.push_back(payload);
+        break;
+      case 'N':
+        w.stealPending = false;
+        break;
+      case 'D': {
+        unsigned n = payload.size() / sizeof(uint64_t);
+        if (totals.size() < n)
+          totals.resize(n);
+        for (unsigned j = 0; j != n; ++j) {
+          uint64_t value;
+          memcpy(&value, &payload[j * sizeof(uint64_t)], sizeof(value));
+          totals[j] += value;
+        }
+        w.exited = true;
+        --running;
+        break;
+      }
+      default:
+        klee_error("worker pool: unexpected message '%c' from worker %u",
+                   type, fdWorkers[i]);
+      }
+    }
+  }
+
+  for (std::vector<Worker>::iterator it = workers.begin(), ie = workers.end();
+       it != ie; ++it) {
+    int status;
+    while (waitpid(it->pid, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+}
@@ -30,50 +30,34 @@ enum {
 #error Architecture not supported
 #endif
 
+// The conversions below are written without branches so that a symbolic
+// rounding mode does not fork a state for every mode here. The bitwise
+// operators are deliberate.
+
 int klee_internal_fegetround(void) {
   enum KleeRoundingMode rm = klee_get_rounding_mode();
-  switch(rm) {
-    case KLEE_FP_RNE:
-      return FE_TONEAREST;
-    case KLEE_FP_RNA:
-      return FE_TONEAREST_TIES_TO_AWAY;
-    case KLEE_FP_RU:
-      return FE_UPWARD;
-    case KLEE_FP_RD:
-      return FE_DOWNWARD;
-    case KLEE_FP_RZ:
-      return FE_TOWARDZERO;
-    default:
-      // The rounding mode could not be determined.
-      return -1;
-  }
+  return (rm == KLEE_FP_RNE) * FE_TONEAREST +
+         (rm == KLEE_FP_RNA) * FE_TONEAREST_TIES_TO_AWAY +
+         (rm == KLEE_FP_RU) * FE_UPWARD +
+         (rm == KLEE_FP_RD) * FE_DOWNWARD +
+         (rm == KLEE_FP_RZ) * FE_TOWARDZERO -
+         // The rounding mode could not be determined.
+         (rm > KLEE_FP_RZ);
 }
 
 int klee_internal_fesetround(int rm) {
-  switch (rm) {
-    case FE_TONEAREST:
-      klee_set_rounding_mode(KLEE_FP_RNE);
-      break;
-    // Don't allow setting this mode for now.
-    // It won't be reproducible on native hardware
-    // so there's probably no point in supporting it
-    // via this interface.
-    //
-    //case FE_TONEAREST_TIES_TO_AWAY:
-    //  klee_set_rounding_mode(KLEE_FP_RNA);
-    //  break;
-    case FE_UPWARD:
-      klee_set_rounding_mode(KLEE_FP_RU);
-      break;
-    case FE_DOWNWARD:
-      klee_set_rounding_mode(KLEE_FP_RD);
-      break;
-    case FE_TOWARDZERO:
-      klee_set_rounding_mode(KLEE_FP_RZ);
-      break;
-    default:
-      // Can't set
-      return -1;
+  // Don't allow setting FE_TONEAREST_TIES_TO_AWAY for now.
+  // It won't be reproducible on native hardware
+  // so there's probably no point in supporting it
+  // via this interface.
+  int valid = (rm == FE_TONEAREST) | (rm == FE_UPWARD) | (rm == FE_DOWNWARD) |
+              (rm == FE_TOWARDZERO);
+  if (!valid) {
+    // Can't set
+    return -1;
   }
+  klee_set_rounding_mode((enum KleeRoundingMode)(
+      (rm == FE_UPWARD) * KLEE_FP_RU + (rm == FE_DOWNWARD) * KLEE_FP_RD +
+      (rm == FE_TOWARDZERO) * KLEE_FP_RZ));
   return 0;
 }
@@ -9,11 +9,16 @@
 #include "klee/klee.h"
 
 void klee_set_rounding_mode_internal(enum KleeRoundingMode rm);
+int klee_set_symbolic_rounding_mode_internal(enum KleeRoundingMode rm);
 
 // This indirection is used here so we can easily support a symbolic rounding
 // mode from clients but in the Executor we only need to worry about a concrete
-// rounding mode.
+// rounding mode unless it is able to keep the rounding mode symbolic
+// (see `-symbolic-rounding-mode`).
 void klee_set_rounding_mode(enum KleeRoundingMode rm) {
+  if (klee_is_symbolic(rm) && klee_set_symbolic_rounding_mode_internal(rm))
+    return;
+
   // We have to be careful here to make sure we pass a constant
   // to klee_set_rounding_mode_internal().
   switch (rm) {
@@ -0,0 +1,113 @@
+#!/usr/bin/python
+
+# ===-- FPSolverBench.py --------------------------------------------------===##
+#
+#                      The KLEE Symbolic Virtual Machine
+#
+#  This file is distributed under the University of Illinois Open Source
+#  License. See LICENSE.TXT for details.
+#
+# ===----------------------------------------------------------------------===##
+
+"""Compare solver backends on the floating point regression tests.
+
+Every program in test/Floats is compiled once and then run under KLEE with
+each of the requested solver backends. Z3 reasons about floating point
+natively while STP and metaSMT use the bit-vector lowering, so the table
+shows what the lowering costs or saves. Runs whose number of completed paths
+differs from the first backend are flagged because they point at a
+disagreement between the encodings.
+"""
+
+from __future__ import division
+
+import optparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+def compile(clang, includeDir, source, output):
+    subprocess.check_call([clang, '-emit-llvm', '-O0', '-g', '-c',
+                           '-I', includeDir, source, '-o', output])
+
+def runKLEE(klee, backend, bitcode, outputDir, timeout, extraArgs):
+    args = [klee, '--output-dir=%s' % outputDir,
+            '--solver-backend=%s' % backend,
+            '--max-time=%d' % timeout] + extraArgs + [bitcode]
+    start = time.time()
+    process = subprocess.Popen(args, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT)
+    output = process.communicate()[0]
+    elapsed = time.time() - start
+    m = re.search(r'KLEE: done: completed paths = (\d+)', output)
+    paths = int(m.group(1)) if m else None
+    return elapsed, paths
+
+def main(args):
+    op = optparse.OptionParser(usage='usage: %prog [options] klee-src-dir')
+    op.add_option('--klee', dest='klee', default='klee',
+                  help='KLEE binary to run')
+    op.add_option('--clang', dest='clang', default='clang',
+                  help='compiler used to build the tests')
+    op.add_option('--backends', dest='backends', default='z3,stp',
+                  help='comma separated solver backends (default z3,stp)')
+    op.add_option('--timeout', dest='timeout', type='int', default=300,
+                  help='seconds per KLEE run')
+    op.add_option('--filter', dest='filter', default='',
+                  help='only run tests whose name contains this string')
+    op.add_option('--klee-arg', dest='kleeArgs', action='append', default=[],
+                  help='extra argument passed to KLEE (may be repeated)')
+    opts, args = op.parse_args(args)
+    if len(args) != 1:
+        op.error('expected the KLEE source directory')
+
+    srcDir = args[0]
+    testDir = os.path.join(srcDir, 'test', 'Floats')
+    includeDir = os.path.join(srcDir, 'include')
+    backends = opts.backends.split(',')
+    tests = sorted(f for f in os.listdir(testDir)
+                   if f.endswith('.c') and opts.filter in f)
+
+    workDir = tempfile.mkdtemp(prefix='klee-fp-bench')
+    totals = dict((b, 0.0) for b in backends)
+    mismatches = 0
+    try:
+        print '%-45s' % 'test' + ''.join('%14s' % b for b in backends)
+        for test in tests:
+            bitcode = os.path.join(workDir, test + '.bc')
+            compile(opts.clang, includeDir, os.path.join(testDir, test),
+                    bitcode)
+            row = '%-45s' % test
+            expectedPaths = None
+            for i, backend in enumerate(backends):
+                outputDir = os.path.join(workDir, '%s.%s' % (test, backend))
+                elapsed, paths = runKLEE(opts.klee, backend, bitcode,
+                                         outputDir, opts.timeout,
+                                         opts.kleeArgs)
+                totals[backend] += elapsed
+                flag = ' '
+                if i == 0:
+                    expectedPaths = paths
+                elif paths != expectedPaths:
+                    flag = '!'
+                    mismatches += 1
+                row += '%13.2f%s' % (elapsed, flag)
+                shutil.rmtree(outputDir, ignore_errors=True)
+            print row
+        print '%-45s' % 'total' + ''.join('%13.2f ' % totals[b]
+                                          for b in backends)
+    finally:
+        shutil.rmtree(workDir, ignore_errors=True)
+
+    if mismatches:
+        print '%d run(s) marked with ! completed a different number of paths' \
+              % mismatches
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
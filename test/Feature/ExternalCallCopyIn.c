@@ -0,0 +1,41 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+#include "klee/klee.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// Each state changes its own copy of `buf` between external calls. Only the
+// objects which changed since they were last copied out are copied again, so
+// the memory an external sees must still be that of the calling state.
+char buf[4 << 20];
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  buf[0] = 'a';
+  sprintf(buf + 3000000, "%s", buf);
+  assert(buf[3000000] == 'a');
+
+  if (x) {
+    buf[0] = 'b';
+  } else {
+    buf[1] = 'c';
+  }
+  sprintf(buf + 3000000, "%s", buf);
+  sprintf(buf + 2000000, "%s", buf);
+  if (x) {
+    assert(strcmp(buf + 2000000, "b") == 0);
+    printf("b\n");
+  } else {
+    assert(strcmp(buf + 2000000, "ac") == 0);
+    printf("ac\n");
+  }
+  return 0;
+}
+// CHECK-DAG: {{^}}b
+// CHECK-DAG: {{^}}ac
+// CHECK: KLEE: done: completed paths = 2
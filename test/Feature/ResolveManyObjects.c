@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+#include "klee/klee.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// The pointer can only point into three of the many objects, the others
+// are ruled out a range at a time.
+#define N 500
+
+int main() {
+  char *objs[N];
+  int i, k;
+  for (i = 0; i < N; i++)
+    objs[i] = malloc(16);
+
+  klee_make_symbolic(&k, sizeof(k), "k");
+  klee_assume(k >= 100);
+  klee_assume(k < 103);
+
+  objs[k][3] = 'x';
+  if (objs[k][3] == 'x')
+    printf("resolved\n");
+
+  return 0;
+}
+// CHECK: resolved
+// CHECK: resolved
+// CHECK: resolved
+// CHECK: KLEE: done: completed paths = 3
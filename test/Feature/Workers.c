@@ -0,0 +1,44 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --workers=4 --switch-type=internal %t.bc 2>&1 | FileCheck %s
+// RUN: test -f %t.klee-out/test000064.ktest
+// RUN: not test -f %t.klee-out/test000065.ktest
+// RUN: test -f %t.klee-out/worker0-run.stats
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=CHECK-INFO %s
+// RUN: rm -rf %t.klee-out-nodeterm
+// RUN: not %klee --output-dir=%t.klee-out-nodeterm --workers=2 --allocate-determ=false %t.bc 2>&1 | FileCheck -check-prefix=CHECK-NODETERM %s
+
+// CHECK: KLEE: done: completed paths = 64
+// CHECK: KLEE: done: generated tests = 64
+// CHECK-NODETERM: --workers cannot be combined with --allocate-determ=false
+// CHECK-INFO: Workers: 4
+// CHECK-INFO: KLEE: done: explored paths = 64
+
+#include "klee/klee.h"
+
+int main(int argc, char **argv) {
+  unsigned x;
+  volatile unsigned work = 0;
+  unsigned i, j;
+
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  for (i = 0; i < 4; ++i) {
+    if (x & (1 << i))
+      work += i;
+    // Keep the paths busy for a while so that idle workers steal them.
+    for (j = 0; j < 20000; ++j)
+      work += j;
+  }
+
+  switch (x >> 28) {
+  case 0:
+    return 1;
+  case 1:
+    return 2;
+  case 2:
+    return 3;
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,48 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --symbolic-rounding-mode %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <assert.h>
+#include <fenv.h>
+#include <stdio.h>
+
+int main() {
+  int symbolicRoundingMode = FE_TONEAREST;
+  klee_make_symbolic(&symbolicRoundingMode, sizeof(int), "rounding_mode");
+  klee_assume((symbolicRoundingMode == FE_TONEAREST) |
+              (symbolicRoundingMode == FE_UPWARD) |
+              (symbolicRoundingMode == FE_DOWNWARD) |
+              (symbolicRoundingMode == FE_TOWARDZERO));
+
+  // With a symbolic rounding mode kept as an expression this does not fork.
+  int result = fesetround(symbolicRoundingMode);
+  assert(result == 0);
+
+  float one = 1.0f;
+  float tiny = 0x1p-30f;
+  float sum = one + tiny;
+  if (sum > one) {
+    // CHECK-DAG: rounded up
+    printf("rounded up\n");
+    assert(fegetround() == FE_UPWARD);
+  } else {
+    // CHECK-DAG: rounded to one
+    printf("rounded to one\n");
+    assert(fegetround() != FE_UPWARD);
+  }
+
+  float f;
+  klee_make_symbolic(&f, sizeof(float), "f");
+  if (f > 0.0f) {
+    if (f + one == one) {
+      // CHECK-DAG: f absorbed
+      printf("f absorbed\n");
+      assert(fegetround() != FE_UPWARD);
+    }
+  }
+  return 0;
+}
+// CHECK-NOT: ASSERTION FAIL
+// CHECK-DAG: KLEE: done: completed paths = 6
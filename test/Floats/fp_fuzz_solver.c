@@ -0,0 +1,43 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --use-fp-fuzz-solver --use-cex-cache=0 --use-cache=0 --debug-validate-solver --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=FUZZ %s
+// RUN: rm -rf %t.klee-out-nofuzz
+// RUN: %klee --output-dir=%t.klee-out-nofuzz --solver-backend=z3 --use-cex-cache=0 --use-cache=0 --exit-on-error %t1.bc > %t-output-nofuzz.txt 2>&1
+// RUN: FileCheck -input-file=%t.klee-out-nofuzz/info -check-prefix=NOFUZZ %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <math.h>
+#include <stdio.h>
+
+// Each feasible side of these branches is satisfied by a constant of the
+// program or by a boundary value of the format, which are the first
+// candidates the fuzz solver evaluates. Those queries are answered without
+// Z3. The infeasible side has to be refuted by Z3 and counts as a miss.
+int main() {
+  double d;
+  float f;
+  klee_make_symbolic(&d, sizeof(d), "d");
+  klee_make_symbolic(&f, sizeof(f), "f");
+
+  if (d == 3.25)
+    printf("d is 3.25\n");
+
+  if (isinf(f) && f < 0.0f)
+    printf("f is -inf\n");
+
+  if (d > 1e300 && d == d)
+    printf("d is large\n");
+  return 0;
+}
+// CHECK-DAG: d is 3.25
+// CHECK-DAG: f is -inf
+// CHECK-DAG: d is large
+// CHECK-NOT: silently concretizing (reason: floating point)
+
+// FUZZ: KLEE: done: fp fuzz solver hits = {{[1-9][0-9]*}}
+// FUZZ: KLEE: done: fp fuzz solver misses = {{[0-9]+}}
+
+// NOFUZZ: KLEE: done: query cex
+// NOFUZZ-NOT: fp fuzz solver
@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --fp-word-arrays -z3-validate-models --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <stdio.h>
+
+// With --fp-word-arrays each element of `a` and `x` is a single solver
+// variable rather than a concatenation of bytes. Test cases are still written
+// byte by byte.
+int main() {
+  double a[2];
+  float x;
+  klee_make_symbolic(a, sizeof(a), "a");
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (a[1] > 1.0) {
+    if ((float)a[0] == x)
+      printf("a[1] > 1 and a[0] == x\n");
+    else
+      printf("a[1] > 1 and a[0] != x\n");
+  } else {
+    printf("a[1] <= 1 or NaN\n");
+  }
+  return 0;
+}
+// CHECK-DAG: a[1] > 1 and a[0] == x
+// CHECK-DAG: a[1] > 1 and a[0] != x
+// CHECK-DAG: a[1] <= 1 or NaN
+// CHECK: KLEE: done: completed paths = 3
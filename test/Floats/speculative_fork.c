@@ -0,0 +1,33 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --speculative-fork %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: not grep "^infeasible" %t-output.txt
+// RUN: not ls %t.klee-out/*.err
+// REQUIRES: z3
+// REQUIRES: thread-safe-expr
+#include "klee/klee.h"
+#include <assert.h>
+#include <stdio.h>
+
+// Both sides of each branch run before the solver has decided whether they
+// are feasible. The infeasible one must go away without a trace.
+int main() {
+  float x;
+  klee_make_symbolic(&x, sizeof(float), "x");
+  if (x > 1.0f) {
+    if (x < 0.5f) {
+      printf("infeasible\n");
+      assert(0);
+    } else {
+      // CHECK-DAG: {{^}}x > 1
+      printf("x > 1\n");
+    }
+  } else {
+    // CHECK-DAG: !(x > 1)
+    printf("!(x > 1)\n");
+  }
+  return 0;
+}
+// CHECK: KLEE: done: completed paths = 2
+// CHECK: KLEE: done: generated tests = 2
@@ -0,0 +1,45 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --speculative-fork %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: not grep "^infeasible" %t-output.txt
+// RUN: not ls %t.klee-out/*.err
+// REQUIRES: z3
+// REQUIRES: thread-safe-expr
+#include "klee/klee.h"
+#include <assert.h>
+#include <stdio.h>
+
+int table[4] = { 1, 2, 3, 4 };
+
+// Both sides of each branch start running before the solver has decided
+// whether they are feasible. Each side then issues queries of its own, on
+// a symbolic index and through klee_assume(), while its branch is still
+// undecided. The infeasible side must go away before its queries have any
+// effect.
+int main() {
+  float x;
+  int i;
+  klee_make_symbolic(&x, sizeof(float), "x");
+  klee_make_symbolic(&i, sizeof(int), "i");
+  if (x > 1.0f) {
+    if (x < 0.5f) {
+      klee_assume((i >= 0) & (i < 4));
+      int v = table[i];
+      printf("infeasible %d\n", v);
+      assert(0);
+    } else {
+      klee_assume((i >= 0) & (i < 4));
+      int v = table[i];
+      // CHECK-DAG: {{^}}x > 1
+      printf("x > 1 %d\n", v);
+    }
+  } else {
+    int v = table[i & 3];
+    // CHECK-DAG: !(x > 1)
+    printf("!(x > 1) %d\n", v);
+  }
+  return 0;
+}
+// CHECK: KLEE: done: completed paths = 2
+// CHECK: KLEE: done: generated tests = 2
@@ -0,0 +1,37 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --speculative-fork --max-speculative-solver-time=0.001 --use-cex-cache=false --use-cache=false %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: not grep "^infeasible" %t-output.txt
+// RUN: not ls %t.klee-out/*.early
+// RUN: not ls %t.klee-out/*.err
+// REQUIRES: z3
+// REQUIRES: thread-safe-expr
+#include "klee/klee.h"
+#include <assert.h>
+#include <stdio.h>
+
+// The background solver gives up on the product long before it can decide
+// either branch. The queries are asked again synchronously, so the
+// infeasible side still goes away and neither side is cut short.
+int main() {
+  float x, y;
+  klee_make_symbolic(&x, sizeof(float), "x");
+  klee_make_symbolic(&y, sizeof(float), "y");
+  float p = x * y;
+  // CHECK-DAG: speculative query failed, asking it again
+  if (p == 6.0f) {
+    if (p != 6.0f) {
+      printf("infeasible\n");
+      assert(0);
+    }
+    // CHECK-DAG: {{^}}p == 6
+    printf("p == 6\n");
+  } else {
+    // CHECK-DAG: p != 6
+    printf("p != 6\n");
+  }
+  return 0;
+}
+// CHECK: KLEE: done: completed paths = 2
+// CHECK: KLEE: done: generated tests = 2
@@ -0,0 +1,40 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --symbolic-rounding-mode --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+int main() {
+  enum KleeRoundingMode rm;
+  klee_make_symbolic(&rm, sizeof(rm), "rounding_mode");
+  klee_assume(rm <= KLEE_FP_RZ);
+  klee_set_rounding_mode(rm);
+
+  // The argument is concrete, so the result is folded for every rounding mode
+  // including KLEE_FP_RNA.
+  double x = 2.0;
+  double result = klee_sqrt_double(x);
+  // The square root of two rounded to nearest is just above the exact value.
+  if (result < 1.4142135623730951) {
+    // CHECK-DAG: rounded down
+    printf("rounded down\n");
+    assert(klee_get_rounding_mode() == KLEE_FP_RD ||
+           klee_get_rounding_mode() == KLEE_FP_RZ);
+  } else {
+    // CHECK-DAG: rounded up
+    printf("rounded up\n");
+    assert(klee_get_rounding_mode() != KLEE_FP_RD &&
+           klee_get_rounding_mode() != KLEE_FP_RZ);
+  }
+
+  float y = 2.0f;
+  float resultF = klee_sqrt_float(y);
+  assert(resultF >= 1.4142134f && resultF <= 1.4142137f);
+  return 0;
+}
+// CHECK-NOT: rmNearestTiesToAway not supported natively
+// CHECK-DAG: KLEE: done: completed paths = 2
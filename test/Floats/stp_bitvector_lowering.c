@@ -0,0 +1,28 @@
+// REQUIRES: stp
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=stp --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+#include "klee/klee.h"
+#include <assert.h>
+#include <math.h>
+
+int main() {
+  float f;
+  double d;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&d, sizeof(d), "d");
+  if (isnan(f))
+    return 0;
+  if (f > 1.0f && f < 2.0f) {
+    double product = (double)f * 3.0;
+    assert(product > 3.0 && product < 6.0);
+    assert(sqrtf(f * f) == f);
+  }
+  // Adding 0.5 only has no effect once the spacing of doubles is at least 1.
+  if (!isnan(d) && d == d + 0.5)
+    assert(fabs(d) >= 4503599627370496.0);
+  return 0;
+}
+// CHECK-NOT: silently concretizing (reason: floating point)
+// CHECK: KLEE: done: completed paths = 10
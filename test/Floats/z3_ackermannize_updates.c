@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 -z3-validate-models --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=INFO %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <stdio.h>
+
+// Reading `a` at a symbolic index writes its concrete elements into the
+// update list of the array. Reads of `a[0]` then go through these updates but
+// as they are all to other constant indices `a[0]` is still ackermannized.
+int main() {
+  double a[4];
+  unsigned k;
+  klee_make_symbolic(a, sizeof(a), "a");
+  klee_make_symbolic(&k, sizeof(k), "k");
+  klee_assume(k < 4);
+  a[1] = 1.0;
+  a[2] = 2.0;
+  a[3] = 3.0;
+  volatile double y = a[k];
+  if (a[0] > 1.0) {
+    printf("a[0] > 1\n");
+  } else {
+    printf("a[0] <= 1 or NaN\n");
+  }
+  return 0;
+}
+// CHECK: KLEE: done: completed paths = 2
+// INFO: KLEE: done: ackermannized arrays = [[N:[0-9]+]] of [[N]]
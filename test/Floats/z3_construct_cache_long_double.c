@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-construct-cache-size=1024 --use-cex-cache=0 --use-cache=0 --debug-assignment-validating-solver -z3-validate-models --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=INFO %s
+// REQUIRES: x86_64
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <stdio.h>
+
+// The translation of `x + y` is reused across queries. Its x87 fp80 side
+// constraints need to be emitted again every time it is reused otherwise
+// the models generated by Z3 will have the wrong explicit integer bit.
+int main() {
+  long double x, y;
+  klee_make_symbolic(&x, sizeof(long double), "x");
+  klee_make_symbolic(&y, sizeof(long double), "y");
+  long double z = x + y;
+  if (z > 1.0l) {
+    if (z < 2.0l) {
+      printf("1 < z < 2\n");
+    } else {
+      printf("z >= 2\n");
+    }
+  } else {
+    printf("z <= 1 or NaN\n");
+  }
+  return 0;
+}
+// CHECK-NOT: silently concretizing (reason: floating point)
+// CHECK: KLEE: done: completed paths = 3
+// INFO: KLEE: done: construct cache hits =
@@ -0,0 +1,36 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-incremental --use-cex-cache=0 --use-cache=0 --use-independent-solver=0 --debug-assignment-validating-solver -z3-validate-models --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <stdio.h>
+
+// Each branch extends the constraints of the previous one so the incremental
+// solver gets to reuse the prefix of constraints it has already asserted.
+int main() {
+  double x, y;
+  klee_make_symbolic(&x, sizeof(double), "x");
+  klee_make_symbolic(&y, sizeof(double), "y");
+  if (x > 1.0) {
+    if (x * y < 0.5) {
+      if (y + x == 2.0) {
+        printf("x > 1 && x * y < 0.5 && y + x == 2\n");
+      } else {
+        printf("x > 1 && x * y < 0.5 && y + x != 2\n");
+      }
+    } else {
+      printf("x > 1 && !(x * y < 0.5)\n");
+    }
+  } else {
+    // Not a prefix of the constraints above
+    if (y < x) {
+      printf("!(x > 1) && y < x\n");
+    } else {
+      printf("!(x > 1) && !(y < x)\n");
+    }
+  }
+  return 0;
+}
+// CHECK-NOT: silently concretizing (reason: floating point)
+// CHECK: KLEE: done: completed paths = 5
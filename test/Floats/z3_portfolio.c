@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-portfolio-workers=3 --debug-validate-solver --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <math.h>
+#include <stdio.h>
+
+// Every query is raced between the default, eager bit-blasting and reseeded
+// Z3 workers. Whichever wins, the answers and models must be the same as the
+// in-process solver's.
+int main() {
+  float f;
+  double d;
+  klee_make_symbolic(&f, sizeof(float), "f");
+  klee_make_symbolic(&d, sizeof(double), "d");
+  if (isnan(d)) {
+    printf("d is NaN\n");
+  } else if (d * 2.0 == 3.0) {
+    printf("d is 1.5\n");
+  } else if (d > 1.0 && d < 0.5) {
+    printf("unreachable\n");
+  }
+
+  if (f + 1.0f == 1.0f && f != 0.0f) {
+    printf("f is absorbed\n");
+  }
+  return 0;
+}
+// CHECK-NOT: unreachable
+// CHECK-NOT: silently concretizing (reason: floating point)
+// CHECK-NOT: Z3 portfolio
+// CHECK: KLEE: done: completed paths = 12
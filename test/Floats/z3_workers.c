@@ -0,0 +1,41 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-workers=1 --z3-worker-max-memory=4096 --debug-validate-solver --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=STATS %s
+// RUN: rm -rf %t.klee-out-array
+// RUN: %klee --output-dir=%t.klee-out-array --solver-backend=z3 --z3-workers=2 --z3-array-ackermannize=0 --debug-validate-solver --exit-on-error %t1.bc > %t-output-array.txt 2>&1
+// RUN: FileCheck -input-file=%t-output-array.txt %s
+// RUN: FileCheck -input-file=%t.klee-out-array/info -check-prefix=STATS %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <math.h>
+#include <stdio.h>
+
+// Queries are answered by Z3 processes outside of KLEE. The answers and
+// models sent back have to agree with the in-process solver, both when
+// arrays are replaced by bit-vector variables and when they are not.
+int main() {
+  float f;
+  double d;
+  klee_make_symbolic(&f, sizeof(float), "f");
+  klee_make_symbolic(&d, sizeof(double), "d");
+  if (isnan(d)) {
+    printf("d is NaN\n");
+  } else if (d * 2.0 == 3.0) {
+    printf("d is 1.5\n");
+  } else if (d > 1.0 && d < 0.5) {
+    printf("unreachable\n");
+  }
+
+  if (f + 1.0f == 1.0f && f != 0.0f) {
+    printf("f is absorbed\n");
+  }
+  return 0;
+}
+// CHECK-NOT: unreachable
+// CHECK-NOT: silently concretizing (reason: floating point)
+// CHECK-NOT: Z3 worker
+// CHECK: KLEE: done: completed paths = 12
+// STATS: KLEE: done: z3 worker queries = {{[1-9][0-9]*}}
+// STATS-NEXT: KLEE: done: z3 worker restarts = 0
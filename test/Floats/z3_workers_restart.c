@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-workers=1 --z3-worker-restart-memory=1 --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// RUN: FileCheck -input-file=%t.klee-out/info -check-prefix=STATS %s
+// REQUIRES: z3
+#include "klee/klee.h"
+#include <math.h>
+#include <stdio.h>
+
+// A Z3 worker keeps more than a megabyte of its own after answering a query,
+// so it is restarted before each later query. There is no limit while a query
+// runs, so no query is abandoned and the restarted workers answer them all.
+int main() {
+  double d;
+  klee_make_symbolic(&d, sizeof(double), "d");
+  if (isnan(d)) {
+    printf("d is NaN\n");
+  } else if (d * 2.0 == 3.0) {
+    printf("d is 1.5\n");
+  } else if (d > 1.0) {
+    printf("d is large\n");
+  }
+  return 0;
+}
+// CHECK: Z3 worker kept too much memory, restarting it
+// CHECK-NOT: killing it
+// CHECK: KLEE: done: completed paths = 4
+// STATS: KLEE: done: z3 worker queries = {{[1-9][0-9]*}}
+// STATS-NEXT: KLEE: done: z3 worker restarts = {{[1-9][0-9]*}}
@@ -0,0 +1,385 @@
+//===-- main.cpp ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-bench - Microbenchmarks for KLEE's internals.
+//
+// Each benchmark is run once with the feature under test disabled and once
+// with it enabled so a single invocation shows the before and after numbers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Config/Version.h"
+#include "klee/Expr.h"
+#include "klee/Internal/ADT/RNG.h"
+#include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Signals.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+enum BenchmarkKind { ConstantFP, ExprRefCount, ExprHashCons };
+
+cl::list<BenchmarkKind> Benchmarks(
+    cl::desc("Benchmarks to run (default=all):"),
+    cl::values(clEnumValN(ConstantFP, "constant-fp",
+                          "Constant folding of float and double arithmetic"),
+               clEnumValN(ExprRefCount, "expr-refcount",
+                          "Plain and atomic reference counting of "
+                          "expressions"),
+               clEnumValN(ExprHashCons, "expr-hash-cons",
+                          "Memory and equality checks of expressions "
+                          "with and without hash-consing"),
+               clEnumValEnd));
+
+cl::opt<unsigned> Iterations("iterations", cl::init(2000000),
+                             cl::desc("Operations per measurement "
+                                      "(default=2000000)."));
+
+cl::opt<unsigned> Seed("seed", cl::init(5489),
+                       cl::desc("Seed for generating operands."));
+
+/// Find the boolean command line option \a name. The benchmarks flip the
+/// options that guard the feature they measure.
+cl::opt<bool> *getBoolOption(const char *name) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 7)
+  StringMap<cl::Option *> &options = cl::getRegisteredOptions();
+#else
+  StringMap<cl::Option *> options;
+  cl::getRegisteredOptions(options);
+#endif
+  StringMap<cl::Option *>::iterator it = options.find(name);
+  if (it == options.end()) {
+    errs() << "klee-bench: error: unknown option \"" << name << "\"\n";
+    exit(1);
+  }
+  return static_cast<cl::opt<bool> *>(it->second);
+}
+
+void report(const char *name, const char *config, unsigned numOps,
+            double seconds, uint64_t checksum) {
+  outs() << "  " << name << " [" << config << "]: " << numOps << " ops in "
+         << format("%.3f", seconds) << "s, "
+         << format("%.2f", numOps / seconds / 1e6) << " Mops/s (checksum "
+         << format("%016llx", (unsigned long long)checksum) << ")\n";
+}
+
+/// Operands of a single format: mostly normal numbers of moderate magnitude
+/// with some subnormals, zeros and infinities mixed in.
+std::vector<ref<ConstantExpr> > makeFPOperands(RNG &rng, Expr::Width width,
+                                               unsigned count) {
+  std::vector<ref<ConstantExpr> > operands;
+  for (unsigned i = 0; i < count; ++i) {
+    double value = (rng.getDouble() * 2.0 - 1.0) *
+                   (double)(1 << (rng.getInt32() % 20));
+    switch (rng.getInt32() % 32) {
+    case 0:
+      value = (width == Expr::Int32) ? 1e-40 : 1e-310;
+      break;
+    case 1:
+      value = 0.0;
+      break;
+    case 2:
+      value = HUGE_VAL;
+      break;
+    default:
+      break;
+    }
+    if (width == Expr::Int32)
+      operands.push_back(ConstantExpr::alloc(APFloat((float)value)));
+    else
+      operands.push_back(ConstantExpr::alloc(APFloat(value)));
+  }
+  return operands;
+}
+
+uint64_t runFPOp(const std::vector<ref<ConstantExpr> > &operands,
+                 Expr::Kind op, APFloat::roundingMode rm, unsigned numOps) {
+  uint64_t checksum = 0;
+  unsigned n = operands.size();
+  for (unsigned i = 0; i < numOps; ++i) {
+    const ref<ConstantExpr> &lhs = operands[i % n];
+    const ref<ConstantExpr> &rhs = operands[(i * 7 + 3) % n];
+    ref<ConstantExpr> result;
+    switch (op) {
+    case Expr::FAdd:
+      result = lhs->FAdd(rhs, rm);
+      break;
+    case Expr::FSub:
+      result = lhs->FSub(rhs, rm);
+      break;
+    case Expr::FMul:
+      result = lhs->FMul(rhs, rm);
+      break;
+    case Expr::FDiv:
+      result = lhs->FDiv(rhs, rm);
+      break;
+    default:
+      llvm_unreachable("Unhandled Expr kind");
+    }
+    checksum = checksum * 31 + result->getZExtValue();
+  }
+  return checksum;
+}
+
+void benchmarkConstantFP() {
+  outs() << "constant-fp: ConstantExpr float/double arithmetic\n";
+  cl::opt<bool> *nativeFPEval = getBoolOption("native-fp-eval");
+  bool oldNativeFPEval = *nativeFPEval;
+  RNG rng(Seed);
+
+  static const Expr::Width widths[] = { Expr::Int32, Expr::Int64 };
+  static const struct {
+    Expr::Kind kind;
+    const char *name;
+  } ops[] = { { Expr::FAdd, "fadd" },
+              { Expr::FSub, "fsub" },
+              { Expr::FMul, "fmul" },
+              { Expr::FDiv, "fdiv" } };
+  static const struct {
+    APFloat::roundingMode rm;
+    const char *name;
+  } modes[] = { { APFloat::rmNearestTiesToEven, "rne" },
+                { APFloat::rmTowardZero, "rtz" } };
+
+  bool mismatch = false;
+  for (unsigned w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+    std::vector<ref<ConstantExpr> > operands =
+        makeFPOperands(rng, widths[w], 1024);
+    for (unsigned o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o) {
+      for (unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        std::string name = (widths[w] == Expr::Int32 ? "float " : "double ");
+        name += ops[o].name;
+        name += " ";
+        name += modes[m].name;
+
+        uint64_t checksums[2];
+        for (unsigned native = 0; native < 2; ++native) {
+          nativeFPEval->setValue(native != 0);
+          double start = util::getWallTime();
+          checksums[native] =
+              runFPOp(operands, ops[o].kind, modes[m].rm, Iterations);
+          double elapsed = util::getWallTime() - start;
+          report(name.c_str(), native ? "native" : "apfloat", Iterations,
+                 elapsed, checksums[native]);
+        }
+        if (checksums[0] != checksums[1]) {
+          errs() << "klee-bench: error: native and APFloat results differ for "
+                 << name << "\n";
+          mismatch = true;
+        }
+      }
+    }
+  }
+  nativeFPEval->setValue(oldNativeFPEval);
+  if (mismatch)
+    exit(1);
+}
+
+struct PlainCount {
+  static void inc(unsigned &count) { ++count; }
+  static void dec(unsigned &count) { --count; }
+};
+
+struct AtomicCount {
+  static void inc(unsigned &count) { __sync_add_and_fetch(&count, 1); }
+  static void dec(unsigned &count) { __sync_sub_and_fetch(&count, 1); }
+};
+
+/// Copy references to \a exprs around a small set of slots the way ref<>
+/// does, updating the reference counts with \a Count. The counts never drop
+/// to zero because \a exprs holds a reference to every expression.
+template <class Count>
+uint64_t runRefCount(const std::vector<ref<Expr> > &exprs, unsigned numOps) {
+  const unsigned numSlots = 16;
+  Expr *slots[numSlots] = { 0 };
+  uint64_t checksum = 0;
+  unsigned n = exprs.size();
+  for (unsigned i = 0; i < numOps; ++i) {
+    Expr *e = exprs[(i * 7) % n].get();
+    Count::inc(e->refCount);
+    Expr *&slot = slots[i % numSlots];
+    if (slot)
+      Count::dec(slot->refCount);
+    slot = e;
+    checksum = checksum * 31 + e->hash();
+  }
+  for (unsigned i = 0; i < numSlots; ++i)
+    if (slots[i])
+      Count::dec(slots[i]->refCount);
+  return checksum;
+}
+
+/// Build, copy and destroy small expressions and update lists, which is
+/// dominated by allocation and reference counting.
+uint64_t runExprBuild(const std::vector<ref<Expr> > &reads,
+                      const Array *array, unsigned numOps) {
+  uint64_t checksum = 0;
+  unsigned n = reads.size();
+  UpdateList updates(array, 0);
+  for (unsigned i = 0; i < numOps; ++i) {
+    ref<Expr> e = AddExpr::create(ConstantExpr::create(i % 256, Expr::Int8),
+                                  reads[i % n]);
+    e = UltExpr::create(e, reads[(i + 1) % n]);
+    if (i % 64 == 0)
+      updates = UpdateList(array, 0);
+    UpdateList copy = updates;
+    updates.extend(ConstantExpr::create(i % 8, Expr::Int32),
+                   reads[i % n]);
+    checksum = checksum * 31 + e->hash() + copy.hash();
+  }
+  return checksum;
+}
+
+void benchmarkExprRefCount() {
+#ifdef KLEE_THREAD_SAFE_EXPR
+  const char *build = "atomic";
+#else
+  const char *build = "plain";
+#endif
+  outs() << "expr-refcount: reference counting of expressions (this build "
+         << "uses " << build << " counts)\n";
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 64);
+  std::vector<ref<Expr> > reads;
+  for (unsigned i = 0; i < 1024; ++i)
+    reads.push_back(AddExpr::create(
+        ConstantExpr::create(i % 256, Expr::Int8),
+        ReadExpr::create(UpdateList(array, 0),
+                         ConstantExpr::create(i % 64, Expr::Int32))));
+
+  uint64_t checksums[2];
+  for (unsigned atomic = 0; atomic < 2; ++atomic) {
+    double start = util::getWallTime();
+    checksums[atomic] = atomic ? runRefCount<AtomicCount>(reads, Iterations)
+                               : runRefCount<PlainCount>(reads, Iterations);
+    double elapsed = util::getWallTime() - start;
+    report("ref copy", atomic ? "atomic" : "plain", Iterations, elapsed,
+           checksums[atomic]);
+  }
+  if (checksums[0] != checksums[1]) {
+    errs() << "klee-bench: error: plain and atomic reference counting "
+              "differ\n";
+    exit(1);
+  }
+
+  unsigned numBuilds = Iterations / 10;
+  double start = util::getWallTime();
+  uint64_t checksum = runExprBuild(reads, array, numBuilds);
+  report("expr build", build, numBuilds, util::getWallTime() - start,
+         checksum);
+}
+
+/// Build the same \a numExprs constraints over \a array again, the way each
+/// path of a run rebuilds the expressions for the branches it takes.
+void buildPathExprs(const Array *array, unsigned numExprs,
+                    std::vector<ref<Expr> > &exprs) {
+  UpdateList ul(array, 0);
+  for (unsigned i = 0; i < numExprs; ++i) {
+    ref<Expr> e = ReadExpr::create(
+        ul, ConstantExpr::create(i % array->size, Expr::Int32));
+    for (unsigned j = 0; j < 8; ++j) {
+      ref<Expr> byte = ReadExpr::create(
+          ul, ConstantExpr::create((i + j) % array->size, Expr::Int32));
+      e = AddExpr::create(MulExpr::create(e, byte),
+                          ConstantExpr::create((i + j) % 256, Expr::Int8));
+    }
+    exprs.push_back(UltExpr::create(e, ConstantExpr::create(i, Expr::Int8)));
+  }
+}
+
+/// Look up the expressions of every path in a map of those of the first,
+/// as the caching solvers do. Each lookup needs an equality check.
+uint64_t runExprLookup(const std::vector<std::vector<ref<Expr> > > &paths,
+                       unsigned numOps) {
+  ExprHashMap<unsigned> map;
+  for (unsigned i = 0; i < paths[0].size(); ++i)
+    map[paths[0][i]] = i;
+  uint64_t checksum = 0;
+  for (unsigned i = 0; i < numOps; ++i) {
+    const std::vector<ref<Expr> > &path = paths[1 + i % (paths.size() - 1)];
+    checksum = checksum * 31 + map.find(path[(i * 7) % path.size()])->second;
+  }
+  return checksum;
+}
+
+void benchmarkExprHashCons() {
+  outs() << "expr-hash-cons: the same expressions built on many paths\n";
+  cl::opt<bool> *hashConsExprs = getBoolOption("hash-cons-exprs");
+  bool oldHashConsExprs = *hashConsExprs;
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 64);
+  const unsigned numPaths = 64, numExprs = 256;
+
+  uint64_t checksums[2];
+  for (unsigned hashCons = 0; hashCons < 2; ++hashCons) {
+    const char *config = hashCons ? "hash-consed" : "plain";
+    hashConsExprs->setValue(hashCons != 0);
+    unsigned before = Expr::count;
+    std::vector<std::vector<ref<Expr> > > paths(numPaths);
+    double start = util::getWallTime();
+    for (unsigned i = 0; i < numPaths; ++i)
+      buildPathExprs(array, numExprs, paths[i]);
+    double elapsed = util::getWallTime() - start;
+    report("expr build", config, numPaths * numExprs, elapsed, 0);
+    outs() << "  live expressions [" << config
+           << "]: " << Expr::count - before << "\n";
+
+    start = util::getWallTime();
+    checksums[hashCons] = runExprLookup(paths, Iterations / 10);
+    report("expr lookup", config, Iterations / 10,
+           util::getWallTime() - start, checksums[hashCons]);
+  }
+  hashConsExprs->setValue(oldHashConsExprs);
+  if (checksums[0] != checksums[1]) {
+    errs() << "klee-bench: error: lookups with and without hash-consing "
+              "differ\n";
+    exit(1);
+  }
+}
+}
+
+int main(int argc, char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::cl::SetVersionPrinter(klee::printVersion);
+  llvm::cl::ParseCommandLineOptions(argc, argv, " klee-bench\n");
+
+  if (Benchmarks.empty()) {
+    Benchmarks.push_back(ConstantFP);
+    Benchmarks.push_back(ExprRefCount);
+    Benchmarks.push_back(ExprHashCons);
+  }
+
+  for (unsigned i = 0; i < Benchmarks.size(); ++i) {
+    switch (Benchmarks[i]) {
+    case ConstantFP:
+      benchmarkConstantFP();
+      break;
+    case ExprRefCount:
+      benchmarkExprRefCount();
+      break;
+    case ExprHashCons:
+      benchmarkExprHashCons();
+      break;
+    }
+  }
+  return 0;
+}
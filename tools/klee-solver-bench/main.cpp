@@ -0,0 +1,419 @@
+//===-- main.cpp ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-solver-bench - Replay a KQuery log under several solver chains.
+//
+// Every query in the log is issued to each configured solver chain in turn
+// and one CSV row is written per query and chain with the wall time, the
+// result and how many core solver calls and cache hits it caused. This makes
+// it possible to evaluate a change to the solver chain without rerunning the
+// KLEE jobs that produced the log.
+//
+//===----------------------------------------------------------------------===//
+
+#include "expr/Parser.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Config/Version.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
+#include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/system_error.h"
+#endif
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+using namespace klee::expr;
+
+namespace {
+cl::opt<std::string> InputFile(cl::desc("<input query log>"), cl::Positional,
+                               cl::init("-"));
+
+cl::list<std::string> Chains(
+    "chain", cl::CommaSeparated,
+    cl::desc("Solver chains to replay the log under. Each chain is a core "
+             "solver (stp, metasmt, z3 or dummy) followed by '+' separated "
+             "settings: cache, cex-cache, independent, fast-cex, fp-fuzz, "
+             "persistent-cache=<file>, ackermannize, no-ackermannize and "
+             "timeout=<seconds>. Layers are stacked in the same order as in "
+             "KLEE. Chains are separated by commas (default=the "
+             "--solver-backend solver on its own and with KLEE's default "
+             "layers)"));
+
+cl::opt<std::string> OutputFile("output", cl::init("-"),
+                                cl::desc("File to write the CSV to "
+                                         "(default=stdout)"));
+}
+
+namespace {
+/// A solver chain as given on the command line.
+struct ChainConfig {
+  std::string name;
+  CoreSolverType coreSolver;
+  bool useFastCex;
+  bool useFPFuzz;
+  bool useCexCache;
+  bool useCache;
+  bool useIndependent;
+  /// -1 keeps the current setting, otherwise the value to use for
+  /// --z3-array-ackermannize.
+  int ackermannize;
+  double timeout;
+  /// The persistent solver cache file, or empty for none.
+  std::string cacheFile;
+
+  ChainConfig()
+      : coreSolver(CoreSolverToUse), useFastCex(false), useFPFuzz(false),
+        useCexCache(false), useCache(false), useIndependent(false),
+        ackermannize(-1), timeout(MaxCoreSolverTime) {}
+};
+
+bool parseCoreSolver(StringRef name, CoreSolverType &cst) {
+  if (name == "stp")
+    cst = STP_SOLVER;
+  else if (name == "metasmt")
+    cst = METASMT_SOLVER;
+  else if (name == "z3")
+    cst = Z3_SOLVER;
+  else if (name == "dummy")
+    cst = DUMMY_SOLVER;
+  else
+    return false;
+  return true;
+}
+
+bool parseChain(StringRef spec, ChainConfig &config) {
+  config.name = spec.str();
+  SmallVector<StringRef, 8> parts;
+  spec.split(parts, "+");
+  if (!parseCoreSolver(parts[0], config.coreSolver)) {
+    errs() << "klee-solver-bench: error: unknown core solver \"" << parts[0]
+           << "\" in chain \"" << spec << "\"\n";
+    return false;
+  }
+  for (unsigned i = 1; i < parts.size(); ++i) {
+    StringRef part = parts[i];
+    if (part == "cache") {
+      config.useCache = true;
+    } else if (part == "cex-cache") {
+      config.useCexCache = true;
+    } else if (part == "independent") {
+      config.useIndependent = true;
+    } else if (part == "fast-cex") {
+      config.useFastCex = true;
+    } else if (part == "fp-fuzz") {
+      config.useFPFuzz = true;
+    } else if (part.startswith("persistent-cache=")) {
+      config.cacheFile = part.substr(17).str();
+      if (config.cacheFile.empty()) {
+        errs() << "klee-solver-bench: error: missing persistent cache file "
+               << "in chain \"" << spec << "\"\n";
+        return false;
+      }
+    } else if (part == "ackermannize") {
+      config.ackermannize = 1;
+    } else if (part == "no-ackermannize") {
+      config.ackermannize = 0;
+    } else if (part.startswith("timeout=")) {
+      std::string value = part.substr(8).str();
+      char *end;
+      config.timeout = strtod(value.c_str(), &end);
+      if (value.empty() || *end) {
+        errs() << "klee-solver-bench: error: invalid timeout \"" << value
+               << "\" in chain \"" << spec << "\"\n";
+        return false;
+      }
+    } else {
+      errs() << "klee-solver-bench: error: unknown setting \"" << part
+             << "\" in chain \"" << spec << "\"\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Build the chain in the same order as constructSolverChain().
+Solver *createChain(const ChainConfig &config) {
+  Solver *coreSolver = createCoreSolver(config.coreSolver);
+  if (!coreSolver)
+    return 0;
+  if (config.coreSolver != DUMMY_SOLVER && config.timeout != 0)
+    coreSolver->setCoreSolverTimeout(config.timeout);
+
+  Solver *solver = coreSolver;
+  if (config.useFastCex)
+    solver = createFastCexSolver(solver);
+  if (config.useFPFuzz)
+    solver = createFPFuzzSolver(solver);
+  if (!config.cacheFile.empty())
+    solver = createPersistentCachingSolver(solver, config.cacheFile,
+                                           (uint64_t)SolverCacheSize << 20);
+  if (config.useCexCache)
+    solver = createCexCachingSolver(solver);
+  if (config.useCache)
+    solver = createCachingSolver(solver);
+  if (config.useIndependent)
+    solver = createIndependentSolver(solver);
+  return solver;
+}
+
+/// Find the boolean command line option \a name, or return null if it is not
+/// registered because the solver that defines it is not compiled in.
+cl::opt<bool> *findBoolOption(const char *name) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 7)
+  StringMap<cl::Option *> &options = cl::getRegisteredOptions();
+#else
+  StringMap<cl::Option *> options;
+  cl::getRegisteredOptions(options);
+#endif
+  StringMap<cl::Option *>::iterator it = options.find(name);
+  if (it == options.end())
+    return 0;
+  return static_cast<cl::opt<bool> *>(it->second);
+}
+
+/// Issue \a QC to \a S like kleaver's evaluate action does and return the
+/// outcome as VALID, INVALID, VALUE followed by the value, TIMEOUT or FAIL.
+std::string runQuery(Solver *S, QueryCommand *QC, const char *&kind) {
+  SolverImpl::SolverRunStatus status;
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    kind = "validity";
+    bool result;
+    if (S->mustBeTrue(Query(ConstraintManager(QC->Constraints), QC->Query),
+                      result))
+      return result ? "VALID" : "INVALID";
+    status = S->impl->getOperationStatusCode();
+  } else if (!QC->Values.empty()) {
+    kind = "value";
+    ref<ConstantExpr> result;
+    if (S->getValue(Query(ConstraintManager(QC->Constraints), QC->Values[0]),
+                    result)) {
+      std::string value;
+      result->toString(value);
+      return "VALUE " + value;
+    }
+    status = S->impl->getOperationStatusCode();
+  } else {
+    kind = "initial-values";
+    std::vector<std::vector<unsigned char> > result;
+    bool hasSolution;
+    // Solver::getInitialValues() cannot tell a valid query from a failure.
+    if (S->impl->computeInitialValues(Query(ConstraintManager(QC->Constraints),
+                                            QC->Query),
+                                      QC->Objects, result, hasSolution))
+      return hasSolution ? "INVALID" : "VALID";
+    status = S->impl->getOperationStatusCode();
+  }
+  return status == SolverImpl::SOLVER_RUN_STATUS_TIMEOUT ? "TIMEOUT" : "FAIL";
+}
+
+struct ChainSummary {
+  double time;
+  unsigned solverQueries;
+  unsigned cacheHits;
+  unsigned cexCacheHits;
+  std::map<std::string, unsigned> results;
+
+  ChainSummary() : time(0), solverQueries(0), cacheHits(0), cexCacheHits(0) {}
+};
+}
+
+int main(int argc, char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::cl::SetVersionPrinter(klee::printVersion);
+  llvm::cl::ParseCommandLineOptions(argc, argv, " klee-solver-bench\n");
+
+  std::vector<ChainConfig> configs;
+  if (Chains.empty()) {
+    ChainConfig bare;
+    bare.name = "core";
+    configs.push_back(bare);
+    ChainConfig layered;
+    layered.name = "default";
+    layered.useFastCex = UseFastCexSolver;
+    layered.useFPFuzz = UseFPFuzzSolver;
+    layered.cacheFile = SolverCacheFile;
+    layered.useCexCache = UseCexCache;
+    layered.useCache = UseCache;
+    layered.useIndependent = UseIndependentSolver;
+    configs.push_back(layered);
+  }
+  for (unsigned i = 0; i < Chains.size(); ++i) {
+    ChainConfig config;
+    if (!parseChain(Chains[i], config))
+      return 1;
+    configs.push_back(config);
+  }
+
+  cl::opt<bool> *ackermannize = findBoolOption("z3-array-ackermannize");
+  for (unsigned i = 0; i < configs.size(); ++i) {
+    if (configs[i].ackermannize != -1 && !ackermannize) {
+      errs() << "klee-solver-bench: error: chain \"" << configs[i].name
+             << "\" sets ackermannization but KLEE was built without Z3\n";
+      return 1;
+    }
+  }
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> MB;
+  error_code ec = MemoryBuffer::getFileOrSTDIN(InputFile.c_str(), MB);
+  if (ec) {
+    errs() << argv[0] << ": error: " << ec.message() << "\n";
+    return 1;
+  }
+#else
+  auto MBResult = MemoryBuffer::getFileOrSTDIN(InputFile.c_str());
+  if (!MBResult) {
+    errs() << argv[0] << ": error: " << MBResult.getError().message() << "\n";
+    return 1;
+  }
+  std::unique_ptr<MemoryBuffer> &MB = *MBResult;
+#endif
+
+  const char *Filename = InputFile == "-" ? "<stdin>" : InputFile.c_str();
+  ExprBuilder *Builder = createDefaultExprBuilder();
+  Parser *P = Parser::Create(Filename, MB.get(), Builder, false);
+  P->SetMaxErrors(20);
+  std::vector<Decl *> Decls;
+  while (Decl *D = P->ParseTopLevelDecl())
+    Decls.push_back(D);
+  if (unsigned N = P->GetNumErrors()) {
+    errs() << Filename << ": parse failure: " << N << " errors.\n";
+    return 1;
+  }
+
+  std::vector<QueryCommand *> queries;
+  for (unsigned i = 0; i < Decls.size(); ++i)
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(Decls[i]))
+      queries.push_back(QC);
+
+  std::string Error;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 5)
+  raw_fd_ostream csv(OutputFile.c_str(), Error, sys::fs::F_None);
+#else
+  raw_fd_ostream csv(OutputFile.c_str(), Error, sys::fs::F_Binary);
+#endif
+  if (!Error.empty()) {
+    errs() << "klee-solver-bench: error: " << Error << "\n";
+    return 1;
+  }
+  csv << "chain,query,kind,result,time,solver_queries,cache_hits,"
+         "cex_cache_hits\n";
+
+  std::vector<ChainSummary> summaries(configs.size());
+  std::vector<std::string> expected(queries.size());
+  unsigned mismatches = 0;
+  bool success = true;
+  for (unsigned c = 0; c < configs.size(); ++c) {
+    const ChainConfig &config = configs[c];
+    bool oldAckermannize = ackermannize ? (bool)*ackermannize : false;
+    if (config.ackermannize != -1)
+      ackermannize->setValue(config.ackermannize != 0);
+
+    Solver *S = createChain(config);
+    if (!S) {
+      errs() << "klee-solver-bench: error: cannot create core solver for "
+             << "chain \"" << config.name << "\"\n";
+      success = false;
+      break;
+    }
+
+    ChainSummary &summary = summaries[c];
+    for (unsigned i = 0; i < queries.size(); ++i) {
+      uint64_t solverQueries = stats::queries;
+      uint64_t cacheHits = stats::queryCacheHits;
+      uint64_t cexCacheHits = stats::queryCexCacheHits;
+      const char *kind;
+      double start = util::getWallTime();
+      std::string result = runQuery(S, queries[i], kind);
+      double elapsed = util::getWallTime() - start;
+      solverQueries = stats::queries - solverQueries;
+      cacheHits = stats::queryCacheHits - cacheHits;
+      cexCacheHits = stats::queryCexCacheHits - cexCacheHits;
+
+      csv << config.name << "," << i << "," << kind << "," << result << ","
+          << format("%.6f", elapsed) << "," << solverQueries << ","
+          << cacheHits << "," << cexCacheHits << "\n";
+
+      summary.time += elapsed;
+      summary.solverQueries += solverQueries;
+      summary.cacheHits += cacheHits;
+      summary.cexCacheHits += cexCacheHits;
+      ++summary.results[result.substr(0, result.find(' '))];
+
+      // Timeouts and failures say nothing about the answer, and chains may
+      // pick different values that are all correct.
+      bool definite = result == "VALID" || result == "INVALID";
+      if (!definite)
+        continue;
+      if (expected[i].empty()) {
+        expected[i] = result;
+      } else if (expected[i] != result) {
+        errs() << "klee-solver-bench: error: chain \"" << config.name
+               << "\" answers " << result << " for query " << i << " but "
+               << "an earlier chain answered " << expected[i] << "\n";
+        ++mismatches;
+      }
+    }
+    delete S;
+
+    if (config.ackermannize != -1)
+      ackermannize->setValue(oldAckermannize);
+  }
+
+  for (unsigned c = 0; c < configs.size() && success; ++c) {
+    const ChainSummary &summary = summaries[c];
+    errs() << configs[c].name << ": " << queries.size() << " queries in "
+           << format("%.3f", summary.time) << "s, " << summary.solverQueries
+           << " solver queries, " << summary.cacheHits << " cache hits, "
+           << summary.cexCacheHits << " cex cache hits (";
+    for (std::map<std::string, unsigned>::const_iterator
+             it = summary.results.begin(),
+             ie = summary.results.end();
+         it != ie; ++it) {
+      if (it != summary.results.begin())
+        errs() << ", ";
+      errs() << it->second << " " << it->first;
+    }
+    errs() << ")\n";
+  }
+
+  for (unsigned i = 0; i < Decls.size(); ++i)
+    delete Decls[i];
+  delete P;
+  delete Builder;
+  llvm::llvm_shutdown();
+
+  if (mismatches)
+    success = false;
+  return success ? 0 : 1;
+}
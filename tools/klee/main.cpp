@@ -21,6 +21,7 @@
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/Support/PrintVersion.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/WorkerPool.h"
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
 #include "llvm/IR/Constants.h"
@@ -40,6 +41,7 @@
 #include "llvm/LLVMContext.h"
 #include "llvm/Support/FileSystem.h"
 #endif
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Errno.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Bitcode/ReaderWriter.h"
@@ -225,6 +227,14 @@ namespace {
   Watchdog("watchdog",
            cl::desc("Use a watchdog process to enforce --max-time."),
            cl::init(0));
+
+  cl::opt<unsigned>
+  Workers("workers",
+          cl::desc("Split the exploration between the given number of "
+                   "worker processes which steal paths from each other.  "
+                   "Turns on --allocate-determ so that stolen paths are "
+                   "replayed exactly (default=1)"),
+          cl::init(1));
 }
 
 extern cl::opt<double> MaxTime;
@@ -242,6 +252,9 @@ private:
   unsigned m_testIndex;  // number of tests written so far
   unsigned m_pathsExplored; // number of paths explored so far
 
+  // when exploring with several processes, the pool this one belongs to
+  WorkerPool *m_workerPool;
+
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
@@ -256,13 +269,18 @@ public:
   void incPathsExplored() { m_pathsExplored++; }
 
   void setInterpreter(Interpreter *i);
+  void setWorkerPool(WorkerPool *pool);
+  void addWorkerResults(unsigned numPathsExplored, unsigned numTestCases);
 
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  // files other than test cases are named per worker
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
+  std::string getOutputPath(const std::string &filename);
+  llvm::raw_fd_ostream *openOutputPath(const std::string &path);
   std::string getTestFilename(const std::string &suffix, unsigned id);
   llvm::raw_fd_ostream *openTestFile(const std::string &suffix, unsigned id);
 
@@ -284,6 +302,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
     m_outputDirectory(),
     m_testIndex(0),
     m_pathsExplored(0),
+    m_workerPool(0),
     m_argc(argc),
     m_argv(argv) {
 
@@ -379,16 +398,43 @@ void KleeHandler::setInterpreter(Interpreter *i) {
   }
 }
 
-std::string KleeHandler::getOutputFilename(const std::string &filename) {
+void KleeHandler::setWorkerPool(WorkerPool *pool) {
+  m_workerPool = pool;
+
+  // The info file of the output directory gets the merged results, each
+  // worker writes its own.
+  delete m_infoFile;
+  m_infoFile = openOutputFile("info");
+}
+
+void KleeHandler::addWorkerResults(unsigned numPathsExplored,
+                                   unsigned numTestCases) {
+  m_pathsExplored += numPathsExplored;
+  m_testIndex += numTestCases;
+}
+
+std::string KleeHandler::getOutputPath(const std::string &filename) {
   SmallString<128> path = m_outputDirectory;
   sys::path::append(path,filename);
   return path.str();
 }
 
+std::string KleeHandler::getOutputFilename(const std::string &filename) {
+  if (!m_workerPool)
+    return getOutputPath(filename);
+
+  std::stringstream name;
+  name << "worker" << m_workerPool->getWorkerID() << '-' << filename;
+  return getOutputPath(name.str());
+}
+
 llvm::raw_fd_ostream *KleeHandler::openOutputFile(const std::string &filename) {
+  return openOutputPath(getOutputFilename(filename));
+}
+
+llvm::raw_fd_ostream *KleeHandler::openOutputPath(const std::string &path) {
   llvm::raw_fd_ostream *f;
   std::string Error;
-  std::string path = getOutputFilename(filename);
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3,5)
   f = new llvm::raw_fd_ostream(path.c_str(), Error, llvm::sys::fs::F_None);
 #elif LLVM_VERSION_CODE >= LLVM_VERSION(3,4)
@@ -400,7 +446,7 @@ llvm::raw_fd_ostream *KleeHandler::openOutputFile(const std::string &filename) {
     klee_warning("error opening file \"%s\".  KLEE may have run out of file "
                "descriptors: try to increase the maximum number of open file "
                "descriptors by using ulimit (%s).",
-               filename.c_str(), Error.c_str());
+               path.c_str(), Error.c_str());
     delete f;
     f = NULL;
   }
@@ -416,7 +462,7 @@ std::string KleeHandler::getTestFilename(const std::string &suffix, unsigned id)
 
 llvm::raw_fd_ostream *KleeHandler::openTestFile(const std::string &suffix,
                                                 unsigned id) {
-  return openOutputFile(getTestFilename(suffix, id));
+  return openOutputPath(getOutputPath(getTestFilename(suffix, id)));
 }
 
 
@@ -439,6 +485,8 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     double start_time = util::getWallTime();
 
     unsigned id = ++m_testIndex;
+    if (m_workerPool)
+      id = m_workerPool->allocateTestID();
 
     if (success) {
       KTest b;
@@ -458,7 +506,7 @@ void KleeHandler::processTestCase(const ExecutionState &state,
         std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
       }
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+      if (!kTest_toFile(&b, getOutputPath(getTestFilename("ktest", id)).c_str())) {
         klee_warning("unable to write output test case, losing it");
       }
 
@@ -538,7 +586,7 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       delete f;
     }
 
-    if (m_testIndex == StopAfterNTests)
+    if ((m_workerPool ? id : m_testIndex) == StopAfterNTests)
       m_interpreter->setHaltExecution(true);
 
     if (WriteTestInfo) {
@@ -1039,6 +1087,124 @@ static char *format_tdiff(char *buf, long seconds)
   return buf;
 }
 
+// the counters a worker reports to the coordinator: the value of every
+// statistic followed by the number of explored paths, less \a baseline
+static std::vector<uint64_t>
+getWorkerCounters(KleeHandler &handler,
+                  const std::vector<uint64_t> &baseline = std::vector<uint64_t>()) {
+  std::vector<uint64_t> counters;
+  for (unsigned i = 0, e = theStatisticManager->getNumStatistics(); i != e; ++i)
+    counters.push_back(theStatisticManager->getStatistic(i).getValue());
+  counters.push_back(handler.getNumPathsExplored());
+  for (unsigned i = 0; i != baseline.size(); ++i)
+    counters[i] -= baseline[i];
+  return counters;
+}
+
+// hand out work until the workers are done and merge their results into
+// the statistics of this process
+static void coordinateWorkers(WorkerPool &pool, KleeHandler &handler) {
+  // the workers halt on ctrl-c themselves, just wait for them
+  sys::SetInterruptFunction(interrupt_handle_watchdog);
+
+  std::vector<uint64_t> totals;
+  pool.coordinate(totals);
+
+  unsigned numStatistics = theStatisticManager->getNumStatistics();
+  totals.resize(numStatistics + 1);
+  for (unsigned i = 0; i != numStatistics; ++i)
+    theStatisticManager->incrementStatistic(
+        theStatisticManager->getStatistic(i), totals[i]);
+  handler.addWorkerResults(totals[numStatistics], pool.getNumTestIDs());
+}
+
+static void printSummary(KleeHandler &handler) {
+  uint64_t queries =
+    *theStatisticManager->getStatisticByName("Queries");
+  uint64_t queriesValid =
+    *theStatisticManager->getStatisticByName("QueriesValid");
+  uint64_t queriesInvalid =
+    *theStatisticManager->getStatisticByName("QueriesInvalid");
+  uint64_t queryCounterexamples =
+    *theStatisticManager->getStatisticByName("QueriesCEX");
+  uint64_t queryConstructs =
+    *theStatisticManager->getStatisticByName("QueriesConstructs");
+  uint64_t queryConstructCacheHits =
+    *theStatisticManager->getStatisticByName("QueryConstructCacheHits");
+  uint64_t queryConstructCacheMisses =
+    *theStatisticManager->getStatisticByName("QueryConstructCacheMisses");
+  uint64_t queryArrays =
+    *theStatisticManager->getStatisticByName("QueryArrays");
+  uint64_t queryAckermannizedArrays =
+    *theStatisticManager->getStatisticByName("QueryAckermannizedArrays");
+  uint64_t queryFPFuzzHits =
+    *theStatisticManager->getStatisticByName("QueryFPFuzzHits");
+  uint64_t queryFPFuzzMisses =
+    *theStatisticManager->getStatisticByName("QueryFPFuzzMisses");
+  uint64_t queryZ3WorkerQueries =
+    *theStatisticManager->getStatisticByName("QueryZ3WorkerQueries");
+  uint64_t queryZ3WorkerRestarts =
+    *theStatisticManager->getStatisticByName("QueryZ3WorkerRestarts");
+  uint64_t instructions =
+    *theStatisticManager->getStatisticByName("Instructions");
+  uint64_t forks =
+    *theStatisticManager->getStatisticByName("Forks");
+
+  handler.getInfoStream()
+    << "KLEE: done: explored paths = " << 1 + forks << "\n";
+
+  // Write some extra information in the info file which users won't
+  // necessarily care about or understand.
+  if (queries)
+    handler.getInfoStream()
+      << "KLEE: done: avg. constructs per query = "
+                             << queryConstructs / queries << "\n";
+  handler.getInfoStream()
+    << "KLEE: done: construct cache hits = " << queryConstructCacheHits << "\n"
+    << "KLEE: done: construct cache misses = " << queryConstructCacheMisses
+    << "\n";
+  handler.getInfoStream()
+    << "KLEE: done: total queries = " << queries << "\n"
+    << "KLEE: done: valid queries = " << queriesValid << "\n"
+    << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
+    << "KLEE: done: query cex = " << queryCounterexamples << "\n";
+  if (queryFPFuzzHits || queryFPFuzzMisses)
+    handler.getInfoStream()
+      << "KLEE: done: fp fuzz solver hits = " << queryFPFuzzHits << "\n"
+      << "KLEE: done: fp fuzz solver misses = " << queryFPFuzzMisses << "\n";
+  if (queryZ3WorkerQueries)
+    handler.getInfoStream()
+      << "KLEE: done: z3 worker queries = " << queryZ3WorkerQueries << "\n"
+      << "KLEE: done: z3 worker restarts = " << queryZ3WorkerRestarts
+      << "\n";
+  if (queryArrays)
+    handler.getInfoStream()
+      << "KLEE: done: ackermannized arrays = " << queryAckermannizedArrays
+      << " of " << queryArrays << "\n";
+
+  std::stringstream stats;
+  stats << "\n";
+  stats << "KLEE: done: total instructions = "
+        << instructions << "\n";
+  stats << "KLEE: done: completed paths = "
+        << handler.getNumPathsExplored() << "\n";
+  stats << "KLEE: done: generated tests = "
+        << handler.getNumTestCases() << "\n";
+
+  bool useColors = llvm::errs().is_displayed();
+  if (useColors)
+    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
+                             /*bold=*/true,
+                             /*bg=*/false);
+
+  llvm::errs() << stats.str();
+
+  if (useColors)
+    llvm::errs().resetColor();
+
+  handler.getInfoStream() << stats.str();
+}
+
 #ifndef SUPPORT_KLEE_UCLIBC
 static llvm::Module *linkWithUclibc(llvm::Module *mainModule, StringRef libDir) {
   klee_error("invalid libc, no uclibc support!\n");
@@ -1426,9 +1592,79 @@ int main(int argc, char **argv, char **envp) {
     KleeHandler::loadPathFile(ReplayPathFile, replayPath);
   }
 
+  if (Workers == 0)
+    klee_error("--workers must be at least 1");
+  if (Workers > 1 &&
+      (!ReplayKTestDir.empty() || !ReplayKTestFile.empty() ||
+       ReplayPathFile != "" || !SeedOutFile.empty() || !SeedOutDir.empty()))
+    klee_error("--workers cannot be combined with replaying or seeding");
+  if (Workers > 1) {
+    // A stolen path is only replayed exactly if symbolic pointers resolve to
+    // the same objects in every worker, which needs the same addresses.
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 7)
+    StringMap<cl::Option *> &options = cl::getRegisteredOptions();
+#else
+    StringMap<cl::Option *> options;
+    cl::getRegisteredOptions(options);
+#endif
+    cl::opt<bool> *allocateDeterm =
+        static_cast<cl::opt<bool> *>(options["allocate-determ"]);
+    if (allocateDeterm->getNumOccurrences() && !*allocateDeterm)
+      klee_error("--workers cannot be combined with --allocate-determ=false");
+    allocateDeterm->setValue(true);
+  }
+
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
+
+  // Fork the workers before the module is prepared so that each writes its
+  // own statistics. The coordinator only hands out work and merges results.
+  WorkerPool *workerPool = 0;
+  std::vector<uint64_t> workerBaseline;
+  if (Workers > 1) {
+    for (int i=0; i<argc; i++) {
+      handler->getInfoStream() << argv[i] << (i+1<argc ? " ":"\n");
+    }
+    handler->getInfoStream() << "PID: " << getpid() << "\n"
+                             << "Workers: " << Workers << "\n";
+    handler->getInfoStream().flush();
+
+    workerPool = new WorkerPool(Workers);
+    workerPool->start();
+
+    if (!workerPool->isWorker()) {
+      char buf[256];
+      time_t t[2];
+      t[0] = time(NULL);
+      strftime(buf, sizeof(buf), "Started: %Y-%m-%d %H:%M:%S\n",
+               localtime(&t[0]));
+      handler->getInfoStream() << buf;
+
+      coordinateWorkers(*workerPool, *handler);
+
+      t[1] = time(NULL);
+      strftime(buf, sizeof(buf), "Finished: %Y-%m-%d %H:%M:%S\n",
+               localtime(&t[1]));
+      handler->getInfoStream() << buf;
+      strcpy(buf, "Elapsed: ");
+      strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
+      handler->getInfoStream() << buf;
+
+      printSummary(*handler);
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+      BufferPtr.take();
+#endif
+      delete workerPool;
+      delete handler;
+      return 0;
+    }
+
+    handler->setWorkerPool(workerPool);
+    workerBaseline = getWorkerCounters(*handler);
+  }
+
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(ctx, IOpts, handler);
   handler->setInterpreter(interpreter);
@@ -1438,6 +1674,9 @@ int main(int argc, char **argv, char **envp) {
   }
   handler->getInfoStream() << "PID: " << getpid() << "\n";
 
+  if (workerPool)
+    interpreter->setWorkerPool(workerPool);
+
   const Module *finalModule =
     interpreter->setModule(mainModule, Opts);
   externalsAndGlobalsCheck(finalModule);
@@ -1541,7 +1780,15 @@ int main(int argc, char **argv, char **envp) {
                    sys::StrError(errno).c_str());
       }
     }
-    interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    if (workerPool) {
+      std::vector<bool> prefix;
+      while (workerPool->getJob(prefix)) {
+        interpreter->setWorkPrefix(prefix);
+        interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+      }
+    } else {
+      interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    }
 
     while (!seeds.empty()) {
       kTest_free(seeds.back());
@@ -1564,57 +1811,10 @@ int main(int argc, char **argv, char **envp) {
 
   delete interpreter;
 
-  uint64_t queries =
-    *theStatisticManager->getStatisticByName("Queries");
-  uint64_t queriesValid =
-    *theStatisticManager->getStatisticByName("QueriesValid");
-  uint64_t queriesInvalid =
-    *theStatisticManager->getStatisticByName("QueriesInvalid");
-  uint64_t queryCounterexamples =
-    *theStatisticManager->getStatisticByName("QueriesCEX");
-  uint64_t queryConstructs =
-    *theStatisticManager->getStatisticByName("QueriesConstructs");
-  uint64_t instructions =
-    *theStatisticManager->getStatisticByName("Instructions");
-  uint64_t forks =
-    *theStatisticManager->getStatisticByName("Forks");
-
-  handler->getInfoStream()
-    << "KLEE: done: explored paths = " << 1 + forks << "\n";
-
-  // Write some extra information in the info file which users won't
-  // necessarily care about or understand.
-  if (queries)
-    handler->getInfoStream()
-      << "KLEE: done: avg. constructs per query = "
-                             << queryConstructs / queries << "\n";
-  handler->getInfoStream()
-    << "KLEE: done: total queries = " << queries << "\n"
-    << "KLEE: done: valid queries = " << queriesValid << "\n"
-    << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
-    << "KLEE: done: query cex = " << queryCounterexamples << "\n";
-
-  std::stringstream stats;
-  stats << "\n";
-  stats << "KLEE: done: total instructions = "
-        << instructions << "\n";
-  stats << "KLEE: done: completed paths = "
-        << handler->getNumPathsExplored() << "\n";
-  stats << "KLEE: done: generated tests = "
-        << handler->getNumTestCases() << "\n";
-
-  bool useColors = llvm::errs().is_displayed();
-  if (useColors)
-    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
-                             /*bold=*/true,
-                             /*bg=*/false);
-
-  llvm::errs() << stats.str();
-
-  if (useColors)
-    llvm::errs().resetColor();
-
-  handler->getInfoStream() << stats.str();
+  if (workerPool)
+    workerPool->finish(getWorkerCounters(*handler, workerBaseline));
+  else
+    printSummary(*handler);
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
   // FIXME: This really doesn't look right
@@ -1623,6 +1823,7 @@ int main(int argc, char **argv, char **envp) {
   BufferPtr.take();
 #endif
   delete handler;
+  delete workerPool;
 
   return 0;
 }
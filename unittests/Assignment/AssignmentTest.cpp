@@ -33,3 +33,31 @@ TEST(AssignmentTest, FoldNotOptimized)
   ASSERT_TRUE(asConstant != NULL);
   ASSERT_EQ(asConstant->getZExtValue(), (unsigned) 128);
 }
+
+TEST(AssignmentTest, WordArray)
+{
+  ArrayCache ac;
+  const Array* array = ac.CreateArray("word_array", /*size=*/ 2, 0, 0,
+                                      Expr::Int32, Expr::Int64);
+  ASSERT_EQ(16u, array->getSizeInBytes());
+  std::vector<const Array*> objects;
+  std::vector<unsigned char> value;
+  std::vector< std::vector<unsigned char> > values;
+  objects.push_back(array);
+  for (unsigned i = 0; i < 16; ++i)
+    value.push_back(i);
+  values.push_back(value);
+  Assignment assignment(objects, values);
+
+  // Elements are stored little-endian.
+  ref<Expr> element = assignment.evaluate(array, 1);
+  const ConstantExpr* asConstant = dyn_cast<ConstantExpr>(element);
+  ASSERT_TRUE(asConstant != NULL);
+  ASSERT_EQ(64u, asConstant->getWidth());
+  ASSERT_EQ(0x0f0e0d0c0b0a0908ULL, asConstant->getZExtValue());
+
+  assignment.setValue(array, 0, 0x1122334455667788ULL);
+  ASSERT_EQ(0x88, assignment.bindings[array][0]);
+  ASSERT_EQ(0x11, assignment.bindings[array][7]);
+  ASSERT_EQ(8, assignment.bindings[array][8]);
+}
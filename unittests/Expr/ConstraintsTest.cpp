@@ -0,0 +1,44 @@
+//===-- ConstraintsTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+
+using namespace klee;
+
+namespace {
+
+TEST(ConstraintsTest, TryAddConstraint) {
+  ArrayCache ac;
+  ref<Expr> x = Expr::createTempRead(ac.CreateArray("x", 4), Expr::Int32);
+  ref<Expr> ten = ConstantExpr::create(10, Expr::Int32);
+  ref<Expr> five = ConstantExpr::create(5, Expr::Int32);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(ten, x));
+  ASSERT_EQ(1u, cm.size());
+
+  // x == 5 rewrites 10 < x to false, so it must be refused.
+  EXPECT_FALSE(cm.tryAddConstraint(EqExpr::create(five, x)));
+  ASSERT_EQ(1u, cm.size());
+  EXPECT_EQ(ref<Expr>(UltExpr::create(ten, x)), *cm.begin());
+
+  // The negation of an existing constraint simplifies to false directly.
+  EXPECT_FALSE(cm.tryAddConstraint(Expr::createIsZero(UltExpr::create(ten, x))));
+  EXPECT_EQ(1u, cm.size());
+
+  EXPECT_TRUE(cm.tryAddConstraint(UltExpr::create(x, ConstantExpr::create(
+                                                         100, Expr::Int32))));
+  EXPECT_EQ(2u, cm.size());
+}
+
+}
@@ -10,8 +10,12 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Config/config.h"
+#include "klee/Config/Version.h"
 #include "klee/Expr.h"
 #include "klee/util/ArrayCache.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
 #include <fenv.h>
 #include <inttypes.h>
 #include <math.h>
@@ -268,6 +272,106 @@ printf("result from another Z3 model as bits: 0x%" PRIx32 "\n" , otherZ3result);
 
 }
 
+TEST(ExprTest, FPArithMatchesAPFloat) {
+  // Operands that exercise rounding, subnormal results, overflow, signed
+  // zeros and invalid operations.
+  const double values[] = { 1.0,     -1.0,  3.0,    0.1,     1e-39, 1e-310,
+                            0.0,     -0.0,  1e308,  3.4e38,  HUGE_VAL,
+                            -HUGE_VAL };
+  const unsigned numValues = sizeof(values) / sizeof(values[0]);
+  const llvm::APFloat::roundingMode modes[] = {
+    llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmTowardPositive,
+    llvm::APFloat::rmTowardNegative, llvm::APFloat::rmTowardZero
+  };
+  const Expr::Kind ops[] = { Expr::FAdd, Expr::FSub, Expr::FMul, Expr::FDiv };
+  int hostRoundingMode = fegetround();
+
+  for (unsigned w = 0; w < 2; ++w) {
+    for (unsigned i = 0; i < numValues; ++i) {
+      for (unsigned j = 0; j < numValues; ++j) {
+        llvm::APFloat lhsF = (w == 0) ? llvm::APFloat((float)values[i])
+                                      : llvm::APFloat(values[i]);
+        llvm::APFloat rhsF = (w == 0) ? llvm::APFloat((float)values[j])
+                                      : llvm::APFloat(values[j]);
+        ref<ConstantExpr> lhs = ConstantExpr::alloc(lhsF);
+        ref<ConstantExpr> rhs = ConstantExpr::alloc(rhsF);
+        for (unsigned m = 0; m < 4; ++m) {
+          for (unsigned o = 0; o < 4; ++o) {
+            llvm::APFloat expected(lhsF);
+            ref<ConstantExpr> result;
+            switch (ops[o]) {
+            case Expr::FAdd:
+              expected.add(rhsF, modes[m]);
+              result = lhs->FAdd(rhs, modes[m]);
+              break;
+            case Expr::FSub:
+              expected.subtract(rhsF, modes[m]);
+              result = lhs->FSub(rhs, modes[m]);
+              break;
+            case Expr::FMul:
+              expected.multiply(rhsF, modes[m]);
+              result = lhs->FMul(rhs, modes[m]);
+              break;
+            default:
+              expected.divide(rhsF, modes[m]);
+              result = lhs->FDiv(rhs, modes[m]);
+              break;
+            }
+            if (expected.isNaN()) {
+              EXPECT_TRUE(result->getAPFloatValue().isNaN());
+              continue;
+            }
+            EXPECT_EQ(expected.bitcastToAPInt().getZExtValue(),
+                      result->getZExtValue())
+                << "width " << result->getWidth() << " values[" << i
+                << "] op " << ops[o] << " values[" << j << "] mode " << m;
+          }
+        }
+      }
+    }
+  }
+  // Constant folding must not leak its rounding mode into the host.
+  EXPECT_EQ(hostRoundingMode, fegetround());
+}
+
+TEST(ExprTest, FPCanonicalForms) {
+  ArrayCache ac;
+  ref<Expr> x = Expr::createTempRead(ac.CreateArray("x", 8), Expr::Int64);
+  ref<Expr> y = Expr::createTempRead(ac.CreateArray("y", 8), Expr::Int64);
+  ref<Expr> f = Expr::createTempRead(ac.CreateArray("f", 4), Expr::Int32);
+  ref<Expr> one = ConstantExpr::alloc(llvm::APFloat(1.0));
+
+  // Both spellings of a comparison build the same expression.
+  EXPECT_EQ(FOLtExpr::create(y, x), FOGtExpr::create(x, y));
+  EXPECT_EQ(FOLeExpr::create(y, x), FOGeExpr::create(x, y));
+  EXPECT_EQ(Expr::FOLt, FOGtExpr::create(x, one)->getKind());
+  EXPECT_EQ(FOEqExpr::create(x, y), FOEqExpr::create(y, x));
+  ref<Expr> eq = FOEqExpr::create(x, one);
+  EXPECT_EQ(eq, FOEqExpr::create(one, x));
+  EXPECT_TRUE(isa<ConstantExpr>(eq->getKid(0)));
+
+  // Classification predicates ignore the sign, and NaN and infinity survive
+  // widening.
+  ref<Expr> wide = FPExtExpr::create(FAbsExpr::create(f), Expr::Int64);
+  EXPECT_EQ(IsNaNExpr::create(f), IsNaNExpr::create(wide));
+  EXPECT_EQ(IsInfiniteExpr::create(f), IsInfiniteExpr::create(wide));
+  EXPECT_EQ(IsNormalExpr::create(x),
+            IsNormalExpr::create(FAbsExpr::create(x)));
+  EXPECT_EQ(IsSubnormalExpr::create(x),
+            IsSubnormalExpr::create(FAbsExpr::create(x)));
+  // A subnormal float is a normal double.
+  EXPECT_EQ(Expr::FPExt,
+            cast<IsNormalExpr>(IsNormalExpr::create(wide))->expr->getKind());
+  EXPECT_TRUE(IsNaNExpr::create(SIToFPExpr::create(
+                  y, Expr::Int32, llvm::APFloat::rmNearestTiesToEven))
+                  ->isFalse());
+
+  // x87 widening is left alone.
+  ref<Expr> l = Expr::createTempRead(ac.CreateArray("l", 10), Expr::Fl80);
+  ref<Expr> lwide = FPExtExpr::create(l, Expr::Int128);
+  EXPECT_EQ(lwide, cast<IsNaNExpr>(IsNaNExpr::create(lwide))->expr);
+}
+
 TEST(ExprTest, ReadExprFoldingBasic) {
   unsigned size = 5;
 
@@ -419,4 +523,49 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+#ifndef KLEE_THREAD_SAFE_EXPR
+TEST(ExprTest, HashConsing) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 7)
+  llvm::StringMap<llvm::cl::Option *> &options =
+      llvm::cl::getRegisteredOptions();
+#else
+  llvm::StringMap<llvm::cl::Option *> options;
+  llvm::cl::getRegisteredOptions(options);
+#endif
+  llvm::cl::opt<bool> *hashConsExprs =
+      static_cast<llvm::cl::opt<bool> *>(options["hash-cons-exprs"]);
+  ASSERT_TRUE(hashConsExprs != NULL);
+
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  ref<Expr> read = ReadExpr::createTempRead(array, Expr::Int32);
+  ref<Expr> a = AddExpr::create(read, getConstant(1, Expr::Int32));
+  ref<Expr> b = AddExpr::create(read, getConstant(1, Expr::Int32));
+  EXPECT_NE(a.get(), b.get());
+
+  hashConsExprs->setValue(true);
+  ref<Expr> two = getConstant(2, Expr::Int32);
+  ref<Expr> c = AddExpr::create(read, getConstant(1, Expr::Int32));
+  ref<Expr> d = AddExpr::create(read, getConstant(1, Expr::Int32));
+  ref<Expr> e = AddExpr::create(read, two);
+  EXPECT_EQ(c.get(), d.get());
+  EXPECT_NE(c.get(), e.get());
+  EXPECT_EQ(a, c);
+
+  // Constants that only print differently are not shared.
+  ref<Expr> f = ConstantExpr::alloc(llvm::APFloat(1.0f));
+  ref<Expr> g = ConstantExpr::alloc(llvm::APInt(32, 0x3f800000));
+  EXPECT_EQ(f, g);
+  EXPECT_NE(f.get(), g.get());
+
+  // Expressions leave the table when they are destroyed.
+  unsigned count = Expr::count;
+  e = 0;
+  EXPECT_EQ(count - 1, Expr::count);
+  e = AddExpr::create(read, two);
+  EXPECT_EQ(count, Expr::count);
+  hashConsExprs->setValue(false);
+}
+#endif
 }
@@ -0,0 +1,179 @@
+//===-- FPBitVectorLoweringTest.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/FPBitVectorLowering.h"
+#include <math.h>
+
+using namespace klee;
+
+namespace {
+
+const double values[] = { 1.0,    -1.0,  3.0,   0.1,    -2.5,      1e-39,
+                          1e-310, 0.0,   -0.0,  1e308,  3.4e38,    65504.0,
+                          6e-8,   7.0,   0.5,   HUGE_VAL, -HUGE_VAL, NAN };
+const unsigned numValues = sizeof(values) / sizeof(values[0]);
+
+const llvm::APFloat::roundingMode modes[] = {
+  llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmNearestTiesToAway,
+  llvm::APFloat::rmTowardPositive, llvm::APFloat::rmTowardNegative,
+  llvm::APFloat::rmTowardZero
+};
+const unsigned numModes = sizeof(modes) / sizeof(modes[0]);
+
+ref<ConstantExpr> getFloat(double value, Expr::Width width) {
+  llvm::APFloat f(value);
+  if (width != Expr::Int64) {
+    bool losesInfo;
+    f.convert(width == Expr::Int32 ? llvm::APFloat::IEEEsingle
+                                   : llvm::APFloat::x87DoubleExtended,
+              llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+  }
+  return ConstantExpr::alloc(f);
+}
+
+/// Lower \a e, which only has constant operands, and check that it folds to
+/// the same constant as \a expected.
+void checkLowering(const ref<Expr> &e, const ref<ConstantExpr> &expected,
+                   bool isFloat) {
+  FPBitVectorLowering lowering;
+  ref<Expr> lowered = lowering.lower(e);
+  ConstantExpr *result = dyn_cast<ConstantExpr>(lowered);
+  ASSERT_TRUE(result != NULL);
+  ASSERT_EQ(expected->getWidth(), result->getWidth());
+  if (isFloat && expected->getAPFloatValue().isNaN()) {
+    EXPECT_TRUE(result->getAPFloatValue().isNaN());
+    return;
+  }
+  EXPECT_EQ(expected->getAPValue(), result->getAPValue())
+      << "kind " << e->getKind() << " width " << e->getWidth();
+}
+
+TEST(FPBitVectorLoweringTest, Arithmetic) {
+  const Expr::Width widths[] = { Expr::Int32, Expr::Int64, Expr::Fl80 };
+  for (unsigned w = 0; w < 3; ++w) {
+    for (unsigned i = 0; i < numValues; ++i) {
+      ref<ConstantExpr> lhs = getFloat(values[i], widths[w]);
+      for (unsigned m = 0; m < numModes; ++m) {
+        llvm::APFloat::roundingMode rm = modes[m];
+        // Constant sqrt is evaluated natively, which has no ties-to-away.
+        if (rm != llvm::APFloat::rmNearestTiesToAway)
+          checkLowering(FSqrtExpr::alloc(lhs, rm), lhs->FSqrt(rm), true);
+        for (unsigned j = 0; j < numValues; ++j) {
+          ref<ConstantExpr> rhs = getFloat(values[j], widths[w]);
+          checkLowering(FAddExpr::alloc(lhs, rhs, rm), lhs->FAdd(rhs, rm),
+                        true);
+          checkLowering(FSubExpr::alloc(lhs, rhs, rm), lhs->FSub(rhs, rm),
+                        true);
+          checkLowering(FMulExpr::alloc(lhs, rhs, rm), lhs->FMul(rhs, rm),
+                        true);
+          checkLowering(FDivExpr::alloc(lhs, rhs, rm), lhs->FDiv(rhs, rm),
+                        true);
+        }
+      }
+    }
+  }
+}
+
+TEST(FPBitVectorLoweringTest, ComparisonsAndPredicates) {
+  for (unsigned i = 0; i < numValues; ++i) {
+    ref<ConstantExpr> lhs = getFloat(values[i], Expr::Int64);
+    checkLowering(IsNaNExpr::alloc(lhs),
+                  cast<ConstantExpr>(IsNaNExpr::create(lhs)), false);
+    checkLowering(IsInfiniteExpr::alloc(lhs),
+                  cast<ConstantExpr>(IsInfiniteExpr::create(lhs)), false);
+    checkLowering(IsNormalExpr::alloc(lhs),
+                  cast<ConstantExpr>(IsNormalExpr::create(lhs)), false);
+    checkLowering(IsSubnormalExpr::alloc(lhs),
+                  cast<ConstantExpr>(IsSubnormalExpr::create(lhs)), false);
+    checkLowering(FAbsExpr::alloc(lhs), lhs->FAbs(), true);
+    for (unsigned j = 0; j < numValues; ++j) {
+      ref<ConstantExpr> rhs = getFloat(values[j], Expr::Int64);
+      checkLowering(FOEqExpr::alloc(lhs, rhs), lhs->FOEq(rhs), false);
+      checkLowering(FOLtExpr::alloc(lhs, rhs), lhs->FOLt(rhs), false);
+      checkLowering(FOLeExpr::alloc(lhs, rhs), lhs->FOLe(rhs), false);
+      checkLowering(FOGtExpr::alloc(lhs, rhs), lhs->FOGt(rhs), false);
+      checkLowering(FOGeExpr::alloc(lhs, rhs), lhs->FOGe(rhs), false);
+    }
+  }
+}
+
+TEST(FPBitVectorLoweringTest, Conversions) {
+  for (unsigned i = 0; i < numValues; ++i) {
+    ref<ConstantExpr> d = getFloat(values[i], Expr::Int64);
+    checkLowering(FPExtExpr::alloc(d, Expr::Fl80), d->FPExt(Expr::Fl80),
+                  true);
+    for (unsigned m = 0; m < numModes; ++m) {
+      llvm::APFloat::roundingMode rm = modes[m];
+      checkLowering(FPTruncExpr::alloc(d, Expr::Int32, rm),
+                    d->FPTrunc(Expr::Int32, rm), true);
+      checkLowering(FPTruncExpr::alloc(d, Expr::Int16, rm),
+                    d->FPTrunc(Expr::Int16, rm), true);
+      // Out of range conversions to integers are unspecified.
+      if (!isnan(values[i]) && fabs(values[i]) < 1e9) {
+        checkLowering(FPToSIExpr::alloc(d, Expr::Int32, rm),
+                      d->FPToSI(Expr::Int32, rm), false);
+        if (values[i] >= 0)
+          checkLowering(FPToUIExpr::alloc(d, Expr::Int64, rm),
+                        d->FPToUI(Expr::Int64, rm), false);
+      }
+    }
+  }
+
+  const int64_t integers[] = { 0, 1, -1, 7, 16777217, -16777217,
+                               INT64_MAX, INT64_MIN };
+  for (unsigned i = 0; i < sizeof(integers) / sizeof(integers[0]); ++i) {
+    ref<ConstantExpr> n = ConstantExpr::alloc(integers[i], Expr::Int64);
+    for (unsigned m = 0; m < numModes; ++m) {
+      llvm::APFloat::roundingMode rm = modes[m];
+      checkLowering(SIToFPExpr::alloc(n, Expr::Int32, rm),
+                    n->SIToFP(Expr::Int32, rm), true);
+      checkLowering(UIToFPExpr::alloc(n, Expr::Int64, rm),
+                    n->UIToFP(Expr::Int64, rm), true);
+    }
+  }
+}
+
+TEST(FPBitVectorLoweringTest, SymbolicOperandsAreFullyLowered) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 16);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int64);
+  ref<Expr> y = ConcatExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                   ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> e =
+      FOLtExpr::create(FAddExpr::create(x, y, llvm::APFloat::rmTowardZero),
+                       FSqrtExpr::create(x, llvm::APFloat::rmTowardZero));
+
+  FPBitVectorLowering lowering;
+  ref<Expr> lowered = lowering.lower(e);
+  EXPECT_EQ(1u, lowered->getWidth());
+
+  // The lowered expression is a DAG with a lot of sharing.
+  ExprHashSet seen;
+  std::vector<ref<Expr> > stack(1, lowered);
+  while (!stack.empty()) {
+    ref<Expr> cur = stack.back();
+    stack.pop_back();
+    if (!seen.insert(cur).second)
+      continue;
+    EXPECT_FALSE(cur->getKind() >= Expr::FSqrt &&
+                 cur->getKind() <= Expr::IsSubnormal);
+    EXPECT_FALSE(cur->getKind() >= Expr::FPExt &&
+                 cur->getKind() <= Expr::SIToFP);
+    EXPECT_FALSE(cur->getKind() >= Expr::FAdd && cur->getKind() <= Expr::FDiv);
+    EXPECT_FALSE(cur->getKind() >= Expr::FOEq && cur->getKind() <= Expr::FOGe);
+    for (unsigned i = 0; i < cur->getNumKids(); ++i)
+      stack.push_back(cur->getKid(i));
+  }
+}
+}
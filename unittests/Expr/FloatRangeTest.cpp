@@ -0,0 +1,115 @@
+//===-- FloatRangeTest.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/util/FloatRange.h"
+
+using namespace klee;
+using llvm::APFloat;
+
+namespace {
+
+FloatRange range(double lo, double hi, bool mayBeNaN = false) {
+  return FloatRange(APFloat(lo), APFloat(hi), mayBeNaN);
+}
+
+TEST(FloatRangeTest, SignedZero) {
+  FloatRange negZero(APFloat::getZero(APFloat::IEEEdouble, true));
+  FloatRange posZero(APFloat::getZero(APFloat::IEEEdouble, false));
+
+  EXPECT_FALSE(negZero.contains(APFloat(0.0)));
+  EXPECT_TRUE(negZero.set_union(posZero).contains(APFloat(0.0)));
+  // -0 == +0 under IEEE-754 comparison.
+  EXPECT_TRUE(negZero.mustEqual(posZero));
+  EXPECT_FALSE(negZero.mayBeLessThan(posZero));
+
+  // Only a strict comparison excludes both zeros.
+  FloatRange all = FloatRange::full(APFloat::IEEEdouble);
+  EXPECT_FALSE(all.restrictToLessThan(posZero).contains(APFloat(-0.0)));
+  EXPECT_TRUE(all.restrictToLessOrEqual(negZero).contains(APFloat(0.0)));
+}
+
+TEST(FloatRangeTest, Comparisons) {
+  FloatRange big = range(1e10, 1e20);
+  FloatRange negative = range(-5.0, -1.0);
+
+  EXPECT_TRUE(negative.mustBeLessThan(big));
+  EXPECT_FALSE(big.mayBeLessThan(negative));
+  EXPECT_FALSE(big.mayEqual(negative));
+
+  // NaN is unordered.
+  EXPECT_FALSE(negative.withNaN(true).mustBeLessThan(big));
+  EXPECT_TRUE(negative.withNaN(true).mayBeLessThan(big));
+  EXPECT_FALSE(FloatRange::nan(APFloat::IEEEdouble).mayEqual(big));
+}
+
+TEST(FloatRangeTest, Restrict) {
+  FloatRange all = FloatRange::full(APFloat::IEEEdouble);
+  FloatRange c = FloatRange(APFloat(1e10));
+  FloatRange zero = FloatRange(APFloat(0.0));
+
+  // x > 1e10 && x < 0 has no solution.
+  FloatRange x = all.restrictToGreaterThan(c);
+  EXPECT_FALSE(x.mayBeNaN());
+  EXPECT_FALSE(x.contains(APFloat(1e10)));
+  EXPECT_TRUE(x.restrictToLessThan(zero).isEmpty());
+
+  EXPECT_TRUE(all.restrictToInfinite(true).mayBeInfinite());
+  EXPECT_FALSE(all.restrictToInfinite(false).mayBeInfinite());
+  EXPECT_TRUE(all.restrictToInfinite(false).mayBeNaN());
+}
+
+TEST(FloatRangeTest, Arithmetic) {
+  FloatRange a = range(1.0, 2.0);
+  FloatRange b = range(-3.0, 0.5);
+
+  FloatRange sum = a.add(b);
+  EXPECT_TRUE(sum.contains(APFloat(-2.0)));
+  EXPECT_TRUE(sum.contains(APFloat(2.5)));
+  EXPECT_FALSE(sum.contains(APFloat(2.6)));
+  EXPECT_FALSE(sum.mayBeNaN());
+
+  // Outward rounding keeps the exact result of 0.1 + 0.2 inside.
+  FloatRange inexact = FloatRange(APFloat(0.1)).add(FloatRange(APFloat(0.2)));
+  EXPECT_TRUE(inexact.contains(APFloat(0.1 + 0.2)));
+  EXPECT_FALSE(inexact.isFixed());
+
+  // 0 * inf is NaN even if zero is not a bound.
+  FloatRange inf = FloatRange(APFloat::getInf(APFloat::IEEEdouble));
+  EXPECT_TRUE(b.mul(inf).mayBeNaN());
+  EXPECT_FALSE(a.mul(inf).mayBeNaN());
+
+  // Division by a range containing zero is unbounded.
+  EXPECT_TRUE(a.div(b).mayBeInfinite());
+  EXPECT_TRUE(a.div(b).mayBeNaN());
+
+  FloatRange root = range(4.0, 9.0).sqrt();
+  EXPECT_TRUE(root.contains(APFloat(2.0)));
+  EXPECT_TRUE(root.contains(APFloat(3.0)));
+  EXPECT_FALSE(root.contains(APFloat(3.5)));
+  EXPECT_TRUE(b.sqrt().mayBeNaN());
+
+  FloatRange absolute = b.abs();
+  EXPECT_TRUE(absolute.contains(APFloat(3.0)));
+  EXPECT_FALSE(absolute.contains(APFloat(-0.0)));
+}
+
+TEST(FloatRangeTest, Convert) {
+  FloatRange d = FloatRange(APFloat(0.1));
+  FloatRange f = d.convert(APFloat::IEEEsingle);
+  EXPECT_FALSE(f.isFixed());
+
+  bool losesInfo = false;
+  APFloat nearest(0.1);
+  nearest.convert(APFloat::IEEEsingle, APFloat::rmNearestTiesToEven,
+                  &losesInfo);
+  EXPECT_TRUE(f.contains(nearest));
+}
+}
@@ -0,0 +1,114 @@
+//===-- ThreadSafeExprTest.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Config/config.h"
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+
+using namespace klee;
+
+#ifdef KLEE_THREAD_SAFE_EXPR
+#include <pthread.h>
+
+namespace {
+const unsigned numThreads = 8;
+const unsigned numIterations = 20000;
+
+struct SharedState {
+  ArrayCache *cache;
+  const Array *array;
+  std::vector<ref<Expr> > exprs;
+  /// Pairs of distinct but structurally equal expressions.
+  std::vector<std::pair<ref<Expr>, ref<Expr> > > equalPairs;
+  UpdateList updates;
+  const Array *created[numThreads];
+
+  SharedState(ArrayCache *_cache, const Array *_array)
+      : cache(_cache), array(_array), updates(_array, 0) {}
+};
+
+struct ThreadArgs {
+  SharedState *state;
+  unsigned id;
+};
+
+void *work(void *p) {
+  ThreadArgs *args = static_cast<ThreadArgs *>(p);
+  SharedState &state = *args->state;
+  unsigned n = state.exprs.size();
+  for (unsigned i = 0; i < numIterations; ++i) {
+    // Copy references to shared expressions and build new ones from them.
+    ref<Expr> a = state.exprs[(i + args->id) % n];
+    ref<Expr> b = state.exprs[(i * 7) % n];
+    ref<Expr> sum = AddExpr::create(a, b);
+    ref<Expr> e = UltExpr::create(sum, a);
+    // Extend copies of a shared update list.
+    UpdateList copy = state.updates;
+    copy.extend(ConstantExpr::create(i % 8, Expr::Int32),
+                ExtractExpr::create(sum, 0, Expr::Int8));
+    EXPECT_EQ(1u, e->getWidth());
+    // Comparing equal expressions records the equal subtrees.
+    const std::pair<ref<Expr>, ref<Expr> > &equal =
+        state.equalPairs[(i + args->id) % state.equalPairs.size()];
+    EXPECT_EQ(0, equal.first->compare(*equal.second));
+    EXPECT_NE(0, equal.first->compare(*b));
+  }
+  state.created[args->id] = state.cache->CreateArray("shared", 8);
+  return 0;
+}
+
+TEST(ThreadSafeExprTest, ConcurrentReferenceCounting) {
+  ArrayCache ac;
+  SharedState state(&ac, ac.CreateArray("arr", 8));
+  for (unsigned i = 0; i < 16; ++i)
+    state.exprs.push_back(AddExpr::create(
+        ConstantExpr::create(i, Expr::Int32),
+        Expr::createTempRead(state.array, Expr::Int32)));
+  state.updates.extend(ConstantExpr::create(0, Expr::Int32),
+                       ConstantExpr::create(1, Expr::Int8));
+  // Built with alloc() so that no node is shared between the two sides.
+  for (unsigned i = 0; i < 16; ++i) {
+    ref<Expr> sides[2];
+    for (unsigned j = 0; j < 2; ++j) {
+      ref<Expr> read = Expr::createTempRead(state.array, Expr::Int32);
+      ref<Expr> sum =
+          AddExpr::alloc(ConstantExpr::create(i, Expr::Int32), read);
+      sides[j] = MulExpr::alloc(sum, AddExpr::alloc(sum, read));
+    }
+    ASSERT_NE(sides[0].get(), sides[1].get());
+    state.equalPairs.push_back(std::make_pair(sides[0], sides[1]));
+  }
+
+  std::vector<unsigned> refCounts;
+  for (unsigned i = 0; i < state.exprs.size(); ++i)
+    refCounts.push_back(state.exprs[i]->refCount);
+
+  pthread_t threads[numThreads];
+  ThreadArgs args[numThreads];
+  for (unsigned t = 0; t < numThreads; ++t) {
+    args[t].state = &state;
+    args[t].id = t;
+    ASSERT_EQ(0, pthread_create(&threads[t], 0, work, &args[t]));
+  }
+  for (unsigned t = 0; t < numThreads; ++t)
+    ASSERT_EQ(0, pthread_join(threads[t], 0));
+
+  // Every reference taken by a thread was released again.
+  for (unsigned i = 0; i < state.exprs.size(); ++i)
+    EXPECT_EQ(refCounts[i], state.exprs[i]->refCount);
+  EXPECT_EQ(1u, state.updates.getSize());
+
+  // All threads got the same cached array.
+  for (unsigned t = 1; t < numThreads; ++t)
+    EXPECT_EQ(state.created[0], state.created[t]);
+}
+}
+#endif
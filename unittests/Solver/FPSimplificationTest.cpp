@@ -0,0 +1,197 @@
+//===-- FPSimplificationTest.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
+#include "klee/Solver.h"
+#include "klee/util/ArrayCache.h"
+#include "llvm/ADT/APFloat.h"
+
+using namespace klee;
+
+#ifdef ENABLE_Z3
+namespace {
+// The solver holds on to the arrays so the cache must outlive it.
+ArrayCache ac;
+
+const Expr::Width widths[] = { Expr::Int16, Expr::Int32, Expr::Int64,
+                               Expr::Int128 };
+const unsigned numWidths = sizeof(widths) / sizeof(widths[0]);
+
+const llvm::APFloat::roundingMode modes[] = {
+  llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmNearestTiesToAway,
+  llvm::APFloat::rmTowardPositive, llvm::APFloat::rmTowardNegative,
+  llvm::APFloat::rmTowardZero
+};
+const unsigned numModes = sizeof(modes) / sizeof(modes[0]);
+
+class FPSimplificationTest : public ::testing::Test {
+protected:
+  Solver *solver;
+  ExprBuilder *plain;
+  ExprBuilder *simplifier;
+
+  void SetUp() {
+    solver = createCoreSolver(Z3_SOLVER);
+    plain = createDefaultExprBuilder();
+    simplifier = createSimplifyingExprBuilder(
+        createConstantFoldingExprBuilder(createDefaultExprBuilder()));
+  }
+
+  void TearDown() {
+    delete simplifier;
+    delete plain;
+    delete solver;
+  }
+
+  ref<Expr> read(const char *name, Expr::Width width) {
+    return Expr::createTempRead(ac.CreateArray(name, width / 8), width);
+  }
+
+  ref<Expr> getFloat(double value, Expr::Width width) {
+    llvm::APFloat f(value);
+    bool losesInfo;
+    f.convert(ConstantExpr::widthToFloatSemantics(width),
+              llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+    return ConstantExpr::alloc(f);
+  }
+
+  bool isEquivalent(const ref<Expr> &a, const ref<Expr> &b) {
+    bool result;
+    EXPECT_TRUE(solver->mustBeTrue(Query(ConstraintManager(),
+                                         EqExpr::create(a, b)),
+                                   result));
+    return result;
+  }
+
+  /// Check that the simplifier rewrote \a original into \a simplified and
+  /// that Z3 proves both have the same bits.
+  void checkRewrite(const ref<Expr> &original, const ref<Expr> &simplified) {
+    EXPECT_NE(original, simplified) << "not simplified: " << original;
+    EXPECT_TRUE(isEquivalent(original, simplified))
+        << original << " is not " << simplified;
+  }
+};
+
+TEST_F(FPSimplificationTest, Identities) {
+  for (unsigned w = 0; w < numWidths; ++w) {
+    Expr::Width width = widths[w];
+    ref<Expr> x = read("x", width);
+    ref<Expr> one = getFloat(1.0, width);
+    ref<Expr> posZero = getFloat(0.0, width);
+    ref<Expr> negZero = getFloat(-0.0, width);
+    for (unsigned m = 0; m < numModes; ++m) {
+      llvm::APFloat::roundingMode rm = modes[m];
+      bool down = rm == llvm::APFloat::rmTowardNegative;
+      ref<Expr> addZero = down ? posZero : negZero;
+      ref<Expr> subZero = down ? negZero : posZero;
+
+      checkRewrite(plain->FAdd(x, addZero, rm),
+                   simplifier->FAdd(x, addZero, rm));
+      checkRewrite(plain->FAdd(addZero, x, rm),
+                   simplifier->FAdd(addZero, x, rm));
+      checkRewrite(plain->FSub(x, subZero, rm),
+                   simplifier->FSub(x, subZero, rm));
+      checkRewrite(plain->FDiv(x, one, rm), simplifier->FDiv(x, one, rm));
+      // Multiplication is commutative so a single mode is enough for fp128.
+      if (width != Expr::Int128 || m == 0) {
+        checkRewrite(plain->FMul(x, one, rm), simplifier->FMul(x, one, rm));
+        checkRewrite(plain->FMul(one, x, rm), simplifier->FMul(one, x, rm));
+      }
+    }
+  }
+}
+
+TEST_F(FPSimplificationTest, SignedZeroRewritesDependOnRoundingMode) {
+  // Justify why the rewrites above pick the zero by rounding mode: with the
+  // other zero +0.0 is not an identity.
+  ref<Expr> x = read("x", Expr::Int32);
+  ref<Expr> posZero = getFloat(0.0, Expr::Int32);
+  ref<Expr> negZero = getFloat(-0.0, Expr::Int32);
+  llvm::APFloat::roundingMode rne = llvm::APFloat::rmNearestTiesToEven;
+  llvm::APFloat::roundingMode rd = llvm::APFloat::rmTowardNegative;
+
+  EXPECT_FALSE(isEquivalent(x, plain->FAdd(x, posZero, rne)));
+  EXPECT_FALSE(isEquivalent(x, plain->FAdd(x, negZero, rd)));
+  EXPECT_EQ(simplifier->FAdd(x, posZero, rne), plain->FAdd(x, posZero, rne));
+  EXPECT_EQ(simplifier->FAdd(x, negZero, rd), plain->FAdd(x, negZero, rd));
+  EXPECT_EQ(simplifier->FSub(x, negZero, rne), plain->FSub(x, negZero, rne));
+}
+
+TEST_F(FPSimplificationTest, Conversions) {
+  for (unsigned w = 0; w < numWidths; ++w) {
+    Expr::Width width = widths[w];
+    ref<Expr> x = read("x", width);
+    for (unsigned v = w + 1; v < numWidths; ++v) {
+      for (unsigned m = 0; m < numModes; ++m) {
+        llvm::APFloat::roundingMode rm = modes[m];
+        checkRewrite(plain->FPTrunc(plain->FPExt(x, widths[v]), width, rm),
+                     simplifier->FPTrunc(simplifier->FPExt(x, widths[v]),
+                                         width, rm));
+      }
+    }
+    checkRewrite(plain->FAbs(plain->FAbs(x)),
+                 simplifier->FAbs(simplifier->FAbs(x)));
+  }
+}
+
+TEST_F(FPSimplificationTest, IsNaN) {
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+  ref<Expr> x = read("x", Expr::Int32);
+  ref<Expr> i = read("i", Expr::Int32);
+  ref<Expr> j = read("j", Expr::Int64);
+  ref<Expr> fi = plain->SIToFP(i, Expr::Int64, rm);
+  ref<Expr> fj = plain->UIToFP(j, Expr::Int64, rm);
+
+  // Operations that cannot produce a NaN.
+  ref<Expr> noNaN[] = {
+    plain->FAdd(fi, fj, rm),
+    plain->FMul(fi, plain->FAbs(fj), rm),
+    plain->FSub(plain->FPExt(plain->SIToFP(i, Expr::Int32, rm), Expr::Int64),
+                fj, rm),
+    plain->FSqrt(plain->FAbs(fi), rm),
+    plain->FSqrt(fj, rm),
+  };
+  for (unsigned k = 0; k < sizeof(noNaN) / sizeof(noNaN[0]); ++k) {
+    EXPECT_TRUE(simplifier->IsNaN(noNaN[k])->isFalse()) << noNaN[k];
+    EXPECT_TRUE(isEquivalent(plain->IsNaN(noNaN[k]), plain->False()));
+  }
+
+  // Operations that can.
+  ref<Expr> mayBeNaN[] = {
+    plain->FAdd(fi, plain->FPExt(x, Expr::Int64), rm),
+    plain->FDiv(fi, fj, rm),
+    plain->FSqrt(fi, rm),
+  };
+  for (unsigned k = 0; k < sizeof(mayBeNaN) / sizeof(mayBeNaN[0]); ++k)
+    EXPECT_FALSE(simplifier->IsNaN(mayBeNaN[k])->isFalse()) << mayBeNaN[k];
+
+  checkRewrite(plain->IsNaN(plain->FAbs(x)),
+               simplifier->IsNaN(simplifier->FAbs(x)));
+  checkRewrite(plain->IsNaN(plain->FPExt(x, Expr::Int64)),
+               simplifier->IsNaN(simplifier->FPExt(x, Expr::Int64)));
+}
+
+TEST_F(FPSimplificationTest, Comparisons) {
+  ref<Expr> x = read("x", Expr::Int64);
+  ref<Expr> y = read("y", Expr::Int64);
+  ref<Expr> gt = simplifier->FOGt(x, y);
+  ref<Expr> ge = simplifier->FOGe(x, y);
+  EXPECT_EQ(Expr::FOLt, gt->getKind());
+  EXPECT_EQ(Expr::FOLe, ge->getKind());
+  checkRewrite(plain->FOGt(x, y), gt);
+  checkRewrite(plain->FOGe(x, y), ge);
+}
+}
+#endif
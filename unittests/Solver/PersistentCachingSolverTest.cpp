@@ -0,0 +1,216 @@
+//===-- PersistentCachingSolverTest.cpp -----------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ArrayCache.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+ArrayCache ac;
+
+/// A solver whose answers are a fixed function of the query, which counts
+/// how often it is asked.
+class CountingSolver : public SolverImpl {
+public:
+  unsigned calls;
+
+  CountingSolver() : calls(0) {}
+
+  static uint8_t answer(const Query &query) {
+    return (uint8_t)(query.expr->hash() * 2654435761u >> 24);
+  }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    ++calls;
+    isValid = answer(query) & 1;
+    return true;
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    ++calls;
+    result = ConstantExpr::create(answer(query), query.expr->getWidth());
+    return true;
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    ++calls;
+    hasSolution = answer(query) & 1;
+    values.clear();
+    if (hasSolution)
+      for (unsigned i = 0; i != objects.size(); ++i)
+        values.push_back(
+            std::vector<unsigned char>(objects[i]->size, answer(query)));
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+class PersistentCachingSolverTest : public ::testing::Test {
+protected:
+  char path[64];
+  const Array *array;
+
+  void SetUp() {
+    strcpy(path, "/tmp/klee-solver-cache-XXXXXX");
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    array = ac.CreateArray("arr", 8);
+  }
+
+  void TearDown() { unlink(path); }
+
+  /// A family of distinct queries over one array.
+  ref<Expr> getQuery(unsigned i) {
+    return UltExpr::create(ConstantExpr::create(i, Expr::Int32),
+                           Expr::createTempRead(array, Expr::Int32));
+  }
+
+  Solver *createSolver(CountingSolver *&counter, uint64_t capacity) {
+    counter = new CountingSolver();
+    return createPersistentCachingSolver(new Solver(counter), path, capacity);
+  }
+
+  /// Ask \a solver the \a i-th truth query and check the answer.
+  bool checkTruth(Solver *solver, unsigned i) {
+    Query query(ConstraintManager(), getQuery(i));
+    bool isValid;
+    return solver->impl->computeTruth(query, isValid) &&
+           isValid == (CountingSolver::answer(query) & 1);
+  }
+};
+
+TEST_F(PersistentCachingSolverTest, ResultsPersistAcrossSolvers) {
+  std::vector<const Array *> objects(1, array);
+  CountingSolver *counter;
+  for (unsigned run = 0; run != 2; ++run) {
+    Solver *solver = createSolver(counter, 1 << 20);
+    for (unsigned i = 0; i != 20; ++i) {
+      EXPECT_TRUE(checkTruth(solver, i));
+
+      Query query(ConstraintManager(), getQuery(i));
+      Solver::Validity validity;
+      EXPECT_TRUE(solver->impl->computeValidity(query, validity));
+
+      ref<Expr> value;
+      Query valueQuery(
+          ConstraintManager(),
+          AddExpr::create(ConstantExpr::create(i % 2, Expr::Int64),
+                          Expr::createTempRead(array, Expr::Int64)));
+      EXPECT_TRUE(solver->impl->computeValue(valueQuery, value));
+      EXPECT_EQ(ref<Expr>(ConstantExpr::create(
+                    CountingSolver::answer(valueQuery), Expr::Int64)),
+                value);
+
+      std::vector<std::vector<unsigned char> > values;
+      bool hasSolution;
+      EXPECT_TRUE(solver->impl->computeInitialValues(query, objects, values,
+                                                     hasSolution));
+      EXPECT_EQ((bool)(CountingSolver::answer(query) & 1), hasSolution);
+      if (hasSolution) {
+        ASSERT_EQ(1u, values.size());
+        EXPECT_EQ(std::vector<unsigned char>(8, CountingSolver::answer(query)),
+                  values[0]);
+      }
+    }
+    // The first run asks the solver, the second only the cache.
+    if (run == 0)
+      EXPECT_LT(0u, counter->calls);
+    else
+      EXPECT_EQ(0u, counter->calls);
+    delete solver;
+  }
+}
+
+TEST_F(PersistentCachingSolverTest, OldestEntriesAreEvicted) {
+  CountingSolver *counter;
+  Solver *solver = createSolver(counter, 64 << 10);
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+  off_t size = st.st_size;
+
+  const unsigned numQueries = 2000;
+  for (unsigned i = 0; i != numQueries; ++i)
+    EXPECT_TRUE(checkTruth(solver, i));
+  EXPECT_EQ(numQueries, counter->calls);
+
+  ASSERT_EQ(0, stat(path, &st));
+  EXPECT_EQ(size, st.st_size);
+
+  EXPECT_TRUE(checkTruth(solver, numQueries - 1));
+  EXPECT_EQ(numQueries, counter->calls);
+  EXPECT_TRUE(checkTruth(solver, 0));
+  EXPECT_EQ(numQueries + 1, counter->calls);
+  delete solver;
+}
+
+TEST_F(PersistentCachingSolverTest, SharedBetweenProcesses) {
+  const unsigned numProcesses = 4, numQueries = 300;
+  std::vector<pid_t> children;
+  for (unsigned p = 0; p != numProcesses; ++p) {
+    pid_t pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+      CountingSolver *counter;
+      Solver *solver = createSolver(counter, 1 << 20);
+      bool ok = true;
+      // Overlapping ranges in different orders.
+      for (unsigned i = 0; i != numQueries; ++i)
+        ok &= checkTruth(solver, p % 2 ? numQueries - 1 - i : i);
+      delete solver;
+      _exit(ok ? 0 : 1);
+    }
+    children.push_back(pid);
+  }
+  for (unsigned p = 0; p != numProcesses; ++p) {
+    int status;
+    ASSERT_EQ(children[p], waitpid(children[p], &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  CountingSolver *counter;
+  Solver *solver = createSolver(counter, 1 << 20);
+  for (unsigned i = 0; i != numQueries; ++i)
+    EXPECT_TRUE(checkTruth(solver, i));
+  EXPECT_EQ(0u, counter->calls);
+  delete solver;
+}
+
+TEST_F(PersistentCachingSolverTest, ForeignFileIsLeftAlone) {
+  FILE *f = fopen(path, "w");
+  ASSERT_TRUE(f != NULL);
+  fputs("not a cache", f);
+  fclose(f);
+
+  CountingSolver *counter;
+  Solver *solver = createSolver(counter, 1 << 20);
+  EXPECT_TRUE(checkTruth(solver, 0));
+  EXPECT_TRUE(checkTruth(solver, 0));
+  EXPECT_EQ(2u, counter->calls);
+  delete solver;
+
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+  EXPECT_EQ(11, st.st_size);
+}
+}
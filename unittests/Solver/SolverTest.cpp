@@ -166,4 +166,39 @@ TEST(SolverTest, Evaluation) {
   delete solver;
 }
 
+TEST(SolverTest, FastCexFloatRanges) {
+  // The dummy solver always fails, so every query below must be answered by
+  // the fast counterexample solver's floating point ranges.
+  Solver *solver = createFastCexSolver(createDummySolver());
+
+  const Array *array = ac.CreateArray("fastcex_fp", 8);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int64);
+  ref<Expr> big = ConstantExpr::alloc(llvm::APFloat(1e10));
+  ref<Expr> zero = ConstantExpr::alloc(llvm::APFloat(0.0));
+
+  ConstraintManager constraints;
+  constraints.addConstraint(FOLtExpr::create(big, x));
+
+  // x > 1e10 && x < 0 is unsatisfiable.
+  bool result;
+  ASSERT_TRUE(solver->mustBeFalse(
+      Query(constraints, FOLtExpr::create(x, zero)), result));
+  EXPECT_TRUE(result);
+
+  // x > 1e10 && isnan(x) is unsatisfiable.
+  ASSERT_TRUE(
+      solver->mustBeFalse(Query(constraints, IsNaNExpr::create(x)), result));
+  EXPECT_TRUE(result);
+
+  // x > 1e10 on its own is satisfiable.
+  std::vector<const Array *> objects(1, array);
+  std::vector<std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+      values));
+  ASSERT_EQ(1U, values.size());
+
+  delete solver;
+}
+
 }
@@ -0,0 +1,217 @@
+//===-- Z3AckermannizationTest.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Config/Version.h"
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/SolverStats.h"
+#include "klee/util/ArrayCache.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <vector>
+
+using namespace klee;
+
+#ifdef ENABLE_Z3
+namespace {
+// The solver holds on to the arrays so the cache must outlive it.
+ArrayCache ac;
+
+/// Sets the ``z3-construct-cache-size`` option for the lifetime of the
+/// object.
+class ConstructCacheSizeOverride {
+  llvm::cl::opt<unsigned> *option;
+  unsigned oldValue;
+
+public:
+  explicit ConstructCacheSizeOverride(unsigned value) : option(0), oldValue(0) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 7)
+    llvm::StringMap<llvm::cl::Option *> &options =
+        llvm::cl::getRegisteredOptions();
+#else
+    llvm::StringMap<llvm::cl::Option *> options;
+    llvm::cl::getRegisteredOptions(options);
+#endif
+    option = static_cast<llvm::cl::opt<unsigned> *>(
+        options["z3-construct-cache-size"]);
+    if (option) {
+      oldValue = *option;
+      option->setValue(value);
+    }
+  }
+  ~ConstructCacheSizeOverride() {
+    if (option)
+      option->setValue(oldValue);
+  }
+  bool found() const { return option != 0; }
+};
+
+class Z3AckermannizationTest : public ::testing::Test {
+protected:
+  Solver *solver;
+  ConstraintManager cm;
+
+  void SetUp() { solver = createCoreSolver(Z3_SOLVER); }
+  void TearDown() { delete solver; }
+
+  ref<Expr> byte(unsigned value) {
+    return ConstantExpr::create(value, Expr::Int8);
+  }
+
+  ref<Expr> index(unsigned value) {
+    return ConstantExpr::create(value, Expr::Int32);
+  }
+
+  /// Read \a bytes bytes from \a ul starting at \a offset, little-endian.
+  ref<Expr> read(const UpdateList &ul, unsigned offset, unsigned bytes) {
+    ref<Expr> res = ReadExpr::create(ul, index(offset));
+    for (unsigned i = 1; i < bytes; ++i)
+      res = ConcatExpr::create(ReadExpr::create(ul, index(offset + i)), res);
+    return res;
+  }
+};
+
+TEST_F(Z3AckermannizationTest, ReadThroughConstantUpdates) {
+  const Array *a = ac.CreateArray("z3ack_updated", 16);
+  UpdateList ul(a, 0);
+  for (unsigned i = 8; i < 16; ++i)
+    ul.extend(index(i), byte(i));
+  cm.addConstraint(EqExpr::create(
+      read(ul, 0, 8), ConstantExpr::create(0x0102030405060708ULL,
+                                           Expr::Int64)));
+
+  uint64_t before = stats::queryAckermannizedArrays;
+  std::vector<const Array *> objects(1, a);
+  std::vector<std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(cm, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  EXPECT_EQ(before + 1, stats::queryAckermannizedArrays);
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(8 - i, values[0][i]);
+}
+
+TEST_F(Z3AckermannizationTest, SymbolicUpdatePreventsAckermannization) {
+  const Array *a = ac.CreateArray("z3ack_symbolic_update", 8);
+  const Array *j = ac.CreateArray("z3ack_symbolic_index", 4);
+  UpdateList ul(a, 0);
+  ul.extend(Expr::createTempRead(j, Expr::Int32), byte(0xff));
+  ref<Expr> value = read(ul, 0, 4);
+  cm.addConstraint(EqExpr::create(value, ConstantExpr::create(0, Expr::Int32)));
+
+  uint64_t before = stats::queryAckermannizedArrays;
+  uint64_t arraysBefore = stats::queryArrays;
+  bool result;
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm, EqExpr::create(Expr::createTempRead(j, Expr::Int32),
+                               index(2))),
+      result));
+  EXPECT_FALSE(result);
+  // Only `j` itself can be ackermannized.
+  EXPECT_EQ(arraysBefore + 2, stats::queryArrays);
+  EXPECT_EQ(before + 1, stats::queryAckermannizedArrays);
+}
+
+TEST_F(Z3AckermannizationTest, ReadInsideUpdate) {
+  // `z` is read as a whole and, inside the update of `b`, byte by byte. The
+  // byte read must refer to the same value as the whole read.
+  const Array *z = ac.CreateArray("z3ack_z", 2);
+  const Array *b = ac.CreateArray("z3ack_b", 16);
+  ref<Expr> i = Expr::createTempRead(ac.CreateArray("z3ack_i", 4),
+                                     Expr::Int32);
+  ref<Expr> j = Expr::createTempRead(ac.CreateArray("z3ack_j", 4),
+                                     Expr::Int32);
+  UpdateList zul(z, 0);
+  UpdateList bul(b, 0);
+  bul.extend(j, ReadExpr::create(zul, index(0)));
+  cm.addConstraint(EqExpr::create(read(zul, 0, 2),
+                                  ConstantExpr::create(0x1234, Expr::Int16)));
+  cm.addConstraint(UltExpr::create(j, index(16)));
+  cm.addConstraint(EqExpr::create(i, j));
+
+  bool result;
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm, EqExpr::create(ReadExpr::create(bul, i), byte(0x35))),
+      result));
+  EXPECT_FALSE(result);
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm, EqExpr::create(ReadExpr::create(bul, i), byte(0x34))),
+      result));
+  EXPECT_TRUE(result);
+}
+
+TEST_F(Z3AckermannizationTest, CachedTranslationOfLaterAckermannizedArray) {
+  ConstructCacheSizeOverride cacheSize(1000);
+  ASSERT_TRUE(cacheSize.found());
+
+  const Array *x = ac.CreateArray("z3ack_cached_x", 4);
+  const Array *j = ac.CreateArray("z3ack_cached_j", 4);
+  UpdateList ul(x, 0);
+  ref<Expr> small = UltExpr::create(read(ul, 0, 4), index(10));
+
+  // The symbolic index keeps `x` from being ackermannized, so `small` is
+  // translated with array selects and kept for later queries.
+  cm.addConstraint(small);
+  cm.addConstraint(EqExpr::create(
+      ReadExpr::create(ul, Expr::createTempRead(j, Expr::Int32)), byte(1)));
+  bool result;
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm, UltExpr::create(read(ul, 0, 4), index(5))), result));
+  EXPECT_TRUE(result);
+
+  // Now `x` is ackermannized. Reusing the translation of `small` would leave
+  // it unrelated to the replacement variable used by the query expression.
+  ConstraintManager cm2;
+  cm2.addConstraint(small);
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm2, UgtExpr::create(read(ul, 0, 4), index(20))), result));
+  EXPECT_FALSE(result);
+}
+
+TEST_F(Z3AckermannizationTest, UnrelatedTranslationSurvivesAckermannization) {
+  ConstructCacheSizeOverride cacheSize(1000);
+  ASSERT_TRUE(cacheSize.found());
+
+  const Array *x = ac.CreateArray("z3ack_survive_x", 4);
+  const Array *y = ac.CreateArray("z3ack_survive_y", 4);
+  UpdateList xul(x, 0);
+  UpdateList yul(y, 0);
+  // `y` is read at a symbolic index so it is never ackermannized.
+  ref<Expr> onY = EqExpr::create(
+      ReadExpr::create(yul, ZExtExpr::create(ReadExpr::create(yul, index(0)),
+                                             Expr::Int32)),
+      byte(1));
+
+  // Only `x` is ackermannized here.
+  cm.addConstraint(onY);
+  cm.addConstraint(UltExpr::create(read(xul, 0, 4), index(10)));
+  bool result;
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm, UltExpr::create(read(xul, 0, 4), index(5))), result));
+  EXPECT_TRUE(result);
+
+  // Nothing is ackermannized here. The change only concerns `x` so the
+  // translation of `onY` is reused.
+  ConstraintManager cm2;
+  cm2.addConstraint(onY);
+  uint64_t hitsBefore = stats::queryConstructCacheHits;
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(cm2, UltExpr::create(ReadExpr::create(yul, index(1)), byte(5))),
+      result));
+  EXPECT_TRUE(result);
+  EXPECT_LT(hitsBefore, stats::queryConstructCacheHits);
+}
+}
+#endif
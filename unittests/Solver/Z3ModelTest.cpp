@@ -0,0 +1,152 @@
+//===-- Z3ModelTest.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/util/ArrayCache.h"
+
+#include <vector>
+
+using namespace klee;
+
+#ifdef ENABLE_Z3
+namespace {
+// The solver holds on to the arrays so the cache must outlive it.
+ArrayCache ac;
+
+class Z3ModelTest : public ::testing::Test {
+protected:
+  Solver *solver;
+  ConstraintManager cm;
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+
+  void SetUp() { solver = createCoreSolver(Z3_SOLVER); }
+  void TearDown() { delete solver; }
+
+  bool solve() {
+    values.clear();
+    return solver->getInitialValues(
+        Query(cm, ConstantExpr::alloc(0, Expr::Bool)), objects, values);
+  }
+};
+
+TEST_F(Z3ModelTest, AckermannizedRead) {
+  const Array *a = ac.CreateArray("z3model_ack64", 8);
+  cm.addConstraint(EqExpr::create(Expr::createTempRead(a, Expr::Int64),
+                                  ConstantExpr::create(0x0102030405060708ULL,
+                                                       Expr::Int64)));
+  objects.push_back(a);
+  ASSERT_TRUE(solve());
+  ASSERT_EQ(1u, values.size());
+  ASSERT_EQ(8u, values[0].size());
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(8 - i, values[0][i]);
+}
+
+TEST_F(Z3ModelTest, WideAckermannizedRead) {
+  const Array *a = ac.CreateArray("z3model_ack128", 16);
+  ref<Expr> value = ConcatExpr::create(
+      ConstantExpr::create(0x8899aabbccddeeffULL, Expr::Int64),
+      ConstantExpr::create(0x0011223344556677ULL, Expr::Int64));
+  cm.addConstraint(EqExpr::create(Expr::createTempRead(a, Expr::Int128),
+                                  value));
+  objects.push_back(a);
+  ASSERT_TRUE(solve());
+  ASSERT_EQ(16u, values[0].size());
+  const unsigned char expected[16] = { 0x77, 0x66, 0x55, 0x44, 0x33, 0x22,
+                                       0x11, 0x00, 0xff, 0xee, 0xdd, 0xcc,
+                                       0xbb, 0xaa, 0x99, 0x88 };
+  for (unsigned i = 0; i < 16; ++i)
+    EXPECT_EQ(expected[i], values[0][i]);
+}
+
+TEST_F(Z3ModelTest, ArrayInterpretation) {
+  const Array *buf = ac.CreateArray("z3model_buf", 4096);
+  const Array *idx = ac.CreateArray("z3model_idx", 4);
+  ref<Expr> index = Expr::createTempRead(idx, Expr::Int32);
+  UpdateList ul(buf, 0);
+  cm.addConstraint(UltExpr::create(index, ConstantExpr::create(4096,
+                                                               Expr::Int32)));
+  cm.addConstraint(EqExpr::create(ReadExpr::create(ul, index),
+                                  ConstantExpr::create(0x2a, Expr::Int8)));
+  cm.addConstraint(EqExpr::create(
+      ReadExpr::create(ul, ConstantExpr::create(100, Expr::Int32)),
+      ConstantExpr::create(0x11, Expr::Int8)));
+  objects.push_back(buf);
+  objects.push_back(idx);
+  ASSERT_TRUE(solve());
+  ASSERT_EQ(2u, values.size());
+  ASSERT_EQ(4096u, values[0].size());
+  ASSERT_EQ(4u, values[1].size());
+
+  unsigned i = values[1][0] | (values[1][1] << 8) | (values[1][2] << 16) |
+               (values[1][3] << 24);
+  ASSERT_LT(i, 4096u);
+  EXPECT_NE(100u, i);
+  EXPECT_EQ(0x2a, values[0][i]);
+  EXPECT_EQ(0x11, values[0][100]);
+}
+
+TEST_F(Z3ModelTest, WordArray) {
+  // Models of word arrays are returned byte by byte, little-endian.
+  const Array *a = ac.CreateArray("z3model_words", 4, 0, 0, Expr::Int32,
+                                  Expr::Int32);
+  UpdateList ul(a, 0);
+  ref<Expr> index = Expr::createTempRead(ac.CreateArray("z3model_widx", 4),
+                                         Expr::Int32);
+  cm.addConstraint(UltExpr::create(index, ConstantExpr::create(4,
+                                                               Expr::Int32)));
+  cm.addConstraint(EqExpr::create(ReadExpr::create(ul, index),
+                                  ConstantExpr::create(0x11223344,
+                                                       Expr::Int32)));
+  cm.addConstraint(EqExpr::create(
+      ReadExpr::create(ul, ConstantExpr::create(3, Expr::Int32)),
+      ConstantExpr::create(0x55667788, Expr::Int32)));
+  objects.push_back(a);
+  ASSERT_TRUE(solve());
+  ASSERT_EQ(16u, values[0].size());
+  EXPECT_EQ(0x88, values[0][12]);
+  EXPECT_EQ(0x55, values[0][15]);
+}
+
+TEST_F(Z3ModelTest, AckermannizedWordArray) {
+  const Array *a = ac.CreateArray("z3model_ackwords", 2, 0, 0, Expr::Int32,
+                                  Expr::Int64);
+  UpdateList ul(a, 0);
+  cm.addConstraint(EqExpr::create(
+      ReadExpr::create(ul, ConstantExpr::create(1, Expr::Int32)),
+      ConstantExpr::create(0x0102030405060708ULL, Expr::Int64)));
+  objects.push_back(a);
+  ASSERT_TRUE(solve());
+  ASSERT_EQ(16u, values[0].size());
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(8 - i, values[0][8 + i]);
+}
+
+TEST_F(Z3ModelTest, UnusedArray) {
+  const Array *a = ac.CreateArray("z3model_used", 1);
+  const Array *unused = ac.CreateArray("z3model_unused", 64);
+  cm.addConstraint(EqExpr::create(Expr::createTempRead(a, Expr::Int8),
+                                  ConstantExpr::create(7, Expr::Int8)));
+  objects.push_back(a);
+  objects.push_back(unused);
+  ASSERT_TRUE(solve());
+  EXPECT_EQ(7, values[0][0]);
+  ASSERT_EQ(64u, values[1].size());
+  for (unsigned i = 0; i < 64; ++i)
+    EXPECT_EQ(0, values[1][i]);
+}
+}
+#endif